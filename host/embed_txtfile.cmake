@@ -0,0 +1,20 @@
+# Host replacement for idf_component_register(EMBED_TXTFILES ...).
+#
+# Generates a C array named _binary_<file>_start holding the file contents
+# plus a trailing NUL, which is what the asm() labels in main/ resolve to
+# when EMBED_TXTFILES is used on device.
+
+function(host_embed_txtfile target src)
+    get_filename_component(name "${src}" NAME)
+    string(MAKE_C_IDENTIFIER "${name}" ident)
+    set(out "${CMAKE_CURRENT_BINARY_DIR}/embed/${ident}.c")
+
+    file(READ "${src}" hex HEX)
+    string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+    file(WRITE "${out}"
+        "/* Generated from ${name} by embed_txtfile.cmake */\n"
+        "const unsigned char _binary_${ident}_start[] = {${bytes}0x00};\n")
+
+    set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS "${src}")
+    target_sources(${target} PRIVATE "${out}")
+endfunction()
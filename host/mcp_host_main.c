@@ -0,0 +1,166 @@
+/* EdgeMCP host build
+ *
+ * Runs the MCP core (jsonrpc, protocol, server, tools, log capture and the
+ * Lua runtime) as a Linux process and serves POST/GET /mcp over plain
+ * POSIX sockets, mirroring start_http_server() in main/main.c.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+#include "mcp_server.h"
+#include "mcp_session.h"
+#include "mcp_log.h"
+#include "mcp_log_archive.h"
+#include "mcp_ota.h"
+#include "mcp_metrics.h"
+#include "mcp_trace.h"
+#include "lua_runtime.h"
+
+static const char *TAG = "mcp_host";
+
+static const httpd_uri_t mcp_http = {
+    .uri        = "/mcp",
+    .method     = HTTP_POST,
+    .handler    = mcp_http_handler,
+    .user_ctx   = NULL,
+};
+
+static const httpd_uri_t mcp_info = {
+    .uri        = "/mcp",
+    .method     = HTTP_GET,
+    .handler    = mcp_info_handler,
+    .user_ctx   = NULL,
+};
+
+static const httpd_uri_t mcp_metrics = {
+    .uri        = "/metrics",
+    .method     = HTTP_GET,
+    .handler    = mcp_metrics_handler,
+    .user_ctx   = NULL,
+};
+
+static const httpd_uri_t mcp_trace = {
+    .uri        = "/trace",
+    .method     = HTTP_GET,
+    .handler    = mcp_trace_handler,
+    .user_ctx   = NULL,
+};
+
+static const httpd_uri_t mcp_delete = {
+    .uri        = "/mcp",
+    .method     = HTTP_DELETE,
+    .handler    = mcp_delete_handler,
+    .user_ctx   = NULL,
+};
+
+static void http_close_fd(httpd_handle_t hd, int sockfd)
+{
+    (void)hd;
+    mcp_session_close_fd(sockfd);
+    close(sockfd);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-p port] [-d data_dir] [-c max_clients] [-L] [-v|-q]\n"
+        "  -p port         TCP port to listen on (default 8080)\n"
+        "  -d data_dir     working directory holding spiffs/ (default ./host_data)\n"
+        "  -c max_clients  max open sockets (default 4, same as device)\n"
+        "  -L              do not start main.lua (quieter benchmarks)\n"
+        "  -v / -q         debug / warning log level\n",
+        prog);
+}
+
+int main(int argc, char **argv)
+{
+    int port = 8080;
+    int max_clients = 4;
+    const char *data_dir = "host_data";
+    bool start_lua = true;
+    esp_log_level_t level = ESP_LOG_INFO;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:d:c:Lvqh")) != -1) {
+        switch (opt) {
+            case 'p': port = atoi(optarg); break;
+            case 'd': data_dir = optarg; break;
+            case 'c': max_clients = atoi(optarg); break;
+            case 'L': start_lua = false; break;
+            case 'v': level = ESP_LOG_DEBUG; break;
+            case 'q': level = ESP_LOG_WARN; break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+
+    if (mkdir(data_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Cannot create %s: %s\n", data_dir, strerror(errno));
+        return 1;
+    }
+    if (chdir(data_dir) != 0) {
+        fprintf(stderr, "Cannot enter %s: %s\n", data_dir, strerror(errno));
+        return 1;
+    }
+
+    /* Block the stop signals in every thread; main waits for them below */
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    esp_log_level_set("*", level);
+    mcp_log_init();
+    mcp_log_archive_init();
+    mcp_ota_init();
+
+    esp_err_t ret = lua_runtime_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize Lua runtime: %s", esp_err_to_name(ret));
+    } else if (start_lua) {
+        lua_runtime_start();
+    }
+
+    httpd_handle_t server = NULL;
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = (uint16_t)port;
+    config.max_open_sockets = (uint16_t)max_clients;
+    config.recv_wait_timeout = 10;
+    config.send_wait_timeout = 10;
+    config.lru_purge_enable = true;
+    config.close_fn = http_close_fd;
+
+    ret = httpd_start(&server, &config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Error starting HTTP server on port %d", port);
+        return 1;
+    }
+    httpd_register_uri_handler(server, &mcp_http);
+    httpd_register_uri_handler(server, &mcp_info);
+    httpd_register_uri_handler(server, &mcp_delete);
+    httpd_register_uri_handler(server, &mcp_metrics);
+    httpd_register_uri_handler(server, &mcp_trace);
+
+    ret = mcp_server_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize MCP server: %s", esp_err_to_name(ret));
+        httpd_stop(server);
+        return 1;
+    }
+
+    ESP_LOGW(TAG, "MCP host server ready at http://127.0.0.1:%d/mcp (data: %s)", port, data_dir);
+
+    int sig = 0;
+    sigwait(&stop_signals, &sig);
+    ESP_LOGW(TAG, "Signal %d, stopping", sig);
+    httpd_stop(server);
+    return 0;
+}
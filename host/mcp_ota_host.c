@@ -0,0 +1,52 @@
+/*
+ * MCP OTA Handler - host stand-in
+ *
+ * main/mcp_ota.c depends on the partition table and esp_https_ota, neither
+ * of which exists on Linux. The tools stay registered so tools/list matches
+ * the device, but every call reports that OTA is unavailable.
+ */
+
+#include "mcp_ota.h"
+#include <stdio.h>
+#include <esp_log.h>
+
+static const char *TAG = "mcp_ota";
+
+esp_err_t mcp_ota_init(void)
+{
+    ESP_LOGI(TAG, "OTA disabled on host build");
+    return ESP_OK;
+}
+
+static esp_err_t ota_unavailable(mcp_result_t *result)
+{
+    mcp_result_printf(result, "OTA is not available on the host build");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t tool_sys_ota_push(cJSON *args, mcp_result_t *result)
+{
+    (void)args;
+    return ota_unavailable(result);
+}
+
+esp_err_t tool_sys_ota_status(cJSON *args, mcp_result_t *result)
+{
+    (void)args;
+    mcp_result_printf(result,
+        "{\"state\":\"idle\",\"progress_pct\":0,\"message\":\"OTA disabled on host\","
+        "\"partition\":\"host\",\"app_version\":\"host\"}");
+    return ESP_OK;
+}
+
+esp_err_t tool_sys_ota_rollback(cJSON *args, mcp_result_t *result)
+{
+    (void)args;
+    return ota_unavailable(result);
+}
+
+esp_err_t tool_sys_reboot(cJSON *args, mcp_result_t *result)
+{
+    (void)args;
+    return ota_unavailable(result);
+}
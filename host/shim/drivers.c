@@ -0,0 +1,121 @@
+/*
+ * Host shim: GPIO, I2C and Wi-Fi mocks
+ */
+
+#include "driver/gpio.h"
+#include "driver/i2c_master.h"
+#include "esp_wifi.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HOST_GPIO_COUNT 64
+
+struct host_i2c_bus {
+    int sda;
+    int scl;
+};
+
+struct host_i2c_dev {
+    uint16_t addr;
+    uint32_t scl_speed_hz;
+};
+
+static uint8_t s_gpio_level[HOST_GPIO_COUNT];
+
+/* ── GPIO ──────────────────────────────────────────────────────── */
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    if (!config || config->pin_bit_mask == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= HOST_GPIO_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpio_level[gpio_num] = level ? 1 : 0;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (gpio_num < 0 || gpio_num >= HOST_GPIO_COUNT) {
+        return 0;
+    }
+    return s_gpio_level[gpio_num];
+}
+
+/* ── I2C ───────────────────────────────────────────────────────── */
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *config, i2c_master_bus_handle_t *ret_bus)
+{
+    if (!config || !ret_bus) return ESP_ERR_INVALID_ARG;
+    struct host_i2c_bus *bus = calloc(1, sizeof(*bus));
+    if (!bus) return ESP_ERR_NO_MEM;
+    bus->sda = config->sda_io_num;
+    bus->scl = config->scl_io_num;
+    *ret_bus = bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus)
+{
+    free(bus);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus, const i2c_device_config_t *config,
+                                    i2c_master_dev_handle_t *ret_dev)
+{
+    if (!bus || !config || !ret_dev) return ESP_ERR_INVALID_ARG;
+    struct host_i2c_dev *dev = calloc(1, sizeof(*dev));
+    if (!dev) return ESP_ERR_NO_MEM;
+    dev->addr = config->device_address;
+    dev->scl_speed_hz = config->scl_speed_hz;
+    *ret_dev = dev;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t dev)
+{
+    free(dev);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t dev, const uint8_t *buf, size_t len, int timeout_ms)
+{
+    (void)buf;
+    (void)len;
+    (void)timeout_ms;
+    return dev ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t dev, uint8_t *buf, size_t len, int timeout_ms)
+{
+    (void)timeout_ms;
+    if (!dev || !buf) return ESP_ERR_INVALID_ARG;
+    memset(buf, 0, len);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t dev, const uint8_t *wbuf, size_t wlen,
+                                      uint8_t *rbuf, size_t rlen, int timeout_ms)
+{
+    esp_err_t ret = i2c_master_transmit(dev, wbuf, wlen, timeout_ms);
+    if (ret != ESP_OK) return ret;
+    return i2c_master_receive(dev, rbuf, rlen, timeout_ms);
+}
+
+/* ── Wi-Fi ─────────────────────────────────────────────────────── */
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    if (ap_info) {
+        memset(ap_info, 0, sizeof(*ap_info));
+    }
+    return ESP_ERR_WIFI_NOT_CONNECT;
+}
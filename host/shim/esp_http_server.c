@@ -0,0 +1,913 @@
+/*
+ * Host shim: esp_http_server over POSIX sockets
+ *
+ * Single server thread, poll() over the listening socket, open sessions and
+ * a wake pipe for httpd_queue_work(). Requests are HTTP/1.1 with keep-alive;
+ * bodies are read on demand by the handler through httpd_req_recv().
+ *
+ * Every response carries X-Host-Alloc-Bytes / X-Host-Alloc-Count: heap
+ * traffic on the server thread from the start of the request until the
+ * response headers were written. mcp_loadgen reports these per method.
+ */
+
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "host_alloc.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define HOST_HTTPD_RECV_BUF     8192
+#define HOST_HTTPD_MAX_HANDLERS 16
+#define HOST_HTTPD_MAX_RESP_HDR 8
+
+static const char *TAG = "host_httpd";
+
+typedef struct host_sess {
+    int fd;
+    bool used;
+    bool close_pending;
+    volatile bool async;            /* Owned by an async request, not polled */
+    volatile bool resume;           /* Async request done with pipelined input left */
+    uint64_t lru;
+    void *ctx;                      /* sess_ctx, kept for the session lifetime */
+    httpd_free_ctx_fn_t free_ctx;
+    size_t buf_len;
+    char buf[HOST_HTTPD_RECV_BUF];
+} host_sess_t;
+
+typedef struct host_work {
+    httpd_work_fn_t fn;
+    void *arg;
+    struct host_work *next;
+} host_work_t;
+
+typedef struct host_httpd {
+    httpd_config_t config;
+    int listen_fd;
+    int wake_pipe[2];
+    pthread_t thread;
+    volatile bool running;
+    uint64_t lru_counter;
+    httpd_uri_t handlers[HOST_HTTPD_MAX_HANDLERS];
+    size_t handler_count;
+    host_sess_t *sessions;
+    pthread_mutex_t work_lock;
+    host_work_t *work_head;
+    host_work_t *work_tail;
+} host_httpd_t;
+
+typedef struct {
+    host_sess_t *sess;
+    char headers[HTTPD_MAX_REQ_HDR_LEN];
+    size_t body_remaining;
+    const char *status;
+    const char *content_type;
+    const char *resp_hdr_field[HOST_HTTPD_MAX_RESP_HDR];
+    const char *resp_hdr_value[HOST_HTTPD_MAX_RESP_HDR];
+    int resp_hdr_count;
+    bool headers_sent;
+    bool chunked;
+    bool keep_alive;
+    bool resp_done;                 /* Response sent completely */
+    bool async;                     /* Handed to httpd_req_async_handler_begin */
+    host_alloc_stats_t alloc_start; /* Async copy: server-thread share instead */
+} host_req_aux_t;
+
+/* Heap copy made by httpd_req_async_handler_begin */
+typedef struct {
+    httpd_req_t req;
+    host_req_aux_t aux;
+} host_async_req_t;
+
+/* Counters of a thread finishing async requests, as of its last one: an
+ * async response reports the server-thread share plus what the finishing
+ * thread allocated since then */
+static __thread host_alloc_stats_t t_async_mark;
+
+/* ── Socket helpers ────────────────────────────────────────────── */
+
+static int send_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void set_timeouts(int fd, const httpd_config_t *config)
+{
+    struct timeval rt = { .tv_sec = config->recv_wait_timeout, .tv_usec = 0 };
+    struct timeval st = { .tv_sec = config->send_wait_timeout, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &rt, sizeof(rt));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &st, sizeof(st));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/* ── Sessions ──────────────────────────────────────────────────── */
+
+static void sess_close(host_httpd_t *hd, host_sess_t *sess)
+{
+    if (!sess->used) return;
+    if (hd->config.close_fn) {
+        /* Like esp_http_server, close_fn owns closing the socket */
+        hd->config.close_fn(hd, sess->fd);
+    } else {
+        close(sess->fd);
+    }
+    if (sess->ctx) {
+        if (sess->free_ctx) {
+            sess->free_ctx(sess->ctx);
+        } else {
+            free(sess->ctx);
+        }
+    }
+    sess->ctx = NULL;
+    sess->free_ctx = NULL;
+    sess->used = false;
+    sess->close_pending = false;
+    sess->async = false;
+    sess->resume = false;
+    sess->buf_len = 0;
+    sess->fd = -1;
+}
+
+static host_sess_t *sess_find(host_httpd_t *hd, int fd)
+{
+    for (int i = 0; i < hd->config.max_open_sockets; i++) {
+        if (hd->sessions[i].used && hd->sessions[i].fd == fd) {
+            return &hd->sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static void accept_client(host_httpd_t *hd)
+{
+    int fd = accept(hd->listen_fd, NULL, NULL);
+    if (fd < 0) return;
+
+    host_sess_t *slot = NULL;
+    host_sess_t *oldest = NULL;
+    for (int i = 0; i < hd->config.max_open_sockets; i++) {
+        host_sess_t *s = &hd->sessions[i];
+        if (!s->used) {
+            slot = s;
+            break;
+        }
+        if (!s->async && (!oldest || s->lru < oldest->lru)) {
+            oldest = s;
+        }
+    }
+
+    if (!slot && hd->config.lru_purge_enable && oldest) {
+        ESP_LOGD(TAG, "LRU purge of fd %d", oldest->fd);
+        sess_close(hd, oldest);
+        slot = oldest;
+    }
+    if (!slot) {
+        ESP_LOGW(TAG, "No free session slot, rejecting connection");
+        close(fd);
+        return;
+    }
+
+    set_timeouts(fd, &hd->config);
+    slot->fd = fd;
+    slot->used = true;
+    slot->close_pending = false;
+    slot->buf_len = 0;
+    slot->lru = ++hd->lru_counter;
+
+    if (hd->config.open_fn && hd->config.open_fn(hd, fd) != ESP_OK) {
+        sess_close(hd, slot);
+    }
+}
+
+/* ── Request parsing ───────────────────────────────────────────── */
+
+static const char *find_header(const char *headers, const char *field, size_t *value_len)
+{
+    size_t field_len = strlen(field);
+    const char *line = headers;
+    while (*line) {
+        const char *eol = strstr(line, "\r\n");
+        if (!eol) eol = line + strlen(line);
+        if ((size_t)(eol - line) > field_len && strncasecmp(line, field, field_len) == 0 &&
+            line[field_len] == ':') {
+            const char *v = line + field_len + 1;
+            while (v < eol && (*v == ' ' || *v == '\t')) v++;
+            const char *end = eol;
+            while (end > v && (end[-1] == ' ' || end[-1] == '\t')) end--;
+            *value_len = (size_t)(end - v);
+            return v;
+        }
+        if (!*eol) break;
+        line = eol + 2;
+    }
+    return NULL;
+}
+
+static int parse_method(const char *m, size_t len)
+{
+    if (len == 3 && strncmp(m, "GET", 3) == 0) return HTTP_GET;
+    if (len == 4 && strncmp(m, "POST", 4) == 0) return HTTP_POST;
+    if (len == 3 && strncmp(m, "PUT", 3) == 0) return HTTP_PUT;
+    if (len == 6 && strncmp(m, "DELETE", 6) == 0) return HTTP_DELETE;
+    if (len == 4 && strncmp(m, "HEAD", 4) == 0) return HTTP_HEAD;
+    if (len == 7 && strncmp(m, "OPTIONS", 7) == 0) return HTTP_OPTIONS;
+    return -1;
+}
+
+static bool uri_matches(const char *pattern, const char *uri)
+{
+    size_t uri_len = strcspn(uri, "?");
+    return strlen(pattern) == uri_len && strncmp(pattern, uri, uri_len) == 0;
+}
+
+static void send_simple(int fd, const char *status, bool keep_alive)
+{
+    char buf[160];
+    int n = snprintf(buf, sizeof(buf),
+                     "HTTP/1.1 %s\r\nContent-Length: 0\r\n%s\r\n",
+                     status, keep_alive ? "" : "Connection: close\r\n");
+    send_all(fd, buf, (size_t)n);
+}
+
+/*
+ * Handle one buffered request on a session.
+ * Returns false when the session must be closed.
+ */
+static bool handle_request(host_httpd_t *hd, host_sess_t *sess, size_t hdr_end)
+{
+    host_req_aux_t aux;
+    memset(&aux, 0, sizeof(aux));
+    aux.sess = sess;
+    aux.status = HTTPD_200;
+    aux.content_type = HTTPD_TYPE_TEXT;
+    host_alloc_thread_stats(&aux.alloc_start);
+
+    httpd_req_t req;
+    memset(&req, 0, sizeof(req));
+    req.handle = hd;
+    req.aux = &aux;
+    req.sess_ctx = sess->ctx;
+    req.free_ctx = sess->free_ctx;
+
+    /* Request line */
+    char *line_end = memmem(sess->buf, hdr_end, "\r\n", 2);
+    char *sp1 = memchr(sess->buf, ' ', (size_t)(line_end - sess->buf));
+    char *sp2 = sp1 ? memchr(sp1 + 1, ' ', (size_t)(line_end - sp1 - 1)) : NULL;
+    if (!sp1 || !sp2) {
+        send_simple(sess->fd, HTTPD_400, false);
+        return false;
+    }
+    req.method = parse_method(sess->buf, (size_t)(sp1 - sess->buf));
+    size_t uri_len = (size_t)(sp2 - sp1 - 1);
+    if (uri_len > HTTPD_MAX_URI_LEN) {
+        send_simple(sess->fd, "414 URI Too Long", false);
+        return false;
+    }
+    memcpy((char *)req.uri, sp1 + 1, uri_len);
+    bool http10 = (strncmp(sp2 + 1, "HTTP/1.0", 8) == 0);
+
+    /* Header block, without the request line and the final blank line */
+    size_t hdr_start = (size_t)(line_end - sess->buf) + 2;
+    size_t hdr_len = hdr_end - 2 - hdr_start;
+    if (hdr_len >= sizeof(aux.headers)) {
+        send_simple(sess->fd, "431 Request Header Fields Too Large", false);
+        return false;
+    }
+    memcpy(aux.headers, sess->buf + hdr_start, hdr_len);
+    aux.headers[hdr_len] = '\0';
+
+    size_t vlen = 0;
+    const char *v = find_header(aux.headers, "Content-Length", &vlen);
+    req.content_len = v ? strtoul(v, NULL, 10) : 0;
+    aux.body_remaining = req.content_len;
+
+    v = find_header(aux.headers, "Connection", &vlen);
+    if (http10) {
+        aux.keep_alive = v && vlen == 10 && strncasecmp(v, "keep-alive", 10) == 0;
+    } else {
+        aux.keep_alive = !(v && vlen == 5 && strncasecmp(v, "close", 5) == 0);
+    }
+
+    /* Keep only the already-received body bytes (and anything pipelined) */
+    sess->buf_len -= hdr_end;
+    memmove(sess->buf, sess->buf + hdr_end, sess->buf_len);
+
+    const httpd_uri_t *handler = NULL;
+    bool uri_known = false;
+    for (size_t i = 0; i < hd->handler_count; i++) {
+        if (uri_matches(hd->handlers[i].uri, req.uri)) {
+            uri_known = true;
+            if (hd->handlers[i].method == req.method) {
+                handler = &hd->handlers[i];
+                break;
+            }
+        }
+    }
+
+    bool keep = aux.keep_alive;
+    if (!handler) {
+        httpd_resp_send_err(&req, uri_known ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND, NULL);
+    } else {
+        req.user_ctx = handler->user_ctx;
+        esp_err_t ret = handler->handler(&req);
+        if (aux.async) {
+            keep = true;    /* The async copy finishes the response */
+        } else if (ret != ESP_OK) {
+            keep = false;
+        } else if (!aux.headers_sent) {
+            httpd_resp_send(&req, NULL, 0);
+        }
+    }
+
+    /* Discard any body the handler did not consume */
+    while (keep && !aux.async && aux.body_remaining > 0) {
+        char scratch[512];
+        int n = httpd_req_recv(&req, scratch, sizeof(scratch));
+        if (n <= 0) {
+            keep = false;
+        }
+    }
+
+    /* Like esp_http_server, a replaced sess_ctx frees the old one */
+    if (sess->ctx && sess->ctx != req.sess_ctx) {
+        if (sess->free_ctx) {
+            sess->free_ctx(sess->ctx);
+        } else {
+            free(sess->ctx);
+        }
+    }
+    sess->ctx = req.sess_ctx;
+    sess->free_ctx = req.free_ctx;
+    return keep;
+}
+
+static void serve_session(host_httpd_t *hd, host_sess_t *sess)
+{
+    sess->lru = ++hd->lru_counter;
+
+    for (;;) {
+        char *end = sess->buf_len ? memmem(sess->buf, sess->buf_len, "\r\n\r\n", 4) : NULL;
+        if (end) {
+            if (!handle_request(hd, sess, (size_t)(end - sess->buf) + 4)) {
+                sess_close(hd, sess);
+                return;
+            }
+            if (sess->buf_len == 0 || sess->async) {
+                return;
+            }
+            continue;   // pipelined request already buffered
+        }
+
+        if (sess->buf_len == sizeof(sess->buf)) {
+            send_simple(sess->fd, "431 Request Header Fields Too Large", false);
+            sess_close(hd, sess);
+            return;
+        }
+
+        ssize_t n = recv(sess->fd, sess->buf + sess->buf_len, sizeof(sess->buf) - sess->buf_len, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            sess_close(hd, sess);
+            return;
+        }
+        sess->buf_len += (size_t)n;
+
+        /* Only block for the rest of the headers once something arrived */
+        if (!memmem(sess->buf, sess->buf_len, "\r\n\r\n", 4)) {
+            struct pollfd pfd = { .fd = sess->fd, .events = POLLIN };
+            if (poll(&pfd, 1, hd->config.recv_wait_timeout * 1000) <= 0) {
+                send_simple(sess->fd, HTTPD_408, false);
+                sess_close(hd, sess);
+                return;
+            }
+        }
+    }
+}
+
+/* ── Server thread ─────────────────────────────────────────────── */
+
+static void run_queued_work(host_httpd_t *hd)
+{
+    char drain[64];
+    while (read(hd->wake_pipe[0], drain, sizeof(drain)) > 0) {
+    }
+
+    pthread_mutex_lock(&hd->work_lock);
+    host_work_t *work = hd->work_head;
+    hd->work_head = hd->work_tail = NULL;
+    pthread_mutex_unlock(&hd->work_lock);
+
+    while (work) {
+        host_work_t *next = work->next;
+        work->fn(work->arg);
+        free(work);
+        work = next;
+    }
+
+    for (int i = 0; i < hd->config.max_open_sockets; i++) {
+        host_sess_t *sess = &hd->sessions[i];
+        if (sess->used && sess->close_pending) {
+            sess_close(hd, sess);
+        } else if (sess->used && sess->resume && !sess->async) {
+            sess->resume = false;
+            serve_session(hd, sess);
+        }
+    }
+}
+
+static void *httpd_thread(void *arg)
+{
+    host_httpd_t *hd = arg;
+    int max_fds = hd->config.max_open_sockets + 2;
+    struct pollfd *pfds = calloc((size_t)max_fds, sizeof(struct pollfd));
+    host_sess_t **owners = calloc((size_t)max_fds, sizeof(host_sess_t *));
+    if (!pfds || !owners) {
+        free(pfds);
+        free(owners);
+        return NULL;
+    }
+
+    while (hd->running) {
+        int n = 0;
+        pfds[n].fd = hd->listen_fd;
+        pfds[n].events = POLLIN;
+        owners[n++] = NULL;
+        pfds[n].fd = hd->wake_pipe[0];
+        pfds[n].events = POLLIN;
+        owners[n++] = NULL;
+        for (int i = 0; i < hd->config.max_open_sockets; i++) {
+            if (hd->sessions[i].used && !hd->sessions[i].async) {
+                pfds[n].fd = hd->sessions[i].fd;
+                pfds[n].events = POLLIN;
+                owners[n++] = &hd->sessions[i];
+            }
+        }
+
+        if (poll(pfds, (nfds_t)n, 1000) <= 0) {
+            continue;
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            run_queued_work(hd);
+        }
+        for (int i = 2; i < n; i++) {
+            if (owners[i]->used && owners[i]->fd == pfds[i].fd &&
+                (pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                serve_session(hd, owners[i]);
+            }
+        }
+        if (pfds[0].revents & POLLIN) {
+            accept_client(hd);
+        }
+    }
+
+    free(pfds);
+    free(owners);
+    return NULL;
+}
+
+/* ── Public API: server ────────────────────────────────────────── */
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    if (!handle || !config || config->max_open_sockets == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    host_httpd_t *hd = calloc(1, sizeof(*hd));
+    if (!hd) return ESP_ERR_HTTPD_ALLOC_MEM;
+    hd->config = *config;
+    hd->sessions = calloc(config->max_open_sockets, sizeof(host_sess_t));
+    if (!hd->sessions) {
+        free(hd);
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    pthread_mutex_init(&hd->work_lock, NULL);
+
+    hd->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(hd->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(config->server_port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (hd->listen_fd < 0 ||
+        bind(hd->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(hd->listen_fd, config->backlog_conn) != 0 ||
+        pipe2(hd->wake_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+        ESP_LOGE(TAG, "Cannot listen on port %u: %s", config->server_port, strerror(errno));
+        if (hd->listen_fd >= 0) close(hd->listen_fd);
+        free(hd->sessions);
+        free(hd);
+        return ESP_FAIL;
+    }
+    hd->running = true;
+    if (pthread_create(&hd->thread, NULL, httpd_thread, hd) != 0) {
+        close(hd->listen_fd);
+        close(hd->wake_pipe[0]);
+        close(hd->wake_pipe[1]);
+        free(hd->sessions);
+        free(hd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    pthread_setname_np(hd->thread, "httpd");
+
+    ESP_LOGI(TAG, "Listening on port %u", config->server_port);
+    *handle = hd;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    host_httpd_t *hd = handle;
+    if (!hd) return ESP_ERR_INVALID_ARG;
+
+    hd->running = false;
+    (void)write(hd->wake_pipe[1], "x", 1);
+    pthread_join(hd->thread, NULL);
+
+    for (int i = 0; i < hd->config.max_open_sockets; i++) {
+        sess_close(hd, &hd->sessions[i]);
+    }
+    close(hd->listen_fd);
+    close(hd->wake_pipe[0]);
+    close(hd->wake_pipe[1]);
+
+    host_work_t *work = hd->work_head;
+    while (work) {
+        host_work_t *next = work->next;
+        free(work);
+        work = next;
+    }
+    if (hd->config.global_user_ctx_free_fn) {
+        hd->config.global_user_ctx_free_fn(hd->config.global_user_ctx);
+    }
+    pthread_mutex_destroy(&hd->work_lock);
+    free(hd->sessions);
+    free(hd);
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    host_httpd_t *hd = handle;
+    if (!hd || !uri_handler || !uri_handler->uri || !uri_handler->handler) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (uri_handler->is_websocket) {
+        ESP_LOGW(TAG, "WebSocket handler for %s not supported on host, skipped", uri_handler->uri);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    for (size_t i = 0; i < hd->handler_count; i++) {
+        if (hd->handlers[i].method == uri_handler->method &&
+            strcmp(hd->handlers[i].uri, uri_handler->uri) == 0) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (hd->handler_count >= HOST_HTTPD_MAX_HANDLERS ||
+        hd->handler_count >= hd->config.max_uri_handlers) {
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    hd->handlers[hd->handler_count++] = *uri_handler;
+    return ESP_OK;
+}
+
+void *httpd_get_global_user_ctx(httpd_handle_t handle)
+{
+    host_httpd_t *hd = handle;
+    return hd ? hd->config.global_user_ctx : NULL;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
+{
+    host_httpd_t *hd = handle;
+    if (!hd || !work) return ESP_ERR_INVALID_ARG;
+
+    host_work_t *item = malloc(sizeof(*item));
+    if (!item) return ESP_ERR_NO_MEM;
+    item->fn = work;
+    item->arg = arg;
+    item->next = NULL;
+
+    pthread_mutex_lock(&hd->work_lock);
+    if (hd->work_tail) {
+        hd->work_tail->next = item;
+    } else {
+        hd->work_head = item;
+    }
+    hd->work_tail = item;
+    pthread_mutex_unlock(&hd->work_lock);
+
+    (void)write(hd->wake_pipe[1], "w", 1);
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+    host_httpd_t *hd = handle;
+    if (!hd) return ESP_ERR_INVALID_ARG;
+    host_sess_t *sess = sess_find(hd, sockfd);
+    if (!sess) return ESP_ERR_NOT_FOUND;
+    sess->close_pending = true;
+    (void)write(hd->wake_pipe[1], "c", 1);
+    return ESP_OK;
+}
+
+/* ── Public API: request ───────────────────────────────────────── */
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    if (!r || !r->aux || !buf) return HTTPD_SOCK_ERR_INVALID;
+    host_req_aux_t *aux = r->aux;
+    host_sess_t *sess = aux->sess;
+
+    if (buf_len > aux->body_remaining) {
+        buf_len = aux->body_remaining;
+    }
+    if (buf_len == 0) {
+        return 0;
+    }
+
+    /* Serve already-buffered body bytes first */
+    if (sess->buf_len > 0) {
+        size_t n = sess->buf_len < buf_len ? sess->buf_len : buf_len;
+        memcpy(buf, sess->buf, n);
+        sess->buf_len -= n;
+        memmove(sess->buf, sess->buf + n, sess->buf_len);
+        aux->body_remaining -= n;
+        return (int)n;
+    }
+
+    ssize_t n;
+    do {
+        n = recv(sess->fd, buf, buf_len, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    aux->body_remaining -= (size_t)n;
+    return (int)n;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    if (!r || !r->aux) return -1;
+    return ((host_req_aux_t *)r->aux)->sess->fd;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    if (!r || !r->aux || !field) return 0;
+    size_t len = 0;
+    return find_header(((host_req_aux_t *)r->aux)->headers, field, &len) ? len : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    if (!r || !r->aux || !field || !val || val_size == 0) return ESP_ERR_INVALID_ARG;
+    size_t len = 0;
+    const char *v = find_header(((host_req_aux_t *)r->aux)->headers, field, &len);
+    if (!v) return ESP_ERR_NOT_FOUND;
+
+    size_t n = len < val_size - 1 ? len : val_size - 1;
+    memcpy(val, v, n);
+    val[n] = '\0';
+    return (n < len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out)
+{
+    if (!r || !r->aux || !out) return ESP_ERR_INVALID_ARG;
+    host_req_aux_t *aux = r->aux;
+
+    host_async_req_t *copy = malloc(sizeof(*copy));
+    if (!copy) return ESP_ERR_NO_MEM;
+    memcpy(&copy->req, r, sizeof(copy->req));
+    copy->aux = *aux;
+    copy->aux.async = true;
+    copy->req.aux = &copy->aux;
+
+    host_alloc_stats_t now;
+    host_alloc_thread_stats(&now);
+    copy->aux.alloc_start.bytes = now.bytes - aux->alloc_start.bytes;
+    copy->aux.alloc_start.count = now.count - aux->alloc_start.count;
+
+    aux->async = true;
+    aux->sess->async = true;
+    *out = &copy->req;
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r)
+{
+    if (!r || !r->aux) return ESP_ERR_INVALID_ARG;
+    host_async_req_t *copy = (host_async_req_t *)r;
+    host_httpd_t *hd = r->handle;
+    host_sess_t *sess = copy->aux.sess;
+
+    host_alloc_thread_stats(&t_async_mark);
+
+    /* Hand the socket back to the server thread: keep-alive connections
+     * whose response is complete stay open, anything else is closed */
+    const host_req_aux_t *aux = &copy->aux;
+    if (aux->keep_alive && aux->resp_done && aux->body_remaining == 0) {
+        sess->resume = (sess->buf_len > 0);
+    } else {
+        sess->close_pending = true;
+    }
+    sess->async = false;
+    (void)write(hd->wake_pipe[1], "a", 1);
+    free(copy);
+    return ESP_OK;
+}
+
+/* ── Public API: response ──────────────────────────────────────── */
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    if (!r || !r->aux || !status) return ESP_ERR_INVALID_ARG;
+    ((host_req_aux_t *)r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    if (!r || !r->aux || !type) return ESP_ERR_INVALID_ARG;
+    ((host_req_aux_t *)r->aux)->content_type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    if (!r || !r->aux || !field || !value) return ESP_ERR_INVALID_ARG;
+    host_req_aux_t *aux = r->aux;
+    if (aux->resp_hdr_count >= HOST_HTTPD_MAX_RESP_HDR) return ESP_ERR_HTTPD_RESP_HDR;
+    aux->resp_hdr_field[aux->resp_hdr_count] = field;
+    aux->resp_hdr_value[aux->resp_hdr_count] = value;
+    aux->resp_hdr_count++;
+    return ESP_OK;
+}
+
+static esp_err_t send_headers(host_req_aux_t *aux, ssize_t content_len)
+{
+    host_alloc_stats_t now, used;
+    host_alloc_thread_stats(&now);
+    if (aux->async) {
+        used.bytes = aux->alloc_start.bytes + (now.bytes - t_async_mark.bytes);
+        used.count = aux->alloc_start.count + (now.count - t_async_mark.count);
+    } else {
+        used.bytes = now.bytes - aux->alloc_start.bytes;
+        used.count = now.count - aux->alloc_start.count;
+    }
+
+    char hdr[1024];
+    int n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 %s\r\nContent-Type: %s\r\n",
+                     aux->status, aux->content_type);
+    if (content_len < 0) {
+        n += snprintf(hdr + n, sizeof(hdr) - n, "Transfer-Encoding: chunked\r\n");
+    } else {
+        n += snprintf(hdr + n, sizeof(hdr) - n, "Content-Length: %zd\r\n", content_len);
+    }
+    for (int i = 0; i < aux->resp_hdr_count && n < (int)sizeof(hdr); i++) {
+        n += snprintf(hdr + n, sizeof(hdr) - n, "%s: %s\r\n",
+                      aux->resp_hdr_field[i], aux->resp_hdr_value[i]);
+    }
+    if (n < (int)sizeof(hdr)) {
+        n += snprintf(hdr + n, sizeof(hdr) - n,
+                      "X-Host-Alloc-Bytes: %llu\r\nX-Host-Alloc-Count: %llu\r\n%s\r\n",
+                      (unsigned long long)used.bytes,
+                      (unsigned long long)used.count,
+                      aux->keep_alive ? "" : "Connection: close\r\n");
+    }
+    if (n >= (int)sizeof(hdr)) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+
+    aux->headers_sent = true;
+    return send_all(aux->sess->fd, hdr, (size_t)n) == 0 ? ESP_OK : ESP_ERR_HTTPD_RESP_SEND;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (!r || !r->aux) return ESP_ERR_HTTPD_INVALID_REQ;
+    host_req_aux_t *aux = r->aux;
+    if (aux->headers_sent) return ESP_ERR_HTTPD_RESP_SEND;
+
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf ? (ssize_t)strlen(buf) : 0;
+    }
+    if (!buf) {
+        buf_len = 0;
+    }
+
+    esp_err_t ret = send_headers(aux, buf_len);
+    if (ret != ESP_OK) return ret;
+    if (buf_len > 0 && send_all(aux->sess->fd, buf, (size_t)buf_len) != 0) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    aux->resp_done = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if (!r || !r->aux) return ESP_ERR_HTTPD_INVALID_REQ;
+    host_req_aux_t *aux = r->aux;
+
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = buf ? (ssize_t)strlen(buf) : 0;
+    }
+    if (!buf) {
+        buf_len = 0;
+    }
+
+    if (!aux->headers_sent) {
+        aux->chunked = true;
+        esp_err_t ret = send_headers(aux, -1);
+        if (ret != ESP_OK) return ret;
+    }
+    if (!aux->chunked) return ESP_ERR_HTTPD_RESP_SEND;
+
+    char size_line[24];
+    int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", (size_t)buf_len);
+    if (send_all(aux->sess->fd, size_line, (size_t)n) != 0 ||
+        (buf_len > 0 && send_all(aux->sess->fd, buf, (size_t)buf_len) != 0) ||
+        send_all(aux->sess->fd, "\r\n", 2) != 0) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    aux->resp_done = (buf_len == 0);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg)
+{
+    const char *status;
+    const char *default_msg;
+    switch (error) {
+        case HTTPD_501_METHOD_NOT_IMPLEMENTED: status = "501 Method Not Implemented"; default_msg = "Server does not support this method"; break;
+        case HTTPD_505_VERSION_NOT_SUPPORTED:  status = "505 Version Not Supported";  default_msg = "HTTP version not supported by server"; break;
+        case HTTPD_400_BAD_REQUEST:            status = "400 Bad Request";            default_msg = "Bad request syntax"; break;
+        case HTTPD_401_UNAUTHORIZED:           status = "401 Unauthorized";           default_msg = "No permission -- see authorization schemes"; break;
+        case HTTPD_403_FORBIDDEN:              status = "403 Forbidden";              default_msg = "Request forbidden -- authorization will not help"; break;
+        case HTTPD_404_NOT_FOUND:              status = "404 Not Found";              default_msg = "Nothing matches the given URI"; break;
+        case HTTPD_405_METHOD_NOT_ALLOWED:     status = "405 Method Not Allowed";     default_msg = "Specified method is invalid for this resource"; break;
+        case HTTPD_408_REQ_TIMEOUT:            status = "408 Request Timeout";        default_msg = "Server closed this connection"; break;
+        case HTTPD_411_LENGTH_REQUIRED:        status = "411 Length Required";        default_msg = "Client must specify Content-Length"; break;
+        case HTTPD_413_CONTENT_TOO_LARGE:      status = "413 Content Too Large";      default_msg = "Content is too large"; break;
+        case HTTPD_414_URI_TOO_LONG:           status = "414 URI Too Long";           default_msg = "URI is too long"; break;
+        case HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE: status = "431 Request Header Fields Too Large"; default_msg = "Header fields are too long"; break;
+        default:                               status = "500 Internal Server Error";  default_msg = "Server has encountered an unexpected error"; break;
+    }
+
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+    return httpd_resp_send(req, msg ? msg : default_msg, HTTPD_RESP_USE_STRLEN);
+}
+
+/* ── Public API: WebSocket ─────────────────────────────────────── */
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len)
+{
+    (void)req;
+    (void)pkt;
+    (void)max_len;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt)
+{
+    (void)req;
+    (void)pkt;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame)
+{
+    (void)hd;
+    (void)fd;
+    (void)frame;
+    return ESP_ERR_NOT_SUPPORTED;
+}
@@ -0,0 +1,51 @@
+/*
+ * Host shim: esp_log
+ */
+
+#include "esp_log.h"
+#include <stdio.h>
+#include <pthread.h>
+#include "esp_timer.h"
+
+static vprintf_like_t s_vprintf = vprintf;
+static esp_log_level_t s_level = ESP_LOG_INFO;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func)
+{
+    pthread_mutex_lock(&s_lock);
+    vprintf_like_t prev = s_vprintf;
+    s_vprintf = func;
+    pthread_mutex_unlock(&s_lock);
+    return prev;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    (void)tag;
+    s_level = level;
+}
+
+esp_log_level_t esp_log_level_get(const char *tag)
+{
+    (void)tag;
+    return s_level;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    (void)tag;
+    if (level > s_level) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    s_vprintf(format, args);
+    va_end(args);
+}
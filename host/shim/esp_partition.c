@@ -0,0 +1,155 @@
+/*
+ * Host shim: esp_partition on files
+ */
+
+#include "esp_partition.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_log.h"
+
+static const char *TAG = "partition";
+
+typedef struct {
+    esp_partition_t part;
+    int fd;
+} host_partition_t;
+
+static host_partition_t s_partitions[] = {
+    { .part = { .type = ESP_PARTITION_TYPE_DATA, .subtype = 0x40, .address = 0x311000,
+                .size = 0x20000, .erase_size = SPI_FLASH_SEC_SIZE, .label = "logs" }, .fd = -1 },
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define PARTITION_COUNT (sizeof(s_partitions) / sizeof(s_partitions[0]))
+
+static host_partition_t *host_partition(const esp_partition_t *partition)
+{
+    for (size_t i = 0; i < PARTITION_COUNT; i++) {
+        if (&s_partitions[i].part == partition) {
+            return &s_partitions[i];
+        }
+    }
+    return NULL;
+}
+
+// Open (and on first use create, erased) the backing file
+static bool host_partition_open(host_partition_t *hp)
+{
+    if (hp->fd >= 0) {
+        return true;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "partition_%s.bin", hp->part.label);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        ESP_LOGE(TAG, "Cannot open %s: %s", path, strerror(errno));
+        return false;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size < (off_t)hp->part.size) {
+        uint8_t erased[SPI_FLASH_SEC_SIZE];
+        memset(erased, 0xFF, sizeof(erased));
+        for (off_t off = size; off < (off_t)hp->part.size; off += (off_t)sizeof(erased)) {
+            if (pwrite(fd, erased, sizeof(erased), off) != (ssize_t)sizeof(erased)) {
+                close(fd);
+                return false;
+            }
+        }
+    }
+    hp->fd = fd;
+    return true;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype, const char *label)
+{
+    const esp_partition_t *found = NULL;
+    pthread_mutex_lock(&s_lock);
+    for (size_t i = 0; i < PARTITION_COUNT && !found; i++) {
+        host_partition_t *hp = &s_partitions[i];
+        if (hp->part.type == type &&
+            (subtype == ESP_PARTITION_SUBTYPE_ANY || hp->part.subtype == subtype) &&
+            (!label || strcmp(hp->part.label, label) == 0) && host_partition_open(hp)) {
+            found = &hp->part;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return found;
+}
+
+static esp_err_t check_range(const host_partition_t *hp, size_t offset, size_t size)
+{
+    if (!hp || hp->fd < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (offset > hp->part.size || size > hp->part.size - offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    host_partition_t *hp = host_partition(partition);
+    esp_err_t ret = check_range(hp, src_offset, size);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return pread(hp->fd, dst, size, (off_t)src_offset) == (ssize_t)size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    host_partition_t *hp = host_partition(partition);
+    esp_err_t ret = check_range(hp, dst_offset, size);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    // Programming clears bits and never sets them
+    const uint8_t *in = src;
+    uint8_t buf[256];
+    pthread_mutex_lock(&s_lock);
+    for (size_t done = 0; done < size && ret == ESP_OK; ) {
+        size_t n = size - done < sizeof(buf) ? size - done : sizeof(buf);
+        off_t off = (off_t)(dst_offset + done);
+        if (pread(hp->fd, buf, n, off) != (ssize_t)n) {
+            ret = ESP_FAIL;
+            break;
+        }
+        for (size_t i = 0; i < n; i++) {
+            buf[i] &= in[done + i];
+        }
+        if (pwrite(hp->fd, buf, n, off) != (ssize_t)n) {
+            ret = ESP_FAIL;
+        }
+        done += n;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+    host_partition_t *hp = host_partition(partition);
+    esp_err_t ret = check_range(hp, offset, size);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (offset % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t erased[SPI_FLASH_SEC_SIZE];
+    memset(erased, 0xFF, sizeof(erased));
+    for (size_t done = 0; done < size && ret == ESP_OK; done += sizeof(erased)) {
+        if (pwrite(hp->fd, erased, sizeof(erased), (off_t)(offset + done)) != (ssize_t)sizeof(erased)) {
+            ret = ESP_FAIL;
+        }
+    }
+    return ret;
+}
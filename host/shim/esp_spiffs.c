@@ -0,0 +1,66 @@
+/*
+ * Host shim: SPIFFS mapped onto a plain directory
+ */
+
+#include "esp_spiffs.h"
+#include "esp_log.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define HOST_SPIFFS_TOTAL_BYTES 0x40000     // Matches the "storage" partition
+
+static const char *TAG = "host_spiffs";
+static char s_base_path[256];
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *conf)
+{
+    if (!conf || !conf->base_path) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (mkdir(conf->base_path, 0755) != 0 && errno != EEXIST) {
+        ESP_LOGE(TAG, "Cannot create %s: %s", conf->base_path, strerror(errno));
+        return ESP_FAIL;
+    }
+
+    snprintf(s_base_path, sizeof(s_base_path), "%s", conf->base_path);
+    ESP_LOGI(TAG, "Mounted directory %s as SPIFFS", s_base_path);
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_spiffs_unregister(const char *partition_label)
+{
+    (void)partition_label;
+    s_base_path[0] = '\0';
+    return ESP_OK;
+}
+
+esp_err_t esp_spiffs_info(const char *partition_label, size_t *total_bytes, size_t *used_bytes)
+{
+    (void)partition_label;
+    if (s_base_path[0] == '\0') {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    size_t used = 0;
+    DIR *dir = opendir(s_base_path);
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            char path[512];
+            struct stat st;
+            snprintf(path, sizeof(path), "%s/%s", s_base_path, entry->d_name);
+            if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+                used += (size_t)st.st_size;
+            }
+        }
+        closedir(dir);
+    }
+
+    if (total_bytes) *total_bytes = HOST_SPIFFS_TOTAL_BYTES;
+    if (used_bytes) *used_bytes = used;
+    return ESP_OK;
+}
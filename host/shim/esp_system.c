@@ -0,0 +1,185 @@
+/*
+ * Host shim: esp_err, esp_system, esp_random, esp_timer, esp_heap_caps
+ */
+
+#include "esp_err.h"
+#include "esp_system.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "host_alloc.h"
+#include <malloc.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/random.h>
+
+/* Nominal heap the device-style figures are reported against */
+#ifndef HOST_NOMINAL_HEAP_SIZE
+#define HOST_NOMINAL_HEAP_SIZE (8 * 1024 * 1024)
+#endif
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:                    return "ESP_OK";
+        case ESP_FAIL:                  return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE:  return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC:       return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION:   return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_INVALID_MAC:       return "ESP_ERR_INVALID_MAC";
+        case ESP_ERR_NOT_FINISHED:      return "ESP_ERR_NOT_FINISHED";
+        case ESP_ERR_NOT_ALLOWED:       return "ESP_ERR_NOT_ALLOWED";
+        case ESP_ERR_WIFI_BASE + 15:    return "ESP_ERR_WIFI_NOT_CONNECT";
+        default:                        return "UNKNOWN ERROR";
+    }
+}
+
+int64_t esp_timer_get_time(void)
+{
+    static int64_t s_start_us = 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t now = (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+    if (s_start_us == 0) {
+        s_start_us = now;
+    }
+    return now - s_start_us;
+}
+
+static size_t nominal_free(void)
+{
+    size_t live = host_alloc_live_bytes();
+    return live < HOST_NOMINAL_HEAP_SIZE ? HOST_NOMINAL_HEAP_SIZE - live : 0;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return (uint32_t)nominal_free();
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    size_t peak = host_alloc_peak_bytes();
+    return peak < HOST_NOMINAL_HEAP_SIZE ? (uint32_t)(HOST_NOMINAL_HEAP_SIZE - peak) : 0;
+}
+
+#define SHUTDOWN_HANDLERS 5
+
+static shutdown_handler_t s_shutdown_handlers[SHUTDOWN_HANDLERS];
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler)
+{
+    for (int i = 0; i < SHUTDOWN_HANDLERS; i++) {
+        if (s_shutdown_handlers[i] == handler) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        if (!s_shutdown_handlers[i]) {
+            s_shutdown_handlers[i] = handler;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_reset_reason_t esp_reset_reason(void)
+{
+    return ESP_RST_POWERON;
+}
+
+void esp_restart(void)
+{
+    ESP_LOGW("host", "esp_restart() called, exiting");
+    for (int i = SHUTDOWN_HANDLERS - 1; i >= 0; i--) {
+        if (s_shutdown_handlers[i]) {
+            s_shutdown_handlers[i]();
+        }
+    }
+    exit(0);
+}
+
+void esp_fill_random(void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    while (len > 0) {
+        ssize_t n = getrandom(p, len, 0);
+        if (n <= 0) {
+            continue;   // EINTR
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+uint32_t esp_random(void)
+{
+    uint32_t r;
+    esp_fill_random(&r, sizeof(r));
+    return r;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    (void)caps;
+    return malloc(size);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return calloc(n, size);
+}
+
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t caps)
+{
+    (void)caps;
+    return realloc(ptr, size);
+}
+
+void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+size_t heap_caps_get_allocated_size(void *ptr)
+{
+    return ptr ? malloc_usable_size(ptr) : 0;
+}
+
+size_t heap_caps_get_total_size(uint32_t caps)
+{
+    return (caps & MALLOC_CAP_SPIRAM) ? 0 : HOST_NOMINAL_HEAP_SIZE;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return (caps & MALLOC_CAP_SPIRAM) ? 0 : nominal_free();
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps);
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    return (caps & MALLOC_CAP_SPIRAM) ? 0 : esp_get_minimum_free_heap_size();
+}
+
+esp_err_t heap_caps_monitor_local_minimum_free_size_start(void)
+{
+    host_alloc_peak_reset();
+    return ESP_OK;
+}
+
+esp_err_t heap_caps_monitor_local_minimum_free_size_stop(void)
+{
+    return ESP_OK;
+}
@@ -0,0 +1,225 @@
+/*
+ * Host shim: FreeRTOS tasks and semaphores on pthreads
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct host_task {
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    char name[16];
+};
+
+struct host_sem {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    UBaseType_t count;
+    UBaseType_t max_count;
+};
+
+static __thread struct host_task *t_current;
+
+/* ── Tasks ─────────────────────────────────────────────────────── */
+
+static void *task_trampoline(void *p)
+{
+    struct host_task *task = p;
+    t_current = task;
+    task->fn(task->arg);
+    /* Returning from a FreeRTOS task is a bug on device; treat it as self-delete */
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *out_handle)
+{
+    (void)stack_depth;
+    (void)priority;
+
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (!task) return pdFAIL;
+    task->fn = fn;
+    task->arg = arg;
+    strncpy(task->name, name ? name : "task", sizeof(task->name) - 1);
+
+    /* Publish the handle before the task can observe it */
+    if (out_handle) *out_handle = task;
+
+    if (pthread_create(&task->thread, NULL, task_trampoline, task) != 0) {
+        if (out_handle) *out_handle = NULL;
+        free(task);
+        return pdFAIL;
+    }
+    pthread_setname_np(task->thread, task->name);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                                   void *arg, UBaseType_t priority, TaskHandle_t *out_handle,
+                                   BaseType_t core_id)
+{
+    (void)core_id;
+    return xTaskCreate(fn, name, stack_depth, arg, priority, out_handle);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == t_current) {
+        struct host_task *self = t_current;
+        if (self) {
+            pthread_detach(self->thread);
+            free(self);
+            t_current = NULL;
+        }
+        pthread_exit(NULL);
+    }
+
+    pthread_cancel(task->thread);
+    pthread_join(task->thread, NULL);
+    free(task);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {
+        .tv_sec = ticks / 1000,
+        .tv_nsec = (long)(ticks % 1000) * 1000000L,
+    };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (TickType_t)(ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000ULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return t_current;
+}
+
+char *pcTaskGetName(TaskHandle_t task)
+{
+    static __thread char thread_name[16];
+    if (!task) {
+        task = t_current;
+    }
+    if (task) {
+        return task->name;
+    }
+    /* Not a task (httpd or main thread): use the pthread name */
+    if (pthread_getname_np(pthread_self(), thread_name, sizeof(thread_name)) != 0) {
+        snprintf(thread_name, sizeof(thread_name), "thread");
+    }
+    return thread_name;
+}
+
+/* ── Semaphores ────────────────────────────────────────────────── */
+
+static SemaphoreHandle_t sem_create(UBaseType_t max_count, UBaseType_t initial)
+{
+    struct host_sem *sem = calloc(1, sizeof(*sem));
+    if (!sem) return NULL;
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sem->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    sem->count = initial;
+    sem->max_count = max_count;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return sem_create(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return sem_create(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    return sem_create(max_count, initial_count);
+}
+
+static void sem_unlock_cleanup(void *lock)
+{
+    pthread_mutex_unlock(lock);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    if (!sem) return pdFALSE;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&sem->lock);
+    /* vTaskDelete() may cancel a task blocked here; don't leave sem locked */
+    pthread_cleanup_push(sem_unlock_cleanup, &sem->lock);
+    while (sem->count == 0) {
+        if (ticks == 0) {
+            break;
+        }
+        int rc = (ticks == portMAX_DELAY)
+                 ? pthread_cond_wait(&sem->cond, &sem->lock)
+                 : pthread_cond_timedwait(&sem->cond, &sem->lock, &deadline);
+        if (rc == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_cleanup_pop(0);
+    BaseType_t taken = pdFALSE;
+    if (sem->count > 0) {
+        sem->count--;
+        taken = pdTRUE;
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    if (!sem) return pdFALSE;
+
+    BaseType_t given = pdFALSE;
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count < sem->max_count) {
+        sem->count++;
+        given = pdTRUE;
+        pthread_cond_signal(&sem->cond);
+    }
+    pthread_mutex_unlock(&sem->lock);
+    return given;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    if (!sem) return;
+    pthread_cond_destroy(&sem->cond);
+    pthread_mutex_destroy(&sem->lock);
+    free(sem);
+}
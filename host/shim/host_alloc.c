@@ -0,0 +1,96 @@
+/*
+ * Host allocation accounting
+ *
+ * Wraps the glibc allocator entry points. Counters are thread-local for
+ * per-request attribution and global (atomic) for the live heap figure.
+ */
+
+#include "host_alloc.h"
+#include <malloc.h>
+#include <stdatomic.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static __thread uint64_t t_bytes;
+static __thread uint64_t t_count;
+static atomic_size_t s_live;
+static atomic_size_t s_peak;
+
+static void account_add(void *p, size_t requested)
+{
+    if (!p) return;
+    t_bytes += requested;
+    t_count++;
+
+    size_t live = atomic_fetch_add_explicit(&s_live, malloc_usable_size(p), memory_order_relaxed)
+                  + malloc_usable_size(p);
+    size_t peak = atomic_load_explicit(&s_peak, memory_order_relaxed);
+    while (live > peak &&
+           !atomic_compare_exchange_weak_explicit(&s_peak, &peak, live,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static void account_remove(void *p)
+{
+    if (!p) return;
+    atomic_fetch_sub_explicit(&s_live, malloc_usable_size(p), memory_order_relaxed);
+}
+
+void *malloc(size_t size)
+{
+    void *p = __libc_malloc(size);
+    account_add(p, size);
+    return p;
+}
+
+void *calloc(size_t n, size_t size)
+{
+    void *p = __libc_calloc(n, size);
+    account_add(p, n * size);
+    return p;
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    account_remove(ptr);
+    void *p = __libc_realloc(ptr, size);
+    if (!p && ptr && size) {
+        /* Original block is still valid */
+        atomic_fetch_add_explicit(&s_live, malloc_usable_size(ptr), memory_order_relaxed);
+        return NULL;
+    }
+    account_add(p, size);
+    return p;
+}
+
+void free(void *ptr)
+{
+    account_remove(ptr);
+    __libc_free(ptr);
+}
+
+void host_alloc_thread_stats(host_alloc_stats_t *out)
+{
+    out->bytes = t_bytes;
+    out->count = t_count;
+}
+
+size_t host_alloc_live_bytes(void)
+{
+    return atomic_load_explicit(&s_live, memory_order_relaxed);
+}
+
+size_t host_alloc_peak_bytes(void)
+{
+    return atomic_load_explicit(&s_peak, memory_order_relaxed);
+}
+
+void host_alloc_peak_reset(void)
+{
+    atomic_store_explicit(&s_peak, atomic_load_explicit(&s_live, memory_order_relaxed),
+                          memory_order_relaxed);
+}
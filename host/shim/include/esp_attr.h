@@ -0,0 +1,15 @@
+/*
+ * Host shim: esp_attr.h
+ *
+ * Placement attributes are no-ops. RTC_NOINIT data therefore does not
+ * survive a restart, which on the host is a new process anyway: every
+ * host start looks like a power-on.
+ */
+
+#ifndef HOST_ESP_ATTR_H
+#define HOST_ESP_ATTR_H
+
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+
+#endif // HOST_ESP_ATTR_H
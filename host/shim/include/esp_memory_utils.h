@@ -0,0 +1,34 @@
+/*
+ * Host shim: esp_memory_utils.h
+ *
+ * The host has no external RAM. "Flash rodata" is the executable image
+ * up to the end of initialised data, which holds every string literal of
+ * the program (and its initialised globals).
+ */
+
+#ifndef HOST_ESP_MEMORY_UTILS_H
+#define HOST_ESP_MEMORY_UTILS_H
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+static inline bool esp_ptr_external_ram(const void *p)
+{
+    (void)p;
+    return false;
+}
+
+static inline bool esp_ptr_in_drom(const void *p)
+{
+    extern const char __executable_start[], edata[];
+    return (const char *)p >= __executable_start && (const char *)p < edata;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_ESP_MEMORY_UTILS_H
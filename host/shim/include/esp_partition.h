@@ -0,0 +1,53 @@
+/*
+ * Host shim: esp_partition.h
+ *
+ * Only the data partitions that the host build uses are known (the
+ * "logs" archive partition of partitions_ota.csv). Each is a file named
+ * partition_<label>.bin in the working directory, created erased (0xFF).
+ * Writes clear bits only, like NOR flash, and erases must be sector
+ * aligned, so code that works here makes the same assumptions the
+ * device does.
+ */
+
+#ifndef HOST_ESP_PARTITION_H
+#define HOST_ESP_PARTITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+} esp_partition_type_t;
+
+typedef int esp_partition_subtype_t;
+
+#define ESP_PARTITION_SUBTYPE_ANY 0xff
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    uint32_t erase_size;
+    char label[17];
+} esp_partition_t;
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype, const char *label);
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size);
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size);
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_ESP_PARTITION_H
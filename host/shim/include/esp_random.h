@@ -0,0 +1,22 @@
+/*
+ * Host shim: esp_random.h
+ */
+
+#ifndef HOST_ESP_RANDOM_H
+#define HOST_ESP_RANDOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t esp_random(void);
+void esp_fill_random(void *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_ESP_RANDOM_H
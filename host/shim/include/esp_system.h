@@ -0,0 +1,56 @@
+/*
+ * Host shim: esp_system.h
+ *
+ * Heap figures are derived from the host allocation counters against a
+ * nominal heap size (HOST_NOMINAL_HEAP_SIZE) so get_status stays meaningful.
+ */
+
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+typedef void (*shutdown_handler_t)(void);
+
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+/**
+ * Terminate the host process (there is nothing to reboot into)
+ */
+void esp_restart(void) __attribute__((noreturn));
+
+/**
+ * Run handler in esp_restart before the process exits
+ */
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+
+/**
+ * Every host start is a power-on
+ */
+esp_reset_reason_t esp_reset_reason(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_ESP_SYSTEM_H
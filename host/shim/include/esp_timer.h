@@ -0,0 +1,24 @@
+/*
+ * Host shim: esp_timer.h
+ */
+
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Microseconds since process start (CLOCK_MONOTONIC)
+ */
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_ESP_TIMER_H
@@ -0,0 +1,32 @@
+/*
+ * Host shim: esp_wifi.h
+ *
+ * The host build is never associated with an AP.
+ */
+
+#ifndef HOST_ESP_WIFI_H
+#define HOST_ESP_WIFI_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_ERR_WIFI_NOT_CONNECT    (ESP_ERR_WIFI_BASE + 15)
+
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t ssid[33];
+    uint8_t primary;
+    int8_t  rssi;
+} wifi_ap_record_t;
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_ESP_WIFI_H
@@ -0,0 +1,47 @@
+/*
+ * Host shim: freertos/FreeRTOS.h
+ *
+ * One tick is one millisecond. Tasks are pthreads, semaphores are
+ * mutex + condition variable pairs (see shim/freertos.c).
+ */
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE                 ((BaseType_t)0)
+#define pdTRUE                  ((BaseType_t)1)
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+
+#define portMAX_DELAY           ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS      ((TickType_t)1)
+#define configTICK_RATE_HZ      1000
+#define configMAX_PRIORITIES    25
+#define tskIDLE_PRIORITY        ((UBaseType_t)0U)
+#define tskNO_AFFINITY          0x7FFFFFFF
+
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+
+/* The host does not report which CPU a thread is on */
+static inline BaseType_t xPortGetCoreID(void)
+{
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_FREERTOS_H
@@ -0,0 +1,46 @@
+/*
+ * Host shim: freertos/task.h
+ */
+
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*TaskFunction_t)(void *);
+typedef struct host_task *TaskHandle_t;
+
+/**
+ * Create a task backed by a joinable pthread. Stack depth and priority
+ * are recorded but not enforced.
+ */
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                       void *arg, UBaseType_t priority, TaskHandle_t *out_handle);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                                   void *arg, UBaseType_t priority, TaskHandle_t *out_handle,
+                                   BaseType_t core_id);
+
+/**
+ * Delete a task. NULL deletes the calling task. Deleting another task
+ * cancels its thread at the next cancellation point and joins it, so
+ * the caller may touch state the task owned as soon as this returns.
+ */
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+/* Name given to xTaskCreate; NULL asks for the calling thread's name */
+char *pcTaskGetName(TaskHandle_t task);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_FREERTOS_TASK_H
@@ -0,0 +1,50 @@
+/*
+ * Host allocation accounting
+ *
+ * malloc/calloc/realloc/free are interposed in the host executables so the
+ * transport and benchmarks can report bytes allocated per request.
+ */
+
+#ifndef HOST_ALLOC_H
+#define HOST_ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Cumulative allocation counters
+ */
+typedef struct {
+    uint64_t bytes;     // Bytes requested
+    uint64_t count;     // Number of allocation calls (malloc/calloc/realloc)
+} host_alloc_stats_t;
+
+/**
+ * Counters for the calling thread since it started
+ */
+void host_alloc_thread_stats(host_alloc_stats_t *out);
+
+/**
+ * Bytes currently allocated by the whole process (usable size)
+ */
+size_t host_alloc_live_bytes(void);
+
+/**
+ * High-water mark of host_alloc_live_bytes()
+ */
+size_t host_alloc_peak_bytes(void);
+
+/**
+ * Restart the high-water mark from the current live bytes
+ */
+void host_alloc_peak_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_ALLOC_H
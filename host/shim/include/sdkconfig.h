@@ -0,0 +1,50 @@
+/*
+ * Host shim: sdkconfig.h
+ *
+ * Mirrors the Kconfig defaults and sdkconfig.defaults values that the
+ * MCP core reads. Keep in sync with main/Kconfig.projbuild.
+ */
+
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_HTTPD_WS_SUPPORT 1
+
+#define CONFIG_MCP_MAX_MESSAGE_SIZE 4096
+#define CONFIG_MCP_MAX_STREAM_SIZE 65536
+#define CONFIG_MCP_MAX_BATCH_ENTRIES 16
+/* CONFIG_MCP_BATCH_READONLY_PASS is not set */
+#define CONFIG_MCP_RESPONSE_BUFFER_SIZE 2048
+#define CONFIG_MCP_MAX_TOOL_RESULT_SIZE 16384
+#define CONFIG_BLINK_GPIO 2
+#define CONFIG_MCP_LOG_BUFFER_SIZE 16384
+#define CONFIG_MCP_LOG_STAGING_LINES 16
+#define CONFIG_MCP_LOG_DRAIN_PRIORITY 1
+/* CONFIG_MCP_LOG_DEFERRED is not set */
+#define CONFIG_MCP_LOG_ARCHIVE 1
+#define CONFIG_MCP_LOG_ARCHIVE_LEVEL 3
+#define CONFIG_MCP_LOG_ARCHIVE_FLUSH_MS 5000
+#define CONFIG_MCP_LOG_ARCHIVE_RTC_SIZE 2048
+#define CONFIG_MCP_SSE_MAX_CLIENTS 2
+#define CONFIG_MCP_SSE_QUEUE_SIZE 2048
+#define CONFIG_MCP_SSE_HEARTBEAT_SEC 15
+#define CONFIG_MCP_BUF_POOL_SETS 4
+#define CONFIG_MCP_ARENA_SIZE 8192
+#define CONFIG_MCP_ARENA_COUNT 4
+/* CONFIG_MCP_ARENA_ASSERT_NO_HEAP is not set */
+#define CONFIG_MCP_METRICS_MAX_SERIES 40
+#define CONFIG_MCP_TRACE 1
+#define CONFIG_MCP_TRACE_EVENTS 512
+/* CONFIG_MCP_TRACE_AT_BOOT is not set */
+#define CONFIG_MCP_MAX_SESSIONS 8
+#define CONFIG_MCP_RESOURCE_SUBSCRIPTIONS 8
+#define CONFIG_MCP_RESOURCE_NOTIFY_MS 1000
+#define CONFIG_MCP_RESOURCE_STATUS_SEC 10
+#define CONFIG_MCP_EXECUTOR_WORKERS 2
+#define CONFIG_MCP_EXECUTOR_QUEUE_LEN 8
+#define CONFIG_MCP_EXECUTOR_HTTP_MAX_PENDING 2
+#define CONFIG_MCP_LUA_TOOLS_MAX 16
+#define CONFIG_MCP_OTA_URL "http://YOUR_HOST:8080/wss_server.bin"
+
+#endif // HOST_SDKCONFIG_H
@@ -0,0 +1,103 @@
+/* Dispatch micro-benchmark for the host build
+ *
+ * Compares the linear strcmp scan that method and tool lookup used to do
+ * against name_index (main/name_index.c) for growing registries. Names
+ * look like tool names ("lua_xxx", "sys_xxx", ...) and share prefixes, as
+ * the real ones do; every tenth lookup is a miss.
+ *
+ *   mcp_dispatch_bench [-n lookups]
+ */
+
+#include "name_index.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_NAMES 256
+#define NAME_LEN  32
+
+static char s_names[MAX_NAMES][NAME_LEN];
+static char s_misses[MAX_NAMES][NAME_LEN];
+static name_index_slot_t s_slots[NAME_INDEX_SLOTS(MAX_NAMES)];
+
+static const char *const s_prefixes[] = { "lua_", "sys_", "get_", "control_" };
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static const char *linear_find(size_t count, const char *name)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(s_names[i], name) == 0) {
+            return s_names[i];
+        }
+    }
+    return NULL;
+}
+
+// Keeps the compiler from dropping the lookups
+static volatile uintptr_t s_sink;
+
+int main(int argc, char **argv)
+{
+    long lookups = 2000000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') {
+            lookups = strtol(optarg, NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [-n lookups]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    for (int i = 0; i < MAX_NAMES; i++) {
+        const char *prefix = s_prefixes[i % 4];
+        snprintf(s_names[i], NAME_LEN, "%stool_%03d", prefix, i);
+        snprintf(s_misses[i], NAME_LEN, "%stool_%03d_x", prefix, i);
+    }
+
+    printf("lookups per run: %ld (10%% misses)\n", lookups);
+    printf("%8s %14s %14s %10s\n", "names", "linear ns/op", "index ns/op", "speedup");
+
+    static const size_t counts[] = { 8, 16, 32, 64, 128, 256 };
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        size_t count = counts[c];
+
+        name_index_t idx;
+        name_index_init(&idx, s_slots, NAME_INDEX_SLOTS(MAX_NAMES));
+        for (size_t i = 0; i < count; i++) {
+            if (name_index_add(&idx, s_names[i], s_names[i]) != ESP_OK) {
+                fprintf(stderr, "index add failed at %zu\n", i);
+                return 1;
+            }
+        }
+
+        // Same lookup sequence for both: stride through the names
+        uint64_t t0 = now_ns();
+        for (long n = 0; n < lookups; n++) {
+            size_t k = (size_t)(n * 7) % count;
+            const char *name = (n % 10 == 9) ? s_misses[k] : s_names[k];
+            s_sink += (uintptr_t)linear_find(count, name);
+        }
+        uint64_t t1 = now_ns();
+        for (long n = 0; n < lookups; n++) {
+            size_t k = (size_t)(n * 7) % count;
+            const char *name = (n % 10 == 9) ? s_misses[k] : s_names[k];
+            s_sink += (uintptr_t)name_index_find(&idx, name);
+        }
+        uint64_t t2 = now_ns();
+
+        double linear = (double)(t1 - t0) / (double)lookups;
+        double index = (double)(t2 - t1) / (double)lookups;
+        printf("%8zu %14.1f %14.1f %9.1fx\n", count, linear, index, linear / index);
+    }
+    return 0;
+}
@@ -0,0 +1,479 @@
+/* MCP load generator for the host build
+ *
+ * Replays a weighted initialize / tools/list / tools/call mix against
+ * POST /mcp over keep-alive connections and reports throughput, latency
+ * percentiles and the server-side allocation counters the host transport
+ * returns in X-Host-Alloc-Bytes / X-Host-Alloc-Count.
+ *
+ *   mcp_loadgen -p 8080 -n 5000 -c 2 -m initialize:1,tools/list:2,tools/call:7 \
+ *               -t get_status,sys_get_logs
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_KINDS    8
+#define MAX_TOOLS    16
+#define BODY_MAX     8192
+
+typedef struct {
+    char method[32];
+    unsigned weight;
+} mix_entry_t;
+
+typedef struct {
+    uint32_t latency_us;
+    uint32_t alloc_bytes;
+    uint32_t alloc_count;
+    uint8_t kind;
+    bool ok;
+} sample_t;
+
+typedef struct {
+    int index;
+    int requests;
+    unsigned seed;
+    sample_t *samples;
+    int done;
+    int reconnects;
+    int http_errors;
+    int rpc_errors;
+} worker_t;
+
+static struct {
+    const char *host;
+    int port;
+    int requests;
+    int connections;
+    int warmup;
+    const char *args_json;
+    mix_entry_t mix[MAX_KINDS];
+    int mix_count;
+    unsigned mix_total;
+    char *tools[MAX_TOOLS];
+    int tool_count;
+} g;
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/* ── Connection ────────────────────────────────────────────────── */
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t len;
+    size_t cap;
+} conn_t;
+
+static int conn_open(conn_t *c)
+{
+    char port[16];
+    snprintf(port, sizeof(port), "%d", g.port);
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(g.host, port, &hints, &res) != 0 || !res) {
+        return -1;
+    }
+    c->fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (c->fd < 0 || connect(c->fd, res->ai_addr, res->ai_addrlen) != 0) {
+        if (c->fd >= 0) close(c->fd);
+        c->fd = -1;
+        freeaddrinfo(res);
+        return -1;
+    }
+    freeaddrinfo(res);
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c->len = 0;
+    return 0;
+}
+
+static void conn_close(conn_t *c)
+{
+    if (c->fd >= 0) close(c->fd);
+    c->fd = -1;
+    c->len = 0;
+}
+
+static int conn_fill(conn_t *c)
+{
+    if (c->cap - c->len < 4096) {
+        size_t cap = c->cap ? c->cap * 2 : 65536;
+        char *nb = realloc(c->buf, cap);
+        if (!nb) return -1;
+        c->buf = nb;
+        c->cap = cap;
+    }
+    ssize_t n;
+    do {
+        n = recv(c->fd, c->buf + c->len, c->cap - c->len - 1, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return -1;
+    c->len += (size_t)n;
+    c->buf[c->len] = '\0';
+    return 0;
+}
+
+static void conn_consume(conn_t *c, size_t n)
+{
+    memmove(c->buf, c->buf + n, c->len - n);
+    c->len -= n;
+}
+
+static const char *hdr_value(const char *hdrs, size_t hdrs_len, const char *name)
+{
+    size_t nlen = strlen(name);
+    for (const char *p = hdrs; p && p < hdrs + hdrs_len; ) {
+        if (strncasecmp(p, name, nlen) == 0 && p[nlen] == ':') {
+            p += nlen + 1;
+            while (*p == ' ') p++;
+            return p;
+        }
+        p = strstr(p, "\r\n");
+        if (p) p += 2;
+    }
+    return NULL;
+}
+
+typedef struct {
+    int status;
+    bool close;
+    uint32_t alloc_bytes;
+    uint32_t alloc_count;
+    bool rpc_error;
+} response_t;
+
+/* Read one HTTP response (Content-Length or chunked) */
+static int read_response(conn_t *c, response_t *r)
+{
+    memset(r, 0, sizeof(*r));
+    char *end;
+    while (!(end = (c->len ? strstr(c->buf, "\r\n\r\n") : NULL))) {
+        if (conn_fill(c) != 0) return -1;
+    }
+    size_t hdr_len = (size_t)(end - c->buf) + 4;
+    if (sscanf(c->buf, "HTTP/1.%*d %d", &r->status) != 1) return -1;
+
+    const char *v;
+    if ((v = hdr_value(c->buf, hdr_len, "X-Host-Alloc-Bytes"))) r->alloc_bytes = (uint32_t)strtoul(v, NULL, 10);
+    if ((v = hdr_value(c->buf, hdr_len, "X-Host-Alloc-Count"))) r->alloc_count = (uint32_t)strtoul(v, NULL, 10);
+    if ((v = hdr_value(c->buf, hdr_len, "Connection"))) r->close = strncasecmp(v, "close", 5) == 0;
+    bool chunked = (v = hdr_value(c->buf, hdr_len, "Transfer-Encoding")) && strncasecmp(v, "chunked", 7) == 0;
+    size_t content_len = (v = hdr_value(c->buf, hdr_len, "Content-Length")) ? strtoul(v, NULL, 10) : 0;
+    conn_consume(c, hdr_len);
+
+    if (!chunked) {
+        while (c->len < content_len) {
+            if (conn_fill(c) != 0) return -1;
+        }
+        char saved = c->buf[content_len];
+        c->buf[content_len] = '\0';
+        r->rpc_error = strstr(c->buf, "\"error\":{") != NULL;
+        c->buf[content_len] = saved;
+        conn_consume(c, content_len);
+        return 0;
+    }
+
+    for (;;) {
+        char *eol;
+        while (!(eol = (c->len ? strstr(c->buf, "\r\n") : NULL))) {
+            if (conn_fill(c) != 0) return -1;
+        }
+        size_t chunk = strtoul(c->buf, NULL, 16);
+        size_t need = (size_t)(eol - c->buf) + 2 + chunk + 2;
+        while (c->len < need) {
+            if (conn_fill(c) != 0) return -1;
+        }
+        if (chunk > 0 && memmem(eol + 2, chunk, "\"error\":{", 9)) {
+            r->rpc_error = true;
+        }
+        conn_consume(c, need);
+        if (chunk == 0) return 0;
+    }
+}
+
+/* ── Workload ──────────────────────────────────────────────────── */
+
+static int build_body(char *body, size_t cap, const char *method, int id, unsigned *seed)
+{
+    if (strcmp(method, "initialize") == 0) {
+        return snprintf(body, cap,
+            "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"initialize\",\"params\":{"
+            "\"protocolVersion\":\"2024-11-05\",\"capabilities\":{},"
+            "\"clientInfo\":{\"name\":\"mcp_loadgen\",\"version\":\"1.0\"}}}", id);
+    }
+    if (strcmp(method, "tools/call") == 0) {
+        const char *tool = g.tools[rand_r(seed) % g.tool_count];
+        return snprintf(body, cap,
+            "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"tools/call\",\"params\":{"
+            "\"name\":\"%s\",\"arguments\":%s}}", id, tool, g.args_json);
+    }
+    return snprintf(body, cap, "{\"jsonrpc\":\"2.0\",\"id\":%d,\"method\":\"%s\",\"params\":{}}", id, method);
+}
+
+static int pick_kind(unsigned *seed)
+{
+    unsigned r = (unsigned)rand_r(seed) % g.mix_total;
+    for (int i = 0; i < g.mix_count; i++) {
+        if (r < g.mix[i].weight) return i;
+        r -= g.mix[i].weight;
+    }
+    return 0;
+}
+
+static int do_request(conn_t *c, worker_t *w, int id, sample_t *s)
+{
+    char body[BODY_MAX];
+    char req[BODY_MAX + 256];
+    int kind = pick_kind(&w->seed);
+    int blen = build_body(body, sizeof(body), g.mix[kind].method, id, &w->seed);
+    int rlen = snprintf(req, sizeof(req),
+        "POST /mcp HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\n"
+        "Accept: application/json, text/event-stream\r\nContent-Length: %d\r\n\r\n%s",
+        g.host, blen, body);
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (c->fd < 0) {
+            if (conn_open(c) != 0) return -1;
+            w->reconnects++;
+        }
+        uint64_t t0 = now_us();
+        if (send(c->fd, req, (size_t)rlen, MSG_NOSIGNAL) != rlen) {
+            conn_close(c);
+            continue;
+        }
+        response_t r;
+        if (read_response(c, &r) != 0) {
+            conn_close(c);
+            continue;
+        }
+        uint64_t t1 = now_us();
+        if (r.close) conn_close(c);
+
+        if (s) {
+            s->latency_us = (uint32_t)(t1 - t0);
+            s->alloc_bytes = r.alloc_bytes;
+            s->alloc_count = r.alloc_count;
+            s->kind = (uint8_t)kind;
+            s->ok = (r.status / 100 == 2) && !r.rpc_error;
+            if (r.status / 100 != 2) w->http_errors++;
+            if (r.rpc_error) w->rpc_errors++;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+static void *worker_main(void *arg)
+{
+    worker_t *w = arg;
+    conn_t c = { .fd = -1 };
+    if (conn_open(&c) != 0) {
+        fprintf(stderr, "worker %d: cannot connect to %s:%d\n", w->index, g.host, g.port);
+        return NULL;
+    }
+
+    for (int i = 0; i < g.warmup; i++) {
+        do_request(&c, w, 1000000 + i, NULL);
+    }
+    for (int i = 0; i < w->requests; i++) {
+        if (do_request(&c, w, w->index * 1000000 + i + 1, &w->samples[w->done]) != 0) {
+            fprintf(stderr, "worker %d: request failed, stopping\n", w->index);
+            break;
+        }
+        w->done++;
+    }
+    conn_close(&c);
+    free(c.buf);
+    return NULL;
+}
+
+/* ── Reporting ─────────────────────────────────────────────────── */
+
+static int cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, double p)
+{
+    if (n == 0) return 0;
+    size_t idx = (size_t)(p * (double)(n - 1) + 0.5);
+    return sorted[idx];
+}
+
+static void report_row(const char *name, const sample_t *all, size_t n, int kind)
+{
+    uint32_t *lat = malloc((n ? n : 1) * sizeof(uint32_t));
+    size_t m = 0;
+    uint64_t bytes = 0, count = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (kind >= 0 && all[i].kind != kind) continue;
+        lat[m++] = all[i].latency_us;
+        bytes += all[i].alloc_bytes;
+        count += all[i].alloc_count;
+    }
+    if (m == 0) {
+        free(lat);
+        return;
+    }
+    qsort(lat, m, sizeof(uint32_t), cmp_u32);
+    printf("%-14s %7zu %9u %9u %9u %9u %13.0f %11.1f\n", name, m,
+           percentile(lat, m, 0.50), percentile(lat, m, 0.90), percentile(lat, m, 0.99),
+           lat[m - 1], (double)bytes / (double)m, (double)count / (double)m);
+    free(lat);
+}
+
+/* ── Options ───────────────────────────────────────────────────── */
+
+static int parse_mix(const char *spec)
+{
+    char *copy = strdup(spec);
+    char *save = NULL;
+    g.mix_count = 0;
+    g.mix_total = 0;
+    for (char *tok = strtok_r(copy, ",", &save); tok && g.mix_count < MAX_KINDS;
+         tok = strtok_r(NULL, ",", &save)) {
+        mix_entry_t *e = &g.mix[g.mix_count];
+        char *colon = strrchr(tok, ':');
+        e->weight = colon ? (unsigned)atoi(colon + 1) : 1;
+        if (colon) *colon = '\0';
+        snprintf(e->method, sizeof(e->method), "%s", tok);
+        if (e->weight == 0) continue;
+        g.mix_total += e->weight;
+        g.mix_count++;
+    }
+    free(copy);
+    return g.mix_count > 0 ? 0 : -1;
+}
+
+static void parse_tools(const char *spec)
+{
+    char *copy = strdup(spec);
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok && g.tool_count < MAX_TOOLS;
+         tok = strtok_r(NULL, ",", &save)) {
+        g.tools[g.tool_count++] = strdup(tok);
+    }
+    free(copy);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-H host] [-p port] [-n requests] [-c connections] [-w warmup]\n"
+        "          [-m method:weight,...] [-t tool,...] [-a arguments_json] [-s seed]\n"
+        "  defaults: -H 127.0.0.1 -p 8080 -n 1000 -c 1 -w 20\n"
+        "            -m initialize:1,tools/list:2,tools/call:7 -t get_status -a '{}'\n",
+        prog);
+}
+
+int main(int argc, char **argv)
+{
+    g.host = "127.0.0.1";
+    g.port = 8080;
+    g.requests = 1000;
+    g.connections = 1;
+    g.warmup = 20;
+    g.args_json = "{}";
+    unsigned seed = 1;
+    const char *mix = "initialize:1,tools/list:2,tools/call:7";
+    const char *tools = "get_status";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "H:p:n:c:w:m:t:a:s:h")) != -1) {
+        switch (opt) {
+            case 'H': g.host = optarg; break;
+            case 'p': g.port = atoi(optarg); break;
+            case 'n': g.requests = atoi(optarg); break;
+            case 'c': g.connections = atoi(optarg); break;
+            case 'w': g.warmup = atoi(optarg); break;
+            case 'm': mix = optarg; break;
+            case 't': tools = optarg; break;
+            case 'a': g.args_json = optarg; break;
+            case 's': seed = (unsigned)strtoul(optarg, NULL, 10); break;
+            default:  usage(argv[0]); return opt == 'h' ? 0 : 2;
+        }
+    }
+    if (g.requests < 1 || g.connections < 1 || parse_mix(mix) != 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    parse_tools(tools);
+    if (g.tool_count == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    worker_t *workers = calloc((size_t)g.connections, sizeof(worker_t));
+    pthread_t *threads = calloc((size_t)g.connections, sizeof(pthread_t));
+    for (int i = 0; i < g.connections; i++) {
+        workers[i].index = i;
+        workers[i].requests = g.requests / g.connections + (i < g.requests % g.connections ? 1 : 0);
+        workers[i].seed = seed + (unsigned)i * 7919u;
+        workers[i].samples = calloc((size_t)workers[i].requests + 1, sizeof(sample_t));
+    }
+
+    uint64_t t0 = now_us();
+    for (int i = 0; i < g.connections; i++) {
+        pthread_create(&threads[i], NULL, worker_main, &workers[i]);
+    }
+    for (int i = 0; i < g.connections; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = (double)(now_us() - t0) / 1e6;
+
+    size_t total = 0;
+    int reconnects = 0, http_errors = 0, rpc_errors = 0;
+    for (int i = 0; i < g.connections; i++) {
+        total += (size_t)workers[i].done;
+        reconnects += workers[i].reconnects;
+        http_errors += workers[i].http_errors;
+        rpc_errors += workers[i].rpc_errors;
+    }
+    sample_t *all = malloc((total ? total : 1) * sizeof(sample_t));
+    size_t k = 0;
+    for (int i = 0; i < g.connections; i++) {
+        memcpy(all + k, workers[i].samples, (size_t)workers[i].done * sizeof(sample_t));
+        k += (size_t)workers[i].done;
+    }
+
+    printf("target: http://%s:%d/mcp  connections: %d  warmup/conn: %d\n",
+           g.host, g.port, g.connections, g.warmup);
+    printf("requests: %zu  elapsed: %.3f s  throughput: %.1f req/s\n",
+           total, elapsed, elapsed > 0 ? (double)total / elapsed : 0.0);
+    printf("%-14s %7s %9s %9s %9s %9s %13s %11s\n",
+           "method", "count", "p50 us", "p90 us", "p99 us", "max us", "alloc B/req", "allocs/req");
+    report_row("all", all, total, -1);
+    for (int i = 0; i < g.mix_count; i++) {
+        report_row(g.mix[i].method, all, total, i);
+    }
+    printf("errors: http %d, json-rpc %d, reconnects %d\n", http_errors, rpc_errors, reconnects);
+
+    for (int i = 0; i < g.connections; i++) {
+        free(workers[i].samples);
+    }
+    free(workers);
+    free(threads);
+    free(all);
+    return (total == (size_t)g.requests && http_errors == 0) ? 0 : 1;
+}
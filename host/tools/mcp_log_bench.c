@@ -0,0 +1,246 @@
+/* Log capture micro-benchmark for the host build
+ *
+ * Times one ESP_LOGI call through the mcp_log hook, in text mode (the line
+ * is formatted into a staging slot) and in deferred mode (only the format
+ * pointer and arguments are copied), for a Lua-style "%s" line, an
+ * integer-heavy line and a float line. Console output goes nowhere.
+ *
+ * As on a single core with the drain task at low priority, the process
+ * is pinned to one CPU and the drain thread runs as SCHED_IDLE (it
+ * inherits that from the thread that calls mcp_log_init), so it only
+ * runs when the benchmark waits. Calls come in bursts of BURST, below
+ * the staging queue size, and each burst waits for the drain to store
+ * it, so no call overflows into the synchronous path.
+ *
+ * It then fills the ring with "lua" lines and an occasional "wifi"
+ * warning and times sys_get_logs queries answered from the tag, level
+ * and time index against the substring scans that select the same lines.
+ *
+ *   mcp_log_bench [-n calls]
+ */
+
+#include "mcp_log.h"
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <esp_log.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+static const char *TAG = "bench";
+
+#define BURST 8                 // Below CONFIG_MCP_LOG_STAGING_LINES
+
+static uint64_t now_cycles(void)
+{
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static int null_vprintf(const char *fmt, va_list args)
+{
+    (void)fmt;
+    (void)args;
+    return 0;
+}
+
+static void log_case(int which, long i, const char *msg)
+{
+    switch (which) {
+    case 0:
+        ESP_LOGI("lua", "%s", msg);
+        break;
+    case 1:
+        ESP_LOGI(TAG, "rx %u bytes from %d.%d.%d.%d:%u, seq %08" PRIx32, (unsigned)(i & 1023),
+                 192, 168, 4, (int)(i & 255), 8080u, (uint32_t)i * 2654435761u);
+        break;
+    default:
+        ESP_LOGI(TAG, "temp %.2f C, hum %.1f%%, vbat %d mV", 21.5 + (double)(i % 100) / 10,
+                 40.0 + (double)(i % 7), 3300 + (int)(i % 50));
+        break;
+    }
+}
+
+static void *init_idle(void *arg)
+{
+    struct sched_param param = { 0 };
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    *(esp_err_t *)arg = mcp_log_init();
+    return NULL;
+}
+
+static void wait_drained(uint32_t seq)
+{
+    const struct timespec pause = { 0, 20000 };
+    while ((int32_t)(mcp_log_next_seq() - seq) < 0) {
+        nanosleep(&pause, NULL);
+    }
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static esp_err_t count_write(mcp_result_t *r, const char *data, size_t len)
+{
+    (void)r;
+    (void)data;
+    (void)len;
+    return ESP_OK;
+}
+
+// Median cycles of one sys_get_logs call with the given arguments
+static uint64_t time_query(const char *json, uint64_t *samples, int runs, size_t *out_len)
+{
+    cJSON *args = cJSON_Parse(json);
+    for (int i = 0; i < runs; i++) {
+        mcp_result_t result = { .write = count_write, .budget = SIZE_MAX };
+        uint64_t t0 = now_cycles();
+        tool_sys_get_logs(args, &result);
+        samples[i] = now_cycles() - t0;
+        *out_len = result.len;
+    }
+    cJSON_Delete(args);
+    qsort(samples, (size_t)runs, sizeof(samples[0]), cmp_u64);
+    return samples[runs / 2];
+}
+
+static void bench_queries(uint64_t *samples, int runs)
+{
+    mcp_log_set_deferred(false);
+    uint32_t start = mcp_log_next_seq();
+    for (int i = 0; i < 4000; i++) {
+        if (i % 200 == 0) {
+            ESP_LOGW("wifi", "beacon timeout, rssi %d", -70 - i % 20);
+        } else {
+            ESP_LOGI("lua", "tick %d", i);
+        }
+        if (i % BURST == BURST - 1) {
+            wait_drained(start + (uint32_t)(i + 1));
+        }
+    }
+    wait_drained(start + 4000);
+    mcp_log_line_t line;
+    uint32_t recent_t = 0;
+    if (mcp_log_read(mcp_log_next_seq() - 300, &line) == ESP_OK) {
+        recent_t = (uint32_t)line.timestamp_ms;
+    }
+    char recent_tags[96];
+    char recent_filter[96];
+    snprintf(recent_tags, sizeof(recent_tags), "{\"tags\":\"wifi\",\"since_t\":%u}", (unsigned)recent_t);
+    snprintf(recent_filter, sizeof(recent_filter), "{\"filter\":\" wifi: \",\"since_t\":%u}", (unsigned)recent_t);
+
+    static const struct {
+        const char *name;
+        const char *indexed;
+        const char *scan;
+    } queries[] = {
+        { "one tag", "{\"tags\":\"wifi\",\"level\":\"verbose\"}",
+          "{\"filter\":\" wifi: \",\"level\":\"verbose\"}" },
+        { "not tag", "{\"exclude_tags\":\"lua\",\"level\":\"verbose\"}",
+          "{\"exclude\":\" lua: \",\"level\":\"verbose\"}" },
+        { "recent", NULL, NULL },
+    };
+    printf("\n%-10s %12s %12s   (sys_get_logs cycles, median of %d)\n", "query", "indexed", "scan", runs);
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        const char *indexed = queries[q].indexed ? queries[q].indexed : recent_tags;
+        const char *scan = queries[q].scan ? queries[q].scan : recent_filter;
+        size_t indexed_len = 0;
+        size_t scan_len = 0;
+        uint64_t t_indexed = time_query(indexed, samples, runs, &indexed_len);
+        uint64_t t_scan = time_query(scan, samples, runs, &scan_len);
+        printf("%-10s %12" PRIu64 " %12" PRIu64 "   %zu / %zu bytes\n", queries[q].name, t_indexed, t_scan,
+               indexed_len, scan_len);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    long calls = 20000;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') {
+            calls = strtol(optarg, NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [-n calls]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (calls <= 0) {
+        return 2;
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(sched_getcpu() < 0 ? 0 : sched_getcpu(), &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+
+    esp_log_set_vprintf(null_vprintf);
+    esp_err_t err = ESP_FAIL;
+    pthread_t init;
+    if (pthread_create(&init, NULL, init_idle, &err) == 0) {
+        pthread_join(init, NULL);
+    }
+    if (err != ESP_OK) {
+        fprintf(stderr, "mcp_log_init failed\n");
+        return 1;
+    }
+    uint64_t *samples = malloc((size_t)calls * sizeof(uint64_t));
+    if (!samples) {
+        return 1;
+    }
+
+    static const char *const cases[] = { "lua %s", "integers", "floats" };
+    char msg[64];
+    printf("calls per run: %ld, %s per call\n", calls, HAVE_TSC ? "TSC cycles" : "ns");
+    printf("%-10s %-9s %10s %10s %10s\n", "line", "mode", "median", "mean", "p99");
+
+    for (int c = 0; c < 3; c++) {
+        for (int deferred = 0; deferred <= 1; deferred++) {
+            mcp_log_set_deferred(deferred);
+            uint64_t total = 0;
+            uint32_t expected = mcp_log_next_seq();
+            for (long i = 0; i < calls; i++) {
+                snprintf(msg, sizeof(msg), "step %ld: motor=%ld pos=%ld ok", i, i & 3, i * 7);
+                uint64_t t0 = now_cycles();
+                log_case(c, i, msg);
+                uint64_t t1 = now_cycles();
+                samples[i] = t1 - t0;
+                total += t1 - t0;
+                if (i % BURST == BURST - 1 || i == calls - 1) {
+                    wait_drained(expected + (uint32_t)(i + 1));
+                }
+            }
+            qsort(samples, (size_t)calls, sizeof(samples[0]), cmp_u64);
+
+            mcp_log_line_t line;
+            uint32_t last = mcp_log_next_seq() - 1;
+            if (mcp_log_read(last, &line) != ESP_OK) {
+                line.text[0] = '\0';
+            }
+            printf("%-10s %-9s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "   %s\n", cases[c],
+                   deferred ? "deferred" : "text", samples[calls / 2], total / (uint64_t)calls,
+                   samples[calls * 99 / 100], line.text);
+        }
+    }
+    bench_queries(samples, calls < 200 ? (int)calls : 200);
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,61 @@
+/* TLS handshake benchmark for the host build
+ *
+ * Runs the same in-memory handshakes as the sys_tls_bench tool
+ * (main/tls_bench.c) with the RSA-2048 example certificate from main/certs
+ * and a freshly generated ECDSA P-256 key. Times are for this machine's
+ * software mbedTLS, so only the ratio between the two keys carries over to
+ * the device; peak heap is comparable.
+ *
+ *   mcp_tls_bench [-n handshakes]
+ */
+
+#include "tls_bench.h"
+#include "tls_keys.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Generated by host_embed_txtfile from main/certs
+extern const unsigned char _binary_servercert_pem_start[];
+extern const unsigned char _binary_prvtkey_pem_start[];
+
+static int report(const char *label, esp_err_t err, const tls_bench_result_t *r)
+{
+    if (err != ESP_OK) {
+        fprintf(stderr, "%-12s failed: %s\n", label, esp_err_to_name(err));
+        return 1;
+    }
+    printf("%-12s %4u handshakes  server %8.3f ms  client %8.3f ms  peak heap %7zu B  %s\n",
+           label, (unsigned)r->handshakes, r->server_us / 1000.0, r->client_us / 1000.0,
+           r->peak_heap, r->ciphersuite);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int handshakes = 20;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        if (opt == 'n') {
+            handshakes = atoi(optarg);
+        } else {
+            fprintf(stderr, "usage: %s [-n handshakes]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    tls_bench_result_t r;
+    esp_err_t err = tls_bench_run((const char *)_binary_servercert_pem_start,
+                                  (const char *)_binary_prvtkey_pem_start, handshakes, NULL, &r);
+    int failed = report("RSA-2048", err, &r);
+
+    char *cert = NULL, *key = NULL;
+    err = tls_keys_generate_ecdsa("esp32-mcp-server", &cert, &key);
+    if (err == ESP_OK) {
+        err = tls_bench_run(cert, key, handshakes, NULL, &r);
+    }
+    failed |= report("ECDSA P-256", err, &r);
+    free(cert);
+    free(key);
+    return failed;
+}
@@ -0,0 +1,404 @@
+/*
+ * Streaming JSON Writer Implementation
+ */
+
+#include "json_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include "mcp_mem.h"
+
+static const char *TAG = "json_writer";
+
+/*
+ * Word-at-a-time scan for bytes that need escaping: '"', '\\' and < 0x20.
+ * The tests may report a false positive position but never miss a byte,
+ * so a hit only means "finish this word byte by byte".
+ */
+#define JW_ONES        ((size_t)-1 / 0xFF)
+#define JW_HIGHS       (JW_ONES * 0x80)
+#define JW_HAS_ZERO(v) (((v) - JW_ONES) & ~(v) & JW_HIGHS)
+#define JW_HAS_LESS(v, n) (((v) - JW_ONES * (n)) & ~(v) & JW_HIGHS)
+#define JW_NEEDS_ESCAPE_WORD(v) \
+    (JW_HAS_LESS(v, 0x20) | JW_HAS_ZERO((v) ^ (JW_ONES * '"')) | JW_HAS_ZERO((v) ^ (JW_ONES * '\\')))
+
+static inline bool needs_escape(unsigned char c)
+{
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+// Length of the prefix of str that can be copied verbatim
+static size_t clean_prefix(const char *str, size_t len)
+{
+    size_t i = 0;
+    while (i + sizeof(size_t) <= len) {
+        size_t v;
+        memcpy(&v, str + i, sizeof(v));
+        if (JW_NEEDS_ESCAPE_WORD(v)) {
+            break;
+        }
+        i += sizeof(size_t);
+    }
+    while (i < len && !needs_escape((unsigned char)str[i])) {
+        i++;
+    }
+    return i;
+}
+
+static bool make_room(json_writer_t *w, size_t need)
+{
+    if (w->err != ESP_OK) {
+        return false;
+    }
+    if (w->cap - w->len >= need) {
+        return true;
+    }
+
+    if (w->flush) {
+        if (w->len > 0) {
+            w->err = w->flush(w->flush_ctx, w->buf, w->len);
+            w->flushed += w->len;
+            w->len = 0;
+            if (w->err != ESP_OK) {
+                return false;
+            }
+        }
+        return true;  // Caller writes what fits and flushes again
+    }
+
+    // Growable: keep one spare byte for detach()'s terminator
+    size_t new_cap = w->cap ? w->cap : 256;
+    while (new_cap - w->len < need + 1) {
+        new_cap *= 2;
+    }
+    char *new_buf = mcp_mem_realloc(MCP_MEM_JSON, w->owned ? w->buf : NULL, new_cap);
+    if (!new_buf) {
+        ESP_LOGE(TAG, "Out of memory growing output to %u bytes", (unsigned)new_cap);
+        w->err = ESP_ERR_NO_MEM;
+        return false;
+    }
+    if (!w->owned && w->len > 0) {
+        memcpy(new_buf, w->buf, w->len);
+    }
+    w->buf = new_buf;
+    w->cap = new_cap;
+    w->owned = true;
+    return true;
+}
+
+static void put(json_writer_t *w, const char *data, size_t len)
+{
+    while (len > 0) {
+        if (!make_room(w, len)) {
+            return;
+        }
+        size_t n = w->cap - w->len;
+        if (n > len) {
+            n = len;
+        }
+        if (n == 0) {
+            // Flush mode with a zero-sized buffer: pass through directly
+            w->err = w->flush(w->flush_ctx, data, len);
+            w->flushed += len;
+            return;
+        }
+        memcpy(w->buf + w->len, data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static inline void put_char(json_writer_t *w, char c)
+{
+    if (w->len < w->cap && w->err == ESP_OK) {
+        w->buf[w->len++] = c;
+    } else {
+        put(w, &c, 1);
+    }
+}
+
+// Comma / member bookkeeping before any value or key
+static void before_value(json_writer_t *w)
+{
+    if (w->after_key) {
+        w->after_key = false;
+        return;
+    }
+    if (w->depth > 0) {
+        uint32_t bit = 1u << (w->depth - 1);
+        if (w->has_items & bit) {
+            put_char(w, ',');
+        }
+        w->has_items |= bit;
+    }
+}
+
+static void put_escaped(json_writer_t *w, const char *str, size_t len)
+{
+    while (len > 0) {
+        size_t n = clean_prefix(str, len);
+        put(w, str, n);
+        if (n == len) {
+            return;
+        }
+
+        unsigned char c = (unsigned char)str[n];
+        char esc[7] = {'\\', 0};
+        size_t esc_len = 2;
+        switch (c) {
+        case '"':  esc[1] = '"';  break;
+        case '\\': esc[1] = '\\'; break;
+        case '\b': esc[1] = 'b';  break;
+        case '\f': esc[1] = 'f';  break;
+        case '\n': esc[1] = 'n';  break;
+        case '\r': esc[1] = 'r';  break;
+        case '\t': esc[1] = 't';  break;
+        default:
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            esc_len = 6;
+            break;
+        }
+        put(w, esc, esc_len);
+        str += n + 1;
+        len -= n + 1;
+    }
+}
+
+void json_writer_init(json_writer_t *w, char *buf, size_t cap,
+                      json_writer_flush_t flush, void *ctx)
+{
+    memset(w, 0, sizeof(*w));
+    w->buf = buf;
+    w->cap = buf ? cap : 0;
+    w->flush = flush;
+    w->flush_ctx = ctx;
+}
+
+esp_err_t json_writer_finish(json_writer_t *w)
+{
+    if (w->err == ESP_OK && w->flush && w->len > 0) {
+        w->err = w->flush(w->flush_ctx, w->buf, w->len);
+        w->flushed += w->len;
+        w->len = 0;
+    }
+    return w->err;
+}
+
+char* json_writer_detach(json_writer_t *w)
+{
+    if (w->err != ESP_OK || w->flush || w->len == 0 || !make_room(w, 1)) {
+        json_writer_release(w);
+        return NULL;
+    }
+    if (!w->owned) {
+        // Output still sits in the caller's buffer: copy it out
+        char *copy = malloc(w->len + 1);
+        if (copy) {
+            memcpy(copy, w->buf, w->len);
+            copy[w->len] = '\0';
+        }
+        return copy;
+    }
+    char *out = w->buf;
+    out[w->len] = '\0';
+    mcp_mem_disown(MCP_MEM_JSON, out);
+    w->buf = NULL;
+    w->cap = 0;
+    w->len = 0;
+    w->owned = false;
+    return out;
+}
+
+void json_writer_release(json_writer_t *w)
+{
+    if (w->owned) {
+        mcp_mem_free(MCP_MEM_JSON, w->buf);
+    }
+    w->buf = NULL;
+    w->cap = 0;
+    w->len = 0;
+    w->owned = false;
+}
+
+static void open_container(json_writer_t *w, char c)
+{
+    before_value(w);
+    if (w->depth >= JSON_WRITER_MAX_DEPTH) {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->has_items &= ~(1u << w->depth);
+    w->depth++;
+    put_char(w, c);
+}
+
+static void close_container(json_writer_t *w, char c)
+{
+    if (w->depth == 0) {
+        w->err = ESP_ERR_INVALID_STATE;
+        return;
+    }
+    w->depth--;
+    put_char(w, c);
+}
+
+void json_writer_object_begin(json_writer_t *w)
+{
+    open_container(w, '{');
+}
+
+void json_writer_object_end(json_writer_t *w)
+{
+    close_container(w, '}');
+}
+
+void json_writer_array_begin(json_writer_t *w)
+{
+    open_container(w, '[');
+}
+
+void json_writer_array_end(json_writer_t *w)
+{
+    close_container(w, ']');
+}
+
+void json_writer_key(json_writer_t *w, const char *key)
+{
+    before_value(w);
+    put_char(w, '"');
+    put_escaped(w, key, strlen(key));
+    put(w, "\":", 2);
+    w->after_key = true;
+}
+
+void json_writer_string(json_writer_t *w, const char *str)
+{
+    if (!str) {
+        json_writer_null(w);
+        return;
+    }
+    json_writer_string_len(w, str, strlen(str));
+}
+
+void json_writer_string_len(json_writer_t *w, const char *str, size_t len)
+{
+    before_value(w);
+    put_char(w, '"');
+    put_escaped(w, str, len);
+    put_char(w, '"');
+}
+
+void json_writer_string_begin(json_writer_t *w)
+{
+    before_value(w);
+    put_char(w, '"');
+}
+
+void json_writer_string_append(json_writer_t *w, const char *str, size_t len)
+{
+    put_escaped(w, str, len);
+}
+
+void json_writer_string_end(json_writer_t *w)
+{
+    put_char(w, '"');
+}
+
+void json_writer_int(json_writer_t *w, long long value)
+{
+    char num[24];
+    int n = snprintf(num, sizeof(num), "%lld", value);
+    before_value(w);
+    put(w, num, (size_t)n);
+}
+
+void json_writer_double(json_writer_t *w, double value)
+{
+    // Same output as cJSON: integers without a fraction, NaN/Inf as null
+    if (value != value || value - value != 0) {
+        json_writer_null(w);
+        return;
+    }
+    if (value >= -1e15 && value <= 1e15 && (double)(long long)value == value) {
+        json_writer_int(w, (long long)value);
+        return;
+    }
+    char num[32];
+    int n = snprintf(num, sizeof(num), "%1.15g", value);
+    if (strtod(num, NULL) != value) {
+        n = snprintf(num, sizeof(num), "%1.17g", value);
+    }
+    before_value(w);
+    put(w, num, (size_t)n);
+}
+
+void json_writer_bool(json_writer_t *w, bool value)
+{
+    before_value(w);
+    if (value) {
+        put(w, "true", 4);
+    } else {
+        put(w, "false", 5);
+    }
+}
+
+void json_writer_null(json_writer_t *w)
+{
+    before_value(w);
+    put(w, "null", 4);
+}
+
+void json_writer_raw(json_writer_t *w, const char *json, size_t len)
+{
+    before_value(w);
+    put(w, json, len);
+}
+
+void json_writer_cjson(json_writer_t *w, const cJSON *item)
+{
+    if (!item) {
+        json_writer_null(w);
+        return;
+    }
+
+    switch (item->type & 0xFF) {
+    case cJSON_False:
+        json_writer_bool(w, false);
+        break;
+    case cJSON_True:
+        json_writer_bool(w, true);
+        break;
+    case cJSON_NULL:
+        json_writer_null(w);
+        break;
+    case cJSON_Number:
+        json_writer_double(w, item->valuedouble);
+        break;
+    case cJSON_String:
+        json_writer_string(w, item->valuestring);
+        break;
+    case cJSON_Raw:
+        json_writer_raw(w, item->valuestring, item->valuestring ? strlen(item->valuestring) : 0);
+        break;
+    case cJSON_Array:
+        json_writer_array_begin(w);
+        for (const cJSON *child = item->child; child; child = child->next) {
+            json_writer_cjson(w, child);
+        }
+        json_writer_array_end(w);
+        break;
+    case cJSON_Object:
+        json_writer_object_begin(w);
+        for (const cJSON *child = item->child; child; child = child->next) {
+            json_writer_key(w, child->string ? child->string : "");
+            json_writer_cjson(w, child);
+        }
+        json_writer_object_end(w);
+        break;
+    default:
+        w->err = ESP_ERR_INVALID_ARG;
+        break;
+    }
+}
@@ -0,0 +1,115 @@
+/*
+ * Streaming JSON Writer
+ *
+ * Emits JSON straight into a caller-provided buffer. When the buffer fills
+ * it is either handed to a flush callback (e.g. httpd_resp_send_chunk) or,
+ * without a callback, grown on the heap. Commas are inserted automatically.
+ */
+
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <cJSON.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSON_WRITER_MAX_DEPTH 32
+
+/**
+ * Flush callback: consume len bytes of output
+ */
+typedef esp_err_t (*json_writer_flush_t)(void *ctx, const char *data, size_t len);
+
+/**
+ * Writer state (treat fields as private unless noted)
+ */
+typedef struct {
+    char *buf;                      // Current output buffer
+    size_t cap;                     // Capacity of buf
+    size_t len;                     // Bytes pending in buf
+    size_t flushed;                 // Bytes already passed to flush (read-only for callers)
+    json_writer_flush_t flush;      // NULL: grow buf on the heap instead
+    void *flush_ctx;
+    bool owned;                     // buf was allocated by the writer
+    esp_err_t err;                  // Sticky error
+    uint8_t depth;
+    bool after_key;                 // Next value completes an object member
+    uint32_t has_items;             // Bit d set: container at depth d+1 is non-empty
+} json_writer_t;
+
+/**
+ * Start writing into buf
+ *
+ * @param w Writer
+ * @param buf Initial buffer (may be NULL with cap 0 in growable mode)
+ * @param cap Size of buf
+ * @param flush Flush callback, or NULL to grow the buffer instead
+ * @param ctx Context passed to flush
+ */
+void json_writer_init(json_writer_t *w, char *buf, size_t cap,
+                      json_writer_flush_t flush, void *ctx);
+
+/**
+ * Flush pending output (flush mode) and return the sticky error
+ */
+esp_err_t json_writer_finish(json_writer_t *w);
+
+/**
+ * Take the output of a growable writer as a NUL-terminated heap string
+ *
+ * @return String (caller must free), or NULL if nothing was written or on error
+ */
+char* json_writer_detach(json_writer_t *w);
+
+/**
+ * Release a buffer allocated by the writer (no-op for caller buffers)
+ */
+void json_writer_release(json_writer_t *w);
+
+/**
+ * Structure
+ */
+void json_writer_object_begin(json_writer_t *w);
+void json_writer_object_end(json_writer_t *w);
+void json_writer_array_begin(json_writer_t *w);
+void json_writer_array_end(json_writer_t *w);
+void json_writer_key(json_writer_t *w, const char *key);
+
+/**
+ * Values
+ */
+void json_writer_string(json_writer_t *w, const char *str);
+void json_writer_string_len(json_writer_t *w, const char *str, size_t len);
+void json_writer_int(json_writer_t *w, long long value);
+void json_writer_double(json_writer_t *w, double value);
+void json_writer_bool(json_writer_t *w, bool value);
+void json_writer_null(json_writer_t *w);
+
+/**
+ * Write a cJSON tree as a value without printing it to an intermediate string
+ */
+void json_writer_cjson(json_writer_t *w, const cJSON *item);
+
+/**
+ * Write pre-serialized JSON as a value (not validated)
+ */
+void json_writer_raw(json_writer_t *w, const char *json, size_t len);
+
+/**
+ * String value produced in pieces: begin, any number of appends, end
+ */
+void json_writer_string_begin(json_writer_t *w);
+void json_writer_string_append(json_writer_t *w, const char *str, size_t len);
+void json_writer_string_end(json_writer_t *w);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JSON_WRITER_H
@@ -3,80 +3,301 @@
  */
 
 #include "jsonrpc.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <esp_log.h>
 
 static const char *TAG = "jsonrpc";
 
-esp_err_t jsonrpc_parse_message(const char *json_str, jsonrpc_message_t *msg)
+#define SCAN_MAX_DEPTH 32
+
+static const char *skip_ws(const char *p, const char *end)
 {
-    if (!json_str || !msg) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+static bool is_hex(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// p points at the opening quote; returns the position after the closing quote
+static const char *scan_string(const char *p, const char *end)
+{
+    p++;
+    while (p < end) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"') {
+            return p + 1;
+        }
+        if (c < 0x20) {
+            return NULL;
+        }
+        if (c == '\\') {
+            if (++p >= end) {
+                return NULL;
+            }
+            if (*p == 'u') {
+                if (end - p < 5 || !is_hex(p[1]) || !is_hex(p[2]) || !is_hex(p[3]) || !is_hex(p[4])) {
+                    return NULL;
+                }
+                p += 4;
+            } else if (!strchr("\"\\/bfnrt", *p)) {
+                return NULL;
+            }
+        }
+        p++;
+    }
+    return NULL;
+}
+
+static const char *scan_number(const char *p, const char *end)
+{
+    if (p < end && *p == '-') {
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9') {
+        return NULL;
+    }
+    if (*p == '0') {
+        p++;
+    } else {
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        if (p >= end || *p < '0' || *p > '9') {
+            return NULL;
+        }
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        if (p < end && (*p == '+' || *p == '-')) p++;
+        if (p >= end || *p < '0' || *p > '9') {
+            return NULL;
+        }
+        while (p < end && *p >= '0' && *p <= '9') p++;
+    }
+    return p;
+}
+
+static const char *scan_literal(const char *p, const char *end, const char *lit)
+{
+    size_t n = strlen(lit);
+    if ((size_t)(end - p) < n || memcmp(p, lit, n) != 0) {
+        return NULL;
+    }
+    return p + n;
+}
+
+// Validate one JSON value starting at p without building a tree
+static const char *scan_value(const char *p, const char *end, int depth)
+{
+    if (p >= end) {
+        return NULL;
+    }
+    switch (*p) {
+    case '"':
+        return scan_string(p, end);
+    case '{':
+    case '[': {
+        char close = (*p == '{') ? '}' : ']';
+        bool is_obj = (*p == '{');
+        if (depth >= SCAN_MAX_DEPTH) {
+            return NULL;
+        }
+        p = skip_ws(p + 1, end);
+        if (p < end && *p == close) {
+            return p + 1;
+        }
+        while (p < end) {
+            if (is_obj) {
+                if (*p != '"' || !(p = scan_string(p, end))) {
+                    return NULL;
+                }
+                p = skip_ws(p, end);
+                if (p >= end || *p != ':') {
+                    return NULL;
+                }
+                p = skip_ws(p + 1, end);
+            }
+            if (!(p = scan_value(p, end, depth + 1))) {
+                return NULL;
+            }
+            p = skip_ws(p, end);
+            if (p < end && *p == ',') {
+                p = skip_ws(p + 1, end);
+            } else if (p < end && *p == close) {
+                return p + 1;
+            } else {
+                return NULL;
+            }
+        }
+        return NULL;
+    }
+    case 't':
+        return scan_literal(p, end, "true");
+    case 'f':
+        return scan_literal(p, end, "false");
+    case 'n':
+        return scan_literal(p, end, "null");
+    default:
+        return scan_number(p, end);
+    }
+}
+
+// Copy a JSON string body (without quotes) into out, decoding simple escapes
+static void copy_string(const char *p, size_t len, char *out, size_t out_size)
+{
+    size_t o = 0;
+    for (size_t i = 0; i < len && o + 1 < out_size; i++) {
+        char c = p[i];
+        if (c == '\\' && i + 1 < len) {
+            c = p[++i];
+            switch (c) {
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'n': c = '\n'; break;
+            case 'r': c = '\r'; break;
+            case 't': c = '\t'; break;
+            case 'u': {
+                unsigned cp = (unsigned)strtoul((char[5]){p[i + 1], p[i + 2], p[i + 3], p[i + 4], 0}, NULL, 16);
+                i += 4;
+                c = (cp < 0x80) ? (char)cp : '?';
+                break;
+            }
+            default: break;
+            }
+        }
+        out[o++] = c;
+    }
+    out[o] = '\0';
+}
+
+static bool key_is(const char *key, size_t key_len, const char *name)
+{
+    return strlen(name) == key_len && memcmp(key, name, key_len) == 0;
+}
+
+esp_err_t jsonrpc_parse_message_len(const char *json, size_t len, jsonrpc_message_t *msg)
+{
+    if (!json || !msg) {
         return ESP_ERR_INVALID_ARG;
     }
 
     // Initialize message structure
     memset(msg, 0, sizeof(jsonrpc_message_t));
-    msg->params = NULL;
-    msg->result = NULL;
 
-    // Parse JSON
-    cJSON *root = cJSON_Parse(json_str);
-    if (!root) {
+    const char *end = json + len;
+    const char *p = skip_ws(json, end);
+    if (p >= end || *p != '{') {
         ESP_LOGE(TAG, "Failed to parse JSON");
         return ESP_ERR_INVALID_ARG;
     }
 
-    // Validate JSON-RPC version
-    cJSON *jsonrpc = cJSON_GetObjectItem(root, "jsonrpc");
-    if (!jsonrpc || !cJSON_IsString(jsonrpc) || strcmp(jsonrpc->valuestring, "2.0") != 0) {
-        ESP_LOGE(TAG, "Invalid or missing jsonrpc version");
-        cJSON_Delete(root);
-        return ESP_ERR_INVALID_ARG;
-    }
+    // Scan the top-level members, keeping views of the values we need
+    bool has_version = false, seen_version = false;
+    const char *method = NULL, *result = NULL, *error = NULL;
+    size_t method_len = 0, result_len = 0, error_len = 0;
 
-    // Check for ID field
-    cJSON *id = cJSON_GetObjectItem(root, "id");
-    if (id) {
-        msg->has_id = true;
-        if (cJSON_IsNumber(id)) {
-            msg->id = id->valueint;
-        } else if (cJSON_IsString(id)) {
-            // Try to parse string ID as number
-            msg->id = atoi(id->valuestring);
-        } else {
-            msg->id = 0;
-        }
+    p = skip_ws(p + 1, end);
+    if (p < end && *p == '}') {
+        p++;
     } else {
-        msg->has_id = false;
-        msg->id = 0;
+        while (true) {
+            if (p >= end || *p != '"') {
+                ESP_LOGE(TAG, "Failed to parse JSON");
+                return ESP_ERR_INVALID_ARG;
+            }
+            const char *key = p + 1;
+            const char *key_end = scan_string(p, end);
+            if (!key_end) {
+                ESP_LOGE(TAG, "Failed to parse JSON");
+                return ESP_ERR_INVALID_ARG;
+            }
+            size_t key_len = (size_t)(key_end - key - 1);
+            p = skip_ws(key_end, end);
+            if (p >= end || *p != ':') {
+                ESP_LOGE(TAG, "Failed to parse JSON");
+                return ESP_ERR_INVALID_ARG;
+            }
+            const char *val = skip_ws(p + 1, end);
+            p = scan_value(val, end, 1);
+            if (!p) {
+                ESP_LOGE(TAG, "Failed to parse JSON");
+                return ESP_ERR_INVALID_ARG;
+            }
+            size_t val_len = (size_t)(p - val);
+
+            // First occurrence wins, as with cJSON_GetObjectItem
+            if (key_is(key, key_len, "jsonrpc") && !seen_version) {
+                seen_version = true;
+                has_version = (val_len == 5 && memcmp(val, "\"2.0\"", 5) == 0);
+            } else if (key_is(key, key_len, "id") && !msg->has_id) {
+                msg->has_id = true;
+                if (*val == '"') {
+                    // Try to parse string ID as number
+                    msg->id = atoi(val + 1);
+                } else if (*val == '-' || (*val >= '0' && *val <= '9')) {
+                    msg->id = (int)strtod(val, NULL);
+                }
+            } else if (key_is(key, key_len, "method") && !method) {
+                method = val;
+                method_len = val_len;
+            } else if (key_is(key, key_len, "params") && !msg->params_json) {
+                msg->params_json = val;
+                msg->params_len = val_len;
+            } else if (key_is(key, key_len, "result") && !result) {
+                result = val;
+                result_len = val_len;
+            } else if (key_is(key, key_len, "error") && !error) {
+                error = val;
+                error_len = val_len;
+            }
+
+            p = skip_ws(p, end);
+            if (p < end && *p == ',') {
+                p = skip_ws(p + 1, end);
+            } else if (p < end && *p == '}') {
+                p++;
+                break;
+            } else {
+                ESP_LOGE(TAG, "Failed to parse JSON");
+                return ESP_ERR_INVALID_ARG;
+            }
+        }
     }
 
-    // Check if this is a request or response
-    cJSON *method = cJSON_GetObjectItem(root, "method");
-    cJSON *result = cJSON_GetObjectItem(root, "result");
-    cJSON *error = cJSON_GetObjectItem(root, "error");
+    // Validate JSON-RPC version
+    if (!has_version) {
+        ESP_LOGE(TAG, "Invalid or missing jsonrpc version");
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    if (method && cJSON_IsString(method)) {
-        // This is a request
+    if (method && *method == '"') {
+        // This is a request; params stay a view until a handler asks for them
         msg->type = msg->has_id ? JSONRPC_REQUEST : JSONRPC_NOTIFICATION;
-        strncpy(msg->method, method->valuestring, sizeof(msg->method) - 1);
-        msg->method[sizeof(msg->method) - 1] = '\0';
-
-        // Extract parameters (detach from root so we can delete root)
-        cJSON *params = cJSON_GetObjectItem(root, "params");
-        if (params) {
-            msg->params = cJSON_Duplicate(params, true);
-        }
+        copy_string(method + 1, method_len - 2, msg->method, sizeof(msg->method));
     } else if (result) {
         // This is a success response
         msg->type = JSONRPC_RESPONSE;
-        msg->result = cJSON_Duplicate(result, true);
+        msg->params_json = NULL;
+        msg->params_len = 0;
+        msg->result = cJSON_ParseWithLength(result, result_len);
     } else if (error) {
         // This is an error response
         msg->type = JSONRPC_ERROR;
-        cJSON *code = cJSON_GetObjectItem(error, "code");
-        cJSON *message = cJSON_GetObjectItem(error, "message");
-        
+        msg->params_json = NULL;
+        msg->params_len = 0;
+        cJSON *err = cJSON_ParseWithLength(error, error_len);
+        cJSON *code = cJSON_GetObjectItem(err, "code");
+        cJSON *message = cJSON_GetObjectItem(err, "message");
+
         if (code && cJSON_IsNumber(code)) {
             msg->error_code = code->valueint;
         }
@@ -84,61 +305,591 @@ esp_err_t jsonrpc_parse_message(const char *json_str, jsonrpc_message_t *msg)
             strncpy(msg->error_message, message->valuestring, sizeof(msg->error_message) - 1);
             msg->error_message[sizeof(msg->error_message) - 1] = '\0';
         }
+        cJSON_Delete(err);
     } else {
         ESP_LOGE(TAG, "Invalid JSON-RPC message: no method, result, or error");
-        cJSON_Delete(root);
         return ESP_ERR_INVALID_ARG;
     }
 
-    cJSON_Delete(root);
     return ESP_OK;
 }
 
-char* jsonrpc_create_response(int id, cJSON *result)
+esp_err_t jsonrpc_parse_message(const char *json_str, jsonrpc_message_t *msg)
 {
-    if (!result) {
-        return NULL;
+    if (!json_str || !msg) {
+        return ESP_ERR_INVALID_ARG;
     }
+    return jsonrpc_parse_message_len(json_str, strlen(json_str), msg);
+}
 
-    cJSON *response = cJSON_CreateObject();
-    if (!response) {
-        ESP_LOGE(TAG, "Failed to create response object");
+cJSON* jsonrpc_message_params(jsonrpc_message_t *msg)
+{
+    if (!msg) {
         return NULL;
     }
+    if (!msg->params && msg->params_json) {
+        msg->params = cJSON_ParseWithLength(msg->params_json, msg->params_len);
+    }
+    return msg->params;
+}
+
+bool jsonrpc_is_batch(const char *json, size_t len)
+{
+    const char *p = skip_ws(json, json + len);
+    return p < json + len && *p == '[';
+}
+
+esp_err_t jsonrpc_batch_begin(jsonrpc_batch_iter_t *it, const char *json, size_t len, size_t *count)
+{
+    if (!it || !json) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    cJSON_AddStringToObject(response, "jsonrpc", "2.0");
-    cJSON_AddNumberToObject(response, "id", id);
-    cJSON_AddItemToObject(response, "result", cJSON_Duplicate(result, true));
+    const char *end = json + len;
+    const char *p = skip_ws(json, end);
+    if (p >= end || *p != '[') {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    char *json_str = cJSON_PrintUnformatted(response);
-    cJSON_Delete(response);
+    // Validate the whole array first: a malformed batch gets a single error
+    const char *q = scan_value(p, end, 0);
+    if (!q || skip_ws(q, end) != end) {
+        ESP_LOGE(TAG, "Failed to parse JSON batch");
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    return json_str;
+    it->p = skip_ws(p + 1, end);
+    it->end = end;
+
+    if (count) {
+        jsonrpc_batch_iter_t tmp = *it;
+        const char *elem;
+        size_t elem_len;
+        *count = 0;
+        while (jsonrpc_batch_next(&tmp, &elem, &elem_len)) {
+            (*count)++;
+        }
+    }
+    return ESP_OK;
 }
 
-char* jsonrpc_create_error(int id, int code, const char *message)
+bool jsonrpc_batch_next(jsonrpc_batch_iter_t *it, const char **elem, size_t *elem_len)
 {
-    cJSON *response = cJSON_CreateObject();
-    if (!response) {
-        ESP_LOGE(TAG, "Failed to create error response object");
-        return NULL;
+    if (it->p >= it->end || *it->p == ']') {
+        return false;
+    }
+    const char *start = it->p;
+    const char *q = scan_value(start, it->end, 1);
+    if (!q) {
+        it->p = it->end;
+        return false;
+    }
+    *elem = start;
+    *elem_len = (size_t)(q - start);
+
+    q = skip_ws(q, it->end);
+    if (q < it->end && *q == ',') {
+        q = skip_ws(q + 1, it->end);
+    }
+    it->p = q;
+    return true;
+}
+
+/*
+ * Incremental reader
+ */
+
+enum {
+    ST_VALUE,           // Expecting a value
+    ST_VALUE_OR_END,    // After '[': value or ']'
+    ST_KEY_OR_END,      // After '{': key or '}'
+    ST_KEY_START,       // After ',' in an object
+    ST_KEY,
+    ST_KEY_ESC,
+    ST_COLON,
+    ST_STRING,
+    ST_STRING_ESC,
+    ST_STRING_U,
+    ST_LITERAL,
+    ST_AFTER_VALUE,
+    ST_DONE,
+};
+
+enum {
+    CAPTURE_NONE,
+    CAPTURE_METHOD,
+    CAPTURE_TOOL,
+};
+
+static inline bool is_ws(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool is_literal_char(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+static inline bool stream_in_object(const jsonrpc_stream_t *s)
+{
+    return s->depth > 0 && (s->obj_mask & (1u << (s->depth - 1)));
+}
+
+// Key of the member currently being read at depth d (1-based), "" if untracked
+static inline const char *stream_key(const jsonrpc_stream_t *s, int d)
+{
+    return (d >= 1 && d <= 3 && (s->obj_mask & (1u << (d - 1)))) ? s->keys[d - 1] : "";
+}
+
+static esp_err_t stream_emit(jsonrpc_stream_t *s, const char *data, size_t len)
+{
+    if (s->len + len >= s->cap) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(s->buf + s->len, data, len);
+    s->len += len;
+    return ESP_OK;
+}
+
+static esp_err_t stream_putc(jsonrpc_stream_t *s, char c)
+{
+    if (s->len + 1 >= s->cap) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s->buf[s->len++] = c;
+    return ESP_OK;
+}
+
+static esp_err_t spill_flush(jsonrpc_stream_t *s)
+{
+    esp_err_t ret = ESP_OK;
+    if (s->spill_fill > 0) {
+        ret = s->spill_ops->data(s->spill_ctx, s->spill_buf, s->spill_fill);
+        s->spill_fill = 0;
+    }
+    return ret;
+}
+
+static esp_err_t spill_put(jsonrpc_stream_t *s, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (s->spill_fill == sizeof(s->spill_buf)) {
+            esp_err_t ret = spill_flush(s);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+        s->spill_buf[s->spill_fill++] = data[i];
+    }
+    s->spill_total += len;
+    return ESP_OK;
+}
+
+static esp_err_t spill_codepoint(jsonrpc_stream_t *s, uint32_t cp)
+{
+    char utf8[4];
+    size_t n;
+    if (cp < 0x80) {
+        utf8[0] = (char)cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        utf8[0] = (char)(0xC0 | (cp >> 6));
+        utf8[1] = (char)(0x80 | (cp & 0x3F));
+        n = 2;
+    } else if (cp < 0x10000) {
+        utf8[0] = (char)(0xE0 | (cp >> 12));
+        utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        utf8[2] = (char)(0x80 | (cp & 0x3F));
+        n = 3;
+    } else {
+        utf8[0] = (char)(0xF0 | (cp >> 18));
+        utf8[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+        utf8[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        utf8[3] = (char)(0x80 | (cp & 0x3F));
+        n = 4;
+    }
+    return spill_put(s, utf8, n);
+}
+
+// A lone high surrogate is written as U+FFFD
+static esp_err_t spill_drop_surrogate(jsonrpc_stream_t *s)
+{
+    if (!s->pending_hi) {
+        return ESP_OK;
+    }
+    s->pending_hi = 0;
+    return spill_codepoint(s, 0xFFFD);
+}
+
+static void stream_string_begin(jsonrpc_stream_t *s)
+{
+    s->capture = CAPTURE_NONE;
+    s->capture_len = 0;
+    s->spilling = false;
+
+    if (s->depth == 1 && stream_in_object(s) && strcmp(s->keys[0], "method") == 0) {
+        s->capture = CAPTURE_METHOD;
+    } else if (s->depth == 2 && stream_in_object(s) &&
+               strcmp(stream_key(s, 1), "params") == 0 && strcmp(s->keys[1], "name") == 0) {
+        s->capture = CAPTURE_TOOL;
+    } else if (s->spill_ops && s->depth == 3 && stream_in_object(s) &&
+               strcmp(stream_key(s, 1), "params") == 0 &&
+               strcmp(stream_key(s, 2), "arguments") == 0) {
+        s->spilling = s->spill_ops->begin(s->spill_ctx, s->method, s->tool, s->keys[2]);
+        s->spill_total = 0;
+        s->spill_fill = 0;
+        s->pending_hi = 0;
+    }
+}
+
+static esp_err_t stream_string_end(jsonrpc_stream_t *s)
+{
+    if (!s->spilling) {
+        return stream_putc(s, '"');
+    }
+
+    s->spilling = false;
+    esp_err_t ret = spill_drop_surrogate(s);
+    if (ret == ESP_OK) {
+        ret = spill_flush(s);
+    }
+    char ref[JSONRPC_STREAM_REF_LEN] = {0};
+    esp_err_t end_ret = s->spill_ops->end(s->spill_ctx, s->spill_total, ref, sizeof(ref));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (end_ret != ESP_OK) {
+        return end_ret;
+    }
+
+    char tail[32];
+    int n = snprintf(tail, sizeof(tail), "\",\"length\":%u}", (unsigned)s->spill_total);
+    if ((ret = stream_emit(s, "{\"$spill\":\"", 11)) != ESP_OK ||
+        (ret = stream_emit(s, ref, strlen(ref))) != ESP_OK ||
+        (ret = stream_emit(s, tail, (size_t)n)) != ESP_OK) {
+        return ret;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t stream_string_char(jsonrpc_stream_t *s, char c)
+{
+    if (s->spilling) {
+        esp_err_t ret = spill_drop_surrogate(s);
+        return ret == ESP_OK ? spill_put(s, &c, 1) : ret;
+    }
+    if (s->capture != CAPTURE_NONE && s->capture_len + 1 < JSONRPC_STREAM_NAME_LEN) {
+        char *dst = (s->capture == CAPTURE_METHOD) ? s->method : s->tool;
+        dst[s->capture_len++] = c;
+        dst[s->capture_len] = '\0';
+    }
+    return stream_putc(s, c);
+}
+
+static esp_err_t stream_string_escape(jsonrpc_stream_t *s, char c)
+{
+    static const char esc_in[]  = "\"\\/bfnrt";
+    static const char esc_out[] = "\"\\/\b\f\n\r\t";
+    const char *e = strchr(esc_in, c);
+    if (!e || c == '\0') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s->spilling) {
+        esp_err_t ret = spill_drop_surrogate(s);
+        char out = esc_out[e - esc_in];
+        return ret == ESP_OK ? spill_put(s, &out, 1) : ret;
+    }
+    return stream_putc(s, c);
+}
+
+static esp_err_t stream_unicode_escape(jsonrpc_stream_t *s)
+{
+    uint32_t cp = s->esc_code;
+    if (cp >= 0xD800 && cp <= 0xDBFF) {
+        esp_err_t ret = spill_drop_surrogate(s);
+        s->pending_hi = cp;
+        return ret;
+    }
+    if (cp >= 0xDC00 && cp <= 0xDFFF) {
+        if (!s->pending_hi) {
+            return spill_codepoint(s, 0xFFFD);
+        }
+        cp = 0x10000 + ((s->pending_hi - 0xD800) << 10) + (cp - 0xDC00);
+        s->pending_hi = 0;
+        return spill_codepoint(s, cp);
+    }
+    esp_err_t ret = spill_drop_surrogate(s);
+    return ret == ESP_OK ? spill_codepoint(s, cp) : ret;
+}
+
+static esp_err_t stream_open(jsonrpc_stream_t *s, char c)
+{
+    if (s->depth >= JSONRPC_STREAM_MAX_DEPTH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (c == '{') {
+        s->obj_mask |= (1u << s->depth);
+    } else {
+        s->obj_mask &= ~(1u << s->depth);
+    }
+    s->depth++;
+    if (s->depth <= 3) {
+        s->keys[s->depth - 1][0] = '\0';
+    }
+    s->state = (c == '{') ? ST_KEY_OR_END : ST_VALUE_OR_END;
+    return stream_putc(s, c);
+}
+
+static void stream_value_done(jsonrpc_stream_t *s)
+{
+    s->state = (s->depth == 0) ? ST_DONE : ST_AFTER_VALUE;
+}
+
+static esp_err_t stream_close(jsonrpc_stream_t *s, char c)
+{
+    if (s->depth == 0 || (c == '}') != stream_in_object(s)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s->depth--;
+    stream_value_done(s);
+    return stream_putc(s, c);
+}
+
+static esp_err_t stream_value(jsonrpc_stream_t *s, char c)
+{
+    if (c == '{' || c == '[') {
+        return stream_open(s, c);
+    }
+    if (c == '"') {
+        stream_string_begin(s);
+        s->state = ST_STRING;
+        return s->spilling ? ESP_OK : stream_putc(s, c);
     }
+    if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n') {
+        s->state = ST_LITERAL;
+        return stream_putc(s, c);
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+static esp_err_t stream_byte(jsonrpc_stream_t *s, char c)
+{
+    switch (s->state) {
+    case ST_VALUE:
+        if (is_ws(c)) return ESP_OK;
+        return stream_value(s, c);
+
+    case ST_VALUE_OR_END:
+        if (is_ws(c)) return ESP_OK;
+        if (c == ']') return stream_close(s, c);
+        return stream_value(s, c);
+
+    case ST_KEY_OR_END:
+        if (is_ws(c)) return ESP_OK;
+        if (c == '}') return stream_close(s, c);
+        /* fall through */
+    case ST_KEY_START:
+        if (is_ws(c)) return ESP_OK;
+        if (c != '"') return ESP_ERR_INVALID_ARG;
+        s->key_len = 0;
+        if (s->depth <= 3) {
+            s->keys[s->depth - 1][0] = '\0';
+        }
+        s->state = ST_KEY;
+        return stream_putc(s, c);
+
+    case ST_KEY:
+    case ST_KEY_ESC:
+        if ((unsigned char)c < 0x20) return ESP_ERR_INVALID_ARG;
+        if (s->state == ST_KEY && c == '"') {
+            s->state = ST_COLON;
+        } else {
+            s->state = (s->state == ST_KEY && c == '\\') ? ST_KEY_ESC : ST_KEY;
+            if (s->depth <= 3 && s->key_len + 1 < JSONRPC_STREAM_KEY_LEN) {
+                s->keys[s->depth - 1][s->key_len++] = c;
+                s->keys[s->depth - 1][s->key_len] = '\0';
+            }
+        }
+        return stream_putc(s, c);
+
+    case ST_COLON:
+        if (is_ws(c)) return ESP_OK;
+        if (c != ':') return ESP_ERR_INVALID_ARG;
+        s->state = ST_VALUE;
+        return stream_putc(s, c);
+
+    case ST_STRING:
+        if ((unsigned char)c < 0x20) return ESP_ERR_INVALID_ARG;
+        if (c == '"') {
+            stream_value_done(s);
+            return stream_string_end(s);
+        }
+        if (c == '\\') {
+            s->state = ST_STRING_ESC;
+            return s->spilling ? ESP_OK : stream_putc(s, c);
+        }
+        return stream_string_char(s, c);
+
+    case ST_STRING_ESC:
+        if (c == 'u') {
+            s->state = ST_STRING_U;
+            s->esc_code = 0;
+            s->esc_digits = 0;
+            return s->spilling ? ESP_OK : stream_putc(s, c);
+        }
+        s->state = ST_STRING;
+        return stream_string_escape(s, c);
+
+    case ST_STRING_U:
+        if (!is_hex(c)) return ESP_ERR_INVALID_ARG;
+        s->esc_code = (s->esc_code << 4) |
+                      (uint32_t)(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+        if (++s->esc_digits == 4) {
+            s->state = ST_STRING;
+            if (s->spilling) {
+                return stream_unicode_escape(s);
+            }
+        }
+        return s->spilling ? ESP_OK : stream_putc(s, c);
+
+    case ST_LITERAL:
+        if (is_literal_char(c)) {
+            return stream_putc(s, c);
+        }
+        // Literal ended; this byte belongs to the enclosing context
+        stream_value_done(s);
+        return stream_byte(s, c);
+
+    case ST_AFTER_VALUE:
+        if (is_ws(c)) return ESP_OK;
+        if (c == ',') {
+            s->state = stream_in_object(s) ? ST_KEY_START : ST_VALUE;
+            return stream_putc(s, c);
+        }
+        if (c == '}' || c == ']') {
+            return stream_close(s, c);
+        }
+        return ESP_ERR_INVALID_ARG;
+
+    case ST_DONE:
+        return is_ws(c) ? ESP_OK : ESP_ERR_INVALID_ARG;
+
+    default:
+        return ESP_ERR_INVALID_STATE;
+    }
+}
+
+void jsonrpc_stream_init(jsonrpc_stream_t *stream, char *buf, size_t cap)
+{
+    memset(stream, 0, sizeof(*stream));
+    stream->buf = buf;
+    stream->cap = cap;
+    stream->state = ST_VALUE;
+}
+
+void jsonrpc_stream_set_spill(jsonrpc_stream_t *stream, const jsonrpc_spill_ops_t *ops, void *ctx)
+{
+    stream->spill_ops = ops;
+    stream->spill_ctx = ctx;
+}
 
-    cJSON_AddStringToObject(response, "jsonrpc", "2.0");
+esp_err_t jsonrpc_stream_feed(jsonrpc_stream_t *stream, const char *data, size_t len)
+{
+    for (size_t i = 0; i < len && stream->err == ESP_OK; i++) {
+        stream->err = stream_byte(stream, data[i]);
+    }
+    return stream->err;
+}
+
+esp_err_t jsonrpc_stream_finish(jsonrpc_stream_t *stream, size_t *out_len)
+{
+    if (stream->err == ESP_OK && stream->state == ST_LITERAL && stream->depth == 0) {
+        stream->state = ST_DONE;
+    }
+    if (stream->err == ESP_OK && stream->state != ST_DONE) {
+        stream->err = ESP_ERR_INVALID_ARG;
+    }
+    if (stream->spilling) {
+        // Truncated inside a spilled value: let the sink release its resources
+        char ref[JSONRPC_STREAM_REF_LEN];
+        stream->spilling = false;
+        stream->spill_ops->end(stream->spill_ctx, 0, ref, sizeof(ref));
+    }
+    if (stream->cap > 0) {
+        stream->buf[stream->len < stream->cap ? stream->len : stream->cap - 1] = '\0';
+    }
+    if (out_len) {
+        *out_len = stream->len;
+    }
+    return stream->err;
+}
+
+void jsonrpc_write_result_begin(json_writer_t *w, int id)
+{
+    json_writer_object_begin(w);
+    json_writer_key(w, "jsonrpc");
+    json_writer_string(w, "2.0");
+    json_writer_key(w, "id");
+    json_writer_int(w, id);
+    json_writer_key(w, "result");
+}
+
+void jsonrpc_write_result_end(json_writer_t *w)
+{
+    json_writer_object_end(w);
+}
+
+void jsonrpc_write_error(json_writer_t *w, int id, int code, const char *message)
+{
+    json_writer_object_begin(w);
+    json_writer_key(w, "jsonrpc");
+    json_writer_string(w, "2.0");
+    json_writer_key(w, "id");
     if (id != 0) {
-        cJSON_AddNumberToObject(response, "id", id);
+        json_writer_int(w, id);
     } else {
-        cJSON_AddNullToObject(response, "id");
+        json_writer_null(w);
+    }
+    json_writer_key(w, "error");
+    json_writer_object_begin(w);
+    json_writer_key(w, "code");
+    json_writer_int(w, code);
+    json_writer_key(w, "message");
+    json_writer_string(w, message ? message : "Unknown error");
+    json_writer_object_end(w);
+    json_writer_object_end(w);
+}
+
+char* jsonrpc_create_response(int id, cJSON *result)
+{
+    if (!result) {
+        return NULL;
     }
 
-    cJSON *error = cJSON_CreateObject();
-    cJSON_AddNumberToObject(error, "code", code);
-    cJSON_AddStringToObject(error, "message", message ? message : "Unknown error");
-    cJSON_AddItemToObject(response, "error", error);
+    json_writer_t w;
+    json_writer_init(&w, NULL, 0, NULL, NULL);
+    jsonrpc_write_result_begin(&w, id);
+    json_writer_cjson(&w, result);
+    jsonrpc_write_result_end(&w);
+
+    char *json_str = json_writer_detach(&w);
+    if (!json_str) {
+        ESP_LOGE(TAG, "Failed to create response");
+    }
+    return json_str;
+}
 
-    char *json_str = cJSON_PrintUnformatted(response);
-    cJSON_Delete(response);
+char* jsonrpc_create_error(int id, int code, const char *message)
+{
+    json_writer_t w;
+    json_writer_init(&w, NULL, 0, NULL, NULL);
+    jsonrpc_write_error(&w, id, code, message);
 
+    char *json_str = json_writer_detach(&w);
+    if (!json_str) {
+        ESP_LOGE(TAG, "Failed to create error response");
+    }
     return json_str;
 }
 
@@ -8,8 +8,11 @@
 #define JSONRPC_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <esp_err.h>
 #include <cJSON.h>
+#include "json_writer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,13 +42,19 @@ typedef enum {
 
 /**
  * Parsed JSON-RPC message structure
+ *
+ * The envelope is scanned without building a cJSON tree. params_json is a
+ * view into the parsed input buffer, so the message must not outlive it;
+ * the params tree is only built on demand by jsonrpc_message_params().
  */
 typedef struct {
     jsonrpc_message_type_t type;
     int id;                         // Request ID (0 for notifications)
     bool has_id;                    // Whether ID field is present
     char method[64];                // Method name
-    cJSON *params;                  // Parameters object (owned by this struct)
+    const char *params_json;        // View of the raw "params" value (NULL if absent)
+    size_t params_len;              // Length of params_json
+    cJSON *params;                  // Parameters tree, built lazily (owned by this struct)
     cJSON *result;                  // Result object (for responses)
     int error_code;                 // Error code (for errors)
     char error_message[128];        // Error message
@@ -54,17 +63,153 @@ typedef struct {
 /**
  * Parse a JSON-RPC 2.0 message from JSON string
  * 
- * @param json_str Input JSON string
+ * @param json_str Input JSON string (must stay valid while msg is used)
  * @param msg Output message structure (caller must call jsonrpc_message_cleanup)
  * @return ESP_OK on success, error code otherwise
  */
 esp_err_t jsonrpc_parse_message(const char *json_str, jsonrpc_message_t *msg);
 
+/**
+ * Parse a JSON-RPC 2.0 message from a buffer of known length
+ *
+ * @param json Input JSON (need not be NUL-terminated, must stay valid while msg is used)
+ * @param len Length of json in bytes
+ * @param msg Output message structure (caller must call jsonrpc_message_cleanup)
+ * @return ESP_OK on success, error code otherwise
+ */
+esp_err_t jsonrpc_parse_message_len(const char *json, size_t len, jsonrpc_message_t *msg);
+
+/**
+ * Get the params of a parsed request as a cJSON tree
+ * Parses the params view on first use and caches it in msg->params.
+ *
+ * @param msg Parsed message
+ * @return params tree, or NULL if the request has no params
+ */
+cJSON* jsonrpc_message_params(jsonrpc_message_t *msg);
+
+/**
+ * Iterator over the entries of a JSON-RPC batch (top-level array)
+ */
+typedef struct {
+    const char *p;
+    const char *end;
+} jsonrpc_batch_iter_t;
+
+/**
+ * Check whether a message is a batch (first non-blank character is '[')
+ */
+bool jsonrpc_is_batch(const char *json, size_t len);
+
+/**
+ * Validate a batch and position the iterator on its first entry
+ *
+ * @param it Iterator
+ * @param json Batch JSON (must stay valid while iterating)
+ * @param len Length of json
+ * @param count Output: number of entries (optional)
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG if json is not a well-formed array
+ */
+esp_err_t jsonrpc_batch_begin(jsonrpc_batch_iter_t *it, const char *json, size_t len, size_t *count);
+
+/**
+ * Get the next batch entry as a view
+ *
+ * @return false when there are no more entries
+ */
+bool jsonrpc_batch_next(jsonrpc_batch_iter_t *it, const char **elem, size_t *elem_len);
+
+/**
+ * Incremental request reader
+ */
+
+#define JSONRPC_STREAM_MAX_DEPTH 32
+#define JSONRPC_STREAM_KEY_LEN   32
+#define JSONRPC_STREAM_NAME_LEN  64
+#define JSONRPC_STREAM_SPILL_BUF 128
+#define JSONRPC_STREAM_REF_LEN   64
+
+/**
+ * Spill sink for large string arguments
+ *
+ * begin() is asked for every string value directly under params.arguments;
+ * returning true diverts the decoded value to data() instead of the message
+ * buffer. end() returns a reference (e.g. a file path) and the value is
+ * replaced in the message by {"$spill":"<ref>","length":<bytes>}.
+ */
+typedef struct {
+    bool (*begin)(void *ctx, const char *method, const char *tool, const char *arg_name);
+    esp_err_t (*data)(void *ctx, const char *data, size_t len);
+    esp_err_t (*end)(void *ctx, size_t total_len, char *ref, size_t ref_len);
+} jsonrpc_spill_ops_t;
+
+/**
+ * Incremental reader state (treat fields as private)
+ *
+ * Consumes a request in arbitrary chunks (httpd_req_recv, WS frames) and
+ * keeps a whitespace-stripped copy in a caller-provided buffer. The top
+ * level may be an object or an array.
+ */
+typedef struct {
+    char *buf;                              // Message copy (caller-owned)
+    size_t cap;                             // Capacity of buf including NUL
+    size_t len;                             // Bytes written to buf
+    esp_err_t err;                          // Sticky error
+    uint8_t state;
+    uint8_t depth;                          // Open containers
+    uint32_t obj_mask;                      // Bit d set: container at depth d+1 is an object
+    char keys[3][JSONRPC_STREAM_KEY_LEN];   // Member keys at depth 1..3
+    uint8_t key_len;
+    uint8_t capture;                        // String value being captured (method / tool)
+    uint8_t capture_len;
+    char method[JSONRPC_STREAM_NAME_LEN];   // Top-level "method", once seen
+    char tool[JSONRPC_STREAM_NAME_LEN];     // params.name, once seen
+    const jsonrpc_spill_ops_t *spill_ops;
+    void *spill_ctx;
+    bool spilling;
+    size_t spill_total;
+    size_t spill_fill;
+    uint32_t pending_hi;                    // High surrogate awaiting its pair
+    uint32_t esc_code;
+    uint8_t esc_digits;
+    char spill_buf[JSONRPC_STREAM_SPILL_BUF];
+} jsonrpc_stream_t;
+
+/**
+ * Start reading a request into buf
+ *
+ * @param stream Reader state
+ * @param buf Output buffer for the message copy
+ * @param cap Size of buf (the copy is NUL-terminated)
+ */
+void jsonrpc_stream_init(jsonrpc_stream_t *stream, char *buf, size_t cap);
+
+/**
+ * Divert string arguments to a spill sink (see jsonrpc_spill_ops_t)
+ */
+void jsonrpc_stream_set_spill(jsonrpc_stream_t *stream, const jsonrpc_spill_ops_t *ops, void *ctx);
+
+/**
+ * Feed the next chunk of the request
+ *
+ * @return ESP_OK, ESP_ERR_INVALID_ARG on malformed JSON,
+ *         ESP_ERR_INVALID_SIZE when the copy no longer fits in buf
+ */
+esp_err_t jsonrpc_stream_feed(jsonrpc_stream_t *stream, const char *data, size_t len);
+
+/**
+ * Finish reading: checks the value is complete and NUL-terminates the copy
+ *
+ * @param out_len Length of the message copy (optional)
+ * @return ESP_OK if a complete JSON value was read
+ */
+esp_err_t jsonrpc_stream_finish(jsonrpc_stream_t *stream, size_t *out_len);
+
 /**
  * Create a JSON-RPC 2.0 success response
  * 
  * @param id Request ID
- * @param result Result object (will be deep-copied)
+ * @param result Result object (not modified)
  * @return JSON string (caller must free), or NULL on error
  */
 char* jsonrpc_create_response(int id, cJSON *result);
@@ -79,6 +224,30 @@ char* jsonrpc_create_response(int id, cJSON *result);
  */
 char* jsonrpc_create_error(int id, int code, const char *message);
 
+/**
+ * Write the start of a success response: {"jsonrpc":"2.0","id":N,"result":
+ * The caller writes the result value, then calls jsonrpc_write_result_end().
+ *
+ * @param w Output writer
+ * @param id Request ID
+ */
+void jsonrpc_write_result_begin(json_writer_t *w, int id);
+
+/**
+ * Close a response started with jsonrpc_write_result_begin()
+ */
+void jsonrpc_write_result_end(json_writer_t *w);
+
+/**
+ * Write a complete JSON-RPC 2.0 error response
+ *
+ * @param w Output writer
+ * @param id Request ID (0 writes "id":null)
+ * @param code Error code
+ * @param message Error message
+ */
+void jsonrpc_write_error(json_writer_t *w, int id, int code, const char *message);
+
 /**
  * Cleanup a parsed JSON-RPC message
  * Frees any allocated cJSON objects
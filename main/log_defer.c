@@ -0,0 +1,422 @@
+/*
+ * Deferred-format log records
+ *
+ * Record layout: the format pointer, then one entry per argument in
+ * format order. Integers (and '*' widths and precisions) are varints,
+ * zigzag-encoded when signed; doubles are 8 raw bytes; a string is a
+ * kind byte followed by a pointer (literal) or a varint length and the
+ * bytes (copied). The format itself says how to read each entry back.
+ */
+
+#include "log_defer.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <esp_memory_utils.h>
+
+#define SPEC_MAX 32             // Longest conversion kept, with '*' values filled in
+#define STR_MAX 256             // Longest copied string argument rendered
+
+enum { STR_STATIC, STR_COPY, STR_NULL };
+
+typedef enum { LEN_NONE, LEN_HH, LEN_H, LEN_L, LEN_LL, LEN_J, LEN_Z, LEN_T, LEN_LD } spec_len_t;
+
+typedef struct {
+    const char *start;          // The '%'
+    const char *end;            // Past the conversion character
+    bool star_width;            // '*' width argument before the value
+    bool star_prec;             // '*' precision argument before the value
+    int prec;                   // Literal precision, -1 if none or '*'
+    spec_len_t len;
+    char conv;
+} spec_t;
+
+// Parse the conversion at f (a '%'); false for malformed or over-long ones
+static bool spec_parse(const char *f, spec_t *s)
+{
+    s->start = f++;
+    s->star_width = false;
+    s->star_prec = false;
+    s->prec = -1;
+    while (*f && strchr("-+ #0", *f)) {
+        f++;
+    }
+    if (*f == '*') {
+        s->star_width = true;
+        f++;
+    } else {
+        while (*f >= '0' && *f <= '9') {
+            f++;
+        }
+    }
+    if (*f == '.') {
+        f++;
+        if (*f == '*') {
+            s->star_prec = true;
+            f++;
+        } else {
+            s->prec = 0;
+            while (*f >= '0' && *f <= '9') {
+                s->prec = s->prec * 10 + (*f++ - '0');
+            }
+        }
+    }
+    s->len = LEN_NONE;
+    switch (*f) {
+    case 'h': s->len = (f[1] == 'h') ? LEN_HH : LEN_H; f += (f[1] == 'h') ? 2 : 1; break;
+    case 'l': s->len = (f[1] == 'l') ? LEN_LL : LEN_L; f += (f[1] == 'l') ? 2 : 1; break;
+    case 'j': s->len = LEN_J; f++; break;
+    case 'z': s->len = LEN_Z; f++; break;
+    case 't': s->len = LEN_T; f++; break;
+    case 'L': s->len = LEN_LD; f++; break;
+    default: break;
+    }
+    s->conv = *f;
+    if (*f == '\0') {
+        return false;
+    }
+    s->end = f + 1;
+    return s->end - s->start < SPEC_MAX - 2 * 11;
+}
+
+/* --- Encoding --- */
+
+typedef struct {
+    uint8_t *p;
+    uint8_t *end;
+} enc_t;
+
+static bool put(enc_t *e, const void *src, size_t n)
+{
+    if ((size_t)(e->end - e->p) < n) {
+        return false;
+    }
+    memcpy(e->p, src, n);
+    e->p += n;
+    return true;
+}
+
+static bool put_varint(enc_t *e, uint64_t v)
+{
+    do {
+        uint8_t b = (uint8_t)((v & 0x7F) | (v > 0x7F ? 0x80 : 0));
+        if (!put(e, &b, 1)) {
+            return false;
+        }
+        v >>= 7;
+    } while (v);
+    return true;
+}
+
+static bool put_svarint(enc_t *e, int64_t v)
+{
+    return put_varint(e, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static int64_t arg_signed(va_list *ap, spec_len_t len)
+{
+    switch (len) {
+    case LEN_L:  return va_arg(*ap, long);
+    case LEN_LL: return va_arg(*ap, long long);
+    case LEN_J:  return va_arg(*ap, intmax_t);
+    case LEN_Z:
+    case LEN_T:  return va_arg(*ap, ptrdiff_t);
+    default:     return va_arg(*ap, int);
+    }
+}
+
+static uint64_t arg_unsigned(va_list *ap, spec_len_t len)
+{
+    switch (len) {
+    case LEN_L:  return va_arg(*ap, unsigned long);
+    case LEN_LL: return va_arg(*ap, unsigned long long);
+    case LEN_J:  return va_arg(*ap, uintmax_t);
+    case LEN_Z:
+    case LEN_T:  return va_arg(*ap, size_t);
+    default:     return va_arg(*ap, unsigned int);
+    }
+}
+
+static bool put_string(enc_t *e, const char *str, int prec)
+{
+    uint8_t kind = !str ? STR_NULL : (esp_ptr_in_drom(str) ? STR_STATIC : STR_COPY);
+    if (!put(e, &kind, 1)) {
+        return false;
+    }
+    if (kind == STR_STATIC) {
+        return put(e, &str, sizeof(str));
+    }
+    if (kind == STR_COPY) {
+        size_t n = prec >= 0 ? strnlen(str, (size_t)prec) : strlen(str);
+        return put_varint(e, n) && put(e, str, n);
+    }
+    return true;
+}
+
+static bool encode_arg(enc_t *e, const spec_t *s, va_list *ap)
+{
+    if (s->star_width && !put_svarint(e, va_arg(*ap, int))) {
+        return false;
+    }
+    int prec = s->prec;
+    if (s->star_prec) {
+        prec = va_arg(*ap, int);
+        if (!put_svarint(e, prec)) {
+            return false;
+        }
+    }
+    if (s->len == LEN_LD && s->conv != '%') {
+        return false;
+    }
+    switch (s->conv) {
+    case '%':
+        return true;
+    case 'd': case 'i':
+        return put_svarint(e, arg_signed(ap, s->len));
+    case 'o': case 'u': case 'x': case 'X':
+        return put_varint(e, arg_unsigned(ap, s->len));
+    case 'c':
+        return s->len == LEN_NONE && put_svarint(e, va_arg(*ap, int));
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A': {
+        double d = va_arg(*ap, double);
+        return put(e, &d, sizeof(d));
+    }
+    case 'p':
+        return put_varint(e, (uintptr_t)va_arg(*ap, void *));
+    case 's':
+        return s->len == LEN_NONE && put_string(e, va_arg(*ap, const char *), prec);
+    default:
+        return false;   // %n, wide characters, unknown conversions
+    }
+}
+
+size_t log_defer_encode(uint8_t *buf, size_t cap, const char *fmt, va_list args)
+{
+    enc_t e = { buf, buf + cap };
+    if (!fmt || !esp_ptr_in_drom(fmt) || !put(&e, &fmt, sizeof(fmt))) {
+        return 0;
+    }
+    va_list ap;
+    va_copy(ap, args);
+    bool ok = true;
+    for (const char *f = fmt; ok && (f = strchr(f, '%')) != NULL; ) {
+        spec_t s;
+        ok = spec_parse(f, &s) && encode_arg(&e, &s, &ap);
+        f = ok ? s.end : f;
+    }
+    va_end(ap);
+    return ok ? (size_t)(e.p - buf) : 0;
+}
+
+/* --- Rendering --- */
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+} dec_t;
+
+static bool get(dec_t *d, void *dst, size_t n)
+{
+    if ((size_t)(d->end - d->p) < n) {
+        return false;
+    }
+    memcpy(dst, d->p, n);
+    d->p += n;
+    return true;
+}
+
+static bool get_varint(dec_t *d, uint64_t *v)
+{
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        uint8_t b;
+        if (!get(d, &b, 1)) {
+            return false;
+        }
+        *v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool get_svarint(dec_t *d, int64_t *v)
+{
+    uint64_t zz;
+    if (!get_varint(d, &zz)) {
+        return false;
+    }
+    *v = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+    return true;
+}
+
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t n;
+} out_t;
+
+static void out_text(out_t *o, const char *text, size_t len)
+{
+    if (len > o->cap - 1 - o->n) {
+        len = o->cap - 1 - o->n;
+    }
+    memcpy(o->buf + o->n, text, len);
+    o->n += len;
+    o->buf[o->n] = '\0';
+}
+
+static void out_fmt(out_t *o, const char *spec, ...)
+{
+    va_list ap;
+    va_start(ap, spec);
+    int r = vsnprintf(o->buf + o->n, o->cap - o->n, spec, ap);
+    va_end(ap);
+    if (r > 0) {
+        o->n = ((size_t)r < o->cap - o->n) ? o->n + (size_t)r : o->cap - 1;
+    }
+}
+
+// The conversion as text, with stored '*' values written in
+static bool spec_rebuild(const spec_t *s, dec_t *d, char *spec)
+{
+    size_t n = 0;
+    for (const char *c = s->start; c < s->end; c++) {
+        if (*c != '*') {
+            spec[n++] = *c;
+            continue;
+        }
+        int64_t v;
+        if (!get_svarint(d, &v)) {
+            return false;
+        }
+        n += (size_t)snprintf(spec + n, SPEC_MAX - n, "%d", (int)v);
+    }
+    spec[n] = '\0';
+    return true;
+}
+
+static bool render_arg(out_t *o, const spec_t *s, const char *spec, dec_t *d)
+{
+    int64_t sv;
+    uint64_t uv;
+    switch (s->conv) {
+    case '%':
+        out_text(o, "%", 1);
+        return true;
+    case 'd': case 'i':
+        if (!get_svarint(d, &sv)) {
+            return false;
+        }
+        switch (s->len) {
+        case LEN_L:  out_fmt(o, spec, (long)sv); break;
+        case LEN_LL: out_fmt(o, spec, (long long)sv); break;
+        case LEN_J:  out_fmt(o, spec, (intmax_t)sv); break;
+        case LEN_Z:
+        case LEN_T:  out_fmt(o, spec, (ptrdiff_t)sv); break;
+        default:     out_fmt(o, spec, (int)sv); break;
+        }
+        return true;
+    case 'o': case 'u': case 'x': case 'X':
+        if (!get_varint(d, &uv)) {
+            return false;
+        }
+        switch (s->len) {
+        case LEN_L:  out_fmt(o, spec, (unsigned long)uv); break;
+        case LEN_LL: out_fmt(o, spec, (unsigned long long)uv); break;
+        case LEN_J:  out_fmt(o, spec, (uintmax_t)uv); break;
+        case LEN_Z:
+        case LEN_T:  out_fmt(o, spec, (size_t)uv); break;
+        default:     out_fmt(o, spec, (unsigned int)uv); break;
+        }
+        return true;
+    case 'c':
+        if (!get_svarint(d, &sv)) {
+            return false;
+        }
+        out_fmt(o, spec, (int)sv);
+        return true;
+    case 'p':
+        if (!get_varint(d, &uv)) {
+            return false;
+        }
+        out_fmt(o, spec, (void *)(uintptr_t)uv);
+        return true;
+    case 's': {
+        uint8_t kind;
+        if (!get(d, &kind, 1)) {
+            return false;
+        }
+        if (kind == STR_STATIC) {
+            const char *str;
+            if (!get(d, &str, sizeof(str))) {
+                return false;
+            }
+            out_fmt(o, spec, str);
+        } else if (kind == STR_COPY) {
+            char str[STR_MAX];
+            if (!get_varint(d, &uv) || uv > (uint64_t)(d->end - d->p)) {
+                return false;
+            }
+            size_t n = uv < sizeof(str) ? (size_t)uv : sizeof(str) - 1;
+            memcpy(str, d->p, n);
+            str[n] = '\0';
+            d->p += uv;
+            out_fmt(o, spec, str);
+        } else {
+            out_fmt(o, spec, (const char *)NULL);
+        }
+        return true;
+    }
+    default: {
+        double v;
+        if (!get(d, &v, sizeof(v))) {
+            return false;
+        }
+        out_fmt(o, spec, v);
+        return true;
+    }
+    }
+}
+
+const char *log_defer_format(const uint8_t *rec, size_t len)
+{
+    const char *fmt = NULL;
+    if (len >= sizeof(fmt)) {
+        memcpy(&fmt, rec, sizeof(fmt));
+    }
+    return fmt;
+}
+
+size_t log_defer_render(const uint8_t *rec, size_t len, char *out, size_t cap)
+{
+    if (cap == 0) {
+        return 0;
+    }
+    out_t o = { out, cap, 0 };
+    out[0] = '\0';
+    dec_t d = { rec, rec + len };
+    const char *fmt;
+    if (!get(&d, &fmt, sizeof(fmt))) {
+        return 0;
+    }
+    const char *f = fmt;
+    while (*f && o.n < cap - 1) {
+        const char *pct = strchr(f, '%');
+        out_text(&o, f, pct ? (size_t)(pct - f) : strlen(f));
+        if (!pct) {
+            break;
+        }
+        spec_t s;
+        char spec[SPEC_MAX];
+        if (!spec_parse(pct, &s) || !spec_rebuild(&s, &d, spec) || !render_arg(&o, &s, spec, &d)) {
+            break;      // Only a corrupt record gets here
+        }
+        f = s.end;
+    }
+    return o.n;
+}
@@ -0,0 +1,52 @@
+/*
+ * Deferred-format log records
+ *
+ * Instead of formatting a line at capture time, a record keeps the
+ * format string pointer and the raw arguments, and is turned into text
+ * only when something reads it (the console drain or sys_get_logs), as
+ * defmt and trice do. Format strings must be literals in flash: the
+ * pointer is stored, not the text. String arguments that are literals
+ * are stored as pointers too; others are copied into the record.
+ *
+ * Formats that cannot be deferred (%n, wide or long double arguments,
+ * a format outside flash, a record that would not fit) are refused, and
+ * the caller formats the line as text instead.
+ */
+
+#ifndef LOG_DEFER_H
+#define LOG_DEFER_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Encode fmt and its arguments into buf
+ *
+ * @return Record size in bytes, or 0 if the line cannot be deferred
+ *         (args is left unconsumed for a text fallback)
+ */
+size_t log_defer_encode(uint8_t *buf, size_t cap, const char *fmt, va_list args);
+
+/**
+ * Format string of an encoded record
+ */
+const char *log_defer_format(const uint8_t *rec, size_t len);
+
+/**
+ * Format an encoded record into out (always NUL-terminated), truncating
+ * at cap - 1 characters
+ *
+ * @return Characters written, without the terminator
+ */
+size_t log_defer_render(const uint8_t *rec, size_t len, char *out, size_t cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOG_DEFER_H
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <dirent.h>
+#include <stdatomic.h>
 #include <sys/stat.h>
 #include <esp_log.h>
 #include <esp_system.h>
@@ -20,20 +21,52 @@
 #include <driver/i2c_master.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/semphr.h>
 
 #include "lua.h"
 #include "lauxlib.h"
 #include "lualib.h"
 
+#include "json_writer.h"
+#include "mcp_log.h"
+#include "mcp_mem.h"
+#include "mcp_trace.h"
+#include "mcp_resources.h"
+#include "mcp_tools.h"
+
 static const char *TAG = "lua_rt";
 
+#ifndef SPIFFS_BASE_PATH
 #define SPIFFS_BASE_PATH "/spiffs"
+#endif
 #define LUA_TASK_STACK   8192
 #define LUA_TASK_PRIO    5
+#define LUA_CANCEL_CHECK 1000   /* VM instructions between cancellation checks */
+#define LUA_CALL_WAIT_MS 5000   /* How long a tool call waits for the VM */
+#define LUA_CALL_POLL_MS 100
+#define LUA_JSON_DEPTH   16     /* Nesting limit converting between JSON and Lua */
+#define LUA_TOOLS_KEY    "mcp.tools"    /* Registry table: tool name -> function */
 
 static lua_State *L = NULL;
 static TaskHandle_t lua_task_handle = NULL;
 static volatile bool lua_task_running = false;
+static SemaphoreHandle_t vm_lock = NULL;            /* Serializes exec/restart across tool workers */
+static const volatile bool *exec_cancel = NULL;     /* Cancel flag of the running exec */
+
+/* Tool call handed to the Lua task, which runs it in time.sleep_ms() */
+typedef struct {
+    const char *name;
+    const cJSON *args;
+    lua_runtime_out_fn_t out;
+    void *ctx;
+    const volatile bool *cancel;
+    esp_err_t ret;
+} tool_call_t;
+
+static _Atomic(tool_call_t *) pending_call = NULL;  /* Taken by whoever runs it */
+static SemaphoreHandle_t call_wake = NULL;          /* Given when a call is posted */
+static SemaphoreHandle_t call_done = NULL;          /* Given when a taken call finished */
+
 static volatile uint32_t lua_mem_current = 0;
 static volatile uint32_t lua_mem_peak = 0;
 
@@ -58,14 +91,14 @@ static void *lua_tracking_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
     (void)ud;
 
     if (nsize == 0) {
-        free(ptr);
+        mcp_mem_free(MCP_MEM_LUA, ptr);
         if (ptr) {
             lua_mem_update(osize, 0);
         }
         return NULL;
     }
 
-    void *new_ptr = realloc(ptr, nsize);
+    void *new_ptr = mcp_mem_realloc(MCP_MEM_LUA, ptr, nsize);
     if (!new_ptr) {
         return NULL;
     }
@@ -74,6 +107,15 @@ static void *lua_tracking_alloc(void *ud, void *ptr, size_t osize, size_t nsize)
     return new_ptr;
 }
 
+/* Count hook installed while exec or a tool call runs: aborts it once cancelled */
+static void exec_cancel_hook(lua_State *state, lua_Debug *ar)
+{
+    (void)ar;
+    if (exec_cancel && *exec_cancel) {
+        luaL_error(state, "cancelled");
+    }
+}
+
 /* ── I2C bus state ─────────────────────────────────────────────── */
 
 #define I2C_MAX_DEVICES  4
@@ -120,6 +162,8 @@ extern const uint8_t default_main_lua_start[] asm("_binary_default_main_lua_star
 
 /* ── SPIFFS helpers ─────────────────────────────────────────────── */
 
+#define STAGE_NAME ".stage"     // Staging files for streamed script content
+
 static esp_err_t spiffs_init(void)
 {
     esp_vfs_spiffs_conf_t conf = {
@@ -134,6 +178,20 @@ static esp_err_t spiffs_init(void)
         return ret;
     }
 
+    /* Staging files left by a reset in the middle of a request */
+    DIR *dir = opendir(SPIFFS_BASE_PATH);
+    if (dir) {
+        struct dirent *ent;
+        while ((ent = readdir(dir)) != NULL) {
+            if (strncmp(ent->d_name, STAGE_NAME, strlen(STAGE_NAME)) == 0) {
+                char path[280];
+                snprintf(path, sizeof(path), SPIFFS_BASE_PATH "/%s", ent->d_name);
+                remove(path);
+            }
+        }
+        closedir(dir);
+    }
+
     size_t total = 0, used = 0;
     esp_spiffs_info("storage", &total, &used);
     ESP_LOGI(TAG, "SPIFFS: %d/%d bytes used", (int)used, (int)total);
@@ -240,10 +298,21 @@ static const luaL_Reg gpio_lib[] = {
 
 /* ── Lua C bindings: time ───────────────────────────────────────── */
 
+static void service_pending_call(lua_State *state);
+
+/* Waits on call_wake rather than sleeping, so tool calls run here */
 static int l_time_sleep_ms(lua_State *L)
 {
     int ms = luaL_checkinteger(L, 1);
-    vTaskDelay(pdMS_TO_TICKS(ms));
+    TickType_t ticks = pdMS_TO_TICKS(ms > 0 ? ms : 0);
+    TickType_t start = xTaskGetTickCount();
+    TickType_t elapsed = 0;
+    do {
+        if (xSemaphoreTake(call_wake, ticks - elapsed) == pdTRUE) {
+            service_pending_call(L);
+        }
+        elapsed = xTaskGetTickCount() - start;
+    } while (elapsed < ticks);
     return 0;
 }
 
@@ -463,6 +532,344 @@ static const luaL_Reg i2c_lib[] = {
     {NULL, NULL}
 };
 
+/* ── Lua C bindings: mcp (tools written in Lua) ─────────────────── */
+
+/* Push a JSON value as the matching Lua value (objects and arrays as tables) */
+static void push_json(lua_State *state, const cJSON *item, int depth)
+{
+    luaL_checkstack(state, 3, "arguments nested too deeply");
+    if (!item || cJSON_IsNull(item)) {
+        lua_pushnil(state);
+    } else if (cJSON_IsBool(item)) {
+        lua_pushboolean(state, cJSON_IsTrue(item));
+    } else if (cJSON_IsNumber(item)) {
+        double d = item->valuedouble;
+        if (d >= -9007199254740992.0 && d <= 9007199254740992.0 && d == (double)(lua_Integer)d) {
+            lua_pushinteger(state, (lua_Integer)d);
+        } else {
+            lua_pushnumber(state, d);
+        }
+    } else if (cJSON_IsString(item)) {
+        lua_pushstring(state, item->valuestring);
+    } else if (depth >= LUA_JSON_DEPTH) {
+        luaL_error(state, "arguments nested too deeply");
+    } else if (cJSON_IsArray(item)) {
+        lua_createtable(state, cJSON_GetArraySize(item), 0);
+        lua_Integer i = 1;
+        for (const cJSON *child = item->child; child; child = child->next) {
+            push_json(state, child, depth + 1);
+            lua_rawseti(state, -2, i++);
+        }
+    } else {
+        lua_createtable(state, 0, cJSON_GetArraySize(item));
+        for (const cJSON *child = item->child; child; child = child->next) {
+            push_json(state, child, depth + 1);
+            lua_setfield(state, -2, child->string);
+        }
+    }
+}
+
+/* A table is written as an array if its keys are exactly 1..#t */
+static bool table_is_array(lua_State *state, int idx)
+{
+    lua_Unsigned n = lua_rawlen(state, idx);
+    if (n == 0) {
+        return false;
+    }
+    lua_Unsigned count = 0;
+    lua_pushnil(state);
+    while (lua_next(state, idx)) {
+        lua_pop(state, 1);
+        lua_Integer k = lua_isinteger(state, -1) ? lua_tointeger(state, -1) : 0;
+        if (k < 1 || (lua_Unsigned)k > n) {
+            lua_pop(state, 1);
+            return false;
+        }
+        count++;
+    }
+    return count == n;
+}
+
+/* Write a Lua value as JSON; values JSON cannot hold become null.
+ * Returns false if tables nest deeper than LUA_JSON_DEPTH. */
+static bool write_lua_json(json_writer_t *w, lua_State *state, int idx, int depth)
+{
+    idx = lua_absindex(state, idx);
+    switch (lua_type(state, idx)) {
+    case LUA_TBOOLEAN:
+        json_writer_bool(w, lua_toboolean(state, idx));
+        return true;
+    case LUA_TNUMBER:
+        if (lua_isinteger(state, idx)) {
+            json_writer_int(w, (long long)lua_tointeger(state, idx));
+        } else {
+            lua_Number d = lua_tonumber(state, idx);
+            if (d == d && d - d == 0) {
+                json_writer_double(w, d);
+            } else {
+                json_writer_null(w);    // NaN and infinities
+            }
+        }
+        return true;
+    case LUA_TSTRING: {
+        size_t len = 0;
+        const char *str = lua_tolstring(state, idx, &len);
+        json_writer_string_len(w, str, len);
+        return true;
+    }
+    case LUA_TTABLE:
+        break;
+    default:
+        json_writer_null(w);
+        return true;
+    }
+
+    if (depth >= LUA_JSON_DEPTH || !lua_checkstack(state, 3)) {
+        json_writer_null(w);
+        return false;
+    }
+    bool ok = true;
+    if (table_is_array(state, idx)) {
+        lua_Unsigned n = lua_rawlen(state, idx);
+        json_writer_array_begin(w);
+        for (lua_Unsigned i = 1; i <= n && ok; i++) {
+            lua_rawgeti(state, idx, (lua_Integer)i);
+            ok = write_lua_json(w, state, -1, depth + 1);
+            lua_pop(state, 1);
+        }
+        json_writer_array_end(w);
+        return ok;
+    }
+
+    json_writer_object_begin(w);
+    lua_pushnil(state);
+    while (lua_next(state, idx)) {
+        /* Only string and integer keys; no lua_tolstring on the key itself,
+         * which would confuse lua_next */
+        if (lua_type(state, -2) == LUA_TSTRING) {
+            json_writer_key(w, lua_tostring(state, -2));
+        } else if (lua_isinteger(state, -2)) {
+            char key[24];
+            snprintf(key, sizeof(key), "%lld", (long long)lua_tointeger(state, -2));
+            json_writer_key(w, key);
+        } else {
+            lua_pop(state, 1);
+            continue;
+        }
+        if (ok) {
+            ok = write_lua_json(w, state, -1, depth + 1);
+        } else {
+            json_writer_null(w);
+        }
+        lua_pop(state, 1);
+    }
+    json_writer_object_end(w);
+    return ok;
+}
+
+static esp_err_t call_out_flush(void *ctx, const char *data, size_t len)
+{
+    tool_call_t *call = ctx;
+    call->out(call->ctx, data, len);
+    return ESP_OK;
+}
+
+static void call_out_error(tool_call_t *call, const char *msg)
+{
+    call->out(call->ctx, "error: ", 7);
+    call->out(call->ctx, msg, strlen(msg));
+}
+
+/* Runs under lua_pcall: look the function up, convert the arguments, call */
+static int call_tool_protected(lua_State *state)
+{
+    tool_call_t *call = lua_touserdata(state, 1);
+    if (lua_getfield(state, LUA_REGISTRYINDEX, LUA_TOOLS_KEY) != LUA_TTABLE ||
+        lua_getfield(state, -1, call->name) != LUA_TFUNCTION) {
+        return luaL_error(state, "tool '%s' is not registered in this VM", call->name);
+    }
+    if (call->args) {
+        push_json(state, call->args, 0);
+    } else {
+        lua_newtable(state);
+    }
+    lua_call(state, 1, 1);
+    return 1;
+}
+
+/* Run a tool call on state (the VM's main thread or main.lua's coroutine) */
+static void run_tool_call(lua_State *state, tool_call_t *call)
+{
+    int top = lua_gettop(state);
+
+    /* Keep any hook main.lua installed */
+    lua_Hook hook = lua_gethook(state);
+    int hook_mask = lua_gethookmask(state);
+    int hook_count = lua_gethookcount(state);
+    if (call->cancel) {
+        exec_cancel = call->cancel;
+        lua_sethook(state, exec_cancel_hook, LUA_MASKCOUNT, LUA_CANCEL_CHECK);
+    }
+    MCP_TRACE_BEGIN(MCP_TRACE_LUA, "vm_call");
+    lua_pushcfunction(state, call_tool_protected);
+    lua_pushlightuserdata(state, call);
+    int ret = lua_pcall(state, 1, 1, 0);
+    MCP_TRACE_END(MCP_TRACE_LUA, "vm_call");
+    if (call->cancel) {
+        lua_sethook(state, hook, hook_mask, hook_count);
+        exec_cancel = NULL;
+    }
+
+    if (ret != LUA_OK) {
+        const char *err = lua_tostring(state, -1);
+        call_out_error(call, err ? err : "unknown");
+        call->ret = ESP_FAIL;
+    } else if (lua_type(state, -1) == LUA_TSTRING) {
+        size_t len = 0;
+        const char *s = lua_tolstring(state, -1, &len);
+        call->out(call->ctx, s, len);
+        call->ret = ESP_OK;
+    } else if (!lua_isnil(state, -1)) {
+        /* Tables and other values go out as JSON */
+        char buf[256];
+        json_writer_t w;
+        json_writer_init(&w, buf, sizeof(buf), call_out_flush, call);
+        bool ok = write_lua_json(&w, state, -1, 0);
+        json_writer_finish(&w);
+        call->ret = ok ? ESP_OK : ESP_ERR_INVALID_SIZE;
+        if (!ok) {
+            call_out_error(call, "result nested too deeply");
+        }
+    } else {
+        call->ret = ESP_OK;
+    }
+    lua_settop(state, top);
+}
+
+/* Run the posted call, if any, on the Lua task */
+static void service_pending_call(lua_State *state)
+{
+    tool_call_t *call = atomic_exchange(&pending_call, NULL);
+    if (call) {
+        run_tool_call(state, call);
+        xSemaphoreGive(call_done);
+    }
+}
+
+/* mcp.register_tool(name, description, schema, fn [, {read_only = bool}])
+ * schema is a table or a JSON string; nil means no arguments. */
+static int l_mcp_register_tool(lua_State *L)
+{
+    const char *name = luaL_checkstring(L, 1);
+    const char *description = luaL_checkstring(L, 2);
+    luaL_checktype(L, 4, LUA_TFUNCTION);
+    bool read_only = false;
+    if (!lua_isnoneornil(L, 5)) {
+        luaL_checktype(L, 5, LUA_TTABLE);
+        lua_getfield(L, 5, "read_only");
+        read_only = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+    }
+
+    char *schema = NULL;
+    if (lua_type(L, 3) == LUA_TTABLE) {
+        json_writer_t w;
+        json_writer_init(&w, NULL, 0, NULL, NULL);
+        bool ok = write_lua_json(&w, L, 3, 0);
+        schema = json_writer_detach(&w);
+        if (!ok) {
+            free(schema);
+            return luaL_error(L, "mcp.register_tool: schema nested too deeply");
+        }
+    } else if (lua_isnoneornil(L, 3)) {
+        schema = strdup("{\"type\":\"object\",\"properties\":{}}");
+    } else {
+        schema = strdup(luaL_checkstring(L, 3));
+    }
+    if (!schema) {
+        return luaL_error(L, "mcp.register_tool: out of memory");
+    }
+
+    /* No call can reach the tool before fn is stored: callers need the VM,
+     * and this code is running in it */
+    esp_err_t ret = mcp_tools_register_lua(name, description, schema, read_only);
+    free(schema);
+    switch (ret) {
+    case ESP_OK:
+        if (lua_getfield(L, LUA_REGISTRYINDEX, LUA_TOOLS_KEY) != LUA_TTABLE) {
+            lua_pop(L, 1);
+            lua_newtable(L);
+            lua_pushvalue(L, -1);
+            lua_setfield(L, LUA_REGISTRYINDEX, LUA_TOOLS_KEY);
+        }
+        lua_pushvalue(L, 4);
+        lua_setfield(L, -2, name);
+        lua_pop(L, 1);
+        return 0;
+    case ESP_ERR_INVALID_ARG:
+        return luaL_error(L, "mcp.register_tool: invalid name '%s' (letters, digits, '_' and '-', up to 64)", name);
+    case ESP_ERR_INVALID_SIZE:
+        return luaL_error(L, "mcp.register_tool: schema for '%s' is not a JSON object", name);
+    case ESP_ERR_INVALID_STATE:
+        return luaL_error(L, "mcp.register_tool: '%s' is a built-in tool", name);
+    default:
+        return luaL_error(L, "mcp.register_tool: cannot register '%s' (%s, at most %d Lua tools)",
+                          name, esp_err_to_name(ret), CONFIG_MCP_LUA_TOOLS_MAX);
+    }
+}
+
+/* mcp.unregister_tool(name) -> true if it was registered */
+static int l_mcp_unregister_tool(lua_State *L)
+{
+    const char *name = luaL_checkstring(L, 1);
+    if (lua_getfield(L, LUA_REGISTRYINDEX, LUA_TOOLS_KEY) == LUA_TTABLE) {
+        lua_pushnil(L);
+        lua_setfield(L, -2, name);
+    }
+    lua_pop(L, 1);
+    lua_pushboolean(L, mcp_tools_unregister_lua(name) == ESP_OK);
+    return 1;
+}
+
+/* ── Lua C bindings: trace ──────────────────────────────────────── */
+
+static int trace_span_finish(lua_State *L, int status, lua_KContext ctx)
+{
+    const char *span = (const char *)ctx;
+    if (span) {
+        MCP_TRACE_END(MCP_TRACE_LUA, span);
+    }
+    if (status != LUA_OK && status != LUA_YIELD) {
+        return lua_error(L);
+    }
+    return lua_gettop(L);
+}
+
+/* trace.span(name, fn, ...): call fn(...) inside a span, return its results */
+static int l_trace_span(lua_State *L)
+{
+    const char *name = luaL_checkstring(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    const char *span = mcp_trace_on ? mcp_trace_intern(name) : NULL;
+    if (span) {
+        MCP_TRACE_BEGIN(MCP_TRACE_LUA, span);
+    }
+    lua_remove(L, 1);
+    int status = lua_pcallk(L, lua_gettop(L) - 1, LUA_MULTRET, 0, (lua_KContext)span, trace_span_finish);
+    return trace_span_finish(L, status, (lua_KContext)span);
+}
+
+static const luaL_Reg trace_lib[] = {
+    {"span", l_trace_span},
+    {NULL, NULL}
+};
+
+static const luaL_Reg mcp_lib[] = {
+    {"register_tool",   l_mcp_register_tool},
+    {"unregister_tool", l_mcp_unregister_tool},
+    {NULL, NULL}
+};
+
 /* ── Register all C libraries into a Lua state ──────────────────── */
 
 static void register_libs(lua_State *L)
@@ -473,6 +880,8 @@ static void register_libs(lua_State *L)
     luaL_newlib(L, system_lib); lua_setglobal(L, "system");
     luaL_newlib(L, wifi_lib);   lua_setglobal(L, "wifi");
     luaL_newlib(L, i2c_lib);    lua_setglobal(L, "i2c");
+    luaL_newlib(L, mcp_lib);    lua_setglobal(L, "mcp");
+    luaL_newlib(L, trace_lib);  lua_setglobal(L, "trace");
 }
 
 /* ── Lua VM lifecycle ───────────────────────────────────────────── */
@@ -503,6 +912,7 @@ static void destroy_vm(lua_State *state)
 
 static void lua_task(void *pvParameters)
 {
+    (void)pvParameters;
     lua_task_running = true;
     ESP_LOGI(TAG, "Lua task started, executing main.lua");
 
@@ -516,6 +926,8 @@ static void lua_task(void *pvParameters)
     ESP_LOGI(TAG, "Lua task finished (main.lua returned)");
     lua_task_running = false;
     lua_task_handle = NULL;
+    /* A call posted after the last time.sleep_ms() is still ours */
+    service_pending_call(L);
     vTaskDelete(NULL);
 }
 
@@ -523,6 +935,11 @@ static void lua_task(void *pvParameters)
 
 esp_err_t lua_runtime_init(void)
 {
+    vm_lock = xSemaphoreCreateMutex();
+    call_wake = xSemaphoreCreateBinary();
+    call_done = xSemaphoreCreateBinary();
+    if (!vm_lock || !call_wake || !call_done) return ESP_ERR_NO_MEM;
+
     esp_err_t ret = spiffs_init();
     if (ret != ESP_OK) return ret;
 
@@ -554,7 +971,9 @@ esp_err_t lua_runtime_start(void)
 
 esp_err_t lua_runtime_restart(void)
 {
+    mcp_log_mark_generation();
     ESP_LOGI(TAG, "Restarting Lua VM");
+    xSemaphoreTake(vm_lock, portMAX_DELAY);
 
     /* Stop running task */
     if (lua_task_handle) {
@@ -565,22 +984,29 @@ esp_err_t lua_runtime_restart(void)
         vTaskDelay(pdMS_TO_TICKS(100));
     }
 
-    /* Destroy and recreate VM (task is dead, safe to access directly) */
+    /* Destroy and recreate VM (task is dead, safe to access directly);
+     * tools registered by the old VM go with it */
+    mcp_tools_clear_lua();
     destroy_vm(L);
     L = create_vm();
 
-    if (!L) {
+    esp_err_t ret = ESP_FAIL;
+    if (L) {
+        /* Restart task */
+        ret = lua_runtime_start();
+    } else {
         ESP_LOGE(TAG, "Failed to recreate Lua VM");
-        return ESP_FAIL;
     }
-
-    /* Restart task */
-    return lua_runtime_start();
+    xSemaphoreGive(vm_lock);
+    return ret;
 }
 
-esp_err_t lua_runtime_exec(const char *code, char *result, size_t max_len)
+esp_err_t lua_runtime_exec(const char *code, lua_runtime_out_fn_t out, void *ctx,
+                           const volatile bool *cancel)
 {
-    if (!L || !code || !result) return ESP_ERR_INVALID_ARG;
+    if (!L || !code || !out) return ESP_ERR_INVALID_ARG;
+
+    xSemaphoreTake(vm_lock, portMAX_DELAY);
 
     /* Stop running task so we can safely access the VM */
     bool was_running = false;
@@ -592,50 +1018,144 @@ esp_err_t lua_runtime_exec(const char *code, char *result, size_t max_len)
         vTaskDelay(pdMS_TO_TICKS(50));
     }
 
+    if (cancel) {
+        exec_cancel = cancel;
+        lua_sethook(L, exec_cancel_hook, LUA_MASKCOUNT, LUA_CANCEL_CHECK);
+    }
     int ret = luaL_dostring(L, code);
+    if (cancel) {
+        lua_sethook(L, NULL, 0, 0);
+        exec_cancel = NULL;
+    }
     if (ret != LUA_OK) {
         const char *err = lua_tostring(L, -1);
-        snprintf(result, max_len, "error: %s", err ? err : "unknown");
+        out(ctx, "error: ", 7);
+        err = err ? err : "unknown";
+        out(ctx, err, strlen(err));
         lua_pop(L, 1);
         if (was_running) lua_runtime_start();
+        xSemaphoreGive(vm_lock);
         return ESP_FAIL;
     }
 
     /* Capture return value from top of stack */
     if (lua_gettop(L) > 0) {
-        const char *s = luaL_tolstring(L, -1, NULL);
-        snprintf(result, max_len, "%s", s ? s : "nil");
+        size_t len = 0;
+        const char *s = luaL_tolstring(L, -1, &len);
+        if (s) {
+            out(ctx, s, len);
+        } else {
+            out(ctx, "nil", 3);
+        }
         lua_pop(L, 2);  /* pop tolstring result + original value */
     } else {
-        snprintf(result, max_len, "ok");
+        out(ctx, "ok", 2);
     }
 
     /* Resume main.lua if it was running */
     if (was_running) lua_runtime_start();
+    xSemaphoreGive(vm_lock);
     return ESP_OK;
 }
 
-esp_err_t lua_runtime_get_script(const char *name, char *buf, size_t max_len)
+/* Take vm_lock, giving up after LUA_CALL_WAIT_MS or once cancelled */
+static bool call_lock_vm(const volatile bool *cancel)
 {
-    if (!name || !buf) return ESP_ERR_INVALID_ARG;
+    for (int waited = 0; waited < LUA_CALL_WAIT_MS; waited += LUA_CALL_POLL_MS) {
+        if (cancel && *cancel) {
+            return false;
+        }
+        if (xSemaphoreTake(vm_lock, pdMS_TO_TICKS(LUA_CALL_POLL_MS)) == pdTRUE) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t lua_runtime_call_tool(const char *name, const cJSON *args,
+                                lua_runtime_out_fn_t out, void *ctx,
+                                const volatile bool *cancel)
+{
+    if (!L || !name || !out) return ESP_ERR_INVALID_ARG;
+
+    tool_call_t call = {
+        .name = name,
+        .args = args,
+        .out = out,
+        .ctx = ctx,
+        .cancel = cancel,
+        .ret = ESP_OK,
+    };
+    MCP_TRACE_BEGIN(MCP_TRACE_LUA, "vm_lock");
+    bool locked = call_lock_vm(cancel);
+    MCP_TRACE_END(MCP_TRACE_LUA, "vm_lock");
+    if (!locked) {
+        call_out_error(&call, (cancel && *cancel) ? "cancelled" : "Lua VM busy");
+        return (cancel && *cancel) ? ESP_FAIL : ESP_ERR_TIMEOUT;
+    }
+
+    if (!lua_task_handle) {
+        /* No main.lua running: the VM is ours */
+        run_tool_call(L, &call);
+        xSemaphoreGive(vm_lock);
+        return call.ret;
+    }
+
+    /* Hand the call to main.lua's next time.sleep_ms(). If it does not get
+     * there in time, or the task ends, take the call back. */
+    MCP_TRACE_BEGIN(MCP_TRACE_LUA, "handoff");
+    atomic_store(&pending_call, &call);
+    xSemaphoreGive(call_wake);
+    for (int waited = 0;; waited += LUA_CALL_POLL_MS) {
+        if (xSemaphoreTake(call_done, pdMS_TO_TICKS(LUA_CALL_POLL_MS)) == pdTRUE) {
+            break;
+        }
+        bool task_gone = (lua_task_handle == NULL);
+        bool cancelled = cancel && *cancel;
+        if (!task_gone && !cancelled && waited < LUA_CALL_WAIT_MS) {
+            continue;
+        }
+        tool_call_t *expected = &call;
+        if (!atomic_compare_exchange_strong(&pending_call, &expected, NULL)) {
+            /* Already running: the cancel hook stops it if needed */
+            xSemaphoreTake(call_done, portMAX_DELAY);
+        } else if (task_gone) {
+            run_tool_call(L, &call);
+        } else {
+            call_out_error(&call, cancelled ? "cancelled" :
+                           "Lua VM busy (main.lua did not reach time.sleep_ms)");
+            call.ret = cancelled ? ESP_FAIL : ESP_ERR_TIMEOUT;
+        }
+        break;
+    }
+    MCP_TRACE_END(MCP_TRACE_LUA, "handoff");
+    xSemaphoreGive(vm_lock);
+    return call.ret;
+}
+
+esp_err_t lua_runtime_get_script(const char *name, lua_runtime_out_fn_t out, void *ctx)
+{
+    if (!name || !out) return ESP_ERR_INVALID_ARG;
 
     char path[280];
     snprintf(path, sizeof(path), SPIFFS_BASE_PATH "/%s", name);
 
     FILE *f = fopen(path, "r");
     if (!f) {
-        snprintf(buf, max_len, "Script not found: %s", name);
+        char msg[300];
+        int n = snprintf(msg, sizeof(msg), "Script not found: %s", name);
+        out(ctx, msg, n < (int)sizeof(msg) ? (size_t)n : sizeof(msg) - 1);
         return ESP_ERR_NOT_FOUND;
     }
 
-    size_t total = 0;
-    while (total < max_len - 1) {
-        size_t n = fread(buf + total, 1, max_len - 1 - total, f);
-        if (n == 0) break;
-        total += n;
+    MCP_TRACE_BEGIN(MCP_TRACE_FS, "script_read");
+    char chunk[256];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        out(ctx, chunk, n);
     }
-    buf[total] = '\0';
     fclose(f);
+    MCP_TRACE_END(MCP_TRACE_FS, "script_read");
     return ESP_OK;
 }
 
@@ -646,47 +1166,195 @@ esp_err_t lua_runtime_push_script(const char *name, const char *content, bool ap
     char path[280];
     snprintf(path, sizeof(path), SPIFFS_BASE_PATH "/%s", name);
 
+    MCP_TRACE_BEGIN(MCP_TRACE_FS, "script_write");
     FILE *f = fopen(path, append ? "a" : "w");
     if (!f) {
+        MCP_TRACE_END(MCP_TRACE_FS, "script_write");
         ESP_LOGE(TAG, "Failed to open %s for writing", path);
         return ESP_FAIL;
     }
 
     fputs(content, f);
     fclose(f);
+    MCP_TRACE_END(MCP_TRACE_FS, "script_write");
     ESP_LOGI(TAG, "Script %s: %s (%d bytes)", append ? "appended" : "written",
              name, (int)strlen(content));
+    mcp_resources_script_changed(name);
     return ESP_OK;
 }
 
-esp_err_t lua_runtime_list_scripts(char *buf, size_t max_len)
+#define STAGE_PREFIX SPIFFS_BASE_PATH "/" STAGE_NAME
+
+static atomic_uint_least32_t s_stage_seq = 0;
+static __thread const char *t_stage_path = NULL;    // Staged content of the request on this task
+
+FILE *lua_runtime_stage_open(char *path, size_t path_len)
 {
-    if (!buf) return ESP_ERR_INVALID_ARG;
+    if (!path || path_len == 0) return NULL;
+
+    uint32_t seq = atomic_fetch_add(&s_stage_seq, 1);
+    snprintf(path, path_len, STAGE_PREFIX "%u", (unsigned)(seq & 0xFFFF));
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        ESP_LOGE(TAG, "Failed to open %s for staging", path);
+        path[0] = '\0';
+    }
+    return f;
+}
+
+void lua_runtime_stage_discard(const char *path)
+{
+    if (path && path[0]) {
+        remove(path);
+    }
+}
+
+const char *lua_runtime_stage_enter(const char *path)
+{
+    const char *prev = t_stage_path;
+    t_stage_path = (path && path[0]) ? path : NULL;
+    return prev;
+}
+
+esp_err_t lua_runtime_push_script_file(const char *name, const char *staged_path, bool append)
+{
+    if (!name || !staged_path) return ESP_ERR_INVALID_ARG;
+
+    /* Only the file the transport staged for this request, never a path
+     * from the client (which can write the same {"$spill":...} object) */
+    if (!t_stage_path || strcmp(staged_path, t_stage_path) != 0) {
+        ESP_LOGE(TAG, "Rejected staged path %s", staged_path);
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct stat st;
+    if (stat(staged_path, &st) != 0) {
+        ESP_LOGE(TAG, "Staged file %s is gone", staged_path);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char path[280];
+    snprintf(path, sizeof(path), SPIFFS_BASE_PATH "/%s", name);
+
+    if (!append) {
+        /* SPIFFS rename does not replace an existing file */
+        remove(path);
+        if (rename(staged_path, path) != 0) {
+            ESP_LOGE(TAG, "Failed to move %s to %s", staged_path, path);
+            return ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "Script written: %s (staged)", name);
+        mcp_resources_script_changed(name);
+        return ESP_OK;
+    }
+
+    FILE *src = fopen(staged_path, "r");
+    if (!src) {
+        ESP_LOGE(TAG, "Failed to open %s", staged_path);
+        return ESP_FAIL;
+    }
+    FILE *dst = fopen(path, "a");
+    if (!dst) {
+        ESP_LOGE(TAG, "Failed to open %s for writing", path);
+        fclose(src);
+        return ESP_FAIL;
+    }
+
+    MCP_TRACE_BEGIN(MCP_TRACE_FS, "script_append");
+    char chunk[256];
+    size_t n;
+    esp_err_t ret = ESP_OK;
+    while ((n = fread(chunk, 1, sizeof(chunk), src)) > 0) {
+        if (fwrite(chunk, 1, n, dst) != n) {
+            ret = ESP_FAIL;
+            break;
+        }
+    }
+    fclose(dst);
+    fclose(src);
+    MCP_TRACE_END(MCP_TRACE_FS, "script_append");
+    remove(staged_path);
+    ESP_LOGI(TAG, "Script appended: %s (staged)", name);
+    if (ret == ESP_OK) {
+        mcp_resources_script_changed(name);
+    }
+    return ret;
+}
+
+esp_err_t lua_runtime_foreach_script(void (*fn)(const char *name, size_t size, void *ctx), void *ctx)
+{
+    if (!fn) return ESP_ERR_INVALID_ARG;
 
     DIR *dir = opendir(SPIFFS_BASE_PATH);
     if (!dir) {
-        snprintf(buf, max_len, "Failed to open SPIFFS directory");
         return ESP_FAIL;
     }
 
-    int offset = 0;
     struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL && offset < (int)max_len - 1) {
+    while ((entry = readdir(dir)) != NULL) {
+        /* Skip staging files */
+        if (entry->d_name[0] == '.') continue;
+
         /* Get file size */
         char path[280];
         snprintf(path, sizeof(path), SPIFFS_BASE_PATH "/%s", entry->d_name);
         struct stat st;
-        int size = 0;
+        size_t size = 0;
         if (stat(path, &st) == 0) {
-            size = (int)st.st_size;
+            size = (size_t)st.st_size;
         }
-        offset += snprintf(buf + offset, max_len - offset,
-                           "%s (%d bytes)\n", entry->d_name, size);
+        fn(entry->d_name, size, ctx);
     }
     closedir(dir);
+    return ESP_OK;
+}
+
+esp_err_t lua_runtime_stat_script(const char *name, size_t *size)
+{
+    if (!name || !size) return ESP_ERR_INVALID_ARG;
+
+    /* Plain file names only, and never a staging file */
+    if (name[0] == '\0' || name[0] == '.' || strchr(name, '/') != NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    char path[280];
+    snprintf(path, sizeof(path), SPIFFS_BASE_PATH "/%s", name);
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *size = (size_t)st.st_size;
+    return ESP_OK;
+}
+
+typedef struct {
+    lua_runtime_out_fn_t out;
+    void *ctx;
+    int count;
+} list_scripts_ctx_t;
+
+static void list_scripts_line(const char *name, size_t size, void *ctx)
+{
+    list_scripts_ctx_t *lc = ctx;
+    char line[300];
+    int n = snprintf(line, sizeof(line), "%s (%d bytes)\n", name, (int)size);
+    lc->out(lc->ctx, line, n < (int)sizeof(line) ? (size_t)n : sizeof(line) - 1);
+    lc->count++;
+}
+
+esp_err_t lua_runtime_list_scripts(lua_runtime_out_fn_t out, void *ctx)
+{
+    if (!out) return ESP_ERR_INVALID_ARG;
+
+    list_scripts_ctx_t lc = { .out = out, .ctx = ctx, .count = 0 };
+    if (lua_runtime_foreach_script(list_scripts_line, &lc) != ESP_OK) {
+        const char *msg = "Failed to open SPIFFS directory";
+        out(ctx, msg, strlen(msg));
+        return ESP_FAIL;
+    }
 
-    if (offset == 0) {
-        snprintf(buf, max_len, "(no scripts)");
+    if (lc.count == 0) {
+        out(ctx, "(no scripts)", 12);
     }
     return ESP_OK;
 }
@@ -2,16 +2,19 @@
  * Lua Runtime for ESP32
  *
  * Manages Lua VM lifecycle, SPIFFS script storage, and C bindings
- * for hardware access (GPIO, timers, logging, system info).
+ * for hardware access (GPIO, timers, logging, system info) and for
+ * adding MCP tools written in Lua.
  */
 
 #ifndef LUA_RUNTIME_H
 #define LUA_RUNTIME_H
 
 #include <esp_err.h>
+#include <cJSON.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -33,21 +36,46 @@ esp_err_t lua_runtime_start(void);
  */
 esp_err_t lua_runtime_restart(void);
 
+/**
+ * Output callback for exec results, script text and listings.
+ * May be called several times; data is not NUL-terminated.
+ */
+typedef void (*lua_runtime_out_fn_t)(void *ctx, const char *data, size_t len);
+
 /**
  * Execute a Lua code snippet in the current VM.
+ * Calls from several tasks are serialized.
  * @param code   Lua source to execute
- * @param result Output buffer for return value (as string)
- * @param max_len Size of result buffer
+ * @param out    Receives the return value (as string) or the error
+ * @param ctx    Passed to out
+ * @param cancel Optional flag; once set, the snippet is aborted with an error
+ */
+esp_err_t lua_runtime_exec(const char *code, lua_runtime_out_fn_t out, void *ctx,
+                           const volatile bool *cancel);
+
+/**
+ * Call a tool registered from Lua with mcp.register_tool().
+ * While main.lua runs, the call is handed to the Lua task and runs at its
+ * next time.sleep_ms(); otherwise it runs on the calling task.
+ * @param name   Tool name
+ * @param args   Tool arguments, passed to the function as a table (may be NULL)
+ * @param out    Receives the result (strings as-is, other values as JSON) or the error
+ * @param ctx    Passed to out
+ * @param cancel Optional flag; once set, the function is aborted with an error
+ * @return ESP_OK, ESP_FAIL if the function raised an error, or
+ *         ESP_ERR_TIMEOUT if the VM stayed busy
  */
-esp_err_t lua_runtime_exec(const char *code, char *result, size_t max_len);
+esp_err_t lua_runtime_call_tool(const char *name, const cJSON *args,
+                                lua_runtime_out_fn_t out, void *ctx,
+                                const volatile bool *cancel);
 
 /**
  * Read a script from SPIFFS.
- * @param name    Script filename (e.g. "main.lua")
- * @param buf     Output buffer
- * @param max_len Size of buf
+ * @param name Script filename (e.g. "main.lua")
+ * @param out  Receives the script in chunks
+ * @param ctx  Passed to out
  */
-esp_err_t lua_runtime_get_script(const char *name, char *buf, size_t max_len);
+esp_err_t lua_runtime_get_script(const char *name, lua_runtime_out_fn_t out, void *ctx);
 
 /**
  * Write/overwrite a script on SPIFFS.
@@ -57,12 +85,60 @@ esp_err_t lua_runtime_get_script(const char *name, char *buf, size_t max_len);
  */
 esp_err_t lua_runtime_push_script(const char *name, const char *content, bool append);
 
+/**
+ * Open a staging file on SPIFFS for script content streamed in by the
+ * transport (oversized lua_push_script requests).
+ * @param path     Output: path of the staging file
+ * @param path_len Size of path
+ * @return Open file, or NULL on failure
+ */
+FILE *lua_runtime_stage_open(char *path, size_t path_len);
+
+/**
+ * Remove a staging file if it still exists.
+ */
+void lua_runtime_stage_discard(const char *path);
+
+/**
+ * Make path the staging file that the request handled on the calling
+ * task may consume (set by the transport around handling the request).
+ * @param path Staging file path, or NULL / "" for none
+ * @return The previous one, to restore afterwards
+ */
+const char *lua_runtime_stage_enter(const char *path);
+
+/**
+ * Write or append a script from a staging file.
+ * The staging file is consumed. Only the file entered with
+ * lua_runtime_stage_enter() on the calling task is accepted.
+ * @param name        Script filename
+ * @param staged_path Path returned by lua_runtime_stage_open()
+ * @param append      If true, append instead of overwrite
+ */
+esp_err_t lua_runtime_push_script_file(const char *name, const char *staged_path, bool append);
+
 /**
  * List all scripts on SPIFFS.
- * @param buf     Output buffer (newline-separated filenames)
- * @param max_len Size of buf
+ * @param out Receives newline-separated filenames with sizes
+ * @param ctx Passed to out
+ */
+esp_err_t lua_runtime_list_scripts(lua_runtime_out_fn_t out, void *ctx);
+
+/**
+ * Call fn for every script on SPIFFS (staging files are skipped).
+ * @param fn  Receives the filename and size in bytes
+ * @param ctx Passed to fn
+ * @return ESP_OK, or ESP_FAIL if the directory cannot be read
+ */
+esp_err_t lua_runtime_foreach_script(void (*fn)(const char *name, size_t size, void *ctx), void *ctx);
+
+/**
+ * Size of a script on SPIFFS.
+ * @param name Script filename (no path)
+ * @param size Output: size in bytes
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if there is no such script
  */
-esp_err_t lua_runtime_list_scripts(char *buf, size_t max_len);
+esp_err_t lua_runtime_stat_script(const char *name, size_t *size);
 
 /**
  * Get Lua VM heap usage tracked by Lua allocator.
@@ -17,8 +17,13 @@
 #include <esp_http_server.h>
 #include "keep_alive.h"
 #include "mcp_server.h"
+#include "mcp_session.h"
+#include "mcp_tls.h"
 #include "mcp_log.h"
+#include "mcp_log_archive.h"
 #include "mcp_ota.h"
+#include "mcp_metrics.h"
+#include "mcp_trace.h"
 #include "lua_runtime.h"
 #include "sdkconfig.h"
 #include <freertos/FreeRTOS.h>
@@ -50,10 +55,12 @@ void wss_close_fd(httpd_handle_t hd, int sockfd)
     ESP_LOGI(TAG, "Client disconnected %d", sockfd);
     wss_keep_alive_t h = httpd_get_global_user_ctx(hd);
     wss_keep_alive_remove_client(h, sockfd);
+    mcp_session_close_fd(sockfd);
     close(sockfd);
 }
 
-/* MCP WebSocket endpoint (legacy / direct WS clients) */
+/* MCP WebSocket endpoint (legacy / direct WS clients); on HTTPS it also
+ * serves plain GET /mcp, which the handler hands to mcp_info_handler */
 static const httpd_uri_t mcp_ws = {
     .uri        = "/mcp",
     .method     = HTTP_GET,
@@ -79,6 +86,29 @@ static const httpd_uri_t mcp_info = {
     .user_ctx   = NULL,
 };
 
+/* GET /metrics endpoint (latency histograms, Prometheus text format) */
+static const httpd_uri_t mcp_metrics = {
+    .uri        = "/metrics",
+    .method     = HTTP_GET,
+    .handler    = mcp_metrics_handler,
+    .user_ctx   = NULL,
+};
+
+static const httpd_uri_t mcp_trace = {
+    .uri        = "/trace",
+    .method     = HTTP_GET,
+    .handler    = mcp_trace_handler,
+    .user_ctx   = NULL,
+};
+
+/* MCP DELETE /mcp endpoint (ends a streamable-http session) */
+static const httpd_uri_t mcp_delete = {
+    .uri        = "/mcp",
+    .method     = HTTP_DELETE,
+    .handler    = mcp_delete_handler,
+    .user_ctx   = NULL,
+};
+
 static void send_ping(void *arg)
 {
     struct async_resp_arg *resp_arg = arg;
@@ -108,6 +138,13 @@ bool check_client_alive_cb(wss_keep_alive_t h, int fd)
 
 /* --- Plain HTTP server (no TLS, for easier MCP client testing) --- */
 
+static void http_close_fd(httpd_handle_t hd, int sockfd)
+{
+    (void)hd;
+    mcp_session_close_fd(sockfd);
+    close(sockfd);
+}
+
 static httpd_handle_t start_http_server(void)
 {
     httpd_handle_t server = NULL;
@@ -118,6 +155,7 @@ static httpd_handle_t start_http_server(void)
     config.send_wait_timeout = 10;
     config.lru_purge_enable = true;
     config.stack_size = 8192;                   /* larger stack for WiFi API calls */
+    config.close_fn = http_close_fd;
 
     esp_err_t ret = httpd_start(&server, &config);
     if (ret != ESP_OK) {
@@ -127,6 +165,9 @@ static httpd_handle_t start_http_server(void)
 
     httpd_register_uri_handler(server, &mcp_http);
     httpd_register_uri_handler(server, &mcp_info);
+    httpd_register_uri_handler(server, &mcp_delete);
+    httpd_register_uri_handler(server, &mcp_metrics);
+    httpd_register_uri_handler(server, &mcp_trace);
     ESP_LOGI(TAG, "HTTP server started, MCP at http://<ip>/mcp (POST)");
     return server;
 }
@@ -150,16 +191,11 @@ static httpd_handle_t start_mcp_server(void)
     conf.httpd.global_user_ctx = keep_alive;
     conf.httpd.open_fn = wss_open_fd;
     conf.httpd.close_fn = wss_close_fd;
+    if (mcp_tls_configure(&conf) != ESP_OK) {
+        ESP_LOGW(TAG, "TLS session setup failed, handshakes are not resumed");
+    }
 
-    extern const unsigned char servercert_start[] asm("_binary_servercert_pem_start");
-    extern const unsigned char servercert_end[]   asm("_binary_servercert_pem_end");
-    conf.servercert = servercert_start;
-    conf.servercert_len = servercert_end - servercert_start;
-
-    extern const unsigned char prvtkey_pem_start[] asm("_binary_prvtkey_pem_start");
-    extern const unsigned char prvtkey_pem_end[]   asm("_binary_prvtkey_pem_end");
-    conf.prvtkey_pem = prvtkey_pem_start;
-    conf.prvtkey_len = prvtkey_pem_end - prvtkey_pem_start;
+    mcp_tls_load_credentials(&conf);
 
     esp_err_t ret = httpd_ssl_start(&server, &conf);
     if (ret != ESP_OK) {
@@ -171,6 +207,9 @@ static httpd_handle_t start_mcp_server(void)
     ESP_LOGI(TAG, "Registering MCP endpoints at /mcp (WSS + HTTP POST)");
     httpd_register_uri_handler(server, &mcp_ws);
     httpd_register_uri_handler(server, &mcp_http);
+    httpd_register_uri_handler(server, &mcp_delete);
+    httpd_register_uri_handler(server, &mcp_metrics);
+    httpd_register_uri_handler(server, &mcp_trace);
     wss_keep_alive_set_user_ctx(keep_alive, server);
 
     /* Initialize MCP server */
@@ -223,6 +262,7 @@ void app_main(void)
 
     /* Initialize log capture first, before anything else logs */
     mcp_log_init();
+    mcp_log_archive_init();
 
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -0,0 +1,202 @@
+/*
+ * MCP Request Arena Implementation
+ *
+ * The arenas are slices of one block taken through a free bitmap, like the
+ * buffer pool. A pointer is recognised as arena memory by its address, so
+ * cJSON_Delete works on any task, including trees built on another one.
+ * Freeing the latest allocation gives its space back, which covers cJSON's
+ * print buffers and trees deleted right after they are built.
+ */
+
+#include "mcp_arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <cJSON.h>
+#include <esp_log.h>
+#include "mcp_mem.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "mcp_arena";
+
+#define ARENA_COUNT     CONFIG_MCP_ARENA_COUNT
+#define ARENA_SIZE      CONFIG_MCP_ARENA_SIZE
+#define ARENA_ALIGN     _Alignof(max_align_t)
+
+_Static_assert(ARENA_COUNT >= 1 && ARENA_COUNT <= 32, "free bitmap holds 32 arenas");
+
+struct mcp_arena {
+    char *base;
+    size_t used;
+    size_t last;                // Offset of the latest allocation
+    size_t peak;
+};
+
+static mcp_arena_t s_arenas[ARENA_COUNT];
+static char *s_block = NULL;
+static atomic_uint s_free_mask = 0;
+static atomic_uint s_requests = 0;
+static atomic_uint s_spills = 0;
+static atomic_size_t s_peak = 0;
+
+// Arena of the request the task is working on
+static __thread mcp_arena_t *t_current;
+
+static void arena_spilled(void)
+{
+    atomic_fetch_add(&s_spills, 1);
+#if CONFIG_MCP_ARENA_ASSERT_NO_HEAP
+    if (atomic_load(&s_requests) > CONFIG_MCP_ARENA_WARMUP_REQUESTS) {
+        ESP_LOGE(TAG, "Request memory came from the heap after warm-up (arena %u bytes)",
+                 (unsigned)ARENA_SIZE);
+        abort();
+    }
+#endif
+}
+
+static bool in_block(const void *ptr)
+{
+    const char *p = ptr;
+    return s_block && p >= s_block && p < s_block + (size_t)ARENA_COUNT * ARENA_SIZE;
+}
+
+static void *arena_hook_malloc(size_t size)
+{
+    return mcp_arena_alloc(size);
+}
+
+esp_err_t mcp_arena_init(void)
+{
+    if (s_block) {
+        return ESP_OK;
+    }
+    s_block = mcp_mem_malloc(MCP_MEM_ARENA, (size_t)ARENA_COUNT * ARENA_SIZE);
+    if (!s_block) {
+        ESP_LOGE(TAG, "Cannot allocate %d request arenas of %d bytes", ARENA_COUNT, ARENA_SIZE);
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < ARENA_COUNT; i++) {
+        s_arenas[i].base = s_block + (size_t)i * ARENA_SIZE;
+    }
+    atomic_store(&s_free_mask, (ARENA_COUNT == 32) ? 0xffffffffu : ((1u << ARENA_COUNT) - 1));
+
+    cJSON_Hooks hooks = {
+        .malloc_fn = arena_hook_malloc,
+        .free_fn = mcp_arena_free,
+    };
+    cJSON_InitHooks(&hooks);
+
+    ESP_LOGI(TAG, "%d request arenas of %d bytes", ARENA_COUNT, ARENA_SIZE);
+    return ESP_OK;
+}
+
+mcp_arena_t *mcp_arena_acquire(void)
+{
+    atomic_fetch_add(&s_requests, 1);
+    unsigned mask = atomic_load(&s_free_mask);
+    while (mask) {
+        int i = __builtin_ctz(mask);
+        if (atomic_compare_exchange_weak(&s_free_mask, &mask, mask & ~(1u << i))) {
+            mcp_arena_t *arena = &s_arenas[i];
+            arena->used = 0;
+            arena->last = 0;
+            arena->peak = 0;
+            return arena;
+        }
+    }
+    if (s_block) {
+        arena_spilled();
+    }
+    return NULL;
+}
+
+void mcp_arena_release(mcp_arena_t *arena)
+{
+    if (!arena) {
+        return;
+    }
+    size_t peak = atomic_load(&s_peak);
+    while (arena->peak > peak && !atomic_compare_exchange_weak(&s_peak, &peak, arena->peak)) {
+    }
+    atomic_fetch_or(&s_free_mask, 1u << (arena - s_arenas));
+}
+
+mcp_arena_t *mcp_arena_enter(mcp_arena_t *arena)
+{
+    mcp_arena_t *prev = t_current;
+    t_current = arena;
+    return prev;
+}
+
+void mcp_arena_leave(mcp_arena_t *prev)
+{
+    t_current = prev;
+}
+
+void *mcp_arena_alloc(size_t size)
+{
+    mcp_arena_t *arena = t_current;
+    if (!arena) {
+        return malloc(size);
+    }
+    size_t offset = (arena->used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (size > ARENA_SIZE - offset || offset > ARENA_SIZE) {
+        arena_spilled();
+        return malloc(size);
+    }
+    arena->last = offset;
+    arena->used = offset + size;
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+    return arena->base + offset;
+}
+
+void *mcp_arena_calloc(size_t n, size_t size)
+{
+    if (size && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *p = mcp_arena_alloc(n * size);
+    if (p) {
+        memset(p, 0, n * size);
+    }
+    return p;
+}
+
+void mcp_arena_free(void *ptr)
+{
+    if (!in_block(ptr)) {
+        free(ptr);
+        return;
+    }
+    // Only the latest allocation of the current arena can be taken back
+    mcp_arena_t *arena = t_current;
+    if (arena && (char *)ptr == arena->base + arena->last && arena->used > arena->last) {
+        arena->used = arena->last;
+    }
+}
+
+size_t mcp_arena_mark(void)
+{
+    return t_current ? t_current->used : 0;
+}
+
+void mcp_arena_rewind(size_t mark)
+{
+    mcp_arena_t *arena = t_current;
+    if (arena && mark <= arena->used) {
+        arena->used = mark;
+        arena->last = mark;
+    }
+}
+
+void mcp_arena_get_stats(mcp_arena_stats_t *stats)
+{
+    stats->count = s_block ? ARENA_COUNT : 0;
+    stats->in_use = s_block ? ARENA_COUNT - __builtin_popcount(atomic_load(&s_free_mask)) : 0;
+    stats->size = ARENA_SIZE;
+    stats->peak = atomic_load(&s_peak);
+    stats->requests = atomic_load(&s_requests);
+    stats->spills = atomic_load(&s_spills);
+}
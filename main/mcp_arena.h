@@ -0,0 +1,113 @@
+/*
+ * MCP Request Arena
+ *
+ * Bump allocator for memory that lives only as long as one request: the
+ * cJSON trees of its params and results, and scratch space of the tool
+ * handler. Freeing is a no-op and the whole arena is reset when the
+ * request is answered, so steady traffic leaves no holes in the heap.
+ *
+ * A request takes an arena from a fixed pool and enters it on the task
+ * that works on it; a tools/call hands the arena to its executor job,
+ * which enters it on the worker. cJSON allocates from the current task's
+ * arena (cJSON_InitHooks) and from the heap everywhere else. An arena
+ * that runs full also falls back to the heap.
+ */
+
+#ifndef MCP_ARENA_H
+#define MCP_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mcp_arena mcp_arena_t;
+
+/**
+ * Arena usage since boot
+ */
+typedef struct {
+    int count;                  // Arenas in the pool
+    int in_use;
+    size_t size;                // Bytes per arena
+    size_t peak;                // Most bytes one request used
+    uint32_t requests;          // Arenas handed out
+    uint32_t spills;            // Allocations that went to the heap instead
+} mcp_arena_stats_t;
+
+/**
+ * Allocate the pool and install the cJSON hooks (once, before the server
+ * starts)
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the pool does not fit
+ */
+esp_err_t mcp_arena_init(void);
+
+/**
+ * Take an arena for a new request
+ *
+ * @return Arena, or NULL if all are in use (the request then uses the heap)
+ */
+mcp_arena_t *mcp_arena_acquire(void);
+
+/**
+ * Reset an arena and return it to the pool (NULL is ignored)
+ * Nothing allocated from it may be used afterwards.
+ */
+void mcp_arena_release(mcp_arena_t *arena);
+
+/**
+ * Make an arena current on the calling task
+ *
+ * @param arena Arena, or NULL to allocate from the heap
+ * @return The previously current arena, for mcp_arena_leave
+ */
+mcp_arena_t *mcp_arena_enter(mcp_arena_t *arena);
+
+/**
+ * Restore the arena that was current before mcp_arena_enter
+ */
+void mcp_arena_leave(mcp_arena_t *prev);
+
+/**
+ * Allocate from the current task's arena, or the heap if there is none
+ * or it is full. Release with mcp_arena_free.
+ */
+void *mcp_arena_alloc(size_t size);
+
+/**
+ * Zeroed mcp_arena_alloc
+ */
+void *mcp_arena_calloc(size_t n, size_t size);
+
+/**
+ * Free memory from mcp_arena_alloc (or cJSON); only heap memory is
+ * actually freed
+ */
+void mcp_arena_free(void *ptr);
+
+/**
+ * Position in the current task's arena (0 if there is none)
+ */
+size_t mcp_arena_mark(void);
+
+/**
+ * Give back everything allocated from the current arena since a mark
+ * (batch entries are answered one after another)
+ */
+void mcp_arena_rewind(size_t mark);
+
+/**
+ * Snapshot of the arena usage
+ */
+void mcp_arena_get_stats(mcp_arena_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MCP_ARENA_H
@@ -0,0 +1,97 @@
+/*
+ * MCP Buffer Pool Implementation
+ *
+ * Each kind is one contiguous block of equal buffers with a free bitmap.
+ * A buffer is taken by clearing its bit with compare-and-swap, so the
+ * httpd task and the executor workers never wait on each other; a pointer
+ * is recognised as pooled by its address.
+ */
+
+#include "mcp_bufpool.h"
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <esp_log.h>
+#include "mcp_mem.h"
+
+static const char *TAG = "mcp_bufpool";
+
+#define POOL_SETS CONFIG_MCP_BUF_POOL_SETS
+
+_Static_assert(POOL_SETS >= 1 && POOL_SETS <= 32, "free bitmap holds 32 buffers");
+
+typedef struct {
+    char *base;
+    size_t size;
+    atomic_uint free_mask;
+} buf_pool_t;
+
+static buf_pool_t s_pools[2] = {
+    [MCP_BUF_RX] = { .size = MCP_BUF_RX_SIZE },
+    [MCP_BUF_TX] = { .size = MCP_BUF_TX_SIZE },
+};
+static char *s_block = NULL;
+static bool s_psram = false;
+static atomic_uint s_fallbacks = 0;
+
+esp_err_t mcp_bufpool_init(void)
+{
+    if (s_block) {
+        return ESP_OK;
+    }
+    size_t total = (size_t)POOL_SETS * (MCP_BUF_RX_SIZE + MCP_BUF_TX_SIZE);
+    s_block = mcp_mem_malloc(MCP_MEM_BUFFERS, total);
+    if (!s_block) {
+        ESP_LOGE(TAG, "Cannot allocate %u bytes for the buffer pool", (unsigned)total);
+        return ESP_ERR_NO_MEM;
+    }
+    s_psram = mcp_mem_in_psram(s_block);
+
+    unsigned all = (POOL_SETS == 32) ? 0xffffffffu : ((1u << POOL_SETS) - 1);
+    s_pools[MCP_BUF_RX].base = s_block;
+    s_pools[MCP_BUF_TX].base = s_block + (size_t)POOL_SETS * MCP_BUF_RX_SIZE;
+    atomic_store(&s_pools[MCP_BUF_RX].free_mask, all);
+    atomic_store(&s_pools[MCP_BUF_TX].free_mask, all);
+
+    ESP_LOGI(TAG, "%d buffer sets (%u + %u bytes) in %s", POOL_SETS,
+             (unsigned)MCP_BUF_RX_SIZE, (unsigned)MCP_BUF_TX_SIZE, s_psram ? "PSRAM" : "internal RAM");
+    return ESP_OK;
+}
+
+char *mcp_buf_get(mcp_buf_kind_t kind)
+{
+    buf_pool_t *pool = &s_pools[kind];
+    unsigned mask = atomic_load(&pool->free_mask);
+    while (mask) {
+        int i = __builtin_ctz(mask);
+        if (atomic_compare_exchange_weak(&pool->free_mask, &mask, mask & ~(1u << i))) {
+            return pool->base + (size_t)i * pool->size;
+        }
+    }
+    atomic_fetch_add(&s_fallbacks, 1);
+    return malloc(pool->size);
+}
+
+void mcp_buf_put(void *buf)
+{
+    char *p = buf;
+    if (!p) {
+        return;
+    }
+    for (int k = 0; k < 2; k++) {
+        buf_pool_t *pool = &s_pools[k];
+        if (pool->base && p >= pool->base && p < pool->base + (size_t)POOL_SETS * pool->size) {
+            atomic_fetch_or(&pool->free_mask, 1u << ((p - pool->base) / pool->size));
+            return;
+        }
+    }
+    free(p);
+}
+
+void mcp_bufpool_get_stats(mcp_bufpool_stats_t *stats)
+{
+    stats->sets = s_block ? POOL_SETS : 0;
+    stats->rx_in_use = s_block ? POOL_SETS - __builtin_popcount(atomic_load(&s_pools[MCP_BUF_RX].free_mask)) : 0;
+    stats->tx_in_use = s_block ? POOL_SETS - __builtin_popcount(atomic_load(&s_pools[MCP_BUF_TX].free_mask)) : 0;
+    stats->fallbacks = atomic_load(&s_fallbacks);
+    stats->psram = s_psram;
+}
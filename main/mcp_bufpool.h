@@ -0,0 +1,73 @@
+/*
+ * MCP Buffer Pool
+ *
+ * Receive buffers (one message, CONFIG_MCP_MAX_MESSAGE_SIZE) and response
+ * buffers (CONFIG_MCP_RESPONSE_BUFFER_SIZE) allocated once at startup, so
+ * steady request traffic does not fragment the heap the Lua VM needs.
+ * There are CONFIG_MCP_BUF_POOL_SETS of each; when they are all taken,
+ * buffers come from the heap and go back to it.
+ */
+
+#ifndef MCP_BUFPOOL_H
+#define MCP_BUFPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_BUF_RX_SIZE     (CONFIG_MCP_MAX_MESSAGE_SIZE + 1)  // Message plus NUL
+#define MCP_BUF_TX_SIZE     CONFIG_MCP_RESPONSE_BUFFER_SIZE
+
+typedef enum {
+    MCP_BUF_RX,
+    MCP_BUF_TX,
+} mcp_buf_kind_t;
+
+/**
+ * Pool usage
+ */
+typedef struct {
+    int sets;                   // Buffers of each kind
+    int rx_in_use;
+    int tx_in_use;
+    uint32_t fallbacks;         // Buffers taken from the heap because the pool was empty
+    bool psram;                 // Pool lives in PSRAM
+} mcp_bufpool_stats_t;
+
+/**
+ * Allocate the pool (once, before the server starts)
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the pool does not fit
+ */
+esp_err_t mcp_bufpool_init(void);
+
+/**
+ * Take a buffer of MCP_BUF_RX_SIZE or MCP_BUF_TX_SIZE bytes
+ * Safe from any task.
+ *
+ * @param kind Buffer kind
+ * @return Buffer, or NULL if the pool is empty and the heap is too
+ */
+char *mcp_buf_get(mcp_buf_kind_t kind);
+
+/**
+ * Return a buffer from mcp_buf_get (NULL is ignored)
+ */
+void mcp_buf_put(void *buf);
+
+/**
+ * Snapshot of the pool usage
+ */
+void mcp_bufpool_get_stats(mcp_bufpool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MCP_BUFPOOL_H
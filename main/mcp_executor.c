@@ -0,0 +1,268 @@
+/*
+ * MCP Tool Executor Implementation
+ *
+ * Jobs are kept in one FIFO per lane under a single mutex. Idle workers
+ * wait on a counting semaphore that is given for every submitted job and
+ * every finished normal-lane job, so a wake-up is never lost; a worker
+ * that wakes and finds nothing it may take simply waits again.
+ */
+
+#include "mcp_executor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "sdkconfig.h"
+
+static const char *TAG = "mcp_exec";
+
+#define EXEC_WORKERS        CONFIG_MCP_EXECUTOR_WORKERS
+#define EXEC_QUEUE_LEN      CONFIG_MCP_EXECUTOR_QUEUE_LEN
+#define EXEC_STACK_SIZE     8192    // Same as the httpd task, which ran tools before
+#define EXEC_PRIORITY       5
+// Normal-lane jobs may occupy every worker but one
+#define EXEC_NORMAL_MAX     (EXEC_WORKERS > 1 ? EXEC_WORKERS - 1 : 1)
+
+typedef struct {
+    TaskHandle_t task;
+    mcp_job_t *job;             // Running job, or NULL
+} exec_worker_t;
+
+static exec_worker_t s_workers[EXEC_WORKERS];
+static mcp_job_t *s_head[MCP_LANE_COUNT];
+static mcp_job_t *s_tail[MCP_LANE_COUNT];
+static int s_queued = 0;
+static int s_normal_running = 0;
+static SemaphoreHandle_t s_lock = NULL;     // Guards the queues and worker slots
+static SemaphoreHandle_t s_wake = NULL;     // Counts pending wake-ups
+
+// Next job this worker may start (s_lock held)
+static mcp_job_t *exec_take(void)
+{
+    for (int lane = 0; lane < MCP_LANE_COUNT; lane++) {
+        if (lane == MCP_LANE_NORMAL && s_normal_running >= EXEC_NORMAL_MAX) {
+            break;
+        }
+        mcp_job_t *job = s_head[lane];
+        if (!job) {
+            continue;
+        }
+        s_head[lane] = job->next;
+        if (!s_head[lane]) {
+            s_tail[lane] = NULL;
+        }
+        job->next = NULL;
+        s_queued--;
+        if (lane == MCP_LANE_NORMAL) {
+            s_normal_running++;
+        }
+        return job;
+    }
+    return NULL;
+}
+
+static void exec_worker_task(void *arg)
+{
+    exec_worker_t *self = arg;
+
+    for (;;) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        mcp_job_t *job = exec_take();
+        self->job = job;
+        xSemaphoreGive(s_lock);
+
+        if (!job) {
+            xSemaphoreTake(s_wake, portMAX_DELAY);
+            continue;
+        }
+
+        job->run(job);
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        self->job = NULL;
+        bool normal = (job->lane == MCP_LANE_NORMAL);
+        if (normal) {
+            s_normal_running--;
+        }
+        xSemaphoreGive(s_lock);
+        free(job);
+
+        if (normal) {
+            // A normal-lane slot opened up for an idle worker
+            xSemaphoreGive(s_wake);
+        }
+    }
+}
+
+esp_err_t mcp_executor_init(void)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+
+    s_lock = xSemaphoreCreateMutex();
+    s_wake = xSemaphoreCreateCounting(EXEC_QUEUE_LEN + EXEC_WORKERS, 0);
+    if (!s_lock || !s_wake) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < EXEC_WORKERS; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "mcp_exec%d", i);
+        if (xTaskCreate(exec_worker_task, name, EXEC_STACK_SIZE, &s_workers[i],
+                        EXEC_PRIORITY, &s_workers[i].task) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create worker %d", i);
+            return ESP_FAIL;
+        }
+    }
+
+    ESP_LOGI(TAG, "Executor ready (%d workers, %d queued jobs max)", EXEC_WORKERS, EXEC_QUEUE_LEN);
+    return ESP_OK;
+}
+
+esp_err_t mcp_executor_submit(mcp_job_t *job)
+{
+    if (!job || !job->run || job->lane < 0 || job->lane >= MCP_LANE_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    job->cancelled = false;
+    job->next = NULL;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (s_queued >= EXEC_QUEUE_LEN) {
+        xSemaphoreGive(s_lock);
+        ESP_LOGW(TAG, "Queue full, refusing job");
+        return ESP_ERR_NO_MEM;
+    }
+    if (s_tail[job->lane]) {
+        s_tail[job->lane]->next = job;
+    } else {
+        s_head[job->lane] = job;
+    }
+    s_tail[job->lane] = job;
+    s_queued++;
+    xSemaphoreGive(s_lock);
+
+    xSemaphoreGive(s_wake);
+    return ESP_OK;
+}
+
+bool mcp_executor_cancel(int origin, int id)
+{
+    if (!s_lock || id < 0) {
+        return false;
+    }
+
+    mcp_job_t *removed = NULL;
+    bool found = false;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int lane = 0; lane < MCP_LANE_COUNT && !found; lane++) {
+        mcp_job_t *prev = NULL;
+        for (mcp_job_t *job = s_head[lane]; job; prev = job, job = job->next) {
+            if (job->origin != origin || job->id != id) {
+                continue;
+            }
+            if (prev) {
+                prev->next = job->next;
+            } else {
+                s_head[lane] = job->next;
+            }
+            if (s_tail[lane] == job) {
+                s_tail[lane] = prev;
+            }
+            s_queued--;
+            removed = job;
+            found = true;
+            break;
+        }
+    }
+    for (int i = 0; i < EXEC_WORKERS && !found; i++) {
+        mcp_job_t *job = s_workers[i].job;
+        if (job && job->origin == origin && job->id == id) {
+            job->cancelled = true;
+            found = true;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (removed) {
+        ESP_LOGI(TAG, "Cancelled queued request %d", id);
+        removed->cancelled = true;
+        if (removed->discard) {
+            removed->discard(removed);
+        }
+        free(removed);
+    } else if (found) {
+        ESP_LOGI(TAG, "Cancelling running request %d", id);
+    }
+    return found;
+}
+
+int mcp_executor_cancel_origin(int origin)
+{
+    if (!s_lock) {
+        return 0;
+    }
+
+    mcp_job_t *removed = NULL;      // Discarded outside the lock, linked by next
+    int found = 0;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int lane = 0; lane < MCP_LANE_COUNT; lane++) {
+        mcp_job_t **link = &s_head[lane];
+        s_tail[lane] = NULL;
+        while (*link) {
+            mcp_job_t *job = *link;
+            if (job->origin != origin) {
+                s_tail[lane] = job;
+                link = &job->next;
+                continue;
+            }
+            *link = job->next;
+            job->next = removed;
+            removed = job;
+            s_queued--;
+            found++;
+        }
+    }
+    for (int i = 0; i < EXEC_WORKERS; i++) {
+        mcp_job_t *job = s_workers[i].job;
+        if (job && job->origin == origin) {
+            job->cancelled = true;
+            found++;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    while (removed) {
+        mcp_job_t *job = removed;
+        removed = job->next;
+        job->cancelled = true;
+        if (job->discard) {
+            job->discard(job);
+        }
+        free(job);
+    }
+    if (found) {
+        ESP_LOGI(TAG, "Cancelled %d requests from origin %d", found, origin);
+    }
+    return found;
+}
+
+const volatile bool *mcp_executor_cancel_flag(void)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < EXEC_WORKERS; i++) {
+        // Only the worker itself changes its job, so no lock is needed
+        if (s_workers[i].task == self && s_workers[i].job) {
+            return &s_workers[i].job->cancelled;
+        }
+    }
+    return NULL;
+}
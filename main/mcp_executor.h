@@ -0,0 +1,94 @@
+/*
+ * MCP Tool Executor
+ *
+ * Worker pool for tools/call. The httpd task only parses a request and
+ * queues it; workers run the tool and deliver the response themselves, so
+ * a long lua_exec no longer holds up every other client. Jobs sit in two
+ * lanes: read-only calls (get_status, sys_get_logs, ...) always go first,
+ * and one worker is kept back from the normal lane so they never wait
+ * behind a slow call. Queued and running jobs can be cancelled with
+ * notifications/cancelled.
+ */
+
+#ifndef MCP_EXECUTOR_H
+#define MCP_EXECUTOR_H
+
+#include <stdbool.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Job lanes, in the order workers take them
+ */
+typedef enum {
+    MCP_LANE_FAST = 0,      // Read-only tools
+    MCP_LANE_NORMAL,        // Everything else
+    MCP_LANE_COUNT
+} mcp_lane_t;
+
+/**
+ * Queued unit of work
+ *
+ * Embed as the first member of a heap-allocated job; the executor frees
+ * the whole block after run() or discard() returns.
+ */
+typedef struct mcp_job {
+    void (*run)(struct mcp_job *job);       // Runs on a worker
+    void (*discard)(struct mcp_job *job);   // Cancelled or refused before running (optional)
+    int origin;                             // Session the request arrived on (MCP_SESSION_ORIGIN)
+    int id;                                 // JSON-RPC id to cancel by, or -1
+    mcp_lane_t lane;
+    volatile bool cancelled;                // Set by mcp_executor_cancel() while running
+    struct mcp_job *next;                   // Queue link (executor private)
+} mcp_job_t;
+
+/**
+ * Start the worker tasks (safe to call more than once)
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t mcp_executor_init(void);
+
+/**
+ * Queue a job
+ *
+ * @param job Job to run; on failure it is left to the caller
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if not started, or
+ *         ESP_ERR_NO_MEM if the queue is full
+ */
+esp_err_t mcp_executor_submit(mcp_job_t *job);
+
+/**
+ * Cancel a request
+ * A queued job is removed and discarded; a running one has its cancelled
+ * flag set and is expected to stop early.
+ *
+ * @param origin Session the request arrived on
+ * @param id JSON-RPC id of the request
+ * @return true if a matching job was found
+ */
+bool mcp_executor_cancel(int origin, int id);
+
+/**
+ * Cancel every request from one origin (its session went away)
+ *
+ * @param origin Connection or session the requests arrived on
+ * @return Number of jobs found
+ */
+int mcp_executor_cancel_origin(int origin);
+
+/**
+ * Cancelled flag of the job running on the calling task
+ *
+ * @return Pointer to the flag, or NULL when not called from a worker
+ */
+const volatile bool *mcp_executor_cancel_flag(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MCP_EXECUTOR_H
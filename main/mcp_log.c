@@ -3,38 +3,173 @@
  *
  * Hooks into ESP-IDF logging via esp_log_set_vprintf() and stores
  * recent log lines in a ring buffer for retrieval by the sys_get_logs tool.
+ *
+ * The hook formats each line once, into a staging slot, and returns
+ * without taking a lock or touching the console. A low-priority drain
+ * task copies staged lines to the console and into the ring, so a task
+ * that logs never waits on the ring mutex or on a slow UART. When the
+ * staging queue is full (or before the drain task exists) the line is
+ * printed and stored in the caller's context instead, as before.
+ *
+ * In deferred mode (log_defer.h) the hook does not format at all: it
+ * copies the format pointer and arguments into the slot, and the line is
+ * rendered when the drain task prints it and whenever it is read back.
  */
 
 #include "mcp_log.h"
+#include "log_defer.h"
 #include <string.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <esp_log.h>
 #include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "mcp_mem.h"
+#include "mcp_arena.h"
 #include "sdkconfig.h"
 
 #ifndef CONFIG_MCP_LOG_BUFFER_SIZE
-#define CONFIG_MCP_LOG_BUFFER_SIZE 4096
+#define CONFIG_MCP_LOG_BUFFER_SIZE 16384
+#endif
+#ifndef CONFIG_MCP_LOG_STAGING_LINES
+#define CONFIG_MCP_LOG_STAGING_LINES 16
+#endif
+#ifndef CONFIG_MCP_LOG_DRAIN_PRIORITY
+#define CONFIG_MCP_LOG_DRAIN_PRIORITY 1
+#endif
+// Unset bool options are not defined at all
+#ifndef CONFIG_MCP_LOG_DEFERRED
+#define CONFIG_MCP_LOG_DEFERRED 0
 #endif
 
-#define LOG_LINE_MAX 256
-#define LOG_MAX_LINES (CONFIG_MCP_LOG_BUFFER_SIZE / 64)
+#define LOG_LINE_MAX MCP_LOG_LINE_MAX
+#define LOG_RING_MIN 4096       // Smaller settings from the old line-slot ring are raised to this
+#define LOG_RING_SIZE (CONFIG_MCP_LOG_BUFFER_SIZE < LOG_RING_MIN ? LOG_RING_MIN : CONFIG_MCP_LOG_BUFFER_SIZE)
+#define LOG_TAGS 64             // Distinct tags stored compactly; lines of later tags are kept verbatim
+#define LOG_TAG_MAX 20
+#define LOG_TAG_RAW 0xFF        // Record holds the whole line
+#define LOG_TAG_DEFERRED 0xFE   // Record holds a log_defer record
+#define LOG_HDR_MAX 9           // Length (2), level (1), tag (1), timestamp delta (up to 5)
+#define LOG_PICK_MAX 128        // Lines one sys_get_logs call can return
+#define LOG_IDX_LINES 32        // Records per index block
+#define LOG_IDX_BLOCKS (LOG_RING_SIZE / (LOG_IDX_LINES * 16))  // Covers the ring at 16+ bytes per line
+#define LOG_DROP_MARKS 8        // Places in the sequence where lines were dropped
+#define LOG_QUERY_TAGS 8        // Tags one sys_get_logs call can name (each of tags / exclude_tags)
+#define LOG_STAGE_SLOTS CONFIG_MCP_LOG_STAGING_LINES
+#define LOG_DRAIN_STACK 4096
+#define LOG_CONSOLE_MAX (2 * LOG_LINE_MAX)     // Longest deferred line printed whole
 
 static const char *TAG = "mcp_log";
 
+/*
+ * Records are packed back to back in a byte ring and evicted oldest first:
+ *
+ *   u16 text length | u8 level | u8 tag | varint timestamp delta | text
+ *
+ * For a standard "L (ms) tag: message" line only the message is stored;
+ * the prefix is rebuilt from level, tag and timestamp when read. The delta
+ * is zigzag-encoded against the previous record, so a record's timestamp
+ * is known only by walking from the oldest one.
+ */
+typedef struct {
+    size_t size;                 // Whole record
+    size_t text_off;             // Ring offset of the text
+    uint16_t text_len;
+    uint8_t level;
+    uint8_t tag;
+    uint32_t ts;                 // Milliseconds since boot
+} log_rec_t;
+
+// A record and what decoding it needs (s_log_mutex held while used)
 typedef struct {
+    size_t off;
+    uint32_t seq;
+    uint32_t prev_ts;            // Timestamp of the record before
+} log_pos_t;
+
+static uint8_t *s_log_ring = NULL;   // LOG_RING_SIZE bytes, placed by mcp_mem
+static size_t s_log_tail = 0;        // Offset of the oldest record
+static size_t s_log_used = 0;        // Bytes in use
+static uint32_t s_log_count = 0;     // Records stored
+static uint32_t s_log_seq = 0;       // Records ever stored; the oldest is s_log_seq - s_log_count
+static uint32_t s_tail_base_ts = 0;  // Timestamp of the record before the oldest
+static uint32_t s_head_ts = 0;       // Timestamp of the newest record
+static log_pos_t s_cursor;           // Where mcp_log_read stopped, to resume without a walk
+static uint32_t s_restart_seq = 0;   // first entry of the current generation (last Lua restart)
+static char s_tags[LOG_TAGS][LOG_TAG_MAX];
+static int s_tag_count = 0;
+
+/*
+ * Block index over the ring: each run of LOG_IDX_LINES consecutive
+ * records has a summary of the levels and tags in it and its time range,
+ * updated as records are appended. sys_get_logs skips a block that
+ * cannot match without decoding or rendering any of its records.
+ * Deferred records are indexed by the tag of their rendered line. Records
+ * older than the oldest block (only when the ring holds very short
+ * lines) are walked one by one.
+ */
+typedef struct {
+    uint32_t first_seq;
+    uint32_t off;                // Ring offset of the first record
+    uint32_t base_ts;            // Timestamp of the record before it
+    uint32_t ts_min;
+    uint32_t ts_max;
+    uint32_t tags[2];            // Bit per interned tag id
+    uint16_t count;              // Records in the block, LOG_IDX_LINES unless it is the newest
+    uint8_t levels;              // Bit per level
+    bool untagged;               // Holds lines without an interned tag
+} log_block_t;
+
+static log_block_t *s_idx = NULL;    // LOG_IDX_BLOCKS summaries, a ring
+static uint32_t s_idx_head = 0;      // Newest block
+static uint32_t s_idx_count = 0;
+static SemaphoreHandle_t s_log_mutex = NULL;   // Ring: drain task (or sync fallback) and readers
+
+/*
+ * Lines the sync fallback could not store because the ring stayed locked.
+ * They have no seq; the count is noted against the seq the next stored
+ * line gets, so sys_get_logs can add them to "missed" for a cursor before
+ * that point. When the marks run out, those before the oldest stored line
+ * are discarded, or else the two oldest merge into the later one, which
+ * can only overstate what a reader missed.
+ */
+typedef struct {
+    uint32_t seq;
+    uint32_t count;
+} log_drop_mark_t;
+
+static atomic_uint_least32_t s_drop_pending = 0;
+static log_drop_mark_t s_drops[LOG_DROP_MARKS];
+static int s_drop_count = 0;
+
+/*
+ * Staging queue between logging tasks and the drain task (a bounded
+ * multi-producer queue). A producer claims slot n by advancing the head
+ * with one compare-and-swap while the slot's seq equals n, formats into
+ * it, and publishes it by setting seq to n + 1. The drain task consumes
+ * in order and frees the slot by setting seq to n + LOG_STAGE_SLOTS.
+ */
+typedef struct {
+    atomic_uint_least32_t seq;
+    uint32_t ts;                 // Capture time, for lines without a prefix
+    uint16_t len;
+    bool printed;                // Already on the console (longer than a slot)
+    bool deferred;               // text holds a log_defer record, not a line
     char text[LOG_LINE_MAX];
-    esp_log_level_t level;
-    int64_t timestamp_ms;
-} log_entry_t;
-
-static log_entry_t s_log_ring[LOG_MAX_LINES];
-static int s_log_head = 0;       // next write index
-static int s_log_count = 0;      // total entries stored
-static SemaphoreHandle_t s_log_mutex = NULL;
+} log_slot_t;
+
+static log_slot_t *s_stage = NULL;
+static atomic_uint_least32_t s_stage_head = 0;
+static SemaphoreHandle_t s_drain_wake = NULL;   // Set once the drain task runs
+static atomic_bool s_drain_idle = false;        // Drain task is (about to be) asleep on s_drain_wake
+static volatile bool s_log_deferred = CONFIG_MCP_LOG_DEFERRED;
 static vprintf_like_t s_original_vprintf = NULL;
+static volatile mcp_log_listener_t s_listener = NULL;
+static volatile mcp_log_tap_t s_tap = NULL;
 
 /* Detect log level from the ESP-IDF color-coded prefix character */
 static esp_log_level_t detect_level_from_prefix(const char *str)
@@ -50,10 +185,379 @@ static esp_log_level_t detect_level_from_prefix(const char *str)
     }
 }
 
-/* Custom vprintf hook — captures log output into ring buffer */
-static int log_vprintf_hook(const char *fmt, va_list args)
+static char level_letter(uint8_t level)
+{
+    static const char letters[] = "NEWIDV";
+    return level < sizeof(letters) - 1 ? letters[level] : 'I';
+}
+
+/* --- Packed ring (s_log_mutex held) --- */
+
+static void ring_put(size_t off, const void *src, size_t n)
+{
+    off %= LOG_RING_SIZE;
+    size_t first = LOG_RING_SIZE - off;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(s_log_ring + off, src, first);
+    memcpy(s_log_ring, (const uint8_t *)src + first, n - first);
+}
+
+static void ring_get(size_t off, void *dst, size_t n)
+{
+    off %= LOG_RING_SIZE;
+    size_t first = LOG_RING_SIZE - off;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(dst, s_log_ring + off, first);
+    memcpy((uint8_t *)dst + first, s_log_ring, n - first);
+}
+
+static void log_decode(const log_pos_t *pos, log_rec_t *rec)
+{
+    uint8_t hdr[4];
+    ring_get(pos->off, hdr, sizeof(hdr));
+    rec->text_len = (uint16_t)(hdr[0] | (hdr[1] << 8));
+    rec->level = hdr[2];
+    rec->tag = hdr[3];
+
+    uint32_t zz = 0;
+    size_t n = 4;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t b = s_log_ring[(pos->off + n++) % LOG_RING_SIZE];
+        zz |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            break;
+        }
+    }
+    int32_t delta = (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+    rec->ts = pos->prev_ts + (uint32_t)delta;
+    rec->text_off = pos->off + n;
+    rec->size = n + rec->text_len;
+}
+
+static void log_first(log_pos_t *pos)
+{
+    pos->off = s_log_tail;
+    pos->seq = s_log_seq - s_log_count;
+    pos->prev_ts = s_tail_base_ts;
+}
+
+static void log_advance(log_pos_t *pos, const log_rec_t *rec)
+{
+    pos->off = (pos->off + rec->size) % LOG_RING_SIZE;
+    pos->seq++;
+    pos->prev_ts = rec->ts;
+}
+
+// Position of record seq, which must be stored
+static void log_seek(uint32_t seq, log_pos_t *pos)
+{
+    uint32_t oldest = s_log_seq - s_log_count;
+    if ((int32_t)(s_cursor.seq - oldest) >= 0 && (int32_t)(seq - s_cursor.seq) >= 0) {
+        *pos = s_cursor;
+    } else {
+        log_first(pos);
+    }
+    while (pos->seq != seq) {
+        log_rec_t rec;
+        log_decode(pos, &rec);
+        log_advance(pos, &rec);
+    }
+}
+
+static void log_evict_oldest(void)
+{
+    log_pos_t pos;
+    log_rec_t rec;
+    log_first(&pos);
+    log_decode(&pos, &rec);
+    s_tail_base_ts = rec.ts;
+    s_log_tail = (s_log_tail + rec.size) % LOG_RING_SIZE;
+    s_log_used -= rec.size;
+    s_log_count--;
+}
+
+static void log_index_tag(log_block_t *b, uint8_t tag)
+{
+    if (tag < LOG_TAGS) {
+        b->tags[tag / 32] |= 1u << (tag % 32);
+    } else if (tag == LOG_TAG_RAW) {
+        b->untagged = true;
+    }
+    // LOG_TAG_DEFERRED: the drain task adds the tag once the line is rendered
+}
+
+static void log_index_add(size_t off, uint8_t level, uint8_t tag, uint32_t ts)
+{
+    log_block_t *b = &s_idx[s_idx_head];
+    if (s_idx_count == 0 || b->count == LOG_IDX_LINES) {
+        s_idx_head = (s_idx_head + 1) % LOG_IDX_BLOCKS;
+        if (s_idx_count < LOG_IDX_BLOCKS) {
+            s_idx_count++;
+        }
+        b = &s_idx[s_idx_head];
+        *b = (log_block_t){
+            .first_seq = s_log_seq, .off = (uint32_t)off, .base_ts = s_head_ts, .ts_min = ts, .ts_max = ts,
+        };
+    }
+    b->count++;
+    b->levels |= (uint8_t)(1u << (level & 7));
+    if (ts < b->ts_min) {
+        b->ts_min = ts;
+    }
+    if (ts > b->ts_max) {
+        b->ts_max = ts;
+    }
+    log_index_tag(b, tag);
+}
+
+// Index block holding stored record seq, or NULL if it is older than the index
+static const log_block_t *log_index_find(uint32_t seq)
+{
+    if (s_idx_count == 0) {
+        return NULL;
+    }
+    const log_block_t *newest = &s_idx[s_idx_head];
+    int32_t back = (int32_t)(newest->first_seq - seq);
+    if (back <= 0) {
+        return newest;
+    }
+    uint32_t blocks = ((uint32_t)back + LOG_IDX_LINES - 1) / LOG_IDX_LINES;
+    if (blocks >= s_idx_count) {
+        return NULL;
+    }
+    return &s_idx[(s_idx_head + LOG_IDX_BLOCKS - blocks) % LOG_IDX_BLOCKS];
+}
+
+// Note lines dropped since the last call before seq s_log_seq (s_log_mutex held)
+static void log_drops_collect(void)
+{
+    uint32_t n = atomic_exchange(&s_drop_pending, 0);
+    if (n == 0) {
+        return;
+    }
+    if (s_drop_count > 0 && s_drops[s_drop_count - 1].seq == s_log_seq) {
+        s_drops[s_drop_count - 1].count += n;
+        return;
+    }
+    if (s_drop_count == LOG_DROP_MARKS) {
+        // Marks before the oldest stored line only add to what eviction reports
+        uint32_t oldest = s_log_seq - s_log_count;
+        int stale = 0;
+        while (stale < s_drop_count && (int32_t)(s_drops[stale].seq - oldest) < 0) {
+            stale++;
+        }
+        if (stale == 0) {
+            s_drops[1].count += s_drops[0].count;
+            stale = 1;
+        }
+        memmove(&s_drops[0], &s_drops[stale], (size_t)(s_drop_count - stale) * sizeof(s_drops[0]));
+        s_drop_count -= stale;
+    }
+    s_drops[s_drop_count++] = (log_drop_mark_t){ .seq = s_log_seq, .count = n };
+}
+
+// Lines dropped between reading up to seq from and up to seq to (s_log_mutex held)
+static uint32_t log_drops_between(uint32_t from, uint32_t to)
+{
+    uint32_t n = 0;
+    for (int i = 0; i < s_drop_count; i++) {
+        if ((int32_t)(s_drops[i].seq - from) >= 0 && (int32_t)(s_drops[i].seq - to) < 0) {
+            n += s_drops[i].count;
+        }
+    }
+    return n;
+}
+
+static void log_append(uint8_t level, uint8_t tag, uint32_t ts, const char *text, size_t len)
+{
+    log_drops_collect();
+    uint8_t hdr[LOG_HDR_MAX];
+    hdr[0] = (uint8_t)(len & 0xFF);
+    hdr[1] = (uint8_t)(len >> 8);
+    hdr[2] = level;
+    hdr[3] = tag;
+    int32_t delta = (int32_t)(ts - s_head_ts);
+    uint32_t zz = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+    size_t n = 4;
+    do {
+        hdr[n++] = (uint8_t)((zz & 0x7F) | (zz > 0x7F ? 0x80 : 0));
+        zz >>= 7;
+    } while (zz);
+
+    size_t size = n + len;
+    while (LOG_RING_SIZE - s_log_used < size) {
+        log_evict_oldest();
+    }
+    size_t off = s_log_tail + s_log_used;
+    ring_put(off, hdr, n);
+    ring_put(off + n, text, len);
+    log_index_add(off % LOG_RING_SIZE, level, tag, ts);
+    s_log_used += size;
+    s_log_count++;
+    s_log_seq++;
+    s_head_ts = ts;
+}
+
+// Tag index of an interned tag, or LOG_TAG_RAW
+static uint8_t log_tag_find(const char *tag, size_t len)
+{
+    for (int i = 0; i < s_tag_count; i++) {
+        if (strncmp(s_tags[i], tag, len) == 0 && s_tags[i][len] == '\0') {
+            return (uint8_t)i;
+        }
+    }
+    return LOG_TAG_RAW;
+}
+
+// Tag index of a line prefix, interned on first use (LOG_TAG_RAW when full)
+static uint8_t log_tag_id(const char *tag, size_t len)
+{
+    uint8_t id = log_tag_find(tag, len);
+    if (id != LOG_TAG_RAW || s_tag_count == LOG_TAGS) {
+        return id;
+    }
+    memcpy(s_tags[s_tag_count], tag, len);
+    s_tags[s_tag_count][len] = '\0';
+    return (uint8_t)s_tag_count++;
+}
+
+// Split "L (ms) tag: message"; false for anything that would not rebuild exactly
+static bool log_split_prefix(const char *line, uint32_t *ts, const char **tag, size_t *tag_len,
+                             const char **msg)
+{
+    if (line[0] == '\0' || !strchr("EWIDV", line[0]) || line[1] != ' ' || line[2] != '(' ||
+        line[3] < '0' || line[3] > '9' || (line[3] == '0' && line[4] != ')')) {
+        return false;   // Not the format, or a leading zero the rebuild would lose
+    }
+    char *end;
+    unsigned long ms = strtoul(line + 3, &end, 10);
+    if (end[0] != ')' || end[1] != ' ' || end - (line + 3) > 10 || ms > UINT32_MAX) {
+        return false;
+    }
+    const char *t = end + 2;
+    const char *colon = strstr(t, ": ");
+    if (!colon || colon == t || (size_t)(colon - t) >= LOG_TAG_MAX) {
+        return false;
+    }
+    *ts = (uint32_t)ms;
+    *tag = t;
+    *tag_len = (size_t)(colon - t);
+    *msg = colon + 2;
+    return true;
+}
+
+// Rebuild the captured line of a record into text (LOG_LINE_MAX bytes)
+static void log_render(const log_rec_t *rec, char *text)
+{
+    size_t n = 0;
+    if (rec->tag == LOG_TAG_DEFERRED) {
+        uint8_t record[LOG_LINE_MAX];
+        size_t size = rec->text_len < sizeof(record) ? rec->text_len : sizeof(record);
+        ring_get(rec->text_off, record, size);
+        n = log_defer_render(record, size, text, LOG_LINE_MAX);
+        while (n > 0 && (text[n - 1] == '\n' || text[n - 1] == '\r')) {
+            text[--n] = '\0';
+        }
+        return;
+    }
+    if (rec->tag != LOG_TAG_RAW) {
+        int p = snprintf(text, LOG_LINE_MAX, "%c (%u) %s: ", level_letter(rec->level),
+                         (unsigned)rec->ts, s_tags[rec->tag]);
+        n = (p < 0) ? 0 : ((size_t)p < LOG_LINE_MAX ? (size_t)p : LOG_LINE_MAX - 1);
+    }
+    size_t len = rec->text_len;
+    if (len > LOG_LINE_MAX - 1 - n) {
+        len = LOG_LINE_MAX - 1 - n;
+    }
+    ring_get(rec->text_off, text + n, len);
+    text[n + len] = '\0';
+}
+
+/* --- Capture path --- */
+
+// Hand the line just stored to the tap (s_log_mutex held)
+static void log_tap(uint8_t level, uint32_t ts, const char *line, size_t len)
+{
+    mcp_log_tap_t tap = s_tap;
+    if (tap) {
+        tap(s_log_seq - 1, (esp_log_level_t)level, ts, line, len);
+    }
+}
+
+// Store one formatted line in the packed ring (s_log_mutex held)
+static void log_store(char *line, size_t len, uint32_t capture_ts)
+{
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+        line[--len] = '\0';
+    }
+    if (len == 0) {
+        return;
+    }
+
+    uint32_t ts;
+    const char *tag;
+    size_t tag_len;
+    const char *msg;
+    bool split = log_split_prefix(line, &ts, &tag, &tag_len, &msg);
+    uint8_t level = (uint8_t)detect_level_from_prefix(line);
+    uint8_t tag_id = split ? log_tag_id(tag, tag_len) : LOG_TAG_RAW;
+    if (!split) {
+        ts = capture_ts;
+    }
+    if (tag_id == LOG_TAG_RAW) {
+        log_append(level, LOG_TAG_RAW, ts, line, len);
+    } else {
+        log_append(level, tag_id, ts, msg, len - (size_t)(msg - line));
+    }
+    log_tap(level, ts, line, len);
+}
+
+static void log_notify(void)
+{
+    mcp_log_listener_t listener = s_listener;
+    if (listener) {
+        listener();
+    }
+}
+
+// Console output of text that is already formatted
+static void console_write(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    s_original_vprintf(fmt, args);
+    va_end(args);
+}
+
+// Claim the next staging slot, or NULL when the drain task is a full queue behind
+static log_slot_t *stage_claim(uint32_t *pos)
+{
+    uint_least32_t head = atomic_load_explicit(&s_stage_head, memory_order_relaxed);
+    for (;;) {
+        log_slot_t *slot = &s_stage[head % LOG_STAGE_SLOTS];
+        uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int32_t diff = (int32_t)(seq - head);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&s_stage_head, &head, head + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *pos = head;
+                return slot;
+            }
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            head = atomic_load_explicit(&s_stage_head, memory_order_relaxed);
+        }
+    }
+}
+
+// Queue full, or no drain task yet: print and store in the caller's context
+static int log_capture_sync(const char *fmt, va_list args)
 {
-    /* Always forward to original output first */
     int ret = 0;
     if (s_original_vprintf) {
         va_list args_copy;
@@ -62,47 +566,228 @@ static int log_vprintf_hook(const char *fmt, va_list args)
         va_end(args_copy);
     }
 
-    /* Format the log line */
     char line[LOG_LINE_MAX];
-    vsnprintf(line, sizeof(line), fmt, args);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    if (n <= 0) {
+        return ret;
+    }
+    size_t len = (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1;
+    uint32_t now = (uint32_t)(esp_timer_get_time() / 1000);
+    if (!s_log_mutex) {
+        return ret;
+    }
+    if (xSemaphoreTake(s_log_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
+        log_store(line, len, now);
+        xSemaphoreGive(s_log_mutex);
+        log_notify();
+    } else {
+        atomic_fetch_add(&s_drop_pending, 1);   // Reported as missed by sys_get_logs
+    }
+    return ret;
+}
 
-    /* Strip trailing newline */
-    size_t len = strlen(line);
-    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
-        line[--len] = '\0';
+/*
+ * Formats straight into a staging slot (or, deferred, only encodes the
+ * arguments) and returns; the console write and the ring insert happen
+ * in the drain task. A line longer than a slot goes to the console in
+ * full here, and only its stored copy is truncated.
+ */
+static int log_vprintf_hook(const char *fmt, va_list args)
+{
+    uint32_t pos;
+    log_slot_t *slot = s_drain_wake ? stage_claim(&pos) : NULL;
+    if (!slot) {
+        return log_capture_sync(fmt, args);
     }
-    if (len == 0) return ret;
 
-    /* Store in ring buffer */
-    if (s_log_mutex && xSemaphoreTake(s_log_mutex, pdMS_TO_TICKS(10)) == pdTRUE) {
-        log_entry_t *entry = &s_log_ring[s_log_head];
-        strncpy(entry->text, line, LOG_LINE_MAX - 1);
-        entry->text[LOG_LINE_MAX - 1] = '\0';
-        entry->level = detect_level_from_prefix(line);
-        entry->timestamp_ms = esp_timer_get_time() / 1000;
+    slot->ts = (uint32_t)(esp_timer_get_time() / 1000);
+    slot->printed = false;
+    size_t size = s_log_deferred ? log_defer_encode((uint8_t *)slot->text, sizeof(slot->text), fmt, args) : 0;
+    slot->deferred = size > 0;
+    int n = 0;
+    if (slot->deferred) {
+        // The line is formatted later; report the bytes taken by the record
+        slot->len = (uint16_t)size;
+        n = (int)size;
+    } else {
+        va_list args_copy;
+        va_copy(args_copy, args);
+        n = vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+        if (n >= (int)sizeof(slot->text) && s_original_vprintf) {
+            s_original_vprintf(fmt, args_copy);
+            slot->printed = true;
+        }
+        va_end(args_copy);
+        slot->len = n <= 0 ? 0 : (n < (int)sizeof(slot->text) ? (uint16_t)n : sizeof(slot->text) - 1);
+    }
 
-        s_log_head = (s_log_head + 1) % LOG_MAX_LINES;
-        if (s_log_count < LOG_MAX_LINES) s_log_count++;
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&s_drain_idle, false)) {
+        xSemaphoreGive(s_drain_wake);   // Only a sleeping drain task needs the semaphore
+    }
+    return n;
+}
 
-        xSemaphoreGive(s_log_mutex);
+static void log_drain_deferred(const log_slot_t *slot)
+{
+    const uint8_t *record = (const uint8_t *)slot->text;
+    char line[LOG_CONSOLE_MAX];
+    size_t n = log_defer_render(record, slot->len, line, sizeof(line));
+    if (n > 0) {
+        console_write("%.*s", (int)n, line);
+    }
+    while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) {
+        n--;
     }
+    uint8_t level = (uint8_t)detect_level_from_prefix(log_defer_format(record, slot->len));
+    uint32_t ts;
+    const char *tag;
+    size_t tag_len;
+    const char *msg;
+    bool split = log_split_prefix(line, &ts, &tag, &tag_len, &msg);
+    xSemaphoreTake(s_log_mutex, portMAX_DELAY);
+    log_append(level, LOG_TAG_DEFERRED, slot->ts, slot->text, slot->len);
+    log_index_tag(&s_idx[s_idx_head], split ? log_tag_id(tag, tag_len) : LOG_TAG_RAW);
+    log_tap(level, slot->ts, line, n);
+    xSemaphoreGive(s_log_mutex);
+}
 
-    return ret;
+static void log_drain_task(void *arg)
+{
+    SemaphoreHandle_t wake = arg;
+    uint32_t tail = 0;
+    for (;;) {
+        log_slot_t *slot = &s_stage[tail % LOG_STAGE_SLOTS];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tail + 1) {
+            // Empty, or its producer is still formatting: sleep, then look again
+            atomic_store(&s_drain_idle, true);
+            atomic_thread_fence(memory_order_seq_cst);
+            if (atomic_load_explicit(&slot->seq, memory_order_acquire) != tail + 1) {
+                xSemaphoreTake(wake, portMAX_DELAY);
+            }
+            atomic_store(&s_drain_idle, false);
+            continue;
+        }
+
+        if (slot->deferred) {
+            log_drain_deferred(slot);
+        } else {
+            if (!slot->printed && slot->len > 0) {
+                console_write("%.*s", (int)slot->len, slot->text);
+            }
+            xSemaphoreTake(s_log_mutex, portMAX_DELAY);
+            log_store(slot->text, slot->len, slot->ts);
+            xSemaphoreGive(s_log_mutex);
+        }
+        atomic_store_explicit(&slot->seq, tail + LOG_STAGE_SLOTS, memory_order_release);
+        tail++;
+        log_notify();
+    }
 }
 
 esp_err_t mcp_log_init(void)
 {
+    /* The hook stores lines only once the mutex exists, so the ring comes first */
+    s_log_ring = mcp_mem_malloc(MCP_MEM_LOG, LOG_RING_SIZE);
+    s_stage = mcp_mem_malloc(MCP_MEM_LOG, LOG_STAGE_SLOTS * sizeof(log_slot_t));
+    s_idx = mcp_mem_calloc(MCP_MEM_LOG, LOG_IDX_BLOCKS, sizeof(log_block_t));
     s_log_mutex = xSemaphoreCreateMutex();
-    if (!s_log_mutex) {
+    SemaphoreHandle_t wake = xSemaphoreCreateBinary();
+    if (!s_log_ring || !s_stage || !s_idx || !s_log_mutex || !wake) {
+        if (wake) {
+            vSemaphoreDelete(wake);
+        }
+        if (s_log_mutex) {
+            vSemaphoreDelete(s_log_mutex);
+            s_log_mutex = NULL;
+        }
+        mcp_mem_free(MCP_MEM_LOG, s_idx);
+        mcp_mem_free(MCP_MEM_LOG, s_stage);
+        mcp_mem_free(MCP_MEM_LOG, s_log_ring);
+        s_idx = NULL;
+        s_stage = NULL;
+        s_log_ring = NULL;
         return ESP_ERR_NO_MEM;
     }
+    for (uint32_t i = 0; i < LOG_STAGE_SLOTS; i++) {
+        atomic_init(&s_stage[i].seq, i);
+    }
 
-    /* Hook into ESP-IDF logging */
+    /* Hook into ESP-IDF logging; lines are stored synchronously until the drain task runs */
     s_original_vprintf = esp_log_set_vprintf(log_vprintf_hook);
-    ESP_LOGI(TAG, "Log capture initialized (ring buffer: %d entries)", LOG_MAX_LINES);
+    if (xTaskCreate(log_drain_task, "mcp_log", LOG_DRAIN_STACK, wake,
+                    CONFIG_MCP_LOG_DRAIN_PRIORITY, NULL) != pdPASS) {
+        vSemaphoreDelete(wake);
+        ESP_LOGW(TAG, "No drain task; logging stays synchronous");
+    } else {
+        s_drain_wake = wake;
+    }
+    ESP_LOGI(TAG, "Log capture initialized (%d byte packed ring, %d staging slots)",
+             LOG_RING_SIZE, LOG_STAGE_SLOTS);
     return ESP_OK;
 }
 
+void mcp_log_set_deferred(bool deferred)
+{
+    s_log_deferred = deferred;
+}
+
+void mcp_log_set_listener(mcp_log_listener_t listener)
+{
+    s_listener = listener;
+}
+
+void mcp_log_set_tap(mcp_log_tap_t tap)
+{
+    s_tap = tap;
+}
+
+uint32_t mcp_log_next_seq(void)
+{
+    return s_log_seq;
+}
+
+void mcp_log_mark_generation(void)
+{
+    if (s_log_mutex && xSemaphoreTake(s_log_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+        s_restart_seq = s_log_seq;
+        xSemaphoreGive(s_log_mutex);
+    }
+}
+
+esp_err_t mcp_log_read(uint32_t seq, mcp_log_line_t *line)
+{
+    if (!line) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_log_mutex || xSemaphoreTake(s_log_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    if ((int32_t)(s_log_seq - seq) > 0) {
+        uint32_t oldest = s_log_seq - s_log_count;
+        if ((int32_t)(seq - oldest) < 0) {
+            seq = oldest;
+        }
+        log_pos_t pos;
+        log_rec_t rec;
+        log_seek(seq, &pos);
+        log_decode(&pos, &rec);
+        line->seq = seq;
+        line->level = (esp_log_level_t)rec.level;
+        line->timestamp_ms = rec.ts;
+        log_render(&rec, line->text);
+        log_advance(&pos, &rec);
+        s_cursor = pos;
+        ret = ESP_OK;
+    }
+
+    xSemaphoreGive(s_log_mutex);
+    return ret;
+}
+
 static esp_log_level_t parse_level_string(const char *level_str)
 {
     if (!level_str) return ESP_LOG_INFO;
@@ -114,12 +799,132 @@ static esp_log_level_t parse_level_string(const char *level_str)
     return ESP_LOG_INFO;
 }
 
-esp_err_t tool_sys_get_logs(cJSON *args, char *result, size_t max_len)
+typedef struct {
+    uint32_t seq;
+    uint32_t ts;
+    size_t off;
+} log_pick_t;
+
+// What sys_get_logs selects; tag ids are resolved under s_log_mutex
+typedef struct {
+    uint8_t levels;              // Bit per matching level
+    uint32_t ts_from;
+    uint32_t ts_to;
+    const char *filter;          // Substrings the rendered line must / must not contain
+    const char *exclude;
+    const char *tags[LOG_QUERY_TAGS];
+    int tag_count;
+    const char *exclude_tags[LOG_QUERY_TAGS];
+    int exclude_tag_count;
+    uint32_t tag_ids[2];         // Bits of the interned tags and exclude_tags
+    uint32_t exclude_ids[2];
+} log_query_t;
+
+// Tag names from a string or an array of strings
+static int parse_tag_list(cJSON *item, const char **names)
+{
+    int count = 0;
+    if (cJSON_IsString(item)) {
+        names[count++] = item->valuestring;
+    } else if (cJSON_IsArray(item)) {
+        cJSON *name;
+        cJSON_ArrayForEach(name, item) {
+            if (cJSON_IsString(name) && count < LOG_QUERY_TAGS) {
+                names[count++] = name->valuestring;
+            }
+        }
+    }
+    return count;
+}
+
+static void resolve_tag_ids(const char *const *names, int count, uint32_t *ids)
+{
+    ids[0] = ids[1] = 0;
+    for (int i = 0; i < count; i++) {
+        size_t len = strlen(names[i]);
+        uint8_t id = len < LOG_TAG_MAX ? log_tag_find(names[i], len) : LOG_TAG_RAW;
+        if (id < LOG_TAGS) {
+            ids[id / 32] |= 1u << (id % 32);
+        }
+    }
+}
+
+static bool tag_listed(const char *const *names, int count, const char *tag, size_t len)
+{
+    for (int i = 0; i < count; i++) {
+        if (strncmp(names[i], tag, len) == 0 && names[i][len] == '\0') {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool log_block_may_match(const log_block_t *b, const log_query_t *q)
+{
+    if (!(b->levels & q->levels) || b->ts_max < q->ts_from || b->ts_min > q->ts_to) {
+        return false;
+    }
+    if (b->untagged) {
+        return true;
+    }
+    if (q->tag_count > 0 && !((b->tags[0] & q->tag_ids[0]) | (b->tags[1] & q->tag_ids[1]))) {
+        return false;
+    }
+    return !((b->tags[0] & ~q->exclude_ids[0]) == 0 && (b->tags[1] & ~q->exclude_ids[1]) == 0);
+}
+
+// Whether a record is selected; text (LOG_LINE_MAX bytes) is scratch for rendering
+static bool log_record_matches(const log_rec_t *rec, const log_query_t *q, char *text)
+{
+    if (!(q->levels & (1u << (rec->level & 7))) || rec->ts < q->ts_from || rec->ts > q->ts_to) {
+        return false;
+    }
+    bool rendered = false;
+    if (q->tag_count > 0 || q->exclude_tag_count > 0) {
+        bool listed;
+        bool excluded;
+        if (rec->tag < LOG_TAGS) {
+            listed = q->tag_ids[rec->tag / 32] & (1u << (rec->tag % 32));
+            excluded = q->exclude_ids[rec->tag / 32] & (1u << (rec->tag % 32));
+        } else {
+            // Deferred or verbatim: the tag is only in the rendered prefix
+            log_render(rec, text);
+            rendered = true;
+            uint32_t ts;
+            const char *tag;
+            size_t tag_len;
+            const char *msg;
+            if (log_split_prefix(text, &ts, &tag, &tag_len, &msg)) {
+                listed = tag_listed(q->tags, q->tag_count, tag, tag_len);
+                excluded = tag_listed(q->exclude_tags, q->exclude_tag_count, tag, tag_len);
+            } else {
+                listed = excluded = false;
+            }
+        }
+        if ((q->tag_count > 0 && !listed) || excluded) {
+            return false;
+        }
+    }
+    if (q->filter || q->exclude) {
+        if (!rendered) {
+            log_render(rec, text);
+        }
+        if ((q->filter && !strstr(text, q->filter)) || (q->exclude && strstr(text, q->exclude))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t tool_sys_get_logs(cJSON *args, mcp_result_t *result)
 {
     /* Parse parameters */
     esp_log_level_t min_level = ESP_LOG_INFO;
     int max_lines = 20;
-    const char *filter = NULL;
+    log_query_t q = { .ts_to = UINT32_MAX };
+    bool forward = false;           /* Read on from a cursor instead of the tail */
+    uint32_t since_seq = 0;
+    bool since_restart = false;
 
     if (args) {
         cJSON *level_item = cJSON_GetObjectItem(args, "level");
@@ -130,88 +935,170 @@ esp_err_t tool_sys_get_logs(cJSON *args, char *result, size_t max_len)
         if (lines_item && cJSON_IsNumber(lines_item)) {
             max_lines = lines_item->valueint;
             if (max_lines < 1) max_lines = 1;
-            if (max_lines > LOG_MAX_LINES) max_lines = LOG_MAX_LINES;
+            if (max_lines > LOG_PICK_MAX) max_lines = LOG_PICK_MAX;
         }
         cJSON *filter_item = cJSON_GetObjectItem(args, "filter");
         if (filter_item && cJSON_IsString(filter_item)) {
-            filter = filter_item->valuestring;
+            q.filter = filter_item->valuestring;
+        }
+        cJSON *exclude_item = cJSON_GetObjectItem(args, "exclude");
+        if (exclude_item && cJSON_IsString(exclude_item)) {
+            q.exclude = exclude_item->valuestring;
+        }
+        q.tag_count = parse_tag_list(cJSON_GetObjectItem(args, "tags"), q.tags);
+        q.exclude_tag_count = parse_tag_list(cJSON_GetObjectItem(args, "exclude_tags"), q.exclude_tags);
+        cJSON *from_item = cJSON_GetObjectItem(args, "since_t");
+        if (from_item && cJSON_IsNumber(from_item) && from_item->valuedouble > 0) {
+            q.ts_from = (uint32_t)from_item->valuedouble;
+        }
+        cJSON *to_item = cJSON_GetObjectItem(args, "until_t");
+        if (to_item && cJSON_IsNumber(to_item) && to_item->valuedouble >= 0) {
+            q.ts_to = (uint32_t)to_item->valuedouble;
         }
+        cJSON *last_item = cJSON_GetObjectItem(args, "last_s");
+        if (last_item && cJSON_IsNumber(last_item) && last_item->valuedouble > 0) {
+            int64_t from = esp_timer_get_time() / 1000 - (int64_t)(last_item->valuedouble * 1000);
+            if (from > (int64_t)q.ts_from) {
+                q.ts_from = (uint32_t)from;
+            }
+        }
+        cJSON *since_item = cJSON_GetObjectItem(args, "since_seq");
+        if (since_item && cJSON_IsNumber(since_item) && since_item->valuedouble >= 0) {
+            forward = true;
+            since_seq = (uint32_t)since_item->valuedouble;
+        }
+        since_restart = cJSON_IsTrue(cJSON_GetObjectItem(args, "since_restart"));
     }
 
     if (!s_log_mutex) {
-        snprintf(result, max_len, "Log system not initialized");
+        mcp_result_printf(result, "Log system not initialized");
         return ESP_ERR_INVALID_STATE;
     }
+    q.levels = (uint8_t)((2u << min_level) - 1);
+
+    log_pick_t *picked = mcp_arena_alloc((size_t)max_lines * sizeof(log_pick_t));
+    char *text = mcp_arena_alloc(LOG_LINE_MAX);
+    if (!picked || !text) {
+        mcp_arena_free(picked);
+        mcp_arena_free(text);
+        mcp_result_printf(result, "Out of memory");
+        return ESP_ERR_NO_MEM;
+    }
 
-    /* Collect matching entries */
-    int written = 0;
-    written += snprintf(result + written, max_len - written, "[");
+    /* Pick matching records in one walk under the lock, then render each one
+     * before writing it, so the lock is never held while the result sink
+     * sends data to the client. Stored records never move, so a pick stays
+     * valid for as long as its record is not evicted. The walk jumps over
+     * index blocks that cannot match. */
+    int picked_count = 0;
+    int picked_first = 0;           /* Tail mode keeps the last max_lines picks in a ring */
+    uint32_t next_seq = 0;
+    uint32_t restart_seq = 0;
+    uint32_t missed = 0;
 
     if (xSemaphoreTake(s_log_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-        int start = (s_log_count < LOG_MAX_LINES)
-                    ? 0
-                    : s_log_head;
-        int found = 0;
-        bool first = true;
-
-        /* Walk ring buffer from oldest to newest, collect last max_lines matches */
-        /* First pass: count matches to know where to start outputting */
-        int match_count = 0;
-        for (int i = 0; i < s_log_count; i++) {
-            int idx = (start + i) % LOG_MAX_LINES;
-            log_entry_t *e = &s_log_ring[idx];
-            if (e->level > min_level) continue;
-            if (filter && strstr(e->text, filter) == NULL) continue;
-            match_count++;
+        uint32_t oldest = s_log_seq - s_log_count;
+        restart_seq = s_restart_seq;
+        next_seq = s_log_seq;
+        if (since_restart && (!forward || (int32_t)(restart_seq - since_seq) > 0)) {
+            forward = true;
+            since_seq = restart_seq;
+        }
+        uint32_t cursor = since_seq;
+        if (forward) {
+            if ((int32_t)(since_seq - oldest) < 0) {
+                missed = oldest - since_seq;
+                since_seq = oldest;
+            }
+            if ((int32_t)(s_log_seq - since_seq) < 0) {
+                since_seq = s_log_seq;      /* Cursor from the future (reboot) */
+                cursor = since_seq;
+            }
         }
 
-        int skip = (match_count > max_lines) ? (match_count - max_lines) : 0;
-
-        for (int i = 0; i < s_log_count; i++) {
-            int idx = (start + i) % LOG_MAX_LINES;
-            log_entry_t *e = &s_log_ring[idx];
-
-            if (e->level > min_level) continue;
-            if (filter && strstr(e->text, filter) == NULL) continue;
-
-            if (skip > 0) { skip--; continue; }
+        resolve_tag_ids(q.tags, q.tag_count, q.tag_ids);
+        resolve_tag_ids(q.exclude_tags, q.exclude_tag_count, q.exclude_ids);
 
-            /* Escape the text for JSON */
-            if (!first) {
-                written += snprintf(result + written, max_len - written, ",");
+        log_pos_t pos;
+        if (forward) {
+            log_seek(since_seq, &pos);
+        } else {
+            log_first(&pos);
+        }
+        uint32_t block_end = pos.seq;       /* Look the block up on the way in */
+        while (pos.seq != s_log_seq) {
+            if (pos.seq == block_end) {
+                const log_block_t *block = log_index_find(pos.seq);
+                block_end = block ? block->first_seq + block->count : pos.seq + 1;
+                if (block && !log_block_may_match(block, &q)) {
+                    if (block_end == s_log_seq) {
+                        break;
+                    }
+                    const log_block_t *next = &s_idx[(size_t)(block - s_idx + 1) % LOG_IDX_BLOCKS];
+                    pos.off = next->off;
+                    pos.seq = next->first_seq;
+                    pos.prev_ts = next->base_ts;
+                    continue;
+                }
             }
-            first = false;
-
-            /* Simple JSON object per entry */
-            written += snprintf(result + written, max_len - written,
-                "{\"t\":%lld,\"msg\":\"", (long long)e->timestamp_ms);
-
-            /* Escape special chars in message */
-            for (const char *p = e->text; *p && written < (int)(max_len - 20); p++) {
-                if (*p == '"') {
-                    result[written++] = '\\';
-                    result[written++] = '"';
-                } else if (*p == '\\') {
-                    result[written++] = '\\';
-                    result[written++] = '\\';
-                } else if (*p == '\n') {
-                    result[written++] = '\\';
-                    result[written++] = 'n';
+            log_rec_t rec;
+            log_decode(&pos, &rec);
+            if (log_record_matches(&rec, &q, text)) {
+                log_pick_t pick = { .seq = pos.seq, .ts = rec.ts, .off = pos.off };
+                if (picked_count < max_lines) {
+                    picked[picked_count++] = pick;
                 } else {
-                    result[written++] = *p;
+                    picked[picked_first] = pick;
+                    picked_first = (picked_first + 1) % max_lines;
+                }
+                if (forward && picked_count == max_lines) {
+                    next_seq = pos.seq + 1;
+                    break;
                 }
             }
-            written += snprintf(result + written, max_len - written, "\"}");
-
-            found++;
-            if (written >= (int)(max_len - 100)) break;
+            log_advance(&pos, &rec);
+        }
+        if (forward) {
+            log_drops_collect();
+            missed += log_drops_between(cursor, next_seq);
         }
 
         xSemaphoreGive(s_log_mutex);
     }
 
-    written += snprintf(result + written, max_len - written, "]");
-    result[max_len - 1] = '\0';
+    mcp_result_printf(result, "{\"next_seq\":%u,\"restart_seq\":%u,\"missed\":%u,\"lines\":[",
+                      (unsigned)next_seq, (unsigned)restart_seq, (unsigned)missed);
+
+    bool first = true;
+    for (int i = 0; i < picked_count && !result->truncated; i++) {
+        const log_pick_t *pick = &picked[(picked_first + i) % max_lines];
+        bool present = false;
+        if (xSemaphoreTake(s_log_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+            /* Skip records evicted since they were picked */
+            present = (int32_t)(pick->seq - (s_log_seq - s_log_count)) >= 0;
+            if (present) {
+                log_pos_t pos = { .off = pick->off, .seq = pick->seq, .prev_ts = 0 };
+                log_rec_t rec;
+                log_decode(&pos, &rec);
+                rec.ts = pick->ts;
+                log_render(&rec, text);
+            }
+            xSemaphoreGive(s_log_mutex);
+        }
+        if (!present) continue;
+
+        /* Simple JSON object per entry */
+        mcp_result_printf(result, "%s{\"seq\":%u,\"t\":%u,\"msg\":\"",
+                          first ? "" : ",", (unsigned)pick->seq, (unsigned)pick->ts);
+        first = false;
+
+        mcp_result_json_escaped(result, text);
+        mcp_result_puts(result, "\"}");
+    }
+
+    mcp_result_puts(result, "]}");
 
+    mcp_arena_free(text);
+    mcp_arena_free(picked);
     return ESP_OK;
 }
@@ -8,8 +8,12 @@
 #ifndef MCP_LOG_H
 #define MCP_LOG_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <esp_err.h>
+#include <esp_log.h>
 #include <cJSON.h>
+#include "mcp_tools.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,16 +28,95 @@ extern "C" {
  */
 esp_err_t mcp_log_init(void);
 
+#define MCP_LOG_LINE_MAX 256
+
+/**
+ * A captured log line, copied out of the ring buffer
+ */
+typedef struct {
+    uint32_t seq;                       // Sequence number (count of lines before it)
+    esp_log_level_t level;
+    int64_t timestamp_ms;
+    char text[MCP_LOG_LINE_MAX];
+} mcp_log_line_t;
+
+/**
+ * Called after each captured line is stored, normally from the log
+ * drain task. Must be quick and must not log.
+ */
+typedef void (*mcp_log_listener_t)(void);
+
+/**
+ * Switch deferred formatting on or off (CONFIG_MCP_LOG_DEFERRED sets the
+ * default). Deferred lines are stored as format pointer plus arguments
+ * and formatted only when printed by the drain task or read back, which
+ * takes vsnprintf off the logging task. Lines whose format cannot be
+ * deferred are still captured as text.
+ */
+void mcp_log_set_deferred(bool deferred);
+
+/**
+ * Install (or clear with NULL) the new-line listener
+ */
+void mcp_log_set_listener(mcp_log_listener_t listener);
+
+/**
+ * Called with each stored line, rendered and without its newline, while
+ * the ring is locked (normally from the log drain task). Must be quick
+ * and must not log.
+ */
+typedef void (*mcp_log_tap_t)(uint32_t seq, esp_log_level_t level, uint32_t timestamp_ms,
+                              const char *text, size_t len);
+
+/**
+ * Install (or clear with NULL) the stored-line tap
+ */
+void mcp_log_set_tap(mcp_log_tap_t tap);
+
+/**
+ * Sequence number the next captured line will get
+ */
+uint32_t mcp_log_next_seq(void);
+
+/**
+ * Start a new log generation: sys_get_logs with since_restart reads from
+ * the next captured line on (called when the Lua VM restarts)
+ */
+void mcp_log_mark_generation(void);
+
+/**
+ * Copy out the line with sequence number seq. If it has already been
+ * overwritten, the oldest stored line is returned instead (line->seq
+ * tells which one).
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if seq has not been captured yet,
+ *         ESP_ERR_TIMEOUT if the ring stayed locked
+ */
+esp_err_t mcp_log_read(uint32_t seq, mcp_log_line_t *line);
+
 /**
  * Tool handler: sys_get_logs
- * Returns filtered log lines from the ring buffer.
+ * Returns filtered log lines from the ring buffer as
+ * {"next_seq":N,"restart_seq":R,"missed":M,"lines":[{"seq","t","msg"}...]}.
+ * Passing next_seq back as since_seq returns only lines captured since;
+ * missed counts lines overwritten before they could be returned, plus
+ * lines dropped because the ring stayed locked while they were logged.
  *
  * Parameters (via cJSON args):
- *   level  - minimum log level: "error","warn","info","debug","verbose" (default "info")
- *   lines  - max number of lines to return (default 20)
- *   filter - substring match filter (optional)
+ *   level         - minimum log level: "error","warn","info","debug","verbose" (default "info")
+ *   lines         - max number of lines to return (default 20)
+ *   filter        - substring match filter (optional)
+ *   exclude       - skip lines containing this substring (optional)
+ *   tags          - tag or array of up to 8 tags to include (optional)
+ *   exclude_tags  - tag or array of up to 8 tags to skip (optional)
+ *   since_t       - lines with a timestamp (ms since boot) at or after this (optional)
+ *   until_t       - lines with a timestamp at or before this (optional)
+ *   last_s        - lines from the last N seconds (optional)
+ *   since_seq     - lines from this sequence number on, oldest first (optional;
+ *                   without it the most recent lines are returned)
+ *   since_restart - start no earlier than the last Lua VM restart (optional)
  */
-esp_err_t tool_sys_get_logs(cJSON *args, char *result, size_t max_len);
+esp_err_t tool_sys_get_logs(cJSON *args, mcp_result_t *result);
 
 #ifdef __cplusplus
 }
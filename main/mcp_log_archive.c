@@ -0,0 +1,665 @@
+/*
+ * MCP Log Archive Implementation
+ *
+ * The partition is a ring of sector-sized segments used in turn, so
+ * every sector is erased equally often (the wear leveling of a circular
+ * log). A segment starts with a header naming its sequence number and
+ * the boot that started it, followed by records appended until the
+ * next one would not fit:
+ *
+ *   u16 text length | u8 level | u8 CRC-8 | u32 boot | u32 seq | u32 ms | text
+ *
+ * A record with a bad CRC (a write cut short by a reset) ends its
+ * segment. Each boot starts in a fresh segment, so nothing is ever
+ * appended after a torn record.
+ *
+ * The archive task pulls new lines from the RAM ring with mcp_log_read
+ * and programs whole flash pages as they fill; a partial page is written
+ * after CONFIG_MCP_LOG_ARCHIVE_FLUSH_MS. Meanwhile the mcp_log tap copies
+ * every line into a small ring in RTC memory, which survives everything
+ * except a power-on or brownout.
+ */
+
+#include "mcp_log_archive.h"
+#include "mcp_log.h"
+#include "mcp_arena.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_attr.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+static const char *TAG = "mcp_log_archive";
+
+#if CONFIG_MCP_LOG_ARCHIVE
+
+#define ARCH_LABEL          "logs"
+#define ARCH_SUBTYPE        0x40
+#define ARCH_LEVEL          CONFIG_MCP_LOG_ARCHIVE_LEVEL
+#define SEG_SIZE            4096            // One flash sector
+#define SEG_MAX             64
+#define PAGE_SIZE           256             // Flash program page
+#define SEG_MAGIC           0x474F4C4Du     // "MLOG"
+#define TEXT_MAX            (MCP_LOG_LINE_MAX - 1)
+#define POLL_MS             1000
+#define FLUSH_US            ((int64_t)CONFIG_MCP_LOG_ARCHIVE_FLUSH_MS * 1000)
+#define BOOTS_MAX           32              // Boots listed by sys_get_boot_logs
+#define PICK_MAX            128             // Lines one sys_get_boot_logs call can return
+#define RTC_SIZE            CONFIG_MCP_LOG_ARCHIVE_RTC_SIZE
+#define RTC_MAGIC           (0x52544C47u ^ RTC_SIZE)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seg_seq;               // Segments ever started; the highest is the newest
+    uint32_t boot_id;               // Boot that started the segment
+    uint32_t check;                 // ~(magic ^ seg_seq ^ boot_id)
+} seg_hdr_t;
+
+typedef struct {
+    uint16_t len;                   // Text bytes; 0xFFFF where nothing was written
+    uint8_t level;
+    uint8_t crc;                    // Over the rest of the header and the text
+    uint32_t boot_id;
+    uint32_t seq;                   // mcp_log sequence number in that boot
+    uint32_t ts;                    // Milliseconds since that boot
+} rec_hdr_t;
+
+// RTC tail: the same lines as a byte ring, oldest evicted first
+typedef struct {
+    uint16_t len;
+    uint8_t level;
+    uint8_t reserved;
+    uint32_t seq;
+    uint32_t ts;
+} rtc_rec_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t boot_id;
+    volatile uint32_t state;        // head | used << 16, stored at once so a reset cannot split them
+    uint8_t buf[RTC_SIZE];
+} rtc_tail_t;
+
+static RTC_NOINIT_ATTR rtc_tail_t s_rtc;
+
+static const esp_partition_t *s_part = NULL;
+static uint32_t s_seg_count;
+static uint32_t s_seg;              // Segment being written
+static uint32_t s_seg_seq;          // Its sequence number
+static uint32_t s_off;              // Segment offset where s_batch goes
+static uint8_t s_batch[PAGE_SIZE + sizeof(rec_hdr_t) + TEXT_MAX];
+static size_t s_batch_len;
+static int64_t s_batch_us;          // When the batch started to wait
+static uint32_t s_boot_id;
+static uint32_t s_read_seq;         // Next mcp_log line to archive
+static uint32_t s_missed;           // Lines evicted from RAM before they were archived
+static uint32_t s_errors;           // Failed erases and writes
+static SemaphoreHandle_t s_lock = NULL;     // Flash writes and s_* state
+
+// CRC-8 (polynomial 0x07), a nibble at a time
+static uint8_t crc8(uint8_t crc, const void *data, size_t len)
+{
+    static const uint8_t table[16] = {
+        0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+        0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+    };
+    const uint8_t *p = data;
+    while (len--) {
+        crc ^= *p++;
+        crc = (uint8_t)(crc << 4) ^ table[crc >> 4];
+        crc = (uint8_t)(crc << 4) ^ table[crc >> 4];
+    }
+    return crc;
+}
+
+static uint8_t rec_crc(const rec_hdr_t *hdr, const char *text)
+{
+    uint8_t crc = crc8(0, &hdr->len, sizeof(hdr->len));
+    crc = crc8(crc, &hdr->level, sizeof(hdr->level));
+    crc = crc8(crc, &hdr->boot_id, sizeof(*hdr) - offsetof(rec_hdr_t, boot_id));
+    return crc8(crc, text, hdr->len);
+}
+
+/* --- Flash segments (s_lock held, or during init) --- */
+
+static bool seg_header(uint32_t seg, seg_hdr_t *hdr)
+{
+    return esp_partition_read(s_part, seg * SEG_SIZE, hdr, sizeof(*hdr)) == ESP_OK &&
+           hdr->magic == SEG_MAGIC && hdr->check == ~(hdr->magic ^ hdr->seg_seq ^ hdr->boot_id);
+}
+
+// Valid segments, oldest first
+static uint32_t seg_order(uint32_t *order, uint32_t *seqs)
+{
+    uint32_t n = 0;
+    for (uint32_t seg = 0; seg < s_seg_count; seg++) {
+        seg_hdr_t hdr;
+        if (!seg_header(seg, &hdr)) {
+            continue;
+        }
+        uint32_t i = n++;
+        while (i > 0 && seqs[i - 1] > hdr.seg_seq) {
+            order[i] = order[i - 1];
+            seqs[i] = seqs[i - 1];
+            i--;
+        }
+        order[i] = seg;
+        seqs[i] = hdr.seg_seq;
+    }
+    return n;
+}
+
+static bool rec_valid(uint32_t off, const rec_hdr_t *hdr, const char *text)
+{
+    return hdr->len <= TEXT_MAX && off + sizeof(*hdr) + hdr->len <= SEG_SIZE && rec_crc(hdr, text) == hdr->crc;
+}
+
+// Record at a partition address, text NUL-terminated; false if there is none
+static bool rec_read(uint32_t addr, rec_hdr_t *hdr, char *text)
+{
+    uint32_t off = addr % SEG_SIZE;
+    if (off + sizeof(*hdr) > SEG_SIZE || esp_partition_read(s_part, addr, hdr, sizeof(*hdr)) != ESP_OK ||
+        hdr->len > TEXT_MAX || off + sizeof(*hdr) + hdr->len > SEG_SIZE ||
+        esp_partition_read(s_part, addr + sizeof(*hdr), text, hdr->len) != ESP_OK) {
+        return false;
+    }
+    text[hdr->len] = '\0';
+    return rec_valid(off, hdr, text);
+}
+
+typedef bool (*rec_fn_t)(uint32_t addr, const rec_hdr_t *hdr, void *ctx);
+
+// Call fn for every stored record, oldest first, until it returns false.
+// Each segment is read whole into buf (SEG_SIZE bytes).
+static void archive_walk(const uint32_t *order, uint32_t count, uint8_t *buf, rec_fn_t fn, void *ctx)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (esp_partition_read(s_part, order[i] * SEG_SIZE, buf, SEG_SIZE) != ESP_OK) {
+            continue;
+        }
+        uint32_t off = sizeof(seg_hdr_t);
+        rec_hdr_t hdr;
+        while (off + sizeof(hdr) <= SEG_SIZE) {
+            memcpy(&hdr, buf + off, sizeof(hdr));
+            if (!rec_valid(off, &hdr, (const char *)buf + off + sizeof(hdr))) {
+                break;      // Erased space or a torn write: the end of the segment
+            }
+            if (!fn(order[i] * SEG_SIZE + off, &hdr, ctx)) {
+                return;
+            }
+            off += sizeof(hdr) + hdr.len;
+        }
+    }
+}
+
+static void batch_write(size_t n)
+{
+    if (n == 0) {
+        return;
+    }
+    if (esp_partition_write(s_part, s_seg * SEG_SIZE + s_off, s_batch, n) != ESP_OK) {
+        s_errors++;
+    }
+    memmove(s_batch, s_batch + n, s_batch_len - n);
+    s_off += n;
+    s_batch_len -= n;
+    s_batch_us = esp_timer_get_time();
+}
+
+static void seg_start(uint32_t seg)
+{
+    s_seg = seg;
+    s_seg_seq++;
+    seg_hdr_t hdr = {
+        .magic = SEG_MAGIC,
+        .seg_seq = s_seg_seq,
+        .boot_id = s_boot_id,
+        .check = ~(SEG_MAGIC ^ s_seg_seq ^ s_boot_id),
+    };
+    if (esp_partition_erase_range(s_part, seg * SEG_SIZE, SEG_SIZE) != ESP_OK ||
+        esp_partition_write(s_part, seg * SEG_SIZE, &hdr, sizeof(hdr)) != ESP_OK) {
+        s_errors++;
+    }
+    s_off = sizeof(hdr);
+}
+
+static void archive_append(uint8_t level, uint32_t boot_id, uint32_t seq, uint32_t ts,
+                           const char *text, size_t len)
+{
+    if (len > TEXT_MAX) {
+        len = TEXT_MAX;
+    }
+    rec_hdr_t hdr = {
+        .len = (uint16_t)len,
+        .level = level,
+        .boot_id = boot_id,
+        .seq = seq,
+        .ts = ts,
+    };
+    hdr.crc = rec_crc(&hdr, text);
+
+    size_t size = sizeof(hdr) + len;
+    if (s_off + s_batch_len + size > SEG_SIZE) {
+        batch_write(s_batch_len);
+        seg_start((s_seg + 1) % s_seg_count);
+    }
+    if (s_batch_len == 0) {
+        s_batch_us = esp_timer_get_time();
+    }
+    memcpy(s_batch + s_batch_len, &hdr, sizeof(hdr));
+    memcpy(s_batch + s_batch_len + sizeof(hdr), text, len);
+    s_batch_len += size;
+
+    // Program every page that is complete now; the rest waits for more lines
+    size_t end = s_off + s_batch_len;
+    size_t boundary = end - end % PAGE_SIZE;
+    if (boundary > s_off) {
+        batch_write(boundary - s_off);
+    }
+}
+
+// Move new lines from the RAM ring into the batch (s_lock held)
+static void archive_poll(void)
+{
+    mcp_log_line_t line;
+    while (mcp_log_read(s_read_seq, &line) == ESP_OK) {
+        s_missed += line.seq - s_read_seq;
+        s_read_seq = line.seq + 1;
+        if (line.level <= ARCH_LEVEL) {
+            archive_append((uint8_t)line.level, s_boot_id, line.seq, (uint32_t)line.timestamp_ms,
+                           line.text, strlen(line.text));
+        }
+    }
+}
+
+static void archive_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(POLL_MS));
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        archive_poll();
+        if (s_batch_len > 0 && esp_timer_get_time() - s_batch_us >= FLUSH_US) {
+            batch_write(s_batch_len);
+        }
+        xSemaphoreGive(s_lock);
+    }
+}
+
+// esp_restart: write what is pending (the RTC tail would cover it too)
+static void archive_shutdown(void)
+{
+    if (xSemaphoreTake(s_lock, pdMS_TO_TICKS(100)) == pdTRUE) {
+        archive_poll();
+        batch_write(s_batch_len);
+        xSemaphoreGive(s_lock);
+    }
+}
+
+/* --- RTC tail --- */
+
+static void rtc_copy_in(size_t off, const void *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        s_rtc.buf[(off + i) % RTC_SIZE] = ((const uint8_t *)src)[i];
+    }
+}
+
+static void rtc_copy_out(size_t off, void *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        ((uint8_t *)dst)[i] = s_rtc.buf[(off + i) % RTC_SIZE];
+    }
+}
+
+// mcp_log tap: runs under the log ring lock, one line at a time
+static void rtc_tap(uint32_t seq, esp_log_level_t level, uint32_t ts, const char *text, size_t len)
+{
+    if (level > ARCH_LEVEL || len == 0) {
+        return;
+    }
+    if (len > TEXT_MAX) {
+        len = TEXT_MAX;
+    }
+    uint32_t state = s_rtc.state;
+    size_t head = state & 0xFFFF;
+    size_t used = state >> 16;
+    size_t size = sizeof(rtc_rec_t) + len;
+    while (RTC_SIZE - used < size) {
+        rtc_rec_t old;
+        rtc_copy_out(head + RTC_SIZE - used, &old, sizeof(old));
+        used -= sizeof(old) + old.len;
+        s_rtc.state = (uint32_t)(head | used << 16);
+    }
+    rtc_rec_t rec = { .len = (uint16_t)len, .level = (uint8_t)level, .seq = seq, .ts = ts };
+    rtc_copy_in(head, &rec, sizeof(rec));
+    rtc_copy_in(head + sizeof(rec), text, len);
+    s_rtc.state = (uint32_t)((head + size) % RTC_SIZE | (used + size) << 16);
+}
+
+// Archive the lines of boot_id that the RTC tail has and flash does not
+static uint32_t rtc_recover(uint32_t boot_id, bool any_seq, uint32_t next_seq)
+{
+    size_t head = s_rtc.state & 0xFFFF;
+    size_t used = s_rtc.state >> 16;
+    if (s_rtc.magic != RTC_MAGIC || s_rtc.boot_id != boot_id || head >= RTC_SIZE || used > RTC_SIZE) {
+        return 0;
+    }
+    uint32_t recovered = 0;
+    size_t off = head + RTC_SIZE - used;
+    while (used >= sizeof(rtc_rec_t)) {
+        rtc_rec_t rec;
+        char text[TEXT_MAX + 1];
+        rtc_copy_out(off, &rec, sizeof(rec));
+        if (rec.len > TEXT_MAX || sizeof(rec) + rec.len > used) {
+            break;      // Not a tail this firmware wrote
+        }
+        rtc_copy_out(off + sizeof(rec), text, rec.len);
+        if (!any_seq || (int32_t)(rec.seq - next_seq) >= 0) {
+            archive_append(rec.level, boot_id, rec.seq, rec.ts, text, rec.len);
+            recovered++;
+        }
+        off += sizeof(rec) + rec.len;
+        used -= sizeof(rec) + rec.len;
+    }
+    return recovered;
+}
+
+/* --- Init --- */
+
+typedef struct {
+    uint32_t boot_id;
+    bool any;
+    uint32_t next_seq;
+} last_seq_ctx_t;
+
+static bool find_last_seq(uint32_t addr, const rec_hdr_t *hdr, void *ctx)
+{
+    (void)addr;
+    last_seq_ctx_t *c = ctx;
+    if (hdr->boot_id == c->boot_id && (!c->any || (int32_t)(hdr->seq - c->next_seq) >= 0)) {
+        c->any = true;
+        c->next_seq = hdr->seq + 1;
+    }
+    return true;
+}
+
+static const char *reset_reason_name(esp_reset_reason_t reason)
+{
+    switch (reason) {
+    case ESP_RST_POWERON:   return "power-on";
+    case ESP_RST_EXT:       return "external pin";
+    case ESP_RST_SW:        return "software restart";
+    case ESP_RST_PANIC:     return "panic";
+    case ESP_RST_INT_WDT:   return "interrupt watchdog";
+    case ESP_RST_TASK_WDT:  return "task watchdog";
+    case ESP_RST_WDT:       return "watchdog";
+    case ESP_RST_DEEPSLEEP: return "deep sleep";
+    case ESP_RST_BROWNOUT:  return "brownout";
+    case ESP_RST_SDIO:      return "SDIO";
+    default:                return "unknown";
+    }
+}
+
+esp_err_t mcp_log_archive_init(void)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ARCH_SUBTYPE, ARCH_LABEL);
+    if (!s_part || s_part->size < 2 * SEG_SIZE) {
+        s_part = NULL;
+        ESP_LOGW(TAG, "No \"%s\" data partition, log archive off", ARCH_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_seg_count = s_part->size / SEG_SIZE;
+    if (s_seg_count > SEG_MAX) {
+        s_seg_count = SEG_MAX;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // The newest segment names the last boot; this one is the next
+    uint32_t order[SEG_MAX];
+    uint32_t seqs[SEG_MAX];
+    uint32_t count = seg_order(order, seqs);
+    uint32_t last_boot = 0;
+    if (count > 0) {
+        seg_hdr_t hdr;
+        seg_header(order[count - 1], &hdr);
+        last_boot = hdr.boot_id;
+        s_seg_seq = hdr.seg_seq;
+    }
+    s_boot_id = last_boot + 1;
+
+    uint8_t *buf = malloc(SEG_SIZE);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+    last_seq_ctx_t last = { .boot_id = last_boot };
+    archive_walk(order, count, buf, find_last_seq, &last);
+    free(buf);
+
+    seg_start(count > 0 ? (order[count - 1] + 1) % s_seg_count : 0);
+
+    // RTC memory holds garbage after a power-on or brownout
+    esp_reset_reason_t reason = esp_reset_reason();
+    uint32_t recovered = 0;
+    if (last_boot > 0 && reason != ESP_RST_POWERON && reason != ESP_RST_BROWNOUT) {
+        recovered = rtc_recover(last_boot, last.any, last.next_seq);
+    }
+    s_rtc.magic = RTC_MAGIC;
+    s_rtc.boot_id = s_boot_id;
+    s_rtc.state = 0;
+    mcp_log_set_tap(rtc_tap);
+
+    // Lines logged so far this boot go to flash now
+    archive_poll();
+    batch_write(s_batch_len);
+
+    esp_register_shutdown_handler(archive_shutdown);
+    if (xTaskCreate(archive_task, "mcp_log_archive", 4096, NULL, 1, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create archive task");
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Boot %u after %s reset, %u KB archive", (unsigned)s_boot_id,
+             reset_reason_name(reason), (unsigned)(s_seg_count * SEG_SIZE / 1024));
+    if (recovered > 0) {
+        ESP_LOGI(TAG, "Recovered %u lines of boot %u from RTC memory", (unsigned)recovered, (unsigned)last_boot);
+    }
+    return ESP_OK;
+}
+
+/* --- sys_get_boot_logs --- */
+
+typedef struct {
+    uint32_t boot_id;
+    uint32_t lines;
+    uint32_t first_seq;
+    uint32_t last_seq;
+    uint32_t first_ts;
+    uint32_t last_ts;
+} boot_summary_t;
+
+typedef struct {
+    boot_summary_t *boots;
+    int count;
+} boots_ctx_t;
+
+static bool collect_boot(uint32_t addr, const rec_hdr_t *hdr, void *ctx)
+{
+    (void)addr;
+    boots_ctx_t *c = ctx;
+    int i = 0;
+    while (i < c->count && c->boots[i].boot_id != hdr->boot_id) {
+        i++;
+    }
+    if (i == c->count) {
+        if (c->count == BOOTS_MAX) {
+            return true;
+        }
+        c->boots[c->count++] = (boot_summary_t){
+            .boot_id = hdr->boot_id, .first_seq = hdr->seq, .first_ts = hdr->ts,
+        };
+    }
+    boot_summary_t *b = &c->boots[i];
+    b->lines++;
+    b->last_seq = hdr->seq;
+    b->last_ts = hdr->ts;
+    return true;
+}
+
+typedef struct {
+    uint32_t addr;
+    uint32_t seq;
+} boot_pick_t;
+
+typedef struct {
+    uint32_t boot_id;
+    bool forward;
+    uint32_t since_seq;
+    boot_pick_t *picks;
+    int max;
+    int count;
+    int first;                      // Tail mode keeps the last max picks in a ring
+    uint32_t next_seq;
+} picks_ctx_t;
+
+static bool pick_line(uint32_t addr, const rec_hdr_t *hdr, void *ctx)
+{
+    picks_ctx_t *c = ctx;
+    if (hdr->boot_id != c->boot_id || (c->forward && (int32_t)(hdr->seq - c->since_seq) < 0)) {
+        return true;
+    }
+    boot_pick_t pick = { .addr = addr, .seq = hdr->seq };
+    if (c->count < c->max) {
+        c->picks[c->count++] = pick;
+    } else if (c->forward) {
+        return false;               // next_seq stays at the first line not returned
+    } else {
+        c->picks[c->first] = pick;
+        c->first = (c->first + 1) % c->max;
+    }
+    c->next_seq = hdr->seq + 1;
+    return true;
+}
+
+esp_err_t tool_sys_get_boot_logs(cJSON *args, mcp_result_t *result)
+{
+    bool has_boot = false;
+    uint32_t boot_id = 0;
+    picks_ctx_t pc = { .max = 50 };
+    if (args) {
+        cJSON *boot_item = cJSON_GetObjectItem(args, "boot");
+        if (cJSON_IsNumber(boot_item) && boot_item->valuedouble >= 1) {
+            has_boot = true;
+            boot_id = (uint32_t)boot_item->valuedouble;
+        }
+        cJSON *since_item = cJSON_GetObjectItem(args, "since_seq");
+        if (cJSON_IsNumber(since_item) && since_item->valuedouble >= 0) {
+            pc.forward = true;
+            pc.since_seq = (uint32_t)since_item->valuedouble;
+        }
+        cJSON *lines_item = cJSON_GetObjectItem(args, "lines");
+        if (cJSON_IsNumber(lines_item)) {
+            pc.max = lines_item->valueint < 1 ? 1 : (lines_item->valueint > PICK_MAX ? PICK_MAX : lines_item->valueint);
+        }
+    }
+    if (!s_lock) {
+        mcp_result_printf(result, "Log archive is off: no \"%s\" data partition", ARCH_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint32_t *order = mcp_arena_alloc(2 * SEG_MAX * sizeof(uint32_t));
+    uint8_t *buf = mcp_arena_alloc(SEG_SIZE);
+    boot_summary_t *boots = has_boot ? NULL : mcp_arena_alloc(BOOTS_MAX * sizeof(boot_summary_t));
+    pc.picks = has_boot ? mcp_arena_alloc((size_t)pc.max * sizeof(boot_pick_t)) : NULL;
+    if (!order || !buf || (!boots && !pc.picks)) {
+        mcp_arena_free(pc.picks);
+        mcp_arena_free(boots);
+        mcp_arena_free(buf);
+        mcp_arena_free(order);
+        mcp_result_printf(result, "Out of memory");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Walk under the lock so no segment is erased halfway through
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!has_boot || boot_id == s_boot_id) {
+        archive_poll();
+        batch_write(s_batch_len);
+    }
+    uint32_t count = seg_order(order, order + SEG_MAX);
+    boots_ctx_t bc = { .boots = boots };
+    pc.boot_id = boot_id;
+    pc.next_seq = pc.since_seq;
+    archive_walk(order, count, buf, has_boot ? pick_line : collect_boot, has_boot ? (void *)&pc : (void *)&bc);
+    uint32_t missed = s_missed;
+    uint32_t errors = s_errors;
+    xSemaphoreGive(s_lock);
+
+    if (!has_boot) {
+        mcp_result_printf(result, "{\"boot\":%u,\"missed\":%u,\"errors\":%u,\"boots\":[",
+                          (unsigned)s_boot_id, (unsigned)missed, (unsigned)errors);
+        for (int i = 0; i < bc.count; i++) {
+            const boot_summary_t *b = &boots[i];
+            mcp_result_printf(result,
+                "%s{\"boot\":%u,\"lines\":%u,\"first_seq\":%u,\"last_seq\":%u,\"first_t\":%u,\"last_t\":%u}",
+                i ? "," : "", (unsigned)b->boot_id, (unsigned)b->lines, (unsigned)b->first_seq,
+                (unsigned)b->last_seq, (unsigned)b->first_ts, (unsigned)b->last_ts);
+        }
+        mcp_result_puts(result, "]}");
+    } else {
+        mcp_result_printf(result, "{\"boot\":%u,\"next_seq\":%u,\"lines\":[",
+                          (unsigned)boot_id, (unsigned)pc.next_seq);
+        char *text = (char *)buf;      // The walk is done with it
+        bool first = true;
+        for (int i = 0; i < pc.count && !result->truncated; i++) {
+            const boot_pick_t *pick = &pc.picks[(pc.first + i) % pc.max];
+            rec_hdr_t hdr;
+            // A record erased and rewritten since the walk is skipped
+            if (!rec_read(pick->addr, &hdr, text) || hdr.boot_id != boot_id || hdr.seq != pick->seq) {
+                continue;
+            }
+            mcp_result_printf(result, "%s{\"seq\":%u,\"t\":%u,\"msg\":\"", first ? "" : ",",
+                              (unsigned)hdr.seq, (unsigned)hdr.ts);
+            mcp_result_json_escaped(result, text);
+            mcp_result_puts(result, "\"}");
+            first = false;
+        }
+        mcp_result_puts(result, "]}");
+    }
+
+    mcp_arena_free(pc.picks);
+    mcp_arena_free(boots);
+    mcp_arena_free(buf);
+    mcp_arena_free(order);
+    return ESP_OK;
+}
+
+#else // !CONFIG_MCP_LOG_ARCHIVE
+
+esp_err_t mcp_log_archive_init(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t tool_sys_get_boot_logs(cJSON *args, mcp_result_t *result)
+{
+    (void)args;
+    (void)TAG;
+    mcp_result_printf(result, "The log archive is not built into this firmware (CONFIG_MCP_LOG_ARCHIVE)");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif // CONFIG_MCP_LOG_ARCHIVE
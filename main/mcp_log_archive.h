@@ -0,0 +1,56 @@
+/*
+ * MCP Log Archive
+ *
+ * Keeps captured log lines across resets in the "logs" flash partition
+ * (partitions_ota.csv), so the lines leading up to a panic, watchdog
+ * reset or sys_reboot can still be read after the device comes back.
+ * Every boot gets the next boot id; sys_get_boot_logs lists the archived
+ * boots and returns the lines of one of them by sequence number.
+ *
+ * Lines reach flash in page-sized batches from a background task. The
+ * few not written yet when the device resets are kept in RTC memory and
+ * added to the archive on the next boot (not after a power-on, which
+ * clears RTC memory).
+ */
+
+#ifndef MCP_LOG_ARCHIVE_H
+#define MCP_LOG_ARCHIVE_H
+
+#include <esp_err.h>
+#include <cJSON.h>
+#include "mcp_tools.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Open the archive partition, start this boot's segment, recover the
+ * previous boot's RTC tail and start the archive task. Call right after
+ * mcp_log_init.
+ *
+ * @return ESP_OK, ESP_ERR_NOT_FOUND without a "logs" partition,
+ *         ESP_ERR_NOT_SUPPORTED without CONFIG_MCP_LOG_ARCHIVE
+ */
+esp_err_t mcp_log_archive_init(void);
+
+/**
+ * Tool handler: sys_get_boot_logs
+ * Without boot, lists the archived boots:
+ *   {"boot":current,"boots":[{"boot","lines","first_seq","last_seq","first_t","last_t"}...]}
+ * With boot, returns its lines: {"boot":N,"next_seq":S,"lines":[{"seq","t","msg"}...]}
+ *
+ * Parameters (via cJSON args):
+ *   boot      - boot id to read (optional)
+ *   since_seq - lines from this sequence number on, oldest first (optional;
+ *               without it the last lines of the boot are returned)
+ *   lines     - max number of lines to return (default 50)
+ */
+esp_err_t tool_sys_get_boot_logs(cJSON *args, mcp_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MCP_LOG_ARCHIVE_H
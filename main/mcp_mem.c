@@ -0,0 +1,160 @@
+/*
+ * MCP Memory Placement Implementation
+ *
+ * Block sizes come from heap_caps_get_allocated_size, so allocation and
+ * free count the same number of bytes whatever the allocator rounds to.
+ */
+
+#include "mcp_mem.h"
+#include <stdatomic.h>
+#include <string.h>
+#include <esp_heap_caps.h>
+#include <esp_memory_utils.h>
+#include "sdkconfig.h"
+
+#define CAPS_INTERNAL   (MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT)
+#define CAPS_PSRAM      (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+
+typedef struct {
+    const char *name;
+    bool psram;
+    atomic_size_t live;
+    atomic_size_t peak;
+    atomic_size_t live_psram;
+    atomic_uint misplaced;
+} mem_class_t;
+
+// Unset bool options are not defined at all
+#ifndef CONFIG_MCP_MEM_LOG_PSRAM
+#define CONFIG_MCP_MEM_LOG_PSRAM 0
+#endif
+#ifndef CONFIG_MCP_MEM_BUFFERS_PSRAM
+#define CONFIG_MCP_MEM_BUFFERS_PSRAM 0
+#endif
+#ifndef CONFIG_MCP_MEM_ARENA_PSRAM
+#define CONFIG_MCP_MEM_ARENA_PSRAM 0
+#endif
+#ifndef CONFIG_MCP_MEM_JSON_PSRAM
+#define CONFIG_MCP_MEM_JSON_PSRAM 0
+#endif
+#ifndef CONFIG_MCP_MEM_SSE_PSRAM
+#define CONFIG_MCP_MEM_SSE_PSRAM 0
+#endif
+#ifndef CONFIG_MCP_MEM_OTA_PSRAM
+#define CONFIG_MCP_MEM_OTA_PSRAM 0
+#endif
+#ifndef CONFIG_MCP_MEM_LUA_PSRAM
+#define CONFIG_MCP_MEM_LUA_PSRAM 0
+#endif
+#ifndef CONFIG_MCP_MEM_TRACE_PSRAM
+#define CONFIG_MCP_MEM_TRACE_PSRAM 0
+#endif
+
+static mem_class_t s_classes[MCP_MEM_COUNT] = {
+    [MCP_MEM_LOG]     = { .name = "log",     .psram = CONFIG_MCP_MEM_LOG_PSRAM },
+    [MCP_MEM_BUFFERS] = { .name = "buffers", .psram = CONFIG_MCP_MEM_BUFFERS_PSRAM },
+    [MCP_MEM_ARENA]   = { .name = "arena",   .psram = CONFIG_MCP_MEM_ARENA_PSRAM },
+    [MCP_MEM_JSON]    = { .name = "json",    .psram = CONFIG_MCP_MEM_JSON_PSRAM },
+    [MCP_MEM_SSE]     = { .name = "sse",     .psram = CONFIG_MCP_MEM_SSE_PSRAM },
+    [MCP_MEM_OTA]     = { .name = "ota",     .psram = CONFIG_MCP_MEM_OTA_PSRAM },
+    [MCP_MEM_LUA]     = { .name = "lua",     .psram = CONFIG_MCP_MEM_LUA_PSRAM },
+    [MCP_MEM_TRACE]   = { .name = "trace",   .psram = CONFIG_MCP_MEM_TRACE_PSRAM },
+};
+
+static void mem_count(mem_class_t *c, void *ptr, bool add)
+{
+    if (!ptr) {
+        return;
+    }
+    size_t size = heap_caps_get_allocated_size(ptr);
+    bool psram = esp_ptr_external_ram(ptr);
+    if (!add) {
+        atomic_fetch_sub(&c->live, size);
+        if (psram) {
+            atomic_fetch_sub(&c->live_psram, size);
+        }
+        return;
+    }
+    size_t live = atomic_fetch_add(&c->live, size) + size;
+    if (psram) {
+        atomic_fetch_add(&c->live_psram, size);
+    }
+    if (psram != c->psram) {
+        atomic_fetch_add(&c->misplaced, 1);
+    }
+    size_t peak = atomic_load(&c->peak);
+    while (live > peak && !atomic_compare_exchange_weak(&c->peak, &peak, live)) {
+    }
+}
+
+void *mcp_mem_malloc(mcp_mem_class_t cls, size_t size)
+{
+    mem_class_t *c = &s_classes[cls];
+    void *p = heap_caps_malloc(size, c->psram ? CAPS_PSRAM : CAPS_INTERNAL);
+    if (!p) {
+        p = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+    }
+    mem_count(c, p, true);
+    return p;
+}
+
+void *mcp_mem_calloc(mcp_mem_class_t cls, size_t n, size_t size)
+{
+    if (size && n > SIZE_MAX / size) {
+        return NULL;
+    }
+    void *p = mcp_mem_malloc(cls, n * size);
+    if (p) {
+        memset(p, 0, n * size);
+    }
+    return p;
+}
+
+void *mcp_mem_realloc(mcp_mem_class_t cls, void *ptr, size_t size)
+{
+    if (!ptr) {
+        return mcp_mem_malloc(cls, size);
+    }
+    mem_class_t *c = &s_classes[cls];
+    mem_count(c, ptr, false);
+    void *p = heap_caps_realloc(ptr, size, c->psram ? CAPS_PSRAM : CAPS_INTERNAL);
+    if (!p && size) {
+        p = heap_caps_realloc(ptr, size, MALLOC_CAP_8BIT);
+    }
+    if (!p && size) {
+        mem_count(c, ptr, true);    // Still allocated
+        return NULL;
+    }
+    mem_count(c, p, true);
+    return p;
+}
+
+void mcp_mem_free(mcp_mem_class_t cls, void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+    mem_count(&s_classes[cls], ptr, false);
+    heap_caps_free(ptr);
+}
+
+void mcp_mem_disown(mcp_mem_class_t cls, void *ptr)
+{
+    mem_count(&s_classes[cls], ptr, false);
+}
+
+bool mcp_mem_in_psram(const void *ptr)
+{
+    return esp_ptr_external_ram(ptr);
+}
+
+void mcp_mem_get_stats(mcp_mem_class_t cls, mcp_mem_stats_t *stats)
+{
+    const mem_class_t *c = &s_classes[cls];
+    stats->name = c->name;
+    stats->psram = c->psram;
+    stats->live = atomic_load(&c->live);
+    stats->peak = atomic_load(&c->peak);
+    stats->live_psram = atomic_load(&c->live_psram);
+    stats->misplaced = atomic_load(&c->misplaced);
+}
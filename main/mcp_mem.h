@@ -0,0 +1,77 @@
+/*
+ * MCP Memory Placement
+ *
+ * Central heap policy: every large or long-lived buffer names the
+ * subsystem it belongs to, and the subsystem's Kconfig option decides
+ * whether it goes to PSRAM or internal RAM. Internal RAM runs out first
+ * (TLS sessions, Wi-Fi and DMA need it), so bulk data such as the log
+ * ring, OTA chunks and the Lua heap can move out while hot, small objects
+ * stay in. An allocation that does not fit where it should goes to the
+ * other RAM rather than failing. Live and peak bytes are kept per
+ * subsystem.
+ */
+
+#ifndef MCP_MEM_H
+#define MCP_MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    MCP_MEM_LOG,                // Log ring
+    MCP_MEM_BUFFERS,            // Pooled receive/response buffers
+    MCP_MEM_ARENA,              // Request arenas
+    MCP_MEM_JSON,               // Growable JSON output (WebSocket replies, tools/list)
+    MCP_MEM_SSE,                // Event stream queues
+    MCP_MEM_OTA,                // OTA download buffer
+    MCP_MEM_LUA,                // Lua VM heap
+    MCP_MEM_TRACE,              // Span trace ring
+    MCP_MEM_COUNT
+} mcp_mem_class_t;
+
+/**
+ * Usage of one subsystem
+ */
+typedef struct {
+    const char *name;
+    bool psram;                 // Placed in PSRAM by policy
+    size_t live;                // Bytes allocated now
+    size_t peak;
+    size_t live_psram;          // Part of live that is in PSRAM
+    uint32_t misplaced;         // Allocations that went to the other RAM
+} mcp_mem_stats_t;
+
+/**
+ * Allocate for a subsystem (free with mcp_mem_free and the same class)
+ */
+void *mcp_mem_malloc(mcp_mem_class_t cls, size_t size);
+void *mcp_mem_calloc(mcp_mem_class_t cls, size_t n, size_t size);
+void *mcp_mem_realloc(mcp_mem_class_t cls, void *ptr, size_t size);
+void mcp_mem_free(mcp_mem_class_t cls, void *ptr);
+
+/**
+ * Stop counting a block that leaves the subsystem; its new owner
+ * releases it with free()
+ */
+void mcp_mem_disown(mcp_mem_class_t cls, void *ptr);
+
+/**
+ * Whether a pointer is in PSRAM
+ */
+bool mcp_mem_in_psram(const void *ptr);
+
+/**
+ * Snapshot of one subsystem's usage
+ */
+void mcp_mem_get_stats(mcp_mem_class_t cls, mcp_mem_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MCP_MEM_H
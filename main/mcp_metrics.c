@@ -0,0 +1,395 @@
+/*
+ * MCP Request Metrics Implementation
+ *
+ * Buckets are log-scale with two per power of two, so a percentile read
+ * from them is within about 25% of the true value (and never above the
+ * recorded maximum). Series are appended to a fixed table and published
+ * by bumping its count; lookups scan it without locking.
+ */
+
+#include "mcp_metrics.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "sdkconfig.h"
+
+static const char *TAG = "mcp_metrics";
+
+#define METRICS_MAX_SERIES  CONFIG_MCP_METRICS_MAX_SERIES
+#define METRICS_NAME_MAX    64
+#define METRICS_BUCKETS     48      // Top bucket starts at 2^23 us (8.4 s)
+
+struct mcp_metric {
+    atomic_uint buckets[METRICS_BUCKETS];
+    atomic_uint count;
+    atomic_uint errors;
+    _Atomic uint64_t sum_us;
+    atomic_uint max_us;
+    mcp_metric_kind_t kind;
+    char name[METRICS_NAME_MAX + 1];
+};
+
+static const char *const s_kind_names[MCP_METRIC_KIND_COUNT] = {
+    [MCP_METRIC_STAGE] = "stage",
+    [MCP_METRIC_METHOD] = "method",
+    [MCP_METRIC_TOOL] = "tool",
+};
+
+static mcp_metric_t s_stages[MCP_STAGE_COUNT] = {
+    [MCP_STAGE_MESSAGE] = { .kind = MCP_METRIC_STAGE, .name = "message" },
+    [MCP_STAGE_PARSE] = { .kind = MCP_METRIC_STAGE, .name = "parse" },
+    [MCP_STAGE_WS_SEND] = { .kind = MCP_METRIC_STAGE, .name = "ws_send" },
+    [MCP_STAGE_HTTP_SEND] = { .kind = MCP_METRIC_STAGE, .name = "http_send" },
+};
+
+static mcp_metric_t s_series[METRICS_MAX_SERIES];
+static atomic_int s_series_count = 0;
+static _Atomic(SemaphoreHandle_t) s_create_lock = NULL;
+static _Atomic uint64_t s_bytes[MCP_BYTES_COUNT];
+
+static const char *const s_bytes_labels[MCP_BYTES_COUNT][2] = {
+    [MCP_BYTES_WS_RX] = { "ws", "rx" },
+    [MCP_BYTES_WS_TX] = { "ws", "tx" },
+    [MCP_BYTES_HTTP_RX] = { "http", "rx" },
+    [MCP_BYTES_HTTP_TX] = { "http", "tx" },
+};
+
+/* Bucket 0 holds 0 us; then [2^k, 1.5 * 2^k) and [1.5 * 2^k, 2^(k+1)) */
+static int bucket_index(uint32_t us)
+{
+    if (us == 0) {
+        return 0;
+    }
+    int octave = 31 - __builtin_clz(us);
+    int half = octave > 0 ? (us >> (octave - 1)) & 1 : 0;
+    int idx = 1 + 2 * octave + half;
+    return idx < METRICS_BUCKETS ? idx : METRICS_BUCKETS - 1;
+}
+
+static void bucket_range(int idx, uint32_t *lo, uint32_t *hi)
+{
+    if (idx == 0) {
+        *lo = 0;
+        *hi = 1;
+        return;
+    }
+    int octave = (idx - 1) / 2;
+    int half = (idx - 1) & 1;
+    uint32_t base = 1u << octave;
+    uint32_t step = octave > 0 ? base >> 1 : base;
+    *lo = base + half * step;
+    *hi = *lo + step;
+}
+
+mcp_metric_t *mcp_metrics_stage(mcp_stage_t stage)
+{
+    return &s_stages[stage];
+}
+
+static mcp_metric_t *series_find(mcp_metric_kind_t kind, const char *name, int count)
+{
+    for (int i = 0; i < count; i++) {
+        mcp_metric_t *m = &s_series[i];
+        if (m->kind == kind && m->name[0] == name[0] && strcmp(m->name, name) == 0) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+static SemaphoreHandle_t create_lock(void)
+{
+    SemaphoreHandle_t lock = atomic_load(&s_create_lock);
+    if (lock) {
+        return lock;
+    }
+    SemaphoreHandle_t created = xSemaphoreCreateMutex();
+    if (!created) {
+        return NULL;
+    }
+    if (!atomic_compare_exchange_strong(&s_create_lock, &lock, created)) {
+        vSemaphoreDelete(created);  // Lost the race; lock holds the winner
+        return lock;
+    }
+    return created;
+}
+
+mcp_metric_t *mcp_metrics_get(mcp_metric_kind_t kind, const char *name)
+{
+    if (!name) {
+        return NULL;
+    }
+    mcp_metric_t *m = series_find(kind, name, atomic_load(&s_series_count));
+    if (m) {
+        return m;
+    }
+
+    // New series: one creator at a time, readers only see it once complete
+    SemaphoreHandle_t lock = create_lock();
+    if (!lock) {
+        return NULL;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    int count = atomic_load(&s_series_count);
+    m = series_find(kind, name, count);
+    if (!m && count < METRICS_MAX_SERIES) {
+        m = &s_series[count];
+        m->kind = kind;
+        snprintf(m->name, sizeof(m->name), "%s", name);
+        atomic_store(&s_series_count, count + 1);
+    } else if (!m) {
+        ESP_LOGW(TAG, "No room for %s %s (%d series)", s_kind_names[kind], name, METRICS_MAX_SERIES);
+    }
+    xSemaphoreGive(lock);
+    return m;
+}
+
+void mcp_metrics_record(mcp_metric_t *metric, int64_t us, bool error)
+{
+    if (!metric) {
+        return;
+    }
+    uint32_t v = us <= 0 ? 0 : us >= UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+    atomic_fetch_add_explicit(&metric->buckets[bucket_index(v)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&metric->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&metric->sum_us, v, memory_order_relaxed);
+    if (error) {
+        atomic_fetch_add_explicit(&metric->errors, 1, memory_order_relaxed);
+    }
+    unsigned max = atomic_load_explicit(&metric->max_us, memory_order_relaxed);
+    while (v > max && !atomic_compare_exchange_weak(&metric->max_us, &max, v)) {
+    }
+}
+
+void mcp_metrics_record_since(mcp_metric_t *metric, int64_t start_us, bool error)
+{
+    mcp_metrics_record(metric, esp_timer_get_time() - start_us, error);
+}
+
+void mcp_metrics_add_bytes(mcp_bytes_t counter, size_t len)
+{
+    atomic_fetch_add_explicit(&s_bytes[counter], len, memory_order_relaxed);
+}
+
+uint64_t mcp_metrics_bytes(mcp_bytes_t counter)
+{
+    return atomic_load(&s_bytes[counter]);
+}
+
+const char *mcp_metrics_kind_name(mcp_metric_kind_t kind)
+{
+    return s_kind_names[kind];
+}
+
+// Value below which a fraction q of the samples fall, interpolated in its bucket
+static uint32_t percentile(const uint32_t *buckets, uint32_t total, uint32_t max_us, double q)
+{
+    double rank = q * total;
+    uint32_t seen = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        if (buckets[i] == 0 || seen + buckets[i] < rank) {
+            seen += buckets[i];
+            continue;
+        }
+        uint32_t lo, hi;
+        bucket_range(i, &lo, &hi);
+        if (i == METRICS_BUCKETS - 1 || hi > max_us) {
+            hi = max_us > lo ? max_us : lo;
+        }
+        double v = lo + (hi - lo) * ((rank - seen) / buckets[i]);
+        return v < max_us ? (uint32_t)v : max_us;
+    }
+    return max_us;
+}
+
+static void summarize(mcp_metric_t *m, mcp_metric_summary_t *s)
+{
+    // Copy first: the series keeps counting while it is read
+    uint32_t buckets[METRICS_BUCKETS];
+    uint32_t total = 0;
+    for (int i = 0; i < METRICS_BUCKETS; i++) {
+        buckets[i] = atomic_load_explicit(&m->buckets[i], memory_order_relaxed);
+        total += buckets[i];
+    }
+    s->kind = m->kind;
+    s->name = m->name;
+    s->count = total;
+    s->errors = atomic_load(&m->errors);
+    s->sum_us = atomic_load(&m->sum_us);
+    s->max_us = atomic_load(&m->max_us);
+    s->p50_us = percentile(buckets, total, s->max_us, 0.50);
+    s->p90_us = percentile(buckets, total, s->max_us, 0.90);
+    s->p99_us = percentile(buckets, total, s->max_us, 0.99);
+}
+
+void mcp_metrics_foreach(void (*fn)(const mcp_metric_summary_t *summary, void *ctx), void *ctx)
+{
+    mcp_metric_summary_t s;
+    for (int i = 0; i < MCP_STAGE_COUNT; i++) {
+        if (atomic_load(&s_stages[i].count)) {
+            summarize(&s_stages[i], &s);
+            fn(&s, ctx);
+        }
+    }
+    int count = atomic_load(&s_series_count);
+    for (int i = 0; i < count; i++) {
+        if (atomic_load(&s_series[i].count)) {
+            summarize(&s_series[i], &s);
+            fn(&s, ctx);
+        }
+    }
+}
+
+/* --- GET /metrics --- */
+
+typedef struct {
+    httpd_req_t *req;
+    char buf[512];
+    size_t len;
+    esp_err_t err;
+} prom_out_t;
+
+static void prom_flush(prom_out_t *out)
+{
+    if (out->len && out->err == ESP_OK) {
+        out->err = httpd_resp_send_chunk(out->req, out->buf, out->len);
+    }
+    out->len = 0;
+}
+
+static void __attribute__((format(printf, 2, 3))) prom_printf(prom_out_t *out, const char *fmt, ...)
+{
+    char line[160];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n >= sizeof(line)) {
+        n = sizeof(line) - 1;
+    }
+    if (out->len + n > sizeof(out->buf)) {
+        prom_flush(out);
+    }
+    memcpy(out->buf + out->len, line, n);
+    out->len += n;
+}
+
+static void prom_series(const mcp_metric_summary_t *s, void *ctx)
+{
+    prom_out_t *out = ctx;
+    const char *kind = s_kind_names[s->kind];
+    static const double quantiles[] = { 0.5, 0.9, 0.99 };
+    const uint32_t values[] = { s->p50_us, s->p90_us, s->p99_us };
+    for (int i = 0; i < 3; i++) {
+        prom_printf(out, "mcp_duration_seconds{kind=\"%s\",name=\"%s\",quantile=\"%g\"} %.6f\n",
+                    kind, s->name, quantiles[i], values[i] / 1e6);
+    }
+    prom_printf(out, "mcp_duration_seconds_sum{kind=\"%s\",name=\"%s\"} %.6f\n",
+                kind, s->name, s->sum_us / 1e6);
+    prom_printf(out, "mcp_duration_seconds_count{kind=\"%s\",name=\"%s\"} %lu\n",
+                kind, s->name, (unsigned long)s->count);
+}
+
+static void prom_errors(const mcp_metric_summary_t *s, void *ctx)
+{
+    prom_printf(ctx, "mcp_errors_total{kind=\"%s\",name=\"%s\"} %lu\n",
+                s_kind_names[s->kind], s->name, (unsigned long)s->errors);
+}
+
+static void prom_max(const mcp_metric_summary_t *s, void *ctx)
+{
+    prom_printf(ctx, "mcp_duration_max_seconds{kind=\"%s\",name=\"%s\"} %.6f\n",
+                s_kind_names[s->kind], s->name, s->max_us / 1e6);
+}
+
+esp_err_t mcp_metrics_handler(httpd_req_t *req)
+{
+    prom_out_t *out = calloc(1, sizeof(prom_out_t));
+    if (!out) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+    out->req = req;
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+    prom_printf(out, "# HELP mcp_duration_seconds Time spent per request stage, method and tool\n");
+    prom_printf(out, "# TYPE mcp_duration_seconds summary\n");
+    mcp_metrics_foreach(prom_series, out);
+    prom_printf(out, "# HELP mcp_duration_max_seconds Longest recorded duration\n");
+    prom_printf(out, "# TYPE mcp_duration_max_seconds gauge\n");
+    mcp_metrics_foreach(prom_max, out);
+    prom_printf(out, "# HELP mcp_errors_total Operations that failed\n");
+    prom_printf(out, "# TYPE mcp_errors_total counter\n");
+    mcp_metrics_foreach(prom_errors, out);
+    prom_printf(out, "# HELP mcp_transport_bytes_total Bytes received and sent per transport\n");
+    prom_printf(out, "# TYPE mcp_transport_bytes_total counter\n");
+    for (int i = 0; i < MCP_BYTES_COUNT; i++) {
+        prom_printf(out, "mcp_transport_bytes_total{transport=\"%s\",direction=\"%s\"} %llu\n",
+                    s_bytes_labels[i][0], s_bytes_labels[i][1], (unsigned long long)mcp_metrics_bytes(i));
+    }
+    prom_flush(out);
+    esp_err_t ret = out->err;
+    if (ret == ESP_OK) {
+        ret = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    free(out);
+    return ret;
+}
+
+/* --- sys_get_metrics --- */
+
+typedef struct {
+    mcp_result_t *result;
+    int kind;                   // -1 for every kind
+} tool_out_t;
+
+static void tool_series(const mcp_metric_summary_t *s, void *ctx)
+{
+    tool_out_t *out = ctx;
+    if (out->kind >= 0 && (int)s->kind != out->kind) {
+        return;
+    }
+    mcp_result_printf(out->result,
+        "%s %s: %lu calls, %lu errors, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms, mean %.3f ms\n",
+        s_kind_names[s->kind], s->name, (unsigned long)s->count, (unsigned long)s->errors,
+        s->p50_us / 1000.0, s->p90_us / 1000.0, s->p99_us / 1000.0, s->max_us / 1000.0,
+        s->count ? (double)s->sum_us / s->count / 1000.0 : 0.0);
+}
+
+esp_err_t tool_sys_get_metrics(cJSON *args, mcp_result_t *result)
+{
+    tool_out_t out = { .result = result, .kind = -1 };
+    cJSON *kind_item = cJSON_GetObjectItem(args, "kind");
+    if (cJSON_IsString(kind_item)) {
+        for (int i = 0; i < MCP_METRIC_KIND_COUNT; i++) {
+            if (strcmp(kind_item->valuestring, s_kind_names[i]) == 0) {
+                out.kind = i;
+            }
+        }
+        if (out.kind < 0) {
+            mcp_result_printf(result, "Unknown kind '%s': use stage, method or tool", kind_item->valuestring);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    mcp_metrics_foreach(tool_series, &out);
+    if (result->len == 0) {
+        mcp_result_puts(result, "No requests recorded yet\n");
+    }
+    if (out.kind < 0) {
+        mcp_result_printf(result, "Bytes: WebSocket %llu in / %llu out, HTTP %llu in / %llu out\n",
+            (unsigned long long)mcp_metrics_bytes(MCP_BYTES_WS_RX),
+            (unsigned long long)mcp_metrics_bytes(MCP_BYTES_WS_TX),
+            (unsigned long long)mcp_metrics_bytes(MCP_BYTES_HTTP_RX),
+            (unsigned long long)mcp_metrics_bytes(MCP_BYTES_HTTP_TX));
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,139 @@
+/*
+ * MCP Request Metrics
+ *
+ * Latency histograms for the stages of a request (receive to send), for
+ * each JSON-RPC method and for each tool, plus transport byte counters.
+ * Recording is a handful of relaxed atomic adds, so any task may record
+ * without locks; series are created on first use. Percentiles are
+ * computed from the histograms when read: sys_get_metrics prints them and
+ * GET /metrics serves them in the Prometheus text format.
+ */
+
+#ifndef MCP_METRICS_H
+#define MCP_METRICS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <cJSON.h>
+#include "mcp_tools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * What a series measures
+ */
+typedef enum {
+    MCP_METRIC_STAGE,           // A step every message goes through
+    MCP_METRIC_METHOD,          // Dispatch of one JSON-RPC method
+    MCP_METRIC_TOOL,            // One tool's handler
+    MCP_METRIC_KIND_COUNT
+} mcp_metric_kind_t;
+
+/**
+ * Fixed stages
+ */
+typedef enum {
+    MCP_STAGE_MESSAGE,          // Whole message, parse to last byte written
+    MCP_STAGE_PARSE,            // jsonrpc_parse_message_len
+    MCP_STAGE_WS_SEND,          // One WebSocket frame sent
+    MCP_STAGE_HTTP_SEND,        // One HTTP response or chunk sent
+    MCP_STAGE_COUNT
+} mcp_stage_t;
+
+/**
+ * Byte counters
+ */
+typedef enum {
+    MCP_BYTES_WS_RX,
+    MCP_BYTES_WS_TX,
+    MCP_BYTES_HTTP_RX,
+    MCP_BYTES_HTTP_TX,
+    MCP_BYTES_COUNT
+} mcp_bytes_t;
+
+typedef struct mcp_metric mcp_metric_t;
+
+/**
+ * Summary of one series
+ */
+typedef struct {
+    mcp_metric_kind_t kind;
+    const char *name;
+    uint32_t count;
+    uint32_t errors;
+    uint64_t sum_us;
+    uint32_t max_us;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+} mcp_metric_summary_t;
+
+/**
+ * Series of a fixed stage
+ */
+mcp_metric_t *mcp_metrics_stage(mcp_stage_t stage);
+
+/**
+ * Series for a method or tool, created on first use (the name is copied)
+ *
+ * @return Series, or NULL if CONFIG_MCP_METRICS_MAX_SERIES are in use
+ */
+mcp_metric_t *mcp_metrics_get(mcp_metric_kind_t kind, const char *name);
+
+/**
+ * Record one timing (NULL is ignored)
+ *
+ * @param us Duration in microseconds
+ * @param error The operation failed
+ */
+void mcp_metrics_record(mcp_metric_t *metric, int64_t us, bool error);
+
+/**
+ * Record a timing that started at start_us (esp_timer_get_time)
+ */
+void mcp_metrics_record_since(mcp_metric_t *metric, int64_t start_us, bool error);
+
+/**
+ * Count transport bytes
+ */
+void mcp_metrics_add_bytes(mcp_bytes_t counter, size_t len);
+
+/**
+ * Call fn with the summary of every series that has been recorded to
+ */
+void mcp_metrics_foreach(void (*fn)(const mcp_metric_summary_t *summary, void *ctx), void *ctx);
+
+/**
+ * Read a byte counter
+ */
+uint64_t mcp_metrics_bytes(mcp_bytes_t counter);
+
+/**
+ * Name of a kind ("stage", "method", "tool")
+ */
+const char *mcp_metrics_kind_name(mcp_metric_kind_t kind);
+
+/**
+ * GET /metrics handler (Prometheus text format)
+ */
+esp_err_t mcp_metrics_handler(httpd_req_t *req);
+
+/**
+ * Tool handler: sys_get_metrics
+ * Count, errors, p50/p90/p99, max and mean of each series, and byte counts.
+ *
+ * Parameters (via cJSON args):
+ *   kind - only "stage", "method" or "tool" series (optional)
+ */
+esp_err_t tool_sys_get_metrics(cJSON *args, mcp_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MCP_METRICS_H
@@ -3,6 +3,10 @@
  */
 
 #include "mcp_ota.h"
+#include "mcp_sse.h"
+#include "json_writer.h"
+#include "mcp_mem.h"
+#include <stdarg.h>
 #include <string.h>
 #include <esp_log.h>
 #include <esp_ota_ops.h>
@@ -19,9 +23,67 @@ static const char *TAG = "mcp_ota";
 static ota_state_t s_ota_state = OTA_STATE_IDLE;
 static int s_ota_progress_pct = 0;
 static char s_ota_message[128] = "idle";
+static int s_ota_bytes = 0;
+static int s_ota_total = 0;             /* 0 if the server sent no length */
+static char s_ota_progress_token[48];   /* progressToken of the sys_ota_push call, as JSON */
+static uint32_t s_ota_progress_session;  /* Session of that call (its streams get the progress) */
 
 #define OTA_BUF_SIZE 1024
 #define OTA_AUTO_CONFIRM_SEC 60
+#define OTA_NOTIFY_BYTES (64 * 1024)    /* Progress push interval without a length */
+
+static const char *ota_state_name(ota_state_t state)
+{
+    switch (state) {
+        case OTA_STATE_IDLE:        return "idle";
+        case OTA_STATE_DOWNLOADING: return "downloading";
+        case OTA_STATE_WRITING:     return "writing";
+        case OTA_STATE_REBOOTING:   return "rebooting";
+        case OTA_STATE_ERROR:       return "error";
+        default:                    return "unknown";
+    }
+}
+
+/* --- Push the current state to event-stream subscribers --- */
+static void ota_notify(void)
+{
+    if (!mcp_sse_active()) {
+        return;
+    }
+
+    char buf[256];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    json_writer_object_begin(&w);
+    json_writer_key(&w, "state");
+    json_writer_string(&w, ota_state_name(s_ota_state));
+    json_writer_key(&w, "progress_pct");
+    json_writer_int(&w, s_ota_progress_pct);
+    json_writer_key(&w, "bytes");
+    json_writer_int(&w, s_ota_bytes);
+    json_writer_key(&w, "message");
+    json_writer_string(&w, s_ota_message);
+    json_writer_object_end(&w);
+    if (w.err == ESP_OK) {
+        mcp_sse_notify_message(s_ota_state == OTA_STATE_ERROR ? "error" : "info",
+                               "ota", w.buf, w.len);
+    }
+    json_writer_release(&w);
+
+    if (s_ota_progress_token[0]) {
+        mcp_sse_notify_progress(s_ota_progress_session, s_ota_progress_token, s_ota_bytes, s_ota_total, s_ota_message);
+    }
+}
+
+static void ota_set_state(ota_state_t state, const char *fmt, ...)
+{
+    s_ota_state = state;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(s_ota_message, sizeof(s_ota_message), fmt, args);
+    va_end(args);
+    ota_notify();
+}
 
 /* --- Auto-confirm timer callback --- */
 static void ota_auto_confirm_timer_cb(void *arg)
@@ -42,9 +104,10 @@ static void ota_task(void *arg)
     char *url = (char *)arg;
     ESP_LOGI(TAG, "Starting OTA from: %s", url);
 
-    s_ota_state = OTA_STATE_DOWNLOADING;
     s_ota_progress_pct = 0;
-    snprintf(s_ota_message, sizeof(s_ota_message), "Connecting to %s", url);
+    s_ota_bytes = 0;
+    s_ota_total = 0;
+    ota_set_state(OTA_STATE_DOWNLOADING, "Connecting to %s", url);
 
     esp_http_client_config_t http_cfg = {
         .url = url,
@@ -53,8 +116,7 @@ static void ota_task(void *arg)
 
     esp_http_client_handle_t client = esp_http_client_init(&http_cfg);
     if (!client) {
-        s_ota_state = OTA_STATE_ERROR;
-        snprintf(s_ota_message, sizeof(s_ota_message), "HTTP client init failed");
+        ota_set_state(OTA_STATE_ERROR, "HTTP client init failed");
         free(url);
         vTaskDelete(NULL);
         return;
@@ -62,8 +124,7 @@ static void ota_task(void *arg)
 
     esp_err_t err = esp_http_client_open(client, 0);
     if (err != ESP_OK) {
-        s_ota_state = OTA_STATE_ERROR;
-        snprintf(s_ota_message, sizeof(s_ota_message), "HTTP open failed: %s", esp_err_to_name(err));
+        ota_set_state(OTA_STATE_ERROR, "HTTP open failed: %s", esp_err_to_name(err));
         esp_http_client_cleanup(client);
         free(url);
         vTaskDelete(NULL);
@@ -75,11 +136,11 @@ static void ota_task(void *arg)
         /* Try to proceed anyway — chunked transfer */
         content_length = 0;
     }
+    s_ota_total = content_length;
 
     const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
     if (!update_partition) {
-        s_ota_state = OTA_STATE_ERROR;
-        snprintf(s_ota_message, sizeof(s_ota_message), "No OTA partition available");
+        ota_set_state(OTA_STATE_ERROR, "No OTA partition available");
         esp_http_client_cleanup(client);
         free(url);
         vTaskDelete(NULL);
@@ -92,23 +153,29 @@ static void ota_task(void *arg)
     esp_ota_handle_t ota_handle;
     err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
     if (err != ESP_OK) {
-        s_ota_state = OTA_STATE_ERROR;
-        snprintf(s_ota_message, sizeof(s_ota_message), "OTA begin failed: %s", esp_err_to_name(err));
+        ota_set_state(OTA_STATE_ERROR, "OTA begin failed: %s", esp_err_to_name(err));
         esp_http_client_cleanup(client);
         free(url);
         vTaskDelete(NULL);
         return;
     }
 
-    s_ota_state = OTA_STATE_WRITING;
-    char *buf = malloc(OTA_BUF_SIZE);
+    char *buf = mcp_mem_malloc(MCP_MEM_OTA, OTA_BUF_SIZE);
+    if (!buf) {
+        ota_set_state(OTA_STATE_ERROR, "Out of memory");
+        esp_ota_abort(ota_handle);
+        esp_http_client_cleanup(client);
+        free(url);
+        vTaskDelete(NULL);
+        return;
+    }
+    ota_set_state(OTA_STATE_WRITING, "Writing to %s", update_partition->label);
     int total_read = 0;
 
     while (1) {
         int read_len = esp_http_client_read(client, buf, OTA_BUF_SIZE);
         if (read_len < 0) {
-            s_ota_state = OTA_STATE_ERROR;
-            snprintf(s_ota_message, sizeof(s_ota_message), "HTTP read error");
+            ota_set_state(OTA_STATE_ERROR, "HTTP read error");
             break;
         }
         if (read_len == 0) {
@@ -118,19 +185,25 @@ static void ota_task(void *arg)
 
         err = esp_ota_write(ota_handle, buf, read_len);
         if (err != ESP_OK) {
-            s_ota_state = OTA_STATE_ERROR;
-            snprintf(s_ota_message, sizeof(s_ota_message), "OTA write failed: %s", esp_err_to_name(err));
+            ota_set_state(OTA_STATE_ERROR, "OTA write failed: %s", esp_err_to_name(err));
             break;
         }
 
+        int prev_pct = s_ota_progress_pct;
         total_read += read_len;
+        s_ota_bytes = total_read;
         if (content_length > 0) {
             s_ota_progress_pct = (total_read * 100) / content_length;
         }
         snprintf(s_ota_message, sizeof(s_ota_message), "Written %d bytes", total_read);
+        /* Push on each new percent (or every OTA_NOTIFY_BYTES), not every read */
+        if (s_ota_progress_pct != prev_pct ||
+            (content_length == 0 && total_read % OTA_NOTIFY_BYTES < read_len)) {
+            ota_notify();
+        }
     }
 
-    free(buf);
+    mcp_mem_free(MCP_MEM_OTA, buf);
     esp_http_client_close(client);
     esp_http_client_cleanup(client);
     free(url);
@@ -143,23 +216,20 @@ static void ota_task(void *arg)
 
     err = esp_ota_end(ota_handle);
     if (err != ESP_OK) {
-        s_ota_state = OTA_STATE_ERROR;
-        snprintf(s_ota_message, sizeof(s_ota_message), "OTA end failed: %s", esp_err_to_name(err));
+        ota_set_state(OTA_STATE_ERROR, "OTA end failed: %s", esp_err_to_name(err));
         vTaskDelete(NULL);
         return;
     }
 
     err = esp_ota_set_boot_partition(update_partition);
     if (err != ESP_OK) {
-        s_ota_state = OTA_STATE_ERROR;
-        snprintf(s_ota_message, sizeof(s_ota_message), "Set boot partition failed: %s", esp_err_to_name(err));
+        ota_set_state(OTA_STATE_ERROR, "Set boot partition failed: %s", esp_err_to_name(err));
         vTaskDelete(NULL);
         return;
     }
 
-    s_ota_state = OTA_STATE_REBOOTING;
     s_ota_progress_pct = 100;
-    snprintf(s_ota_message, sizeof(s_ota_message), "OTA complete, rebooting in 2s...");
+    ota_set_state(OTA_STATE_REBOOTING, "OTA complete, rebooting in 2s...");
     ESP_LOGI(TAG, "OTA complete (%d bytes). Rebooting...", total_read);
 
     vTaskDelay(pdMS_TO_TICKS(2000));
@@ -194,54 +264,53 @@ esp_err_t mcp_ota_init(void)
     return ESP_OK;
 }
 
-esp_err_t tool_sys_ota_push(cJSON *args, char *result, size_t max_len)
+esp_err_t tool_sys_ota_push(cJSON *args, mcp_result_t *result)
 {
     if (s_ota_state == OTA_STATE_DOWNLOADING || s_ota_state == OTA_STATE_WRITING) {
-        snprintf(result, max_len, "OTA already in progress (state: %d, progress: %d%%)",
+        mcp_result_printf(result, "OTA already in progress (state: %d, progress: %d%%)",
                  s_ota_state, s_ota_progress_pct);
         return ESP_ERR_INVALID_STATE;
     }
 
     cJSON *url_item = cJSON_GetObjectItem(args, "url");
     if (!url_item || !cJSON_IsString(url_item) || strlen(url_item->valuestring) == 0) {
-        snprintf(result, max_len, "Missing or empty 'url' parameter");
+        mcp_result_printf(result, "Missing or empty 'url' parameter");
         return ESP_ERR_INVALID_ARG;
     }
 
+    /* Progress of this download goes to the caller's progressToken, if any */
+    s_ota_progress_token[0] = '\0';
+    s_ota_progress_session = result->session;
+    if (result->progress_token && strlen(result->progress_token) < sizeof(s_ota_progress_token)) {
+        strcpy(s_ota_progress_token, result->progress_token);
+    }
+
     /* Copy URL for the task (task will free it) */
     char *url = strdup(url_item->valuestring);
     if (!url) {
-        snprintf(result, max_len, "Out of memory");
+        mcp_result_printf(result, "Out of memory");
         return ESP_ERR_NO_MEM;
     }
 
     BaseType_t ret = xTaskCreate(ota_task, "ota_task", 8192, url, 5, NULL);
     if (ret != pdPASS) {
         free(url);
-        snprintf(result, max_len, "Failed to create OTA task");
+        mcp_result_printf(result, "Failed to create OTA task");
         return ESP_FAIL;
     }
 
-    snprintf(result, max_len, "OTA update started from: %s", url_item->valuestring);
+    mcp_result_printf(result, "OTA update started from: %s", url_item->valuestring);
     return ESP_OK;
 }
 
-esp_err_t tool_sys_ota_status(cJSON *args, char *result, size_t max_len)
+esp_err_t tool_sys_ota_status(cJSON *args, mcp_result_t *result)
 {
-    const char *state_str;
-    switch (s_ota_state) {
-        case OTA_STATE_IDLE:        state_str = "idle"; break;
-        case OTA_STATE_DOWNLOADING: state_str = "downloading"; break;
-        case OTA_STATE_WRITING:     state_str = "writing"; break;
-        case OTA_STATE_REBOOTING:   state_str = "rebooting"; break;
-        case OTA_STATE_ERROR:       state_str = "error"; break;
-        default:                    state_str = "unknown"; break;
-    }
+    const char *state_str = ota_state_name(s_ota_state);
 
     const esp_partition_t *running = esp_ota_get_running_partition();
     const esp_app_desc_t *app_desc = esp_app_get_description();
 
-    snprintf(result, max_len,
+    mcp_result_printf(result,
         "{\"state\":\"%s\",\"progress_pct\":%d,\"message\":\"%s\","
         "\"partition\":\"%s\",\"app_version\":\"%s\"}",
         state_str, s_ota_progress_pct, s_ota_message,
@@ -251,10 +320,10 @@ esp_err_t tool_sys_ota_status(cJSON *args, char *result, size_t max_len)
     return ESP_OK;
 }
 
-esp_err_t tool_sys_ota_rollback(cJSON *args, char *result, size_t max_len)
+esp_err_t tool_sys_ota_rollback(cJSON *args, mcp_result_t *result)
 {
     ESP_LOGW(TAG, "Rollback requested — marking app invalid and rebooting");
-    snprintf(result, max_len, "Rolling back to previous firmware and rebooting...");
+    mcp_result_printf(result, "Rolling back to previous firmware and rebooting...");
 
     /* Use a short delay so the response can be sent before reboot */
     esp_ota_mark_app_invalid_rollback_and_reboot();
@@ -263,10 +332,10 @@ esp_err_t tool_sys_ota_rollback(cJSON *args, char *result, size_t max_len)
     return ESP_OK;
 }
 
-esp_err_t tool_sys_reboot(cJSON *args, char *result, size_t max_len)
+esp_err_t tool_sys_reboot(cJSON *args, mcp_result_t *result)
 {
     ESP_LOGW(TAG, "Reboot requested via MCP tool");
-    snprintf(result, max_len, "Rebooting device...");
+    mcp_result_printf(result, "Rebooting device...");
 
     /* Schedule reboot after a short delay so response can be sent */
     vTaskDelay(pdMS_TO_TICKS(500));
@@ -11,6 +11,7 @@
 
 #include <esp_err.h>
 #include <cJSON.h>
+#include "mcp_tools.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,25 +43,25 @@ esp_err_t mcp_ota_init(void);
  * Parameters:
  *   url - HTTP(S) URL to firmware binary
  */
-esp_err_t tool_sys_ota_push(cJSON *args, char *result, size_t max_len);
+esp_err_t tool_sys_ota_push(cJSON *args, mcp_result_t *result);
 
 /**
  * Tool handler: sys_ota_status
  * Returns current OTA state and progress.
  */
-esp_err_t tool_sys_ota_status(cJSON *args, char *result, size_t max_len);
+esp_err_t tool_sys_ota_status(cJSON *args, mcp_result_t *result);
 
 /**
  * Tool handler: sys_ota_rollback
  * Marks current app invalid and reboots to previous version.
  */
-esp_err_t tool_sys_ota_rollback(cJSON *args, char *result, size_t max_len);
+esp_err_t tool_sys_ota_rollback(cJSON *args, mcp_result_t *result);
 
 /**
  * Tool handler: sys_reboot
  * Reboots the device.
  */
-esp_err_t tool_sys_reboot(cJSON *args, char *result, size_t max_len);
+esp_err_t tool_sys_reboot(cJSON *args, mcp_result_t *result);
 
 #ifdef __cplusplus
 }
@@ -4,11 +4,16 @@
 
 #include "mcp_protocol.h"
 #include "mcp_tools.h"
+#include "mcp_sse.h"
+#include "mcp_executor.h"
+#include "mcp_resources.h"
+#include "jsonrpc.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <esp_log.h>
 
 static const char *TAG = "mcp_protocol";
-static bool initialized = false;
 
 esp_err_t mcp_protocol_init(void)
 {
@@ -21,36 +26,44 @@ esp_err_t mcp_protocol_init(void)
         return ret;
     }
     
-    initialized = false; // Will be set to true after client sends initialize
     ESP_LOGI(TAG, "MCP protocol handler ready");
     return ESP_OK;
 }
 
-bool mcp_is_initialized(void)
-{
-    return initialized;
-}
-
-esp_err_t mcp_handle_initialize(cJSON *params, cJSON **result)
+esp_err_t mcp_handle_initialize(mcp_session_t *session, cJSON *params, cJSON **result)
 {
     if (!params || !result) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    ESP_LOGI(TAG, "Handling initialize request");
+    ESP_LOGI(TAG, "Handling initialize request (session %d)", MCP_SESSION_ORIGIN(session));
 
-    // Extract client info (optional, for logging)
+    // Extract client info (optional, kept in the session)
     cJSON *client_info = cJSON_GetObjectItem(params, "clientInfo");
     if (client_info) {
         cJSON *name = cJSON_GetObjectItem(client_info, "name");
         cJSON *version = cJSON_GetObjectItem(client_info, "version");
         if (name && cJSON_IsString(name)) {
             ESP_LOGI(TAG, "Client: %s", name->valuestring);
+            if (session) {
+                snprintf(session->client_name, sizeof(session->client_name), "%s", name->valuestring);
+            }
         }
         if (version && cJSON_IsString(version)) {
             ESP_LOGI(TAG, "Client version: %s", version->valuestring);
         }
     }
+    if (session) {
+        cJSON *version = cJSON_GetObjectItem(params, "protocolVersion");
+        if (cJSON_IsString(version)) {
+            snprintf(session->protocol_version, sizeof(session->protocol_version), "%s",
+                     version->valuestring);
+        }
+        cJSON *caps = cJSON_GetObjectItem(params, "capabilities");
+        session->client_caps = (cJSON_HasObjectItem(caps, "roots") ? MCP_CLIENT_CAP_ROOTS : 0) |
+                               (cJSON_HasObjectItem(caps, "sampling") ? MCP_CLIENT_CAP_SAMPLING : 0) |
+                               (cJSON_HasObjectItem(caps, "elicitation") ? MCP_CLIENT_CAP_ELICITATION : 0);
+    }
 
     // Create response
     cJSON *response = cJSON_CreateObject();
@@ -65,7 +78,13 @@ esp_err_t mcp_handle_initialize(cJSON *params, cJSON **result)
     // Capabilities
     cJSON *capabilities = cJSON_CreateObject();
     cJSON *tools_cap = cJSON_CreateObject();
+    cJSON_AddBoolToObject(tools_cap, "listChanged", true);
     cJSON_AddItemToObject(capabilities, "tools", tools_cap);
+    cJSON *resources_cap = cJSON_CreateObject();
+    cJSON_AddBoolToObject(resources_cap, "subscribe", true);
+    cJSON_AddBoolToObject(resources_cap, "listChanged", false);
+    cJSON_AddItemToObject(capabilities, "resources", resources_cap);
+    cJSON_AddItemToObject(capabilities, "logging", cJSON_CreateObject());
     cJSON_AddItemToObject(response, "capabilities", capabilities);
 
     // Server info
@@ -75,45 +94,65 @@ esp_err_t mcp_handle_initialize(cJSON *params, cJSON **result)
     cJSON_AddItemToObject(response, "serverInfo", server_info);
 
     *result = response;
-    initialized = true;
+    if (session) {
+        session->initialized = true;
+    }
     
     ESP_LOGI(TAG, "MCP server initialized");
     return ESP_OK;
 }
 
-esp_err_t mcp_handle_tools_list(cJSON *params, cJSON **result)
+esp_err_t mcp_write_tools_list(mcp_session_t *session, cJSON *params, int id, json_writer_t *w)
 {
-    if (!result) {
+    (void)session;
+    (void)params;
+    if (!w) {
         return ESP_ERR_INVALID_ARG;
     }
 
     ESP_LOGI(TAG, "Handling tools/list request");
 
-    // Get tools array from tool registry
-    cJSON *tools_array = mcp_tools_get_list();
-    if (!tools_array) {
+    const mcp_tools_list_t *list = mcp_tools_list_get();
+    if (!list) {
         ESP_LOGE(TAG, "Failed to get tools list");
         return ESP_ERR_NO_MEM;
     }
 
-    // Create response
-    cJSON *response = cJSON_CreateObject();
-    if (!response) {
-        cJSON_Delete(tools_array);
-        ESP_LOGE(TAG, "Failed to create response object");
-        return ESP_ERR_NO_MEM;
-    }
+    char etag[9];
+    snprintf(etag, sizeof(etag), "%08lx", (unsigned long)list->etag);
 
-    cJSON_AddItemToObject(response, "tools", tools_array);
-    *result = response;
+    jsonrpc_write_result_begin(w, id);
+    json_writer_object_begin(w);
+    json_writer_key(w, "tools");
+    json_writer_raw(w, list->json, list->len);
+    json_writer_key(w, "_meta");
+    json_writer_object_begin(w);
+    json_writer_key(w, "etag");
+    json_writer_string(w, etag);
+    json_writer_object_end(w);
+    json_writer_object_end(w);
+    jsonrpc_write_result_end(w);
 
-    ESP_LOGI(TAG, "Returned %d tools", cJSON_GetArraySize(tools_array));
+    mcp_tools_list_put(list);
     return ESP_OK;
 }
 
-esp_err_t mcp_handle_tools_call(cJSON *params, cJSON **result)
+/* Tool result sink that escapes straight into the response text value */
+typedef struct {
+    mcp_result_t base;
+    json_writer_t *w;
+} writer_result_t;
+
+static esp_err_t writer_result_write(mcp_result_t *r, const char *data, size_t len)
 {
-    if (!params || !result) {
+    json_writer_t *w = ((writer_result_t *)r)->w;
+    json_writer_string_append(w, data, len);
+    return w->err;
+}
+
+esp_err_t mcp_write_tools_call(mcp_session_t *session, cJSON *params, int id, json_writer_t *w)
+{
+    if (!params || !w) {
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -127,50 +166,245 @@ esp_err_t mcp_handle_tools_call(cJSON *params, cJSON **result)
 
     // Extract arguments
     cJSON *arguments = cJSON_GetObjectItem(params, "arguments");
+    cJSON *empty_args = NULL;
     if (!arguments) {
         // Create empty arguments object if not provided
-        arguments = cJSON_CreateObject();
+        arguments = empty_args = cJSON_CreateObject();
         if (!arguments) {
             return ESP_ERR_NO_MEM;
         }
     }
 
+    // Progress token, kept as JSON so tools can echo it in notifications
+    char *progress_token = NULL;
+    cJSON *meta = cJSON_GetObjectItem(params, "_meta");
+    cJSON *token_item = cJSON_GetObjectItem(meta, "progressToken");
+    if (cJSON_IsString(token_item) || cJSON_IsNumber(token_item)) {
+        progress_token = cJSON_PrintUnformatted(token_item);
+    }
+
     ESP_LOGI(TAG, "Calling tool: %s", tool_name);
+    if (session) {
+        atomic_fetch_add(&session->tool_calls, 1);
+    }
+
+    // Write {"content":[{"type":"text","text":...}],"isError":true}; the
+    // tool's output is escaped into the text value as it is produced
+    jsonrpc_write_result_begin(w, id);
+    json_writer_object_begin(w);
+    json_writer_key(w, "content");
+    json_writer_array_begin(w);
+    json_writer_object_begin(w);
+    json_writer_key(w, "type");
+    json_writer_string(w, "text");
+    json_writer_key(w, "text");
+    json_writer_string_begin(w);
 
     // Execute tool
-    char result_text[2048]; // MCP_MAX_TOOL_RESULT_SIZE
+    writer_result_t sink = {
+        .base = {
+            .write = writer_result_write,
+            .budget = MCP_MAX_TOOL_RESULT_SIZE,
+            .progress_token = progress_token,
+            .session = session ? session->sid : 0,
+            .cancelled = mcp_executor_cancel_flag(),
+        },
+        .w = w,
+    };
+    if (sink.base.cancelled) {
+        // Queued calls report when they leave the queue
+        mcp_result_progress(&sink.base, 0, 0, "Started");
+    }
     bool is_error = false;
-    esp_err_t ret = mcp_tools_execute(tool_name, arguments, result_text, sizeof(result_text), &is_error);
+    esp_err_t ret = mcp_tools_execute(tool_name, arguments, &sink.base, &is_error);
+    cJSON_Delete(empty_args);
+    cJSON_free(progress_token);
 
-    // Create result object
-    cJSON *response = cJSON_CreateObject();
-    if (!response) {
-        ESP_LOGE(TAG, "Failed to create response object");
-        return ESP_ERR_NO_MEM;
+    if (sink.base.truncated) {
+        char note[64];
+        int n = snprintf(note, sizeof(note), "\n[truncated at %u bytes]", (unsigned)sink.base.budget);
+        json_writer_string_append(w, note, (size_t)n);
+        ESP_LOGW(TAG, "Tool %s output truncated at %u bytes", tool_name, (unsigned)sink.base.budget);
     }
-
-    // Create content array
-    cJSON *content = cJSON_CreateArray();
-    cJSON *text_block = cJSON_CreateObject();
-    cJSON_AddStringToObject(text_block, "type", "text");
-    cJSON_AddStringToObject(text_block, "text", result_text);
-    cJSON_AddItemToArray(content, text_block);
-    cJSON_AddItemToObject(response, "content", content);
+    json_writer_string_end(w);
+    json_writer_object_end(w);
+    json_writer_array_end(w);
 
     // Add isError flag if tool execution failed
     if (is_error || ret != ESP_OK) {
-        cJSON_AddBoolToObject(response, "isError", true);
-        ESP_LOGW(TAG, "Tool execution failed: %s", result_text);
+        json_writer_key(w, "isError");
+        json_writer_bool(w, true);
+        ESP_LOGW(TAG, "Tool execution failed: %s (%s)", tool_name, esp_err_to_name(ret));
     } else {
         ESP_LOGI(TAG, "Tool executed successfully");
     }
 
+    json_writer_object_end(w);
+    jsonrpc_write_result_end(w);
+    return ESP_OK;
+}
+
+static void write_resource(const mcp_resource_t *res, void *ctx)
+{
+    json_writer_t *w = ctx;
+    json_writer_object_begin(w);
+    json_writer_key(w, "uri");
+    json_writer_string(w, res->uri);
+    json_writer_key(w, "name");
+    json_writer_string(w, res->name);
+    if (res->description) {
+        json_writer_key(w, "description");
+        json_writer_string(w, res->description);
+    }
+    json_writer_key(w, "mimeType");
+    json_writer_string(w, res->mime_type);
+    if (res->size >= 0) {
+        json_writer_key(w, "size");
+        json_writer_int(w, res->size);
+    }
+    json_writer_object_end(w);
+}
+
+esp_err_t mcp_write_resources_list(mcp_session_t *session, cJSON *params, int id, json_writer_t *w)
+{
+    (void)session;
+    (void)params;
+    if (!w) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    jsonrpc_write_result_begin(w, id);
+    json_writer_object_begin(w);
+    json_writer_key(w, "resources");
+    json_writer_array_begin(w);
+    mcp_resources_foreach(write_resource, w);
+    json_writer_array_end(w);
+    json_writer_object_end(w);
+    jsonrpc_write_result_end(w);
+    return ESP_OK;
+}
+
+esp_err_t mcp_write_resources_read(mcp_session_t *session, cJSON *params, int id, json_writer_t *w)
+{
+    if (!params || !w) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cJSON *uri = cJSON_GetObjectItem(params, "uri");
+    if (!cJSON_IsString(uri)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mcp_resource_t res;
+    if (mcp_resources_find(uri->valuestring, &res) != ESP_OK) {
+        jsonrpc_write_error(w, id, MCP_ERROR_RESOURCE_NOT_FOUND, "Resource not found");
+        return ESP_OK;
+    }
+
+    // {"contents":[{"uri":...,"mimeType":...,"text":...}]}
+    jsonrpc_write_result_begin(w, id);
+    json_writer_object_begin(w);
+    json_writer_key(w, "contents");
+    json_writer_array_begin(w);
+    json_writer_object_begin(w);
+    json_writer_key(w, "uri");
+    json_writer_string(w, res.uri);
+    json_writer_key(w, "mimeType");
+    json_writer_string(w, res.mime_type);
+    json_writer_key(w, "text");
+    json_writer_string_begin(w);
+
+    writer_result_t sink = {
+        .base = {
+            .write = writer_result_write,
+            .budget = MCP_MAX_TOOL_RESULT_SIZE,
+            .session = session ? session->sid : 0,
+            .cancelled = mcp_executor_cancel_flag(),
+        },
+        .w = w,
+    };
+    esp_err_t ret = mcp_resources_read(sink.base.session, res.uri, &sink.base);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Reading %s failed: %s", res.uri, esp_err_to_name(ret));
+    }
+    if (sink.base.truncated) {
+        char note[64];
+        int n = snprintf(note, sizeof(note), "\n[truncated at %u bytes]", (unsigned)sink.base.budget);
+        json_writer_string_append(w, note, (size_t)n);
+    }
+    json_writer_string_end(w);
+    json_writer_object_end(w);
+    json_writer_array_end(w);
+    json_writer_object_end(w);
+    jsonrpc_write_result_end(w);
+    return ESP_OK;
+}
+
+esp_err_t mcp_handle_resources_subscribe(mcp_session_t *session, cJSON *params, cJSON **result)
+{
+    if (!params || !result) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cJSON *uri = cJSON_GetObjectItem(params, "uri");
+    if (!cJSON_IsString(uri)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t ret = mcp_resources_subscribe(session ? session->sid : 0, uri->valuestring);
+    if (ret != ESP_OK) {
+        return ret == ESP_ERR_NOT_FOUND ? ESP_ERR_INVALID_ARG : ret;
+    }
+
+    *result = cJSON_CreateObject();
+    return *result ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t mcp_handle_resources_unsubscribe(mcp_session_t *session, cJSON *params, cJSON **result)
+{
+    if (!params || !result) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cJSON *uri = cJSON_GetObjectItem(params, "uri");
+    if (!cJSON_IsString(uri)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mcp_resources_unsubscribe(session ? session->sid : 0, uri->valuestring);
+
+    *result = cJSON_CreateObject();
+    return *result ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t mcp_handle_logging_set_level(mcp_session_t *session, cJSON *params, cJSON **result)
+{
+    if (!params || !result) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    cJSON *level = cJSON_GetObjectItem(params, "level");
+    esp_log_level_t log_level;
+    if (!cJSON_IsString(level) || mcp_sse_parse_level(level->valuestring, &log_level) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (session) {
+        session->log_level = log_level;
+    }
+    mcp_sse_set_log_level(session ? session->sid : 0, log_level);
+
+    // logging/setLevel returns an empty object
+    cJSON *response = cJSON_CreateObject();
+    if (!response) {
+        ESP_LOGE(TAG, "Failed to create response object");
+        return ESP_ERR_NO_MEM;
+    }
+
     *result = response;
     return ESP_OK;
 }
 
-esp_err_t mcp_handle_ping(cJSON *params, cJSON **result)
+esp_err_t mcp_handle_ping(mcp_session_t *session, cJSON *params, cJSON **result)
 {
+    (void)session;
+    (void)params;
     if (!result) {
         return ESP_ERR_INVALID_ARG;
     }
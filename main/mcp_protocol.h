@@ -1,7 +1,8 @@
 /*
  * MCP Protocol Handler
  * 
- * Implements Model Context Protocol methods
+ * Implements Model Context Protocol methods. Handlers get the session the
+ * request belongs to, or NULL for a sessionless request.
  */
 
 #ifndef MCP_PROTOCOL_H
@@ -10,6 +11,8 @@
 #include <stdbool.h>
 #include <esp_err.h>
 #include <cJSON.h>
+#include "json_writer.h"
+#include "mcp_session.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -32,7 +35,10 @@ extern "C" {
 typedef enum {
     MCP_ERROR_TOOL_NOT_FOUND = -32001,      // Tool not found
     MCP_ERROR_TOOL_EXECUTION = -32002,      // Tool execution failed
-    MCP_ERROR_NOT_INITIALIZED = -32003      // Server not initialized
+    MCP_ERROR_NOT_INITIALIZED = -32003,     // Server not initialized
+    MCP_ERROR_SERVER_BUSY = -32004,         // Tool queue full
+    MCP_ERROR_RESOURCE_NOT_FOUND = -32002,  // resources/read of an unknown URI (the spec's code)
+    MCP_ERROR_REQUEST_CANCELLED = -32800    // Cancelled by notifications/cancelled
 } mcp_error_code_t;
 
 /**
@@ -45,46 +51,105 @@ esp_err_t mcp_protocol_init(void);
 
 /**
  * Handle MCP initialize method
+ * Records the client's name, protocol version and capabilities in the
+ * session.
  * 
+ * @param session Session, or NULL
  * @param params Request parameters
  * @param result Output result object (caller must free with cJSON_Delete)
  * @return ESP_OK on success
  */
-esp_err_t mcp_handle_initialize(cJSON *params, cJSON **result);
+esp_err_t mcp_handle_initialize(mcp_session_t *session, cJSON *params, cJSON **result);
 
 /**
  * Handle MCP tools/list method
+ * Writes the cached tools array; _meta.etag identifies its content, so a
+ * client can tell whether its copy is still current.
  * 
+ * @param session Session, or NULL (unused)
  * @param params Request parameters (unused)
- * @param result Output result object (caller must free with cJSON_Delete)
+ * @param id Request ID
+ * @param w Output writer
  * @return ESP_OK on success
  */
-esp_err_t mcp_handle_tools_list(cJSON *params, cJSON **result);
+esp_err_t mcp_write_tools_list(mcp_session_t *session, cJSON *params, int id, json_writer_t *w);
 
 /**
  * Handle MCP tools/call method
+ * Validates params, then writes the complete response straight to the
+ * writer while the tool runs (its output is streamed into the text value).
+ * Returns an error without writing anything on bad params, so the caller
+ * can write an error response instead.
+ * Progress notifications go to the session's event streams.
  * 
+ * @param session Session, or NULL
  * @param params Request parameters (must contain "name" and "arguments")
- * @param result Output result object (caller must free with cJSON_Delete)
+ * @param id Request ID
+ * @param w Output writer
  * @return ESP_OK on success
  */
-esp_err_t mcp_handle_tools_call(cJSON *params, cJSON **result);
+esp_err_t mcp_write_tools_call(mcp_session_t *session, cJSON *params, int id, json_writer_t *w);
 
 /**
- * Handle MCP ping method
+ * Handle MCP resources/list method
+ * Writes the fixed device resources followed by one spiffs:// resource
+ * per script.
  * 
+ * @param session Session, or NULL (unused)
  * @param params Request parameters (unused)
+ * @param id Request ID
+ * @param w Output writer
+ * @return ESP_OK on success
+ */
+esp_err_t mcp_write_resources_list(mcp_session_t *session, cJSON *params, int id, json_writer_t *w);
+
+/**
+ * Handle MCP resources/read method
+ * Streams the resource text into the response like a tool result. An
+ * unknown URI gets a -32002 error response.
+ * 
+ * @param session Session, or NULL (its pending update counts as read)
+ * @param params Request parameters (must contain "uri")
+ * @param id Request ID
+ * @param w Output writer
+ * @return ESP_OK on success
+ */
+esp_err_t mcp_write_resources_read(mcp_session_t *session, cJSON *params, int id, json_writer_t *w);
+
+/**
+ * Handle MCP resources/subscribe and resources/unsubscribe methods
+ * Updates go to the session's event streams (sessionless streams share
+ * one set of subscriptions).
+ * 
+ * @param session Session, or NULL
+ * @param params Request parameters (must contain "uri")
  * @param result Output result object (caller must free with cJSON_Delete)
  * @return ESP_OK on success
  */
-esp_err_t mcp_handle_ping(cJSON *params, cJSON **result);
+esp_err_t mcp_handle_resources_subscribe(mcp_session_t *session, cJSON *params, cJSON **result);
+esp_err_t mcp_handle_resources_unsubscribe(mcp_session_t *session, cJSON *params, cJSON **result);
 
 /**
- * Check if MCP server is initialized
+ * Handle logging/setLevel method
+ * Sets the minimum level of log lines pushed over the session's event
+ * streams (sessionless streams share one level).
  * 
- * @return true if initialized
+ * @param session Session, or NULL
+ * @param params Request parameters (must contain "level")
+ * @param result Output result object (caller must free with cJSON_Delete)
+ * @return ESP_OK on success
+ */
+esp_err_t mcp_handle_logging_set_level(mcp_session_t *session, cJSON *params, cJSON **result);
+
+/**
+ * Handle MCP ping method
+ * 
+ * @param session Session, or NULL (unused)
+ * @param params Request parameters (unused)
+ * @param result Output result object (caller must free with cJSON_Delete)
+ * @return ESP_OK on success
  */
-bool mcp_is_initialized(void);
+esp_err_t mcp_handle_ping(mcp_session_t *session, cJSON *params, cJSON **result);
 
 #ifdef __cplusplus
 }
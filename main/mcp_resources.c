@@ -0,0 +1,348 @@
+/*
+ * MCP Resources Implementation
+ *
+ * Reads go through the tools that already produce the same text, so a
+ * resource and its tool never disagree. Subscriptions live in a small
+ * table under one mutex. Change sources only mark a subscription dirty;
+ * the SSE sender task tick sends the notifications (to the session's
+ * streams, or its connection for a WebSocket session), rate limited per
+ * subscription by CONFIG_MCP_RESOURCE_NOTIFY_MS, so a busy log cannot
+ * flood a client.
+ */
+
+#include "mcp_resources.h"
+#include "mcp_log.h"
+#include "mcp_sse.h"
+#include "lua_runtime.h"
+#include <stdio.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "sdkconfig.h"
+
+static const char *TAG = "mcp_resources";
+
+#define RES_SUBS            CONFIG_MCP_RESOURCE_SUBSCRIPTIONS
+#define RES_NOTIFY_US       ((int64_t)CONFIG_MCP_RESOURCE_NOTIFY_MS * 1000)
+#define RES_STATUS_US       ((int64_t)CONFIG_MCP_RESOURCE_STATUS_SEC * 1000000)
+#define SCRIPT_SCHEME       "spiffs://"
+
+typedef enum {
+    RES_STATUS,
+    RES_LOGS,
+    RES_SCRIPT,
+} res_kind_t;
+
+// Fixed resources and the tool that renders each
+static const struct {
+    const char *uri;
+    const char *name;
+    const char *description;
+    const char *mime_type;
+    const char *tool;
+    const char *args_json;
+} s_fixed[] = {
+    [RES_STATUS] = {"device://status", "status",
+                    "Device status snapshot: network, memory, tasks, Lua, sessions (same as get_status)",
+                    "text/plain", "get_status", NULL},
+    [RES_LOGS]   = {"device://logs", "logs",
+                    "Most recent captured log lines at info and above (same as sys_get_logs)",
+                    "application/json", "sys_get_logs", "{\"lines\":50}"},
+};
+
+#define RES_FIXED_COUNT (sizeof(s_fixed) / sizeof(s_fixed[0]))
+
+typedef struct {
+    uint32_t sid;
+    char uri[MCP_RESOURCE_URI_MAX];     // "" while the slot is free
+    res_kind_t kind;
+    bool dirty;                         // Changed since the last notification
+    bool pending;                       // Notified, not read since
+    uint32_t log_seq;                   // device://logs: next line not yet reported
+    int64_t read_us;                    // Last read (or subscribe)
+    int64_t notified_us;
+} res_sub_t;
+
+static res_sub_t s_subs[RES_SUBS];
+static SemaphoreHandle_t s_lock = NULL;
+
+static esp_err_t res_kind(const char *uri, res_kind_t *kind)
+{
+    for (size_t i = 0; i < RES_FIXED_COUNT; i++) {
+        if (strcmp(uri, s_fixed[i].uri) == 0) {
+            *kind = (res_kind_t)i;
+            return ESP_OK;
+        }
+    }
+    const char *name = uri + strlen(SCRIPT_SCHEME);
+    if (strncmp(uri, SCRIPT_SCHEME, strlen(SCRIPT_SCHEME)) == 0 && name[0] != '\0' &&
+        name[0] != '.' && strchr(name, '/') == NULL && strlen(uri) < MCP_RESOURCE_URI_MAX) {
+        *kind = RES_SCRIPT;
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+static void res_fill_fixed(res_kind_t kind, mcp_resource_t *res)
+{
+    snprintf(res->uri, sizeof(res->uri), "%s", s_fixed[kind].uri);
+    res->name = s_fixed[kind].name;
+    res->description = s_fixed[kind].description;
+    res->mime_type = s_fixed[kind].mime_type;
+    res->size = -1;
+}
+
+static void res_fill_script(const char *name, size_t size, mcp_resource_t *res)
+{
+    snprintf(res->uri, sizeof(res->uri), SCRIPT_SCHEME "%s", name);
+    res->name = name;
+    res->description = NULL;
+    res->mime_type = "text/x-lua";
+    res->size = (int)size;
+}
+
+/* --- Change tracking (s_lock held) --- */
+
+static void sub_reset(res_sub_t *sub, int64_t now)
+{
+    sub->dirty = false;
+    sub->pending = false;
+    sub->log_seq = mcp_log_next_seq();
+    sub->read_us = now;
+}
+
+// SSE sender task: mark what changed, then notify what may be notified
+static void res_tick(void)
+{
+    if (!s_lock || xSemaphoreTake(s_lock, 0) != pdTRUE) {
+        return;     // Busy; the next wake comes within a second
+    }
+    int64_t now = esp_timer_get_time();
+    uint32_t log_seq = mcp_log_next_seq();
+    for (int i = 0; i < RES_SUBS; i++) {
+        res_sub_t *sub = &s_subs[i];
+        if (!sub->uri[0]) {
+            continue;
+        }
+        if (sub->kind == RES_LOGS && sub->log_seq != log_seq) {
+            sub->dirty = true;
+        } else if (sub->kind == RES_STATUS && now - sub->read_us >= RES_STATUS_US) {
+            sub->dirty = true;
+        }
+        if (!sub->dirty || sub->pending || now - sub->notified_us < RES_NOTIFY_US) {
+            continue;
+        }
+        if (mcp_sse_notify_resource_updated(sub->sid, sub->uri) == ESP_OK) {
+            sub->dirty = false;
+            sub->pending = true;
+            sub->log_seq = log_seq;
+            sub->notified_us = now;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+/* --- Public API --- */
+
+esp_err_t mcp_resources_init(void)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (!s_lock) {
+        return ESP_ERR_NO_MEM;
+    }
+    mcp_sse_set_tick(res_tick);
+    return ESP_OK;
+}
+
+typedef struct {
+    void (*fn)(const mcp_resource_t *res, void *ctx);
+    void *ctx;
+} foreach_ctx_t;
+
+static void foreach_script(const char *name, size_t size, void *ctx)
+{
+    foreach_ctx_t *fc = ctx;
+    mcp_resource_t res;
+    if (strlen(SCRIPT_SCHEME) + strlen(name) >= sizeof(res.uri)) {
+        return;     // Longer than any URI we accept
+    }
+    res_fill_script(name, size, &res);
+    fc->fn(&res, fc->ctx);
+}
+
+void mcp_resources_foreach(void (*fn)(const mcp_resource_t *res, void *ctx), void *ctx)
+{
+    if (!fn) {
+        return;
+    }
+    mcp_resource_t res;
+    for (size_t i = 0; i < RES_FIXED_COUNT; i++) {
+        res_fill_fixed((res_kind_t)i, &res);
+        fn(&res, ctx);
+    }
+    foreach_ctx_t fc = { .fn = fn, .ctx = ctx };
+    lua_runtime_foreach_script(foreach_script, &fc);
+}
+
+esp_err_t mcp_resources_find(const char *uri, mcp_resource_t *res)
+{
+    if (!uri || !res) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    res_kind_t kind;
+    if (res_kind(uri, &kind) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (kind != RES_SCRIPT) {
+        res_fill_fixed(kind, res);
+        return ESP_OK;
+    }
+    const char *name = uri + strlen(SCRIPT_SCHEME);
+    size_t size;
+    if (lua_runtime_stat_script(name, &size) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    res_fill_script(name, size, res);   // name points into uri
+    return ESP_OK;
+}
+
+static void result_out(void *ctx, const char *data, size_t len)
+{
+    mcp_result_write((mcp_result_t *)ctx, data, len);
+}
+
+esp_err_t mcp_resources_read(uint32_t sid, const char *uri, mcp_result_t *result)
+{
+    if (!uri || !result) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    res_kind_t kind;
+    if (res_kind(uri, &kind) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t ret;
+    if (kind == RES_SCRIPT) {
+        ret = lua_runtime_get_script(uri + strlen(SCRIPT_SCHEME), result_out, result);
+    } else {
+        cJSON *args = s_fixed[kind].args_json ? cJSON_Parse(s_fixed[kind].args_json) : cJSON_CreateObject();
+        if (!args) {
+            return ESP_ERR_NO_MEM;
+        }
+        bool is_error = false;
+        ret = mcp_tools_execute(s_fixed[kind].tool, args, result, &is_error);
+        cJSON_Delete(args);
+        if (ret == ESP_OK && is_error) {
+            ret = ESP_FAIL;
+        }
+    }
+
+    // The reader is now up to date
+    if (s_lock) {
+        int64_t now = esp_timer_get_time();
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        for (int i = 0; i < RES_SUBS; i++) {
+            if (s_subs[i].uri[0] && s_subs[i].sid == sid && strcmp(s_subs[i].uri, uri) == 0) {
+                sub_reset(&s_subs[i], now);
+            }
+        }
+        xSemaphoreGive(s_lock);
+    }
+    return ret;
+}
+
+esp_err_t mcp_resources_subscribe(uint32_t sid, const char *uri)
+{
+    if (!uri) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    res_kind_t kind;
+    if (res_kind(uri, &kind) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (!s_lock) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int64_t now = esp_timer_get_time();
+    res_sub_t *free_sub = NULL;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < RES_SUBS; i++) {
+        res_sub_t *sub = &s_subs[i];
+        if (!sub->uri[0]) {
+            if (!free_sub) {
+                free_sub = sub;
+            }
+        } else if (sub->sid == sid && strcmp(sub->uri, uri) == 0) {
+            xSemaphoreGive(s_lock);
+            return ESP_OK;  // Already subscribed
+        }
+    }
+    if (free_sub) {
+        free_sub->sid = sid;
+        free_sub->kind = kind;
+        free_sub->notified_us = 0;
+        sub_reset(free_sub, now);
+        snprintf(free_sub->uri, sizeof(free_sub->uri), "%s", uri);
+    }
+    xSemaphoreGive(s_lock);
+
+    if (!free_sub) {
+        ESP_LOGW(TAG, "Subscription to %s refused: %d in use", uri, RES_SUBS);
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG, "Session %u subscribed to %s", (unsigned)sid, uri);
+    return ESP_OK;
+}
+
+void mcp_resources_unsubscribe(uint32_t sid, const char *uri)
+{
+    if (!uri || !s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < RES_SUBS; i++) {
+        if (s_subs[i].uri[0] && s_subs[i].sid == sid && strcmp(s_subs[i].uri, uri) == 0) {
+            s_subs[i].uri[0] = '\0';
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void mcp_resources_close_session(uint32_t sid)
+{
+    if (!s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < RES_SUBS; i++) {
+        if (s_subs[i].sid == sid) {
+            s_subs[i].uri[0] = '\0';
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
+
+void mcp_resources_script_changed(const char *name)
+{
+    if (!name || !s_lock) {
+        return;
+    }
+    char uri[MCP_RESOURCE_URI_MAX];
+    int n = snprintf(uri, sizeof(uri), SCRIPT_SCHEME "%s", name);
+    if (n < 0 || (size_t)n >= sizeof(uri)) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < RES_SUBS; i++) {
+        if (s_subs[i].uri[0] && strcmp(s_subs[i].uri, uri) == 0) {
+            s_subs[i].dirty = true;
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
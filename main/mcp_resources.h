@@ -0,0 +1,97 @@
+/*
+ * MCP Resources
+ *
+ * Read-only views an agent can fetch and subscribe to instead of polling
+ * tools: device://status (get_status), device://logs (recent captured
+ * lines) and spiffs://<name> for every Lua script. A subscription gets
+ * notifications/resources/updated on the session's event streams when a
+ * script is written, when new log lines arrive, and periodically for the
+ * status. Updates are coalesced: after one notification the next waits
+ * until the client has read the resource again.
+ */
+
+#ifndef MCP_RESOURCES_H
+#define MCP_RESOURCES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include "mcp_tools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCP_RESOURCE_URI_MAX 48
+
+/**
+ * One resource, as listed by resources/list
+ */
+typedef struct {
+    char uri[MCP_RESOURCE_URI_MAX];
+    const char *name;
+    const char *description;            // NULL for scripts
+    const char *mime_type;
+    int size;                           // Bytes, or -1 if not known up front
+} mcp_resource_t;
+
+/**
+ * Create the subscription table and start watching for changes
+ * (safe to call more than once)
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t mcp_resources_init(void);
+
+/**
+ * Call fn for every resource: the fixed ones, then the scripts
+ */
+void mcp_resources_foreach(void (*fn)(const mcp_resource_t *res, void *ctx), void *ctx);
+
+/**
+ * Look up a resource by URI
+ *
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND for an unknown URI or missing script
+ */
+esp_err_t mcp_resources_find(const char *uri, mcp_resource_t *res);
+
+/**
+ * Write the content of a resource to a result sink. A pending update for
+ * the session's subscription counts as delivered.
+ *
+ * @param sid Reading session, or 0
+ * @return ESP_OK, ESP_ERR_NOT_FOUND, or the error of the underlying read
+ */
+esp_err_t mcp_resources_read(uint32_t sid, const char *uri, mcp_result_t *result);
+
+/**
+ * Subscribe a session to a resource. Scripts may be subscribed to before
+ * they exist.
+ *
+ * @param sid Session, or 0 for sessionless streams
+ * @return ESP_OK, ESP_ERR_NOT_FOUND for an unknown scheme or name,
+ *         ESP_ERR_NO_MEM when CONFIG_MCP_RESOURCE_SUBSCRIPTIONS are in use
+ */
+esp_err_t mcp_resources_subscribe(uint32_t sid, const char *uri);
+
+/**
+ * Drop one subscription (unknown ones are ignored)
+ */
+void mcp_resources_unsubscribe(uint32_t sid, const char *uri);
+
+/**
+ * Drop every subscription of a closed session
+ */
+void mcp_resources_close_session(uint32_t sid);
+
+/**
+ * A script was written or appended to
+ */
+void mcp_resources_script_changed(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MCP_RESOURCES_H
@@ -4,56 +4,382 @@
 
 #include "mcp_server.h"
 #include "jsonrpc.h"
+#include "json_writer.h"
 #include "mcp_protocol.h"
+#include "mcp_tools.h"
+#include "mcp_sse.h"
+#include "mcp_resources.h"
+#include "mcp_executor.h"
+#include "mcp_session.h"
+#include "mcp_bufpool.h"
+#include "mcp_arena.h"
+#include "mcp_metrics.h"
+#include "mcp_trace.h"
+#include "name_index.h"
+#include "lua_runtime.h"
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include "sdkconfig.h"
 
 static const char *TAG = "mcp_server";
 
 // Method dispatch table
 typedef struct {
     const char *method;
-    esp_err_t (*handler)(cJSON *params, cJSON **result);
+    esp_err_t (*handler)(mcp_session_t *session, cJSON *params, cJSON **result);        // Returns a result tree
+    esp_err_t (*writer)(mcp_session_t *session, cJSON *params, int id, json_writer_t *w); // Or writes the response itself
+    bool uses_params;   // Build the params tree before calling the handler
+    bool read_only;     // Never changes device state (tools/call: see tool flag)
 } mcp_method_entry_t;
 
 static const mcp_method_entry_t method_table[] = {
-    {"initialize", mcp_handle_initialize},
-    {"tools/list", mcp_handle_tools_list},
-    {"tools/call", mcp_handle_tools_call},
-    {"ping", mcp_handle_ping},
-    {NULL, NULL}  // Sentinel
+    {"initialize", mcp_handle_initialize, NULL, true, false},
+    {"tools/list", NULL, mcp_write_tools_list, false, true},
+    {"tools/call", NULL, mcp_write_tools_call, true, false},
+    {"resources/list", NULL, mcp_write_resources_list, false, true},
+    {"resources/read", NULL, mcp_write_resources_read, true, true},
+    {"resources/subscribe", mcp_handle_resources_subscribe, NULL, true, false},
+    {"resources/unsubscribe", mcp_handle_resources_unsubscribe, NULL, true, false},
+    {"ping", mcp_handle_ping, NULL, false, true},
+    {"logging/setLevel", mcp_handle_logging_set_level, NULL, true, false},
+    {NULL, NULL, NULL, false, false}  // Sentinel
 };
 
+#define METHOD_COUNT (sizeof(method_table) / sizeof(method_table[0]) - 1)
+static name_index_slot_t s_method_slots[NAME_INDEX_SLOTS(METHOD_COUNT)];
+static name_index_t s_method_index;
+static mcp_metric_t *s_method_metrics[METHOD_COUNT];
+
+/* Per-connection state kept in the httpd session context */
+typedef struct {
+    char *tx_buf;       // Pooled response buffer (MCP_BUF_TX_SIZE)
+    char *ws_rx;        // WebSocket message being reassembled, or NULL
+    size_t ws_rx_len;
+} mcp_conn_t;
+
+static void mcp_conn_free(void *ctx)
+{
+    mcp_conn_t *conn = ctx;
+    mcp_buf_put(conn->ws_rx);
+    mcp_buf_put(conn->tx_buf);
+    free(conn);
+}
+
+static mcp_conn_t *mcp_conn_get(httpd_req_t *req)
+{
+    if (!req->sess_ctx) {
+        mcp_conn_t *conn = calloc(1, sizeof(mcp_conn_t));
+        if (!conn) {
+            return NULL;
+        }
+        conn->tx_buf = mcp_buf_get(MCP_BUF_TX);
+        if (!conn->tx_buf) {
+            free(conn);
+            return NULL;
+        }
+        req->sess_ctx = conn;
+        req->free_ctx = mcp_conn_free;
+    }
+    return req->sess_ctx;
+}
+
+static bool ws_notify(uint32_t sid, const char *json, size_t len);
+
 esp_err_t mcp_server_init(void)
 {
     ESP_LOGI(TAG, "Initializing MCP server");
+
+    name_index_init(&s_method_index, s_method_slots, sizeof(s_method_slots) / sizeof(s_method_slots[0]));
+    for (const mcp_method_entry_t *entry = method_table; entry->method != NULL; entry++) {
+        if (name_index_add(&s_method_index, entry->method, entry) != ESP_OK) {
+            ESP_LOGE(TAG, "Cannot index method %s", entry->method);
+            return ESP_ERR_INVALID_STATE;
+        }
+        s_method_metrics[entry - method_table] = mcp_metrics_get(MCP_METRIC_METHOD, entry->method);
+    }
     
-    esp_err_t ret = mcp_protocol_init();
+    esp_err_t ret = mcp_bufpool_init();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "No buffer pool, buffers come from the heap");
+    }
+
+    ret = mcp_arena_init();
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "No request arenas, cJSON allocates from the heap");
+    }
+
+    ret = mcp_protocol_init();
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to initialize MCP protocol: %s", esp_err_to_name(ret));
         return ret;
     }
+
+    ret = mcp_session_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create session table: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = mcp_sse_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to initialize event stream: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    mcp_sse_set_ws_sink(ws_notify);
+
+    ret = mcp_resources_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create resource subscriptions: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = mcp_executor_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start tool executor: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+#if CONFIG_MCP_TRACE_AT_BOOT
+    if (mcp_trace_set_enabled(true) != ESP_OK) {
+        ESP_LOGW(TAG, "Tracing could not be started");
+    }
+#endif
     
     ESP_LOGI(TAG, "MCP server initialized successfully");
     return ESP_OK;
 }
 
-static esp_err_t mcp_dispatch_method(const char *method, cJSON *params, cJSON **result)
+static const mcp_method_entry_t *mcp_find_method(const char *method)
+{
+    return name_index_find(&s_method_index, method);
+}
+
+static esp_err_t mcp_dispatch_entry(const mcp_method_entry_t *entry, mcp_session_t *session,
+                                    jsonrpc_message_t *msg, json_writer_t *w)
+{
+    cJSON *params = NULL;
+    if (entry->uses_params && msg->params_json) {
+        params = jsonrpc_message_params(msg);
+        if (!params) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (entry->writer) {
+        return entry->writer(session, params, msg->id, w);
+    }
+
+    // Tree-based handler: serialize the result straight into the writer
+    cJSON *result = NULL;
+    esp_err_t ret = entry->handler(session, params, &result);
+    if (ret == ESP_OK && result) {
+        jsonrpc_write_result_begin(w, msg->id);
+        json_writer_cjson(w, result);
+        jsonrpc_write_result_end(w);
+    } else if (ret == ESP_OK) {
+        ret = ESP_FAIL;
+    }
+    cJSON_Delete(result);
+    return ret;
+}
+
+static esp_err_t mcp_dispatch_method(mcp_session_t *session, jsonrpc_message_t *msg, json_writer_t *w)
 {
-    if (!method || !result) {
+    if (!msg || !w) {
         return ESP_ERR_INVALID_ARG;
     }
     
     // Find method handler
-    for (const mcp_method_entry_t *entry = method_table; entry->method != NULL; entry++) {
-        if (strcmp(entry->method, method) == 0) {
-            return entry->handler(params, result);
+    const mcp_method_entry_t *entry = mcp_find_method(msg->method);
+    if (entry == NULL) {
+        ESP_LOGW(TAG, "Method not found: %s", msg->method);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    MCP_TRACE_BEGIN(MCP_TRACE_RPC, entry->method);
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = mcp_dispatch_entry(entry, session, msg, w);
+    mcp_metrics_record_since(s_method_metrics[entry - method_table], start, ret != ESP_OK);
+    MCP_TRACE_END(MCP_TRACE_RPC, entry->method);
+    return ret;
+}
+
+// notifications/cancelled: stop the request if it is still queued or running.
+// Requests without a session share one origin, so nothing tells one
+// sessionless client's request 7 from another's; those are not cancelled.
+static void mcp_handle_cancelled(jsonrpc_message_t *msg, mcp_session_t *session)
+{
+    cJSON *id = cJSON_GetObjectItem(jsonrpc_message_params(msg), "requestId");
+    if (!cJSON_IsNumber(id)) {
+        return;
+    }
+    if (!session) {
+        ESP_LOGW(TAG, "Ignoring cancellation of request %d without a session", id->valueint);
+        return;
+    }
+    if (!mcp_executor_cancel(MCP_SESSION_ORIGIN(session), id->valueint)) {
+        ESP_LOGD(TAG, "Nothing to cancel for request %d", id->valueint);
+    }
+}
+
+static void mcp_server_write_reply(jsonrpc_message_t *msg, mcp_session_t *session, json_writer_t *w)
+{
+    // Handle request
+    if (msg->type == JSONRPC_REQUEST) {
+        esp_err_t err = mcp_dispatch_method(session, msg, w);
+        if (session) {
+            atomic_fetch_add(&session->requests, 1);
+            if (err != ESP_OK) {
+                atomic_fetch_add(&session->errors, 1);
+            }
         }
+        
+        if (err == ESP_ERR_NOT_FOUND) {
+            jsonrpc_write_error(w, msg->id, JSONRPC_METHOD_NOT_FOUND, "Method not found");
+        } else if (err == ESP_ERR_INVALID_ARG) {
+            jsonrpc_write_error(w, msg->id, JSONRPC_INVALID_PARAMS, "Invalid parameters");
+        } else if (err != ESP_OK) {
+            jsonrpc_write_error(w, msg->id, JSONRPC_INTERNAL_ERROR, "Internal error");
+        }
+    } else if (msg->type == JSONRPC_NOTIFICATION) {
+        // Notifications don't get responses
+        ESP_LOGI(TAG, "Received notification: %s", msg->method);
+        if (strcmp(msg->method, "notifications/cancelled") == 0) {
+            mcp_handle_cancelled(msg, session);
+        }
+    } else {
+        jsonrpc_write_error(w, 0, JSONRPC_INVALID_REQUEST, "Invalid message type");
     }
     
-    ESP_LOGW(TAG, "Method not found: %s", method);
-    return ESP_ERR_NOT_FOUND;
+    // Cleanup
+    jsonrpc_message_cleanup(msg);
+}
+
+static esp_err_t mcp_parse(const char *json, size_t len, jsonrpc_message_t *msg)
+{
+    MCP_TRACE_BEGIN(MCP_TRACE_RPC, "parse");
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = jsonrpc_parse_message_len(json, len, msg);
+    mcp_metrics_record_since(mcp_metrics_stage(MCP_STAGE_PARSE), start, ret != ESP_OK);
+    MCP_TRACE_END(MCP_TRACE_RPC, "parse");
+    return ret;
+}
+
+/* --- JSON-RPC batches --- */
+
+// Request that cannot change device state, so it may run out of order
+static bool mcp_is_read_only(jsonrpc_message_t *msg)
+{
+    if (msg->type != JSONRPC_REQUEST) {
+        return false;
+    }
+    const mcp_method_entry_t *entry = mcp_find_method(msg->method);
+    if (!entry) {
+        return false;
+    }
+    if (entry->writer == mcp_write_tools_call) {
+        cJSON *name = cJSON_GetObjectItem(jsonrpc_message_params(msg), "name");
+        return cJSON_IsString(name) && mcp_tools_is_read_only(name->valuestring);
+    }
+    return entry->read_only;
+}
+
+/*
+ * Entries are dispatched in order and answered in one array; notifications
+ * get no entry, and a batch of only notifications gets no response at all.
+ * With MCP_BATCH_READONLY_PASS, read-only entries are first answered in a
+ * single pass over the batch and the remaining entries follow in order.
+ */
+static void mcp_server_write_batch(const char *json, size_t len, mcp_session_t *session, json_writer_t *w)
+{
+    jsonrpc_batch_iter_t batch;
+    size_t count = 0;
+    if (jsonrpc_batch_begin(&batch, json, len, &count) != ESP_OK) {
+        jsonrpc_write_error(w, 0, JSONRPC_PARSE_ERROR, "Invalid JSON or JSON-RPC format");
+        return;
+    }
+    if (count == 0) {
+        jsonrpc_write_error(w, 0, JSONRPC_INVALID_REQUEST, "Empty batch");
+        return;
+    }
+    if (count > CONFIG_MCP_MAX_BATCH_ENTRIES) {
+        jsonrpc_write_error(w, 0, JSONRPC_INVALID_REQUEST, "Batch too large");
+        return;
+    }
+
+    ESP_LOGI(TAG, "Processing batch of %u entries", (unsigned)count);
+
+    bool opened = false;
+    uint32_t done = 0;  // Bit i: entry i already handled
+#ifdef CONFIG_MCP_BATCH_READONLY_PASS
+    const int first_pass = 0;
+#else
+    const int first_pass = 1;
+#endif
+    for (int pass = first_pass; pass < 2; pass++) {
+        bool read_only_pass = (pass == 0);
+        jsonrpc_batch_iter_t it = batch;
+        const char *elem;
+        size_t elem_len;
+        // Nothing allocated for an entry outlives its reply
+        size_t mark = mcp_arena_mark();
+        for (size_t i = 0; jsonrpc_batch_next(&it, &elem, &elem_len); i++, mcp_arena_rewind(mark)) {
+            uint32_t bit = 1u << i;
+            if (done & bit) {
+                continue;
+            }
+
+            jsonrpc_message_t msg;
+            bool parsed = (mcp_parse(elem, elem_len, &msg) == ESP_OK);
+            if (read_only_pass && (!parsed || !mcp_is_read_only(&msg))) {
+                if (parsed) {
+                    jsonrpc_message_cleanup(&msg);
+                }
+                continue;
+            }
+            done |= bit;
+
+            if (parsed && msg.type == JSONRPC_NOTIFICATION) {
+                mcp_server_write_reply(&msg, session, w);
+                continue;
+            }
+            if (!opened) {
+                json_writer_array_begin(w);
+                opened = true;
+            }
+            if (parsed) {
+                mcp_server_write_reply(&msg, session, w);
+            } else {
+                jsonrpc_write_error(w, 0, JSONRPC_INVALID_REQUEST, "Invalid Request");
+            }
+        }
+    }
+
+    if (opened) {
+        json_writer_array_end(w);
+    }
+}
+
+static void mcp_server_write_message(const char *json, size_t len, mcp_session_t *session, json_writer_t *w)
+{
+    int64_t start = esp_timer_get_time();
+    if (jsonrpc_is_batch(json, len)) {
+        mcp_server_write_batch(json, len, session, w);
+    } else {
+        jsonrpc_message_t msg;
+        if (mcp_parse(json, len, &msg) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to parse JSON-RPC message");
+            jsonrpc_write_error(w, 0, JSONRPC_PARSE_ERROR, "Invalid JSON or JSON-RPC format");
+        } else {
+            mcp_server_write_reply(&msg, session, w);
+        }
+    }
+    mcp_metrics_record_since(mcp_metrics_stage(MCP_STAGE_MESSAGE), start, w->err != ESP_OK);
 }
 
 char* mcp_server_process_message(const char *json_str)
@@ -64,57 +390,468 @@ char* mcp_server_process_message(const char *json_str)
     
     ESP_LOGD(TAG, "Processing message: %s", json_str);
     
-    // Parse JSON-RPC message
+    json_writer_t w;
+    json_writer_init(&w, NULL, 0, NULL, NULL);
+    mcp_server_write_message(json_str, strlen(json_str), NULL, &w);
+    return json_writer_detach(&w);
+}
+
+/* --- Tool executor jobs ---
+ *
+ * Messages that call a tool (a tools/call request, or a batch containing
+ * one) are handed to the executor together with their body; everything
+ * else is cheap and still answered on the httpd task.
+ */
+
+typedef struct {
+    mcp_job_t job;                  // First member: the executor frees the block
+    httpd_req_t *req;               // HTTP: async copy of the request
+    httpd_handle_t hd;              // WebSocket: server to queue the reply on
+    int fd;                         // WebSocket: socket to reply on
+    mcp_session_t *session;         // Reference held by the job, or NULL
+    mcp_arena_t *arena;             // The request's arena once submitted, or NULL
+    char *body;                     // Message, owned by the job
+    size_t body_len;
+    char spill_path[JSONRPC_STREAM_REF_LEN];    // Staged script content to discard
+    bool single;                    // msg holds the parsed request
     jsonrpc_message_t msg;
-    esp_err_t err = jsonrpc_parse_message(json_str, &msg);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to parse JSON-RPC message");
-        return jsonrpc_create_error(0, JSONRPC_PARSE_ERROR, "Invalid JSON or JSON-RPC format");
+} mcp_call_job_t;
+
+/*
+ * Make a job for a message if it calls a tool. The lane is the fast one
+ * only if every request in the message is read-only. Returns NULL when the
+ * message should be answered inline; body stays with the caller until the
+ * job is submitted.
+ */
+static mcp_call_job_t *mcp_call_job_new(char *body, size_t body_len, mcp_session_t *session)
+{
+    mcp_call_job_t *cj = calloc(1, sizeof(mcp_call_job_t));
+    if (!cj) {
+        return NULL;    // Answer inline instead
     }
-    
-    char *response = NULL;
-    
-    // Handle request
-    if (msg.type == JSONRPC_REQUEST) {
-        cJSON *result = NULL;
-        err = mcp_dispatch_method(msg.method, msg.params, &result);
-        
-        if (err == ESP_OK && result) {
-            response = jsonrpc_create_response(msg.id, result);
-            cJSON_Delete(result);
-        } else if (err == ESP_ERR_NOT_FOUND) {
-            response = jsonrpc_create_error(msg.id, JSONRPC_METHOD_NOT_FOUND, 
-                                           "Method not found");
-        } else if (err == ESP_ERR_INVALID_ARG) {
-            response = jsonrpc_create_error(msg.id, JSONRPC_INVALID_PARAMS, 
-                                           "Invalid parameters");
+    cj->job.origin = MCP_SESSION_ORIGIN(session);
+    cj->job.id = -1;
+
+    bool calls_tool = false;
+    bool read_only = true;
+    if (jsonrpc_is_batch(body, body_len)) {
+        jsonrpc_batch_iter_t it;
+        const char *elem;
+        size_t elem_len;
+        if (jsonrpc_batch_begin(&it, body, body_len, NULL) == ESP_OK) {
+            size_t mark = mcp_arena_mark();
+            while (jsonrpc_batch_next(&it, &elem, &elem_len)) {
+                jsonrpc_message_t msg;
+                if (mcp_parse(elem, elem_len, &msg) != ESP_OK) {
+                    continue;
+                }
+                if (msg.type == JSONRPC_REQUEST && strcmp(msg.method, "tools/call") == 0) {
+                    calls_tool = true;
+                }
+                read_only = read_only && mcp_is_read_only(&msg);
+                jsonrpc_message_cleanup(&msg);
+                mcp_arena_rewind(mark);
+            }
+        }
+    } else if (mcp_parse(body, body_len, &cj->msg) == ESP_OK) {
+        if (cj->msg.type == JSONRPC_REQUEST && strcmp(cj->msg.method, "tools/call") == 0) {
+            calls_tool = true;
+            read_only = mcp_is_read_only(&cj->msg);
+            cj->single = true;
+            cj->job.id = cj->msg.id;
         } else {
-            response = jsonrpc_create_error(msg.id, JSONRPC_INTERNAL_ERROR, 
-                                           "Internal error");
+            jsonrpc_message_cleanup(&cj->msg);
         }
-    } else if (msg.type == JSONRPC_NOTIFICATION) {
-        // Notifications don't get responses
-        ESP_LOGI(TAG, "Received notification: %s", msg.method);
+    }
+
+    if (!calls_tool) {
+        free(cj);
+        return NULL;
+    }
+    cj->job.lane = read_only ? MCP_LANE_FAST : MCP_LANE_NORMAL;
+    cj->session = mcp_session_ref(session);
+    cj->body = body;
+    cj->body_len = body_len;
+    return cj;
+}
+
+static void call_job_write(mcp_call_job_t *cj, json_writer_t *w)
+{
+    int64_t start = esp_timer_get_time();
+    const char *prev_stage = lua_runtime_stage_enter(cj->spill_path);
+    if (cj->single) {
+        cj->single = false;     // write_reply cleans the message up
+        mcp_server_write_reply(&cj->msg, cj->session, w);
     } else {
-        response = jsonrpc_create_error(0, JSONRPC_INVALID_REQUEST, 
-                                       "Invalid message type");
+        mcp_server_write_batch(cj->body, cj->body_len, cj->session, w);
     }
-    
-    // Cleanup
-    jsonrpc_message_cleanup(&msg);
-    
-    return response;
+    lua_runtime_stage_enter(prev_stage);
+    mcp_metrics_record_since(mcp_metrics_stage(MCP_STAGE_MESSAGE), start, w->err != ESP_OK);
+}
+
+static void call_job_release(mcp_call_job_t *cj)
+{
+    if (cj->single) {
+        jsonrpc_message_cleanup(&cj->msg);
+        cj->single = false;
+    }
+    lua_runtime_stage_discard(cj->spill_path);
+    mcp_buf_put(cj->body);
+    cj->body = NULL;
+    mcp_session_put(cj->session);
+    cj->session = NULL;
+    mcp_arena_release(cj->arena);
+    cj->arena = NULL;
+}
+
+// Free a job that was never submitted (the caller keeps the body)
+static void call_job_free(mcp_call_job_t *cj)
+{
+    if (cj->single) {
+        jsonrpc_message_cleanup(&cj->msg);
+    }
+    mcp_session_put(cj->session);
+    mcp_arena_release(cj->arena);
+    free(cj);
+}
+
+// Before submitting: the job takes over the request's arena (its message
+// was parsed there) and this task stops allocating from it
+static void call_job_take_arena(mcp_call_job_t *cj, mcp_arena_t **arena)
+{
+    cj->arena = *arena;
+    *arena = NULL;
+    mcp_arena_enter(NULL);
+}
+
+// Error reply for a job that never ran (queue full or cancelled while queued)
+static void call_job_write_refusal(mcp_call_job_t *cj, json_writer_t *w, bool cancelled)
+{
+    int id = cj->job.id < 0 ? 0 : cj->job.id;
+    if (cancelled) {
+        jsonrpc_write_error(w, id, MCP_ERROR_REQUEST_CANCELLED, "Request cancelled");
+    } else {
+        jsonrpc_write_error(w, id, MCP_ERROR_SERVER_BUSY, "Server busy");
+    }
+}
+
+// Account one WebSocket frame sent since start
+static void ws_count_send(int64_t start, size_t len, esp_err_t ret)
+{
+    mcp_metrics_record_since(mcp_metrics_stage(MCP_STAGE_WS_SEND), start, ret != ESP_OK);
+    mcp_metrics_add_bytes(MCP_BYTES_WS_TX, len);
+}
+
+/* WebSocket: the worker builds the reply on the heap and the httpd task sends it */
+typedef struct {
+    httpd_handle_t hd;
+    int fd;
+    char *data;
+    size_t len;
+} ws_reply_t;
+
+static void ws_send_reply(void *arg)
+{
+    ws_reply_t *reply = arg;
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.type = HTTPD_WS_TYPE_TEXT;
+    frame.final = true;
+    frame.payload = (uint8_t*)reply->data;
+    frame.len = reply->len;
+    MCP_TRACE_BEGIN(MCP_TRACE_WS, "send");
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = httpd_ws_send_frame_async(reply->hd, reply->fd, &frame);
+    ws_count_send(start, reply->len, ret);
+    MCP_TRACE_END(MCP_TRACE_WS, "send");
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to send reply to fd %d: %s", reply->fd, esp_err_to_name(ret));
+    }
+    free(reply->data);
+    free(reply);
+}
+
+// Hand a heap buffer to the httpd task, which sends and frees it
+static void ws_queue_data(httpd_handle_t hd, int fd, char *data, size_t len)
+{
+    ws_reply_t *reply = malloc(sizeof(ws_reply_t));
+    if (!reply || !data) {
+        ESP_LOGE(TAG, "Out of memory queueing reply");
+        free(reply);
+        free(data);
+        return;
+    }
+    reply->hd = hd;
+    reply->fd = fd;
+    reply->data = data;
+    reply->len = len;
+    if (httpd_queue_work(hd, ws_send_reply, reply) != ESP_OK) {
+        free(data);
+        free(reply);
+    }
+}
+
+static void ws_queue_reply(httpd_handle_t hd, int fd, json_writer_t *w)
+{
+    size_t len = w->len;
+    ws_queue_data(hd, fd, json_writer_detach(w), len);
+}
+
+/* Notifications for WebSocket sessions: the event-stream module hands them
+ * over (mcp_sse_set_ws_sink) and each goes out as a frame of its own */
+static volatile httpd_handle_t s_ws_hd = NULL;
+
+typedef struct {
+    uint32_t sid;
+    int n;
+    int fds[CONFIG_MCP_MAX_SESSIONS];
+} ws_targets_t;
+
+static void ws_collect(const mcp_session_t *s, void *ctx)
+{
+    ws_targets_t *t = ctx;
+    if (s->fd >= 0 && (t->sid == 0 || s->sid == t->sid)) {
+        t->fds[t->n++] = s->fd;
+    }
+}
+
+static bool ws_notify(uint32_t sid, const char *json, size_t len)
+{
+    httpd_handle_t hd = s_ws_hd;
+    if (!hd || mcp_session_ws_count() == 0) {
+        return false;
+    }
+    ws_targets_t t = { .sid = sid, .n = 0 };
+    mcp_session_foreach(ws_collect, &t);
+    for (int i = 0; i < t.n; i++) {
+        char *data = malloc(len);
+        if (data) {
+            memcpy(data, json, len);
+        }
+        ws_queue_data(hd, t.fds[i], data, len);
+    }
+    return t.n > 0;
+}
+
+static void ws_job_run(mcp_job_t *job)
+{
+    mcp_call_job_t *cj = (mcp_call_job_t *)job;
+    json_writer_t w;
+    json_writer_init(&w, NULL, 0, NULL, NULL);
+    MCP_TRACE_BEGIN(MCP_TRACE_EXEC, "ws_job");
+    mcp_arena_t *prev = mcp_arena_enter(cj->arena);
+    call_job_write(cj, &w);
+    mcp_arena_leave(prev);
+    call_job_release(cj);
+    MCP_TRACE_END(MCP_TRACE_EXEC, "ws_job");
+
+    // A cancelled request gets no response
+    if (job->cancelled) {
+        ESP_LOGI(TAG, "Request %d cancelled, dropping reply", job->id);
+    } else if (w.err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to build response: %s", esp_err_to_name(w.err));
+    } else if (w.len > 0) {
+        ws_queue_reply(cj->hd, cj->fd, &w);
+    }
+    json_writer_release(&w);
+}
+
+static void ws_job_discard(mcp_job_t *job)
+{
+    call_job_release((mcp_call_job_t *)job);
+}
+
+/* Writer sink for WS responses that outgrow the connection buffer:
+ * each flush becomes one fragment of a single text message */
+typedef struct {
+    httpd_req_t *req;
+    bool started;
+} ws_out_t;
+
+static esp_err_t ws_flush(void *ctx, const char *data, size_t len)
+{
+    ws_out_t *out = ctx;
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.type = out->started ? HTTPD_WS_TYPE_CONTINUE : HTTPD_WS_TYPE_TEXT;
+    frame.fragmented = true;
+    frame.final = false;
+    frame.payload = (uint8_t*)data;
+    frame.len = len;
+    out->started = true;
+    MCP_TRACE_BEGIN(MCP_TRACE_WS, "send");
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = httpd_ws_send_frame(out->req, &frame);
+    ws_count_send(start, len, ret);
+    MCP_TRACE_END(MCP_TRACE_WS, "send");
+    return ret;
+}
+
+#define WS_CONTROL_MAX      125     // RFC 6455: control frames carry at most 125 bytes
+#define WS_CLOSE_PROTOCOL   1002
+#define WS_CLOSE_TOO_BIG    1009
+
+// Close frame with a status code; the handler then fails so httpd drops the socket
+static esp_err_t ws_send_close(httpd_req_t *req, uint16_t status)
+{
+    uint8_t code[2] = { status >> 8, status & 0xff };
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.type = HTTPD_WS_TYPE_CLOSE;
+    frame.final = true;
+    frame.payload = code;
+    frame.len = sizeof(code);
+    httpd_ws_send_frame(req, &frame);
+    return ESP_FAIL;
+}
+
+/*
+ * Receive a text frame into the connection's pooled message buffer. A
+ * fragmented message (TEXT, then CONTINUE frames up to the final one, with
+ * control frames allowed in between) is appended piece by piece. Sets *msg
+ * once the message is complete; the caller then owns the buffer. Messages
+ * over CONFIG_MCP_MAX_MESSAGE_SIZE close the connection with 1009.
+ */
+static esp_err_t ws_recv_message(httpd_req_t *req, httpd_ws_frame_t *pkt, char **msg, size_t *msg_len)
+{
+    mcp_conn_t *conn = mcp_conn_get(req);
+    if (!conn) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (pkt->type == HTTPD_WS_TYPE_TEXT) {
+        if (conn->ws_rx) {
+            ESP_LOGW(TAG, "New message before the last one ended");
+            conn->ws_rx_len = 0;
+        } else {
+            conn->ws_rx = mcp_buf_get(MCP_BUF_RX);
+            conn->ws_rx_len = 0;
+            if (!conn->ws_rx) {
+                ESP_LOGE(TAG, "Failed to allocate memory for WebSocket frame");
+                return ESP_ERR_NO_MEM;
+            }
+        }
+    } else if (!conn->ws_rx) {
+        ESP_LOGW(TAG, "Continuation frame without a message");
+        return ws_send_close(req, WS_CLOSE_PROTOCOL);
+    }
+
+    if (pkt->len > MCP_BUF_RX_SIZE - 1 - conn->ws_rx_len) {
+        ESP_LOGW(TAG, "WebSocket message over %d bytes", CONFIG_MCP_MAX_MESSAGE_SIZE);
+        mcp_buf_put(conn->ws_rx);
+        conn->ws_rx = NULL;
+        return ws_send_close(req, WS_CLOSE_TOO_BIG);
+    }
+    if (pkt->len) {
+        pkt->payload = (uint8_t *)conn->ws_rx + conn->ws_rx_len;
+        MCP_TRACE_BEGIN(MCP_TRACE_WS, "recv");
+        esp_err_t ret = httpd_ws_recv_frame(req, pkt, pkt->len);
+        MCP_TRACE_END(MCP_TRACE_WS, "recv");
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "httpd_ws_recv_frame failed: %s", esp_err_to_name(ret));
+            mcp_buf_put(conn->ws_rx);
+            conn->ws_rx = NULL;
+            return ret;
+        }
+        conn->ws_rx_len += pkt->len;
+        mcp_metrics_add_bytes(MCP_BYTES_WS_RX, pkt->len);
+    }
+
+    if (pkt->final) {
+        conn->ws_rx[conn->ws_rx_len] = '\0';
+        *msg = conn->ws_rx;
+        *msg_len = conn->ws_rx_len;
+        conn->ws_rx = NULL;
+    }
+    return ESP_OK;
+}
+
+// Answer a complete message; takes over msg, and the arena if a job does
+static esp_err_t ws_process_message(httpd_req_t *req, char *msg, size_t msg_len, mcp_arena_t **arena)
+{
+    ESP_LOGI(TAG, "Received MCP message");
+    esp_err_t ret = ESP_OK;
+
+    // Tool calls run on the executor, which owns msg from here on
+    int fd = httpd_req_to_sockfd(req);
+    mcp_session_t *session = mcp_session_for_fd(fd);
+    mcp_session_touch(session);
+    mcp_call_job_t *cj = mcp_call_job_new(msg, msg_len, session);
+    if (cj) {
+        cj->hd = req->handle;
+        cj->fd = fd;
+        cj->job.run = ws_job_run;
+        cj->job.discard = ws_job_discard;
+        call_job_take_arena(cj, arena);
+        if (mcp_executor_submit(&cj->job) == ESP_OK) {
+            mcp_session_put(session);
+            return ESP_OK;
+        }
+    }
+
+    // Write the response into the connection buffer; if it fills up,
+    // the response continues as a fragmented message
+    mcp_conn_t *conn = mcp_conn_get(req);
+    ws_out_t out = { .req = req };
+    json_writer_t w;
+    if (conn) {
+        json_writer_init(&w, conn->tx_buf, MCP_BUF_TX_SIZE, ws_flush, &out);
+    } else {
+        json_writer_init(&w, NULL, 0, NULL, NULL);
+    }
+    if (cj) {
+        // Executor queue full
+        call_job_write_refusal(cj, &w, false);
+        call_job_free(cj);
+    } else {
+        mcp_server_write_message(msg, msg_len, session, &w);
+    }
+    mcp_session_put(session);
+    mcp_buf_put(msg);
+
+    if (w.err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to build response: %s", esp_err_to_name(w.err));
+        ret = w.err;
+    } else if (out.started || w.len > 0) {
+        // Send response (or its final fragment)
+        httpd_ws_frame_t resp_pkt;
+        memset(&resp_pkt, 0, sizeof(httpd_ws_frame_t));
+        resp_pkt.type = out.started ? HTTPD_WS_TYPE_CONTINUE : HTTPD_WS_TYPE_TEXT;
+        resp_pkt.fragmented = out.started;
+        resp_pkt.final = true;
+        resp_pkt.payload = (uint8_t*)w.buf;
+        resp_pkt.len = w.len;
+
+        MCP_TRACE_BEGIN(MCP_TRACE_WS, "send");
+        int64_t start = esp_timer_get_time();
+        ret = httpd_ws_send_frame(req, &resp_pkt);
+        ws_count_send(start, w.len, ret);
+        MCP_TRACE_END(MCP_TRACE_WS, "send");
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to send response: %s", esp_err_to_name(ret));
+        }
+    }
+    json_writer_release(&w);
+    return ret;
 }
 
 esp_err_t mcp_ws_handler(httpd_req_t *req)
 {
     if (req->method == HTTP_GET) {
-        ESP_LOGI(TAG, "MCP client connected");
+        // On the HTTPS server this handler owns GET /mcp: a request that is
+        // not a WebSocket upgrade gets the info document or the SSE stream
+        if (httpd_req_get_hdr_value_len(req, "Upgrade") == 0) {
+            return mcp_info_handler(req);
+        }
+        // The connection is a session until the socket closes
+        s_ws_hd = req->handle;
+        mcp_session_t *session = mcp_session_for_fd(httpd_req_to_sockfd(req));
+        ESP_LOGI(TAG, "MCP client connected (session %d)", MCP_SESSION_ORIGIN(session));
+        mcp_session_put(session);
         return ESP_OK;
     }
     
     httpd_ws_frame_t ws_pkt;
-    uint8_t *buf = NULL;
     memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
     
     // Get frame length
@@ -124,47 +861,45 @@ esp_err_t mcp_ws_handler(httpd_req_t *req)
         return ret;
     }
     
-    ESP_LOGD(TAG, "Received frame len: %d", ws_pkt.len);
-    
+    ESP_LOGD(TAG, "Received frame len: %u", (unsigned)ws_pkt.len);
+
+    if (ws_pkt.type == HTTPD_WS_TYPE_TEXT || ws_pkt.type == HTTPD_WS_TYPE_CONTINUE) {
+        char *msg = NULL;
+        size_t msg_len = 0;
+        ret = ws_recv_message(req, &ws_pkt, &msg, &msg_len);
+        if (ret != ESP_OK || !msg) {
+            return ret;     // Failed, or more fragments to come
+        }
+        if (msg_len == 0) {
+            mcp_buf_put(msg);
+            return ESP_OK;
+        }
+        // cJSON trees and tool scratch of the message come from one arena
+        MCP_TRACE_BEGIN(MCP_TRACE_WS, "message");
+        mcp_arena_t *arena = mcp_arena_acquire();
+        mcp_arena_t *prev = mcp_arena_enter(arena);
+        ret = ws_process_message(req, msg, msg_len, &arena);
+        mcp_arena_leave(prev);
+        mcp_arena_release(arena);
+        MCP_TRACE_END(MCP_TRACE_WS, "message");
+        return ret;
+    }
+
     if (ws_pkt.len) {
-        // Allocate buffer for message
-        buf = calloc(1, ws_pkt.len + 1);
-        if (buf == NULL) {
-            ESP_LOGE(TAG, "Failed to allocate memory for WebSocket frame");
-            return ESP_ERR_NO_MEM;
+        // Control frame: at most 125 bytes
+        uint8_t ctrl[WS_CONTROL_MAX];
+        if (ws_pkt.len > sizeof(ctrl)) {
+            ESP_LOGW(TAG, "Oversized control frame (%u bytes)", (unsigned)ws_pkt.len);
+            return ESP_FAIL;
         }
-        
-        ws_pkt.payload = buf;
-        ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
+        ws_pkt.payload = ctrl;
+        ret = httpd_ws_recv_frame(req, &ws_pkt, sizeof(ctrl));
         if (ret != ESP_OK) {
             ESP_LOGE(TAG, "httpd_ws_recv_frame failed: %s", esp_err_to_name(ret));
-            free(buf);
             return ret;
         }
-        
-        // Process message based on type
-        if (ws_pkt.type == HTTPD_WS_TYPE_TEXT) {
-            ESP_LOGI(TAG, "Received MCP message");
-            
-            // Process MCP message
-            char *response = mcp_server_process_message((char*)ws_pkt.payload);
-            
-            if (response) {
-                // Send response
-                httpd_ws_frame_t resp_pkt;
-                memset(&resp_pkt, 0, sizeof(httpd_ws_frame_t));
-                resp_pkt.type = HTTPD_WS_TYPE_TEXT;
-                resp_pkt.payload = (uint8_t*)response;
-                resp_pkt.len = strlen(response);
-                
-                ret = httpd_ws_send_frame(req, &resp_pkt);
-                if (ret != ESP_OK) {
-                    ESP_LOGE(TAG, "Failed to send response: %s", esp_err_to_name(ret));
-                }
-                
-                free(response);
-            }
-        } else if (ws_pkt.type == HTTPD_WS_TYPE_PING) {
+
+        if (ws_pkt.type == HTTPD_WS_TYPE_PING) {
             ESP_LOGD(TAG, "Received PING, sending PONG");
             ws_pkt.type = HTTPD_WS_TYPE_PONG;
             ret = httpd_ws_send_frame(req, &ws_pkt);
@@ -174,8 +909,6 @@ esp_err_t mcp_ws_handler(httpd_req_t *req)
             ws_pkt.payload = NULL;
             ret = httpd_ws_send_frame(req, &ws_pkt);
         }
-        
-        free(buf);
     }
     
     return ret;
@@ -183,64 +916,436 @@ esp_err_t mcp_ws_handler(httpd_req_t *req)
 
 /* --- Streamable HTTP transport (POST /mcp) --- */
 
-esp_err_t mcp_http_handler(httpd_req_t *req)
+#define HTTP_RECV_CHUNK 512
+
+/*
+ * Spill sink for oversized requests: lua_push_script content is streamed
+ * to a SPIFFS staging file instead of being held in the request buffer.
+ */
+typedef struct {
+    FILE *f;
+    char path[JSONRPC_STREAM_REF_LEN];
+} mcp_spill_ctx_t;
+
+static bool spill_begin(void *ctx, const char *method, const char *tool, const char *arg_name)
 {
-    /* Read POST body */
+    mcp_spill_ctx_t *spill = ctx;
+    if (spill->f || spill->path[0] ||
+        strcmp(method, "tools/call") != 0 || strcmp(tool, "lua_push_script") != 0 ||
+        strcmp(arg_name, "content") != 0) {
+        return false;
+    }
+    spill->f = lua_runtime_stage_open(spill->path, sizeof(spill->path));
+    return spill->f != NULL;
+}
+
+static esp_err_t spill_data(void *ctx, const char *data, size_t len)
+{
+    mcp_spill_ctx_t *spill = ctx;
+    MCP_TRACE_BEGIN(MCP_TRACE_FS, "stage_write");
+    bool ok = spill->f && fwrite(data, 1, len, spill->f) == len;
+    MCP_TRACE_END(MCP_TRACE_FS, "stage_write");
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t spill_end(void *ctx, size_t total_len, char *ref, size_t ref_len)
+{
+    mcp_spill_ctx_t *spill = ctx;
+    if (!spill->f) {
+        return ESP_FAIL;
+    }
+    bool ok = (fclose(spill->f) == 0);
+    spill->f = NULL;
+    ESP_LOGI(TAG, "Staged %u bytes of script content in %s", (unsigned)total_len, spill->path);
+    snprintf(ref, ref_len, "%s", spill->path);
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+static const jsonrpc_spill_ops_t spill_ops = {
+    .begin = spill_begin,
+    .data = spill_data,
+    .end = spill_end,
+};
+
+/* Writer sink for responses that outgrow the connection buffer */
+typedef struct {
+    httpd_req_t *req;
+    bool started;
+} http_out_t;
+
+/* Normal-lane POSTs waiting on the executor; each holds a socket until it
+ * is answered. Read-only calls are not limited: a worker is kept for them. */
+static atomic_int s_http_pending = 0;
+
+static bool http_pending_acquire(const mcp_call_job_t *cj)
+{
+    if (cj->job.lane == MCP_LANE_FAST) {
+        return true;
+    }
+    if (atomic_fetch_add(&s_http_pending, 1) < CONFIG_MCP_EXECUTOR_HTTP_MAX_PENDING) {
+        return true;
+    }
+    atomic_fetch_sub(&s_http_pending, 1);
+    return false;
+}
+
+static void http_pending_release(const mcp_call_job_t *cj)
+{
+    if (cj->job.lane != MCP_LANE_FAST) {
+        atomic_fetch_sub(&s_http_pending, 1);
+    }
+}
+
+// Account one HTTP send since start
+static void http_count_send(int64_t start, size_t len, esp_err_t ret)
+{
+    mcp_metrics_record_since(mcp_metrics_stage(MCP_STAGE_HTTP_SEND), start, ret != ESP_OK);
+    mcp_metrics_add_bytes(MCP_BYTES_HTTP_TX, len);
+}
+
+static esp_err_t http_flush(void *ctx, const char *data, size_t len)
+{
+    http_out_t *out = ctx;
+    if (!out->started) {
+        httpd_resp_set_type(out->req, "application/json");
+        out->started = true;
+    }
+    MCP_TRACE_BEGIN(MCP_TRACE_HTTP, "send");
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = httpd_resp_send_chunk(out->req, data, len);
+    http_count_send(start, len, ret);
+    MCP_TRACE_END(MCP_TRACE_HTTP, "send");
+    return ret;
+}
+
+static void http_writer_init(json_writer_t *w, http_out_t *out, httpd_req_t *req, mcp_conn_t *conn)
+{
+    out->req = req;
+    out->started = false;
+    json_writer_init(w, conn->tx_buf, MCP_BUF_TX_SIZE, http_flush, out);
+}
+
+// Send what the writer holds: the rest of a chunked body, a JSON body or 202
+static esp_err_t http_writer_send(json_writer_t *w, http_out_t *out)
+{
+    httpd_req_t *req = out->req;
+
+    if (w->err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to write response: %s", esp_err_to_name(w->err));
+        if (!out->started) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Internal error");
+        }
+        return ESP_FAIL;
+    }
+
+    if (out->started) {
+        /* Large response: send the tail and terminate the chunked body */
+        if (json_writer_finish(w) != ESP_OK || httpd_resp_send_chunk(req, NULL, 0) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    } else if (w->len > 0) {
+        /* Normal request -> JSON response */
+        httpd_resp_set_type(req, "application/json");
+        MCP_TRACE_BEGIN(MCP_TRACE_HTTP, "send");
+        int64_t start = esp_timer_get_time();
+        esp_err_t ret = httpd_resp_send(req, w->buf, w->len);
+        http_count_send(start, w->len, ret);
+        MCP_TRACE_END(MCP_TRACE_HTTP, "send");
+    } else {
+        /* Notification -> 202 Accepted, no body */
+        httpd_resp_set_status(req, "202 Accepted");
+        httpd_resp_send(req, NULL, 0);
+    }
+
+    return ESP_OK;
+}
+
+/* The session stays reserved for the async request, so its connection
+ * buffer can be used from the worker */
+static void http_job_run(mcp_job_t *job)
+{
+    mcp_call_job_t *cj = (mcp_call_job_t *)job;
+
+    // Skip the tool if the client gave up while the call was queued
+    char b;
+    if (recv(httpd_req_to_sockfd(cj->req), &b, 1, MSG_PEEK | MSG_DONTWAIT) == 0) {
+        ESP_LOGW(TAG, "Client closed before request %d ran", job->id);
+        call_job_release(cj);
+    } else {
+        http_out_t out;
+        json_writer_t w;
+        http_writer_init(&w, &out, cj->req, cj->req->sess_ctx);
+        MCP_TRACE_BEGIN(MCP_TRACE_EXEC, "http_job");
+        mcp_arena_t *prev = mcp_arena_enter(cj->arena);
+        call_job_write(cj, &w);
+        mcp_arena_leave(prev);
+        call_job_release(cj);
+        http_writer_send(&w, &out);
+        MCP_TRACE_END(MCP_TRACE_EXEC, "http_job");
+    }
+    httpd_req_async_handler_complete(cj->req);
+    http_pending_release(cj);
+}
+
+// The POST still needs an answer when its job never runs
+static void http_job_refuse(mcp_call_job_t *cj, bool cancelled)
+{
+    http_out_t out;
+    json_writer_t w;
+    http_writer_init(&w, &out, cj->req, cj->req->sess_ctx);
+    call_job_write_refusal(cj, &w, cancelled);
+    call_job_release(cj);
+    http_writer_send(&w, &out);
+    httpd_req_async_handler_complete(cj->req);
+    http_pending_release(cj);
+}
+
+static void http_job_discard(mcp_job_t *job)
+{
+    http_job_refuse((mcp_call_job_t *)job, true);
+}
+
+/*
+ * Session named by the Mcp-Session-Id header. Returns ESP_OK with NULL if
+ * the request has no header, or ESP_ERR_NOT_FOUND (after answering 404)
+ * if the session is unknown or was closed.
+ */
+static esp_err_t http_session_get(httpd_req_t *req, mcp_session_t **session)
+{
+    char id[MCP_SESSION_ID_LEN + 1];
+    *session = NULL;
+    esp_err_t ret = httpd_req_get_hdr_value_str(req, "Mcp-Session-Id", id, sizeof(id));
+    if (ret == ESP_ERR_NOT_FOUND) {
+        return ESP_OK;
+    }
+    *session = (ret == ESP_OK) ? mcp_session_find(id) : NULL;
+    if (!*session) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Session not found");
+        return ESP_ERR_NOT_FOUND;
+    }
+    mcp_session_touch(*session);
+    return ESP_OK;
+}
+
+/*
+ * An initialize request without Mcp-Session-Id opens a session; its id
+ * goes back in the response header. The body is only parsed if it
+ * mentions initialize, so sessionless clients pay nothing extra. With the
+ * table full the client is answered without a session, as before
+ * sessions existed.
+ */
+static mcp_session_t *http_session_open(httpd_req_t *req, const char *body, size_t len)
+{
+    static const char needle[] = "\"initialize\"";
+    if (len < sizeof(needle) - 1 || !memmem(body, len, needle, sizeof(needle) - 1) ||
+        jsonrpc_is_batch(body, len)) {
+        return NULL;
+    }
+    jsonrpc_message_t msg;
+    if (mcp_parse(body, len, &msg) != ESP_OK) {
+        return NULL;
+    }
+    bool initialize = (msg.type == JSONRPC_REQUEST && strcmp(msg.method, "initialize") == 0);
+    jsonrpc_message_cleanup(&msg);
+    if (!initialize) {
+        return NULL;
+    }
+
+    mcp_session_t *session = mcp_session_create();
+    if (session) {
+        // The value must stay valid until the response is sent; the caller
+        // holds the session until then
+        httpd_resp_set_hdr(req, "Mcp-Session-Id", session->id);
+    }
+    return session;
+}
+
+// Answer one POST; the arena passes to the executor job if there is one
+static esp_err_t http_handle(httpd_req_t *req, mcp_arena_t **arena)
+{
+    mcp_session_t *session = NULL;
+    if (http_session_get(req, &session) != ESP_OK) {
+        return ESP_OK;
+    }
+
+    /* Bodies above MCP_MAX_MESSAGE_SIZE are only accepted if the excess is
+     * lua_push_script content, which is spilled to SPIFFS as it arrives */
     int content_len = req->content_len;
-    if (content_len <= 0 || content_len > CONFIG_MCP_MAX_MESSAGE_SIZE) {
+    if (content_len <= 0 || content_len > CONFIG_MCP_MAX_STREAM_SIZE) {
         httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid content length");
+        mcp_session_put(session);
         return ESP_FAIL;
     }
+    bool oversized = content_len > CONFIG_MCP_MAX_MESSAGE_SIZE;
+    size_t cap = (oversized ? CONFIG_MCP_MAX_MESSAGE_SIZE : content_len) + 1;
 
-    char *body = calloc(1, content_len + 1);
+    char *body = mcp_buf_get(MCP_BUF_RX);
     if (!body) {
         httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        mcp_session_put(session);
         return ESP_ERR_NO_MEM;
     }
 
+    jsonrpc_stream_t stream;
+    mcp_spill_ctx_t spill = {0};
+    jsonrpc_stream_init(&stream, body, cap);
+    if (oversized) {
+        jsonrpc_stream_set_spill(&stream, &spill_ops, &spill);
+    }
+
+    /* Feed the body to the reader chunk by chunk */
+    char chunk[HTTP_RECV_CHUNK];
     int received = 0;
+    MCP_TRACE_BEGIN(MCP_TRACE_HTTP, "recv");
     while (received < content_len) {
-        int ret = httpd_req_recv(req, body + received, content_len - received);
+        int want = content_len - received;
+        int ret = httpd_req_recv(req, chunk, want < (int)sizeof(chunk) ? want : (int)sizeof(chunk));
         if (ret <= 0) {
-            free(body);
+            MCP_TRACE_END(MCP_TRACE_HTTP, "recv");
+            jsonrpc_stream_finish(&stream, NULL);
+            lua_runtime_stage_discard(spill.path);
+            mcp_buf_put(body);
             if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
                 httpd_resp_send_err(req, HTTPD_408_REQ_TIMEOUT, "Timeout");
             }
+            mcp_session_put(session);
             return ESP_FAIL;
         }
         received += ret;
+        mcp_metrics_add_bytes(MCP_BYTES_HTTP_RX, ret);
+        /* Keep draining the socket after a reader error so the reply is clean */
+        jsonrpc_stream_feed(&stream, chunk, ret);
     }
-    body[content_len] = '\0';
+
+    size_t body_len = 0;
+    esp_err_t err = jsonrpc_stream_finish(&stream, &body_len);
+    MCP_TRACE_END(MCP_TRACE_HTTP, "recv");
 
     ESP_LOGI(TAG, "HTTP MCP request (%d bytes)", content_len);
 
-    /* Process through the same MCP pipeline as WebSocket */
-    char *response = mcp_server_process_message(body);
-    free(body);
+    mcp_conn_t *conn = mcp_conn_get(req);
+    if (!conn) {
+        lua_runtime_stage_discard(spill.path);
+        mcp_buf_put(body);
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        mcp_session_put(session);
+        return ESP_ERR_NO_MEM;
+    }
 
-    if (response) {
-        /* Normal request -> JSON response */
-        httpd_resp_set_type(req, "application/json");
-        httpd_resp_send(req, response, strlen(response));
-        free(response);
+    if (!session && err == ESP_OK) {
+        session = http_session_open(req, body, body_len);
+    }
+
+    /* Tool calls run on the executor, which answers on an async copy of the
+     * request; the job owns the body and the staged content from here on.
+     * Past MCP_EXECUTOR_HTTP_MAX_PENDING slow calls are refused, so sockets
+     * stay free for other clients and for notifications/cancelled. */
+    mcp_call_job_t *cj = (err == ESP_OK) ? mcp_call_job_new(body, body_len, session) : NULL;
+    if (cj && http_pending_acquire(cj)) {
+        snprintf(cj->spill_path, sizeof(cj->spill_path), "%s", spill.path);
+        cj->job.run = http_job_run;
+        cj->job.discard = http_job_discard;
+        if (httpd_req_async_handler_begin(req, &cj->req) == ESP_OK) {
+            call_job_take_arena(cj, arena);
+            if (mcp_executor_submit(&cj->job) != ESP_OK) {
+                http_job_refuse(cj, false);
+                free(cj);
+            }
+            mcp_session_put(session);
+            return ESP_OK;
+        }
+        // Answer inline after all
+        http_pending_release(cj);
+        call_job_free(cj);
+        cj = NULL;
+    }
+
+    /* Write the response into the connection buffer; if it fills up, the
+     * response continues with chunked transfer encoding */
+    http_out_t out;
+    json_writer_t w;
+    http_writer_init(&w, &out, req, conn);
+
+    /* Process through the same MCP pipeline as WebSocket */
+    if (cj) {
+        // Too many tool calls pending
+        call_job_write_refusal(cj, &w, false);
+        call_job_free(cj);
+    } else if (err == ESP_ERR_INVALID_SIZE) {
+        jsonrpc_write_error(&w, 0, JSONRPC_INVALID_REQUEST, "Message too large");
+    } else if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to parse JSON-RPC message");
+        jsonrpc_write_error(&w, 0, JSONRPC_PARSE_ERROR, "Invalid JSON or JSON-RPC format");
     } else {
-        /* Notification -> 202 Accepted, no body */
-        httpd_resp_set_status(req, "202 Accepted");
-        httpd_resp_send(req, NULL, 0);
+        const char *prev_stage = lua_runtime_stage_enter(spill.path);
+        mcp_server_write_message(body, body_len, session, &w);
+        lua_runtime_stage_enter(prev_stage);
     }
+    lua_runtime_stage_discard(spill.path);
+    mcp_buf_put(body);
 
+    esp_err_t ret = http_writer_send(&w, &out);
+    mcp_session_put(session);
+    return ret;
+}
+
+esp_err_t mcp_http_handler(httpd_req_t *req)
+{
+    // cJSON trees and tool scratch of the request come from one arena,
+    // reset once it is answered (by the executor job, if it gets one)
+    MCP_TRACE_BEGIN(MCP_TRACE_HTTP, "request");
+    mcp_arena_t *arena = mcp_arena_acquire();
+    mcp_arena_t *prev = mcp_arena_enter(arena);
+    esp_err_t ret = http_handle(req, &arena);
+    mcp_arena_leave(prev);
+    mcp_arena_release(arena);
+    MCP_TRACE_END(MCP_TRACE_HTTP, "request");
+    return ret;
+}
+
+/* --- DELETE /mcp: end a streamable-HTTP session --- */
+
+esp_err_t mcp_delete_handler(httpd_req_t *req)
+{
+    mcp_session_t *session = NULL;
+    if (http_session_get(req, &session) != ESP_OK) {
+        return ESP_OK;
+    }
+    if (!session) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing Mcp-Session-Id");
+        return ESP_OK;
+    }
+    mcp_session_close(session);
+    mcp_session_put(session);
+    httpd_resp_set_status(req, "204 No Content");
+    httpd_resp_send(req, NULL, 0);
     return ESP_OK;
 }
 
+
 /* --- GET /mcp server info --- */
 
 esp_err_t mcp_info_handler(httpd_req_t *req)
 {
+    // Streamable-HTTP clients open the notification stream here
+    char accept[128] = {0};
+    if (httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept)) == ESP_OK &&
+        strstr(accept, "text/event-stream")) {
+        mcp_session_t *session = NULL;
+        if (http_session_get(req, &session) != ESP_OK) {
+            return ESP_OK;
+        }
+        esp_err_t ret = mcp_sse_open(req, session ? session->sid : 0,
+                                     session ? session->log_level : ESP_LOG_INFO);
+        mcp_session_put(session);
+        return ret;
+    }
+
     const char *info =
         "{\"name\":\"" MCP_SERVER_NAME "\","
         "\"version\":\"" MCP_SERVER_VERSION "\","
         "\"protocolVersion\":\"" MCP_PROTOCOL_VERSION "\","
-        "\"transports\":[\"http-post\",\"websocket\"]}";
+        "\"transports\":[\"http-post\",\"sse\",\"websocket\"]}";
 
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, info, strlen(info));
@@ -41,10 +41,16 @@ esp_err_t mcp_ws_handler(httpd_req_t *req);
 esp_err_t mcp_http_handler(httpd_req_t *req);
 
 /**
- * GET /mcp info handler - returns server info as JSON
+ * GET /mcp handler - opens the SSE notification stream when the client
+ * accepts text/event-stream, otherwise returns server info as JSON
  */
 esp_err_t mcp_info_handler(httpd_req_t *req);
 
+/**
+ * DELETE /mcp handler - ends the session named by Mcp-Session-Id
+ */
+esp_err_t mcp_delete_handler(httpd_req_t *req);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,269 @@
+/*
+ * MCP Sessions Implementation
+ *
+ * A small fixed table under one mutex; lookups scan it, which is cheaper
+ * than hashing at CONFIG_MCP_MAX_SESSIONS entries. Session ids are 128
+ * random bits, so one client cannot guess another's.
+ */
+
+#include "mcp_session.h"
+#include "mcp_executor.h"
+#include "mcp_sse.h"
+#include "mcp_resources.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_random.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "sdkconfig.h"
+
+static const char *TAG = "mcp_session";
+
+#define SESSION_MAX         CONFIG_MCP_MAX_SESSIONS
+
+static mcp_session_t *s_sessions[SESSION_MAX];
+static SemaphoreHandle_t s_lock = NULL;
+static uint32_t s_next_sid = 1;
+static volatile int s_ws_open = 0;          // WebSocket sessions in the table
+
+// Free slot, evicting the least recently used HTTP session when the table
+// is full; WebSocket sessions end with their socket (s_lock held)
+static int session_slot(mcp_session_t **evicted)
+{
+    int oldest = -1;
+    for (int i = 0; i < SESSION_MAX; i++) {
+        mcp_session_t *s = s_sessions[i];
+        if (!s) {
+            return i;
+        }
+        if (s->fd < 0 && (oldest < 0 || s->last_seen_us < s_sessions[oldest]->last_seen_us)) {
+            oldest = i;
+        }
+    }
+    if (oldest >= 0) {
+        *evicted = s_sessions[oldest];     // Caller takes over the table's reference
+        s_sessions[oldest] = NULL;
+    }
+    return oldest;
+}
+
+// New session in the table plus a reference for the caller (s_lock held)
+static mcp_session_t *session_new(int fd, mcp_session_t **evicted)
+{
+    int slot = session_slot(evicted);
+    if (slot < 0) {
+        return NULL;
+    }
+    mcp_session_t *s = calloc(1, sizeof(mcp_session_t));
+    if (!s) {
+        return NULL;
+    }
+    s->sid = s_next_sid++;
+    s->fd = fd;
+    s->log_level = ESP_LOG_INFO;
+    s->created_us = esp_timer_get_time();
+    s->last_seen_us = s->created_us;
+    s->refs = 2;
+    if (fd < 0) {
+        uint8_t raw[MCP_SESSION_ID_LEN / 2];
+        esp_fill_random(raw, sizeof(raw));
+        for (size_t i = 0; i < sizeof(raw); i++) {
+            snprintf(&s->id[i * 2], 3, "%02x", raw[i]);
+        }
+    }
+    s_sessions[slot] = s;
+    if (fd >= 0) {
+        s_ws_open++;
+    }
+    return s;
+}
+
+// Take a session out of the table (s_lock held)
+static void session_unlink(int slot)
+{
+    if (s_sessions[slot]->fd >= 0) {
+        s_ws_open--;
+    }
+    s_sessions[slot] = NULL;
+}
+
+// Stop the work and streams of a session that left the table, and drop
+// the table's reference (s_lock not held)
+static void session_shutdown(mcp_session_t *s, const char *why)
+{
+    ESP_LOGI(TAG, "Session %u %s (%u requests, %u tool calls)", (unsigned)s->sid, why,
+             atomic_load(&s->requests), atomic_load(&s->tool_calls));
+    mcp_executor_cancel_origin(MCP_SESSION_ORIGIN(s));
+    mcp_sse_close_session(s->sid);
+    mcp_resources_close_session(s->sid);
+    mcp_session_put(s);
+}
+
+esp_err_t mcp_session_init(void)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    return s_lock ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+mcp_session_t *mcp_session_create(void)
+{
+    if (!s_lock) {
+        return NULL;
+    }
+    mcp_session_t *evicted = NULL;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    mcp_session_t *s = session_new(-1, &evicted);
+    xSemaphoreGive(s_lock);
+
+    if (evicted) {
+        session_shutdown(evicted, "evicted (least recently used)");
+    }
+    if (s) {
+        ESP_LOGI(TAG, "Session %u opened (HTTP)", (unsigned)s->sid);
+    } else {
+        ESP_LOGW(TAG, "No room for a new session (%d WebSocket sessions open), serving without one", SESSION_MAX);
+    }
+    return s;
+}
+
+mcp_session_t *mcp_session_for_fd(int fd)
+{
+    if (!s_lock || fd < 0) {
+        return NULL;
+    }
+    mcp_session_t *evicted = NULL;
+    mcp_session_t *s = NULL;
+    bool created = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SESSION_MAX && !s; i++) {
+        if (s_sessions[i] && s_sessions[i]->fd == fd) {
+            s = s_sessions[i];
+            s->refs++;
+        }
+    }
+    if (!s) {
+        s = session_new(fd, &evicted);
+        created = (s != NULL);
+    }
+    xSemaphoreGive(s_lock);
+
+    if (evicted) {
+        session_shutdown(evicted, "evicted (least recently used)");
+    }
+    if (created) {
+        ESP_LOGI(TAG, "Session %u opened (WebSocket fd %d)", (unsigned)s->sid, fd);
+    }
+    return s;
+}
+
+mcp_session_t *mcp_session_find(const char *id)
+{
+    if (!s_lock || !id || strlen(id) != MCP_SESSION_ID_LEN) {
+        return NULL;
+    }
+    mcp_session_t *s = NULL;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SESSION_MAX && !s; i++) {
+        if (s_sessions[i] && strcmp(s_sessions[i]->id, id) == 0) {
+            s = s_sessions[i];
+            s->refs++;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    return s;
+}
+
+mcp_session_t *mcp_session_ref(mcp_session_t *s)
+{
+    if (s) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s->refs++;
+        xSemaphoreGive(s_lock);
+    }
+    return s;
+}
+
+void mcp_session_put(mcp_session_t *s)
+{
+    if (!s) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool last = (--s->refs == 0);
+    xSemaphoreGive(s_lock);
+    if (last) {
+        free(s);
+    }
+}
+
+void mcp_session_touch(mcp_session_t *s)
+{
+    if (s) {
+        s->last_seen_us = esp_timer_get_time();
+    }
+}
+
+void mcp_session_close(mcp_session_t *s)
+{
+    if (!s) {
+        return;
+    }
+    bool unlinked = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SESSION_MAX; i++) {
+        if (s_sessions[i] == s) {
+            session_unlink(i);
+            unlinked = true;
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    if (unlinked) {
+        session_shutdown(s, "closed");
+    }
+}
+
+void mcp_session_close_fd(int fd)
+{
+    mcp_sse_close_fd(fd);
+    if (!s_lock) {
+        return;
+    }
+    mcp_session_t *s = NULL;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SESSION_MAX; i++) {
+        if (s_sessions[i] && s_sessions[i]->fd == fd) {
+            s = s_sessions[i];
+            session_unlink(i);
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    if (s) {
+        session_shutdown(s, "closed");
+    }
+}
+
+int mcp_session_ws_count(void)
+{
+    return s_ws_open;
+}
+
+void mcp_session_foreach(void (*fn)(const mcp_session_t *s, void *ctx), void *ctx)
+{
+    if (!s_lock || !fn) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SESSION_MAX; i++) {
+        if (s_sessions[i]) {
+            fn(s_sessions[i], ctx);
+        }
+    }
+    xSemaphoreGive(s_lock);
+}
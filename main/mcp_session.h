@@ -0,0 +1,138 @@
+/*
+ * MCP Sessions
+ *
+ * Per-client protocol state. A WebSocket connection is one session, keyed
+ * by its socket; a streamable-HTTP client gets an Mcp-Session-Id header
+ * on its initialize response and sends it back with every request and
+ * event stream. Requests without the header share no session, as before.
+ *
+ * Sessions are reference counted: the table holds one reference while a
+ * session is open, and every request or job working for it holds
+ * another, so closing a session never pulls state from under a worker.
+ */
+
+#ifndef MCP_SESSION_H
+#define MCP_SESSION_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_log.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Length of an Mcp-Session-Id (hex digits)
+ */
+#define MCP_SESSION_ID_LEN 32
+
+/**
+ * Capabilities a client announced in initialize
+ */
+#define MCP_CLIENT_CAP_ROOTS        (1u << 0)
+#define MCP_CLIENT_CAP_SAMPLING     (1u << 1)
+#define MCP_CLIENT_CAP_ELICITATION  (1u << 2)
+
+/**
+ * Session state
+ */
+typedef struct mcp_session {
+    uint32_t sid;                           // Nonzero, never reused; executor origin and stream owner
+    char id[MCP_SESSION_ID_LEN + 1];        // Mcp-Session-Id, or "" for WebSocket
+    int fd;                                 // WebSocket socket, or -1
+    bool initialized;                       // initialize was answered
+    char client_name[32];
+    char protocol_version[16];              // Version the client asked for
+    uint32_t client_caps;                   // MCP_CLIENT_CAP_*
+    esp_log_level_t log_level;              // logging/setLevel for this session's streams
+    atomic_uint requests;                   // Requests answered
+    atomic_uint errors;                     // Error responses
+    atomic_uint tool_calls;
+    int64_t created_us;
+    volatile int64_t last_seen_us;
+    int refs;                               // Private
+} mcp_session_t;
+
+/**
+ * Executor origin of requests from a session (NULL: no session; such
+ * requests cannot be cancelled, see mcp_handle_cancelled)
+ */
+#define MCP_SESSION_ORIGIN(s) ((s) ? (int)(s)->sid : -1)
+
+/**
+ * Create the session table (safe to call more than once)
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t mcp_session_init(void);
+
+/**
+ * Open a session for a streamable-HTTP client
+ * When the table is full, the least recently used HTTP session is closed
+ * to make room.
+ *
+ * @return New session (one reference for the caller), or NULL
+ */
+mcp_session_t *mcp_session_create(void);
+
+/**
+ * Session of a WebSocket connection, opened on first use
+ *
+ * @param fd Socket descriptor
+ * @return Session (one reference for the caller), or NULL if the table is full
+ */
+mcp_session_t *mcp_session_for_fd(int fd);
+
+/**
+ * Look up a session by its Mcp-Session-Id
+ *
+ * @return Session (one reference for the caller), or NULL if unknown or closed
+ */
+mcp_session_t *mcp_session_find(const char *id);
+
+/**
+ * Take another reference (s may be NULL)
+ */
+mcp_session_t *mcp_session_ref(mcp_session_t *s);
+
+/**
+ * Release a reference (s may be NULL)
+ */
+void mcp_session_put(mcp_session_t *s);
+
+/**
+ * Mark the session as used now
+ */
+void mcp_session_touch(mcp_session_t *s);
+
+/**
+ * Close a session: remove it from the table, cancel its tool calls and
+ * end its event streams. References still held stay valid.
+ */
+void mcp_session_close(mcp_session_t *s);
+
+/**
+ * A connection closed (httpd close callback): end the event stream on it
+ * and close the session of a WebSocket connection
+ */
+void mcp_session_close_fd(int fd);
+
+/**
+ * Number of open WebSocket sessions (a hint, read without the lock)
+ */
+int mcp_session_ws_count(void);
+
+/**
+ * Call fn for every open session (the table is locked meanwhile, so fn
+ * must not call back into this module)
+ */
+void mcp_session_foreach(void (*fn)(const mcp_session_t *s, void *ctx), void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MCP_SESSION_H
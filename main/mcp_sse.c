@@ -0,0 +1,702 @@
+/*
+ * MCP Server-Sent Events Stream Implementation
+ *
+ * One sender task owns every open stream. Producers only copy events into
+ * the per-client rings and signal the task, so they never wait on a socket.
+ * Log lines are not copied at all: each client keeps a cursor into the
+ * mcp_log ring and the task formats new lines when it runs.
+ *
+ * The task only writes to a socket that can take data, and each socket has
+ * a short send timeout, so a stalled client keeps its backlog in its ring
+ * instead of holding up the other streams. A client that stays stalled is
+ * dropped.
+ */
+
+#include "mcp_sse.h"
+#include "mcp_log.h"
+#include "mcp_session.h"
+#include "json_writer.h"
+#include "mcp_mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "sdkconfig.h"
+
+static const char *TAG = "mcp_sse";
+
+#define SSE_MAX_CLIENTS     CONFIG_MCP_SSE_MAX_CLIENTS
+#define SSE_QUEUE_SIZE      CONFIG_MCP_SSE_QUEUE_SIZE
+#define SSE_HEARTBEAT_US    ((int64_t)CONFIG_MCP_SSE_HEARTBEAT_SEC * 1000000)
+#define SSE_TX_SIZE         512
+#define SSE_LOG_BATCH       16      // Log lines per client per pass, for fairness
+#define SSE_SEND_TIMEOUT_MS 250     // Longest one chunk may wait for socket space
+#define SSE_STALL_US        (5 * 1000000LL)     // Drop a client not writable for this long
+#define SSE_EVENT_PREFIX    "data: "
+#define SSE_EVENT_SUFFIX    "\n\n"
+
+typedef struct {
+    httpd_req_t *req;           // Async request; NULL while the slot is free
+    uint8_t *ring;              // Queued events (16-bit length + JSON); set while claimed
+    size_t head;                // Offset of the oldest event
+    size_t used;                // Bytes queued
+    uint32_t dropped;           // Events dropped since the last report
+    uint32_t log_seq;           // Next captured log line to forward (sender task only)
+    uint32_t log_missed;        // Log lines overwritten before forwarding (sender task only)
+    int64_t last_send_us;
+    int64_t stalled_us;         // When the socket stopped taking data, or 0
+    int fd;                     // Socket of req
+    uint32_t sid;               // Owning session, or 0
+    esp_log_level_t log_level;  // Forward log lines at or above this level
+    bool closing;               // Session ended; the sender task closes the stream
+    bool fd_closed;             // Socket already closed by the server
+} sse_client_t;
+
+static sse_client_t s_clients[SSE_MAX_CLIENTS];
+static SemaphoreHandle_t s_lock = NULL;     // Guards slot claims and rings
+static SemaphoreHandle_t s_wake = NULL;     // Signals the sender task
+static volatile int s_active = 0;
+static volatile esp_log_level_t s_log_level = ESP_LOG_INFO;   // For new streams of session 0
+static volatile mcp_sse_tick_t s_tick = NULL;
+static volatile mcp_sse_ws_sink_t s_ws_sink = NULL;
+
+// Sender task scratch space
+static char s_event[sizeof(SSE_EVENT_PREFIX) - 1 + SSE_QUEUE_SIZE + sizeof(SSE_EVENT_SUFFIX) - 1];
+static char s_tx[SSE_TX_SIZE];
+static mcp_log_line_t s_line;
+
+/* --- Per-client ring of length-prefixed events (s_lock held) --- */
+
+static void ring_copy_in(sse_client_t *c, size_t off, const void *src, size_t n)
+{
+    size_t pos = (c->head + off) % SSE_QUEUE_SIZE;
+    size_t first = SSE_QUEUE_SIZE - pos;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(c->ring + pos, src, first);
+    memcpy(c->ring, (const uint8_t *)src + first, n - first);
+}
+
+static void ring_copy_out(const sse_client_t *c, size_t off, void *dst, size_t n)
+{
+    size_t pos = (c->head + off) % SSE_QUEUE_SIZE;
+    size_t first = SSE_QUEUE_SIZE - pos;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(dst, c->ring + pos, first);
+    memcpy((uint8_t *)dst + first, c->ring, n - first);
+}
+
+static void ring_discard(sse_client_t *c, size_t n)
+{
+    c->head = (c->head + n) % SSE_QUEUE_SIZE;
+    c->used -= n;
+}
+
+static void ring_push(sse_client_t *c, const char *json, size_t len)
+{
+    // Bounded queue: a slow client loses its oldest events, not the newest
+    while (SSE_QUEUE_SIZE - c->used < len + 2) {
+        uint16_t old_len;
+        ring_copy_out(c, 0, &old_len, 2);
+        ring_discard(c, 2 + (size_t)old_len);
+        c->dropped++;
+    }
+    uint16_t n = (uint16_t)len;
+    ring_copy_in(c, c->used, &n, 2);
+    ring_copy_in(c, c->used + 2, json, len);
+    c->used += len + 2;
+}
+
+static size_t ring_pop(sse_client_t *c, char *dst)
+{
+    if (c->used == 0) {
+        return 0;
+    }
+    uint16_t n;
+    ring_copy_out(c, 0, &n, 2);
+    ring_copy_out(c, 2, dst, n);
+    ring_discard(c, 2 + (size_t)n);
+    return n;
+}
+
+/* --- Notification formatting --- */
+
+static const char *mcp_level_name(esp_log_level_t level)
+{
+    switch (level) {
+        case ESP_LOG_ERROR: return "error";
+        case ESP_LOG_WARN:  return "warning";
+        case ESP_LOG_INFO:  return "info";
+        default:            return "debug";
+    }
+}
+
+// {"jsonrpc":"2.0","method":...,"params":{  (caller closes both objects)
+static void write_notification_begin(json_writer_t *w, const char *method)
+{
+    json_writer_object_begin(w);
+    json_writer_key(w, "jsonrpc");
+    json_writer_string(w, "2.0");
+    json_writer_key(w, "method");
+    json_writer_string(w, method);
+    json_writer_key(w, "params");
+    json_writer_object_begin(w);
+}
+
+static void write_notification_end(json_writer_t *w)
+{
+    json_writer_object_end(w);
+    json_writer_object_end(w);
+}
+
+/* --- Sender task --- */
+
+static esp_err_t sse_flush(void *ctx, const char *data, size_t len)
+{
+    sse_client_t *c = ctx;
+    return httpd_resp_send_chunk(c->req, data, (ssize_t)len);
+}
+
+// One SSE event written straight to the stream; the "data:" framing goes
+// through the writer's raw path so the event leaves in as few chunks as fit
+static void sse_event_begin(json_writer_t *w, sse_client_t *c)
+{
+    json_writer_init(w, s_tx, sizeof(s_tx), sse_flush, c);
+    json_writer_raw(w, SSE_EVENT_PREFIX, sizeof(SSE_EVENT_PREFIX) - 1);
+}
+
+static esp_err_t sse_event_end(json_writer_t *w)
+{
+    json_writer_raw(w, SSE_EVENT_SUFFIX, sizeof(SSE_EVENT_SUFFIX) - 1);
+    return json_writer_finish(w);
+}
+
+static esp_err_t sse_send_log(sse_client_t *c, const mcp_log_line_t *line)
+{
+    json_writer_t w;
+    sse_event_begin(&w, c);
+    write_notification_begin(&w, "notifications/message");
+    json_writer_key(&w, "level");
+    json_writer_string(&w, mcp_level_name(line->level));
+    json_writer_key(&w, "data");
+    json_writer_object_begin(&w);
+    json_writer_key(&w, "seq");
+    json_writer_int(&w, line->seq);
+    json_writer_key(&w, "t");
+    json_writer_int(&w, line->timestamp_ms);
+    json_writer_key(&w, "msg");
+    json_writer_string(&w, line->text);
+    json_writer_object_end(&w);
+    write_notification_end(&w);
+    return sse_event_end(&w);
+}
+
+static esp_err_t sse_send_drop_report(sse_client_t *c, uint32_t dropped, uint32_t log_missed)
+{
+    json_writer_t w;
+    sse_event_begin(&w, c);
+    write_notification_begin(&w, "notifications/message");
+    json_writer_key(&w, "level");
+    json_writer_string(&w, "warning");
+    json_writer_key(&w, "logger");
+    json_writer_string(&w, TAG);
+    json_writer_key(&w, "data");
+    json_writer_object_begin(&w);
+    json_writer_key(&w, "dropped");
+    json_writer_int(&w, dropped);
+    json_writer_key(&w, "log_missed");
+    json_writer_int(&w, log_missed);
+    json_writer_object_end(&w);
+    write_notification_end(&w);
+    return sse_event_end(&w);
+}
+
+static void sse_close(sse_client_t *c)
+{
+    httpd_req_t *req = c->req;
+    httpd_handle_t hd = req->handle;
+    int fd = c->fd;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool fd_closed = c->fd_closed;
+    mcp_mem_free(MCP_MEM_SSE, c->ring);
+    memset(c, 0, sizeof(*c));
+    s_active--;
+    xSemaphoreGive(s_lock);
+
+    httpd_req_async_handler_complete(req);
+    if (!fd_closed) {
+        // Once the server closed it, the descriptor may already be reused
+        httpd_sess_trigger_close(hd, fd);
+    }
+    ESP_LOGI(TAG, "Event stream closed (fd %d)", fd);
+}
+
+// Whether the socket has room for more data right now. Only the TCP socket
+// is checked: a TLS record is written straight through to it.
+static bool sse_writable(const sse_client_t *c)
+{
+    fd_set wfds;
+    FD_ZERO(&wfds);
+    FD_SET(c->fd, &wfds);
+    struct timeval tv = { 0 };
+    return select(c->fd + 1, NULL, &wfds, NULL, &tv) > 0;
+}
+
+// Deliver what is pending for one client; *more is set if log lines remain
+static esp_err_t sse_service(sse_client_t *c, bool *more)
+{
+    const size_t prefix_len = sizeof(SSE_EVENT_PREFIX) - 1;
+    esp_err_t ret = ESP_OK;
+    bool sent = false;
+
+    // Queued notifications, one chunk per event
+    for (;;) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        size_t len = ring_pop(c, s_event + prefix_len);
+        xSemaphoreGive(s_lock);
+        if (len == 0) {
+            break;
+        }
+        memcpy(s_event, SSE_EVENT_PREFIX, prefix_len);
+        memcpy(s_event + prefix_len + len, SSE_EVENT_SUFFIX, sizeof(SSE_EVENT_SUFFIX) - 1);
+        ret = httpd_resp_send_chunk(c->req, s_event,
+                                    (ssize_t)(prefix_len + len + sizeof(SSE_EVENT_SUFFIX) - 1));
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        sent = true;
+    }
+
+    // Captured log lines at or above the subscribed level
+    int n = 0;
+    for (; n < SSE_LOG_BATCH; n++) {
+        if (mcp_log_read(c->log_seq, &s_line) != ESP_OK) {
+            break;
+        }
+        c->log_missed += s_line.seq - c->log_seq;
+        c->log_seq = s_line.seq + 1;
+        if (s_line.level > c->log_level) {
+            continue;
+        }
+        ret = sse_send_log(c, &s_line);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        sent = true;
+    }
+    *more = (n == SSE_LOG_BATCH);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t dropped = c->dropped;
+    c->dropped = 0;
+    xSemaphoreGive(s_lock);
+    if (dropped || c->log_missed) {
+        ret = sse_send_drop_report(c, dropped, c->log_missed);
+        c->log_missed = 0;
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        sent = true;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (sent) {
+        c->last_send_us = now;
+    } else if (now - c->last_send_us >= SSE_HEARTBEAT_US) {
+        // SSE comment: ignored by clients, keeps proxies and NAT state alive
+        ret = httpd_resp_send_chunk(c->req, ": ping\n\n", HTTPD_RESP_USE_STRLEN);
+        c->last_send_us = now;
+    }
+    return ret;
+}
+
+static void sse_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        // The tick also serves WebSocket sessions, which have no stream to
+        // wake this task, so with a tick installed it runs once a second
+        mcp_sse_tick_t tick = s_tick;
+        xSemaphoreTake(s_wake, (s_active || tick) ? pdMS_TO_TICKS(1000) : portMAX_DELAY);
+
+        tick = s_tick;
+        if (tick && mcp_sse_active()) {
+            tick();
+        }
+
+        bool again = false;
+        for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+            sse_client_t *c = &s_clients[i];
+            if (!c->req) {
+                continue;
+            }
+            if (c->closing) {
+                sse_close(c);
+                continue;
+            }
+            // A stalled client keeps its backlog (and misses log lines)
+            // until it drains or the stall limit drops it
+            if (!sse_writable(c)) {
+                int64_t now = esp_timer_get_time();
+                if (!c->stalled_us) {
+                    c->stalled_us = now;
+                } else if (now - c->stalled_us >= SSE_STALL_US) {
+                    ESP_LOGW(TAG, "Dropping stalled event stream (fd %d)", c->fd);
+                    sse_close(c);
+                }
+                continue;
+            }
+            c->stalled_us = 0;
+            bool more = false;
+            if (sse_service(c, &more) != ESP_OK) {
+                sse_close(c);
+                continue;
+            }
+            again |= more;
+        }
+        if (again) {
+            xSemaphoreGive(s_wake);
+        }
+    }
+}
+
+static void sse_on_log(void)
+{
+    if (s_active) {
+        xSemaphoreGive(s_wake);
+    }
+}
+
+/* --- Public API --- */
+
+esp_err_t mcp_sse_init(void)
+{
+    if (s_lock) {
+        return ESP_OK;
+    }
+
+    s_lock = xSemaphoreCreateMutex();
+    s_wake = xSemaphoreCreateBinary();
+    if (!s_lock || !s_wake) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (xTaskCreate(sse_task, "mcp_sse", 4096, NULL, 4, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create SSE task");
+        return ESP_FAIL;
+    }
+    mcp_log_set_listener(sse_on_log);
+
+    ESP_LOGI(TAG, "SSE ready (%d clients, %d byte queues, %ds heartbeat)",
+             SSE_MAX_CLIENTS, SSE_QUEUE_SIZE, CONFIG_MCP_SSE_HEARTBEAT_SEC);
+    return ESP_OK;
+}
+
+esp_err_t mcp_sse_open(httpd_req_t *req, uint32_t sid, esp_log_level_t log_level)
+{
+    if (!s_lock) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Event stream not available");
+    }
+
+    // Claim a slot: a ring without a request is reserved
+    uint8_t *ring = mcp_mem_malloc(MCP_MEM_SSE, SSE_QUEUE_SIZE);
+    if (!ring) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+    sse_client_t *c = NULL;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (!s_clients[i].ring) {
+            c = &s_clients[i];
+            c->ring = ring;
+            break;
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    if (!c) {
+        mcp_mem_free(MCP_MEM_SSE, ring);
+        ESP_LOGW(TAG, "Event stream refused: %d streams open", SSE_MAX_CLIENTS);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "30");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    // Send the headers now so the client sees the stream open
+    httpd_resp_set_type(req, "text/event-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_req_t *async_req = NULL;
+    esp_err_t ret = httpd_resp_send_chunk(req, ": stream open\n\n", HTTPD_RESP_USE_STRLEN);
+    if (ret == ESP_OK) {
+        ret = httpd_req_async_handler_begin(req, &async_req);
+    }
+    int fd = httpd_req_to_sockfd(req);
+    if (ret == ESP_OK) {
+        // The stream owns the socket from here on; a send that cannot
+        // complete quickly fails and drops this client only
+        struct timeval st = { .tv_sec = 0, .tv_usec = SSE_SEND_TIMEOUT_MS * 1000 };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &st, sizeof(st));
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (ret == ESP_OK) {
+        c->head = 0;
+        c->used = 0;
+        c->dropped = 0;
+        c->log_seq = mcp_log_next_seq();
+        c->log_missed = 0;
+        c->last_send_us = esp_timer_get_time();
+        c->stalled_us = 0;
+        c->fd = fd;
+        c->sid = sid;
+        c->log_level = sid ? log_level : s_log_level;
+        c->closing = false;
+        c->fd_closed = false;
+        c->req = async_req;
+        s_active++;
+    } else {
+        c->ring = NULL;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (ret != ESP_OK) {
+        mcp_mem_free(MCP_MEM_SSE, ring);
+        ESP_LOGE(TAG, "Failed to open event stream: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ESP_LOGI(TAG, "Event stream opened (fd %d, session %u)", fd, (unsigned)sid);
+    xSemaphoreGive(s_wake);
+    return ESP_OK;
+}
+
+void mcp_sse_close_session(uint32_t sid)
+{
+    if (!s_lock || sid == 0) {
+        return;
+    }
+    bool found = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (s_clients[i].req && s_clients[i].sid == sid) {
+            s_clients[i].closing = true;
+            found = true;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    if (found) {
+        xSemaphoreGive(s_wake);
+    }
+}
+
+void mcp_sse_close_fd(int fd)
+{
+    if (!s_lock) {
+        return;
+    }
+    bool found = false;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (s_clients[i].req && s_clients[i].fd == fd) {
+            s_clients[i].closing = true;
+            s_clients[i].fd_closed = true;
+            found = true;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    if (found) {
+        xSemaphoreGive(s_wake);
+    }
+}
+
+bool mcp_sse_active(void)
+{
+    return s_active > 0 || (s_ws_sink && mcp_session_ws_count() > 0);
+}
+
+void mcp_sse_set_tick(mcp_sse_tick_t tick)
+{
+    s_tick = tick;
+}
+
+void mcp_sse_set_ws_sink(mcp_sse_ws_sink_t sink)
+{
+    s_ws_sink = sink;
+}
+
+// Queue an event for every stream, or only for the streams of one session;
+// sessions on a WebSocket get it through the sink instead
+static esp_err_t sse_publish(bool all, uint32_t sid, const char *json, size_t len)
+{
+    if (!json) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    mcp_sse_ws_sink_t sink = s_ws_sink;
+    bool delivered = false;
+    if (sink && (all || sid)) {
+        delivered = sink(all ? 0 : sid, json, len);
+    }
+    if (!s_active) {
+        return delivered ? ESP_OK : ESP_ERR_INVALID_STATE;
+    }
+    if (len + 2 > SSE_QUEUE_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (s_clients[i].req && (all || s_clients[i].sid == sid)) {
+            ring_push(&s_clients[i], json, len);
+        }
+    }
+    xSemaphoreGive(s_lock);
+
+    xSemaphoreGive(s_wake);
+    return ESP_OK;
+}
+
+esp_err_t mcp_sse_publish(const char *json, size_t len)
+{
+    return sse_publish(true, 0, json, len);
+}
+
+static esp_err_t publish_writer(json_writer_t *w, bool all, uint32_t sid)
+{
+    esp_err_t ret = w->err;
+    if (ret == ESP_OK) {
+        ret = sse_publish(all, sid, w->buf, w->len);
+    }
+    json_writer_release(w);
+    return ret;
+}
+
+esp_err_t mcp_sse_notify_progress(uint32_t sid, const char *token_json, double progress,
+                                  double total, const char *message)
+{
+    if (!token_json) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!mcp_sse_active()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char buf[192];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    write_notification_begin(&w, "notifications/progress");
+    json_writer_key(&w, "progressToken");
+    json_writer_raw(&w, token_json, strlen(token_json));
+    json_writer_key(&w, "progress");
+    json_writer_double(&w, progress);
+    if (total > 0) {
+        json_writer_key(&w, "total");
+        json_writer_double(&w, total);
+    }
+    if (message) {
+        json_writer_key(&w, "message");
+        json_writer_string(&w, message);
+    }
+    write_notification_end(&w);
+    return publish_writer(&w, false, sid);
+}
+
+esp_err_t mcp_sse_notify_message(const char *level, const char *logger,
+                                 const char *data_json, size_t data_len)
+{
+    if (!level || !data_json) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!mcp_sse_active()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char buf[256];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    write_notification_begin(&w, "notifications/message");
+    json_writer_key(&w, "level");
+    json_writer_string(&w, level);
+    if (logger) {
+        json_writer_key(&w, "logger");
+        json_writer_string(&w, logger);
+    }
+    json_writer_key(&w, "data");
+    json_writer_raw(&w, data_json, data_len);
+    write_notification_end(&w);
+    return publish_writer(&w, true, 0);
+}
+
+esp_err_t mcp_sse_notify_resource_updated(uint32_t sid, const char *uri)
+{
+    if (!uri) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!mcp_sse_active()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char buf[160];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf), NULL, NULL);
+    write_notification_begin(&w, "notifications/resources/updated");
+    json_writer_key(&w, "uri");
+    json_writer_string(&w, uri);
+    write_notification_end(&w);
+    return publish_writer(&w, false, sid);
+}
+
+esp_err_t mcp_sse_parse_level(const char *name, esp_log_level_t *level)
+{
+    static const struct {
+        const char *name;
+        esp_log_level_t level;
+    } levels[] = {
+        {"debug", ESP_LOG_VERBOSE},
+        {"info", ESP_LOG_INFO},
+        {"notice", ESP_LOG_INFO},
+        {"warning", ESP_LOG_WARN},
+        {"error", ESP_LOG_ERROR},
+        {"critical", ESP_LOG_ERROR},
+        {"alert", ESP_LOG_ERROR},
+        {"emergency", ESP_LOG_ERROR},
+    };
+
+    if (!name || !level) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+        if (strcmp(levels[i].name, name) == 0) {
+            *level = levels[i].level;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_ARG;
+}
+
+void mcp_sse_set_log_level(uint32_t sid, esp_log_level_t level)
+{
+    if (sid == 0) {
+        s_log_level = level;
+    }
+    if (!s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (int i = 0; i < SSE_MAX_CLIENTS; i++) {
+        if (s_clients[i].req && s_clients[i].sid == sid) {
+            s_clients[i].log_level = level;
+        }
+    }
+    xSemaphoreGive(s_lock);
+    ESP_LOGI(TAG, "Session %u: forwarding log lines at level %s and above",
+             (unsigned)sid, mcp_level_name(level));
+}
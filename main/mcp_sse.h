@@ -0,0 +1,156 @@
+/*
+ * MCP Server-Sent Events Stream
+ *
+ * Streamable-HTTP push channel: GET /mcp with "Accept: text/event-stream"
+ * keeps a chunked response open and delivers server notifications
+ * (progress, log lines, OTA state) plus periodic heartbeats. Each client
+ * has a bounded queue; when a client falls behind, its oldest events are
+ * dropped and a warning notification reports how many.
+ *
+ * A stream opened with an Mcp-Session-Id belongs to that session: it only
+ * gets progress for the session's own requests and forwards log lines at
+ * the session's logging/setLevel. Streams without one share session 0.
+ *
+ * A WebSocket session has no stream; notifications for it are handed to
+ * the sink the server installs and go out as frames on its connection.
+ */
+
+#ifndef MCP_SSE_H
+#define MCP_SSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_http_server.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Start the SSE sender task (safe to call more than once)
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t mcp_sse_init(void);
+
+/**
+ * Turn a GET request into an event stream
+ * The request is handed to the sender task; the handler returns at once.
+ *
+ * @param req GET /mcp request that accepts text/event-stream
+ * @param sid Session the stream belongs to, or 0
+ * @param log_level Forward captured log lines at or above this level
+ * @return ESP_OK if the stream was opened (or refused with a response)
+ */
+esp_err_t mcp_sse_open(httpd_req_t *req, uint32_t sid, esp_log_level_t log_level);
+
+/**
+ * End the streams of a session (they are closed by the sender task)
+ */
+void mcp_sse_close_session(uint32_t sid);
+
+/**
+ * The server closed a socket (httpd close callback): end the stream on it
+ * without touching the socket again
+ */
+void mcp_sse_close_fd(int fd);
+
+/**
+ * Whether any client can receive notifications: an open stream or a
+ * WebSocket session (lets producers skip formatting)
+ */
+bool mcp_sse_active(void);
+
+/**
+ * Called by the sender task each time it wakes while any client can
+ * receive notifications: at least once a second, and while streams are
+ * open also on every captured log line and every queued event
+ */
+typedef void (*mcp_sse_tick_t)(void);
+
+/**
+ * Install (or clear with NULL) the tick callback; it may publish but must
+ * not block
+ */
+void mcp_sse_set_tick(mcp_sse_tick_t tick);
+
+/**
+ * Delivers a notification to the WebSocket connection of session sid, or
+ * to every WebSocket session for sid 0
+ *
+ * @return true if a frame was queued for at least one connection
+ */
+typedef bool (*mcp_sse_ws_sink_t)(uint32_t sid, const char *json, size_t len);
+
+/**
+ * Install the WebSocket sink (done by mcp_server_init)
+ */
+void mcp_sse_set_ws_sink(mcp_sse_ws_sink_t sink);
+
+/**
+ * Queue a complete JSON-RPC notification for every subscribed client,
+ * WebSocket sessions included
+ *
+ * @param json Serialized notification
+ * @param len Length of json
+ * @return ESP_OK, ESP_ERR_INVALID_STATE without subscribers,
+ *         ESP_ERR_INVALID_SIZE if it can never fit a client queue
+ */
+esp_err_t mcp_sse_publish(const char *json, size_t len);
+
+/**
+ * Send notifications/progress to the streams or WebSocket of one session
+ *
+ * @param sid Session of the originating request, or 0
+ * @param token_json progressToken of the originating request, as JSON
+ * @param progress Progress so far
+ * @param total Total amount, or 0 if unknown
+ * @param message Optional human-readable message
+ */
+esp_err_t mcp_sse_notify_progress(uint32_t sid, const char *token_json, double progress,
+                                  double total, const char *message);
+
+/**
+ * Publish notifications/message (MCP logging) to every client
+ *
+ * @param level MCP level: "debug", "info", "warning", "error", ...
+ * @param logger Logger name, or NULL
+ * @param data_json Message data as serialized JSON
+ * @param data_len Length of data_json
+ */
+esp_err_t mcp_sse_notify_message(const char *level, const char *logger,
+                                 const char *data_json, size_t data_len);
+
+/**
+ * Send notifications/resources/updated to the streams or WebSocket of one
+ * session
+ *
+ * @param sid Subscribing session, or 0
+ * @param uri Resource that changed
+ */
+esp_err_t mcp_sse_notify_resource_updated(uint32_t sid, const char *uri);
+
+/**
+ * Map an MCP level name to a log level
+ *
+ * @param name MCP level name ("debug", "info", "warning", ...)
+ * @param level Output
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for an unknown level
+ */
+esp_err_t mcp_sse_parse_level(const char *name, esp_log_level_t *level);
+
+/**
+ * Set the minimum level of captured log lines forwarded to the streams of
+ * a session (the logging/setLevel request); for session 0 it also becomes
+ * the level of its future streams
+ */
+void mcp_sse_set_log_level(uint32_t sid, esp_log_level_t level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MCP_SSE_H
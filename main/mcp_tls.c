@@ -0,0 +1,338 @@
+/*
+ * MCP TLS Setup Implementation
+ *
+ * Tickets are issued by esp-tls (mbedtls_ssl_ticket), which encrypts them
+ * with a key it replaces every CONFIG_ESP_TLS_SERVER_SESSION_TICKET_TIMEOUT
+ * seconds while still accepting tickets made with the previous one. The
+ * two keys live in esp-tls's ticket context in internal RAM; this code
+ * neither rotates nor moves them. There is no server-side session cache,
+ * so resumption costs no RAM per client.
+ *
+ * esp_https_server runs the whole handshake inside
+ * esp_tls_server_session_create(), on the httpd task. The link wraps that
+ * function (see CMakeLists.txt) to time it, and wraps
+ * mbedtls_ssl_ticket_parse(), the ticket callback esp-tls installs, to see
+ * whether the client's ticket was accepted during it.
+ *
+ * The ECDSA server key is made on the device and, with
+ * CONFIG_MCP_TLS_KEY_PERSIST, kept in NVS (encrypted only if NVS
+ * encryption is on); otherwise a new one is made on every boot. Its
+ * signature is a single scalar multiplication where an RSA-2048 signature
+ * is a 2048-bit modular exponentiation; both run on the MPI accelerator,
+ * and the record layer uses the AES and SHA engines either way. With an EC
+ * certificate mbedTLS can only choose ECDHE-ECDSA suites.
+ */
+
+#include "mcp_tls.h"
+#include "tls_keys.h"
+#include "tls_bench.h"
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_tls.h>
+#include <nvs.h>
+#include <mbedtls/ssl.h>
+#if CONFIG_MCP_TLS_SESSION_TICKETS
+#include <mbedtls/ssl_ticket.h>
+#endif
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "sdkconfig.h"
+
+static const char *TAG = "mcp_tls";
+
+#define TLS_NVS_NAMESPACE   "mcp_tls"
+#define TLS_COMMON_NAME     "esp32-mcp-server"
+#define TLS_BENCH_DEFAULT   3
+#define TLS_BENCH_MAX       20
+
+// Example RSA-2048 pair built into the image (certs/)
+extern const unsigned char servercert_start[] asm("_binary_servercert_pem_start");
+extern const unsigned char servercert_end[]   asm("_binary_servercert_pem_end");
+extern const unsigned char prvtkey_pem_start[] asm("_binary_prvtkey_pem_start");
+extern const unsigned char prvtkey_pem_end[]   asm("_binary_prvtkey_pem_end");
+
+// Device ECDSA pair, loaded once and kept for the server's lifetime
+static char *s_ec_cert = NULL;
+static char *s_ec_key = NULL;
+
+static SemaphoreHandle_t s_lock = NULL;
+static bool s_tickets = false;
+static uint32_t s_started = 0;
+static uint32_t s_count[2];             // [0] full, [1] resumed
+static uint64_t s_total_us[2];
+static uint32_t s_max_us[2];
+
+// Set while this task runs a server handshake; the in-memory handshakes
+// of sys_tls_bench are not inside one, so their tickets are not counted
+static __thread bool t_in_handshake = false;
+static __thread bool t_resumed = false;
+
+#if CONFIG_ESP_HTTPS_SERVER_ENABLE
+int __real_esp_tls_server_session_create(esp_tls_cfg_server_t *cfg, int sockfd, esp_tls_t *tls);
+int __wrap_esp_tls_server_session_create(esp_tls_cfg_server_t *cfg, int sockfd, esp_tls_t *tls);
+
+int __wrap_esp_tls_server_session_create(esp_tls_cfg_server_t *cfg, int sockfd, esp_tls_t *tls)
+{
+    if (s_lock) {
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        s_started++;
+        xSemaphoreGive(s_lock);
+    }
+    t_in_handshake = true;
+    t_resumed = false;
+    int64_t begin = esp_timer_get_time();
+    int ret = __real_esp_tls_server_session_create(cfg, sockfd, tls);
+    uint32_t us = (uint32_t)(esp_timer_get_time() - begin);
+    t_in_handshake = false;
+    if (ret != 0 || !s_lock) {
+        return ret;
+    }
+
+    int kind = t_resumed ? 1 : 0;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_count[kind]++;
+    s_total_us[kind] += us;
+    if (us > s_max_us[kind]) {
+        s_max_us[kind] = us;
+    }
+    xSemaphoreGive(s_lock);
+
+    ESP_LOGD(TAG, "%s handshake on fd %d: %lu ms", kind ? "Resumed" : "Full", sockfd,
+             (unsigned long)(us / 1000));
+    return ret;
+}
+#endif
+
+#if CONFIG_MCP_TLS_SESSION_TICKETS
+int __real_mbedtls_ssl_ticket_parse(void *p_ticket, mbedtls_ssl_session *session,
+                                    unsigned char *buf, size_t len);
+int __wrap_mbedtls_ssl_ticket_parse(void *p_ticket, mbedtls_ssl_session *session,
+                                    unsigned char *buf, size_t len);
+
+int __wrap_mbedtls_ssl_ticket_parse(void *p_ticket, mbedtls_ssl_session *session,
+                                    unsigned char *buf, size_t len)
+{
+    int ret = __real_mbedtls_ssl_ticket_parse(p_ticket, session, buf, len);
+    if (ret == 0 && t_in_handshake) {
+        t_resumed = true;
+    }
+    return ret;
+}
+#endif
+
+esp_err_t mcp_tls_configure(httpd_ssl_config_t *conf)
+{
+    if (!conf) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_lock) {
+        s_lock = xSemaphoreCreateMutex();
+        if (!s_lock) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+#if CONFIG_MCP_TLS_SESSION_TICKETS
+    conf->session_tickets = true;
+    s_tickets = true;
+    ESP_LOGI(TAG, "Session tickets on (key lifetime %d s)", CONFIG_ESP_TLS_SERVER_SESSION_TICKET_TIMEOUT);
+#else
+    s_tickets = false;
+#endif
+    return ESP_OK;
+}
+
+// NUL-terminated blob from NVS, malloc'd
+static esp_err_t nvs_read_pem(nvs_handle_t nvs, const char *name, char **out)
+{
+    size_t len = 0;
+    esp_err_t err = nvs_get_blob(nvs, name, NULL, &len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    char *buf = malloc(len + 1);
+    if (!buf) {
+        return ESP_ERR_NO_MEM;
+    }
+    err = nvs_get_blob(nvs, name, buf, &len);
+    if (err != ESP_OK) {
+        free(buf);
+        return err;
+    }
+    buf[len] = '\0';
+    *out = buf;
+    return ESP_OK;
+}
+
+#if CONFIG_MCP_TLS_KEY_PERSIST
+static esp_err_t ec_credentials_load(void)
+{
+    if (s_ec_cert && s_ec_key) {
+        return ESP_OK;
+    }
+#if !CONFIG_NVS_ENCRYPTION
+    ESP_LOGW(TAG, "NVS encryption is off: the server key is stored in plain text");
+#endif
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(TLS_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    char *cert = NULL, *key = NULL;
+    if (nvs_read_pem(nvs, "cert", &cert) == ESP_OK && nvs_read_pem(nvs, "key", &key) == ESP_OK) {
+        ESP_LOGI(TAG, "Loaded ECDSA P-256 server key from NVS");
+    } else {
+        free(cert);
+        // Generated while Wi-Fi is up, so the RNG is fully seeded
+        ESP_LOGI(TAG, "Generating ECDSA P-256 server key");
+        err = tls_keys_generate_ecdsa(TLS_COMMON_NAME, &cert, &key);
+        if (err == ESP_OK) {
+            err = nvs_set_blob(nvs, "cert", cert, strlen(cert) + 1);
+        }
+        if (err == ESP_OK) {
+            err = nvs_set_blob(nvs, "key", key, strlen(key) + 1);
+        }
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        if (err != ESP_OK && cert) {
+            // Still usable for this boot; a new key is made on the next one
+            ESP_LOGW(TAG, "Could not store server key: %s", esp_err_to_name(err));
+            err = ESP_OK;
+        }
+    }
+    nvs_close(nvs);
+
+    if (err != ESP_OK) {
+        free(cert);
+        free(key);
+        return err;
+    }
+    s_ec_cert = cert;
+    s_ec_key = key;
+    return ESP_OK;
+}
+#else
+static esp_err_t ec_credentials_load(void)
+{
+    if (s_ec_cert && s_ec_key) {
+        return ESP_OK;
+    }
+    // Drop a key an earlier build left in NVS
+    nvs_handle_t nvs;
+    if (nvs_open(TLS_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK) {
+        if (nvs_erase_all(nvs) == ESP_OK) {
+            nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
+
+    ESP_LOGI(TAG, "Generating ECDSA P-256 server key for this boot");
+    char *cert = NULL, *key = NULL;
+    esp_err_t err = tls_keys_generate_ecdsa(TLS_COMMON_NAME, &cert, &key);
+    if (err != ESP_OK) {
+        return err;
+    }
+    s_ec_cert = cert;
+    s_ec_key = key;
+    return ESP_OK;
+}
+#endif
+
+static void use_embedded_credentials(httpd_ssl_config_t *conf)
+{
+    conf->servercert = servercert_start;
+    conf->servercert_len = servercert_end - servercert_start;
+    conf->prvtkey_pem = prvtkey_pem_start;
+    conf->prvtkey_len = prvtkey_pem_end - prvtkey_pem_start;
+}
+
+esp_err_t mcp_tls_load_credentials(httpd_ssl_config_t *conf)
+{
+    if (!conf) {
+        return ESP_ERR_INVALID_ARG;
+    }
+#if CONFIG_MCP_TLS_KEY_ECDSA_P256
+    esp_err_t err = ec_credentials_load();
+    if (err == ESP_OK) {
+        conf->servercert = (const uint8_t *)s_ec_cert;
+        conf->servercert_len = strlen(s_ec_cert) + 1;
+        conf->prvtkey_pem = (const uint8_t *)s_ec_key;
+        conf->prvtkey_len = strlen(s_ec_key) + 1;
+        return ESP_OK;
+    }
+    ESP_LOGW(TAG, "No ECDSA server key (%s), using the built-in RSA certificate", esp_err_to_name(err));
+    use_embedded_credentials(conf);
+    return err;
+#else
+    use_embedded_credentials(conf);
+    return ESP_OK;
+#endif
+}
+
+static void bench_report(mcp_result_t *result, const char *label, esp_err_t err,
+                         const tls_bench_result_t *r)
+{
+    if (err != ESP_OK && r->handshakes == 0) {
+        mcp_result_printf(result, "%s: failed (%s)\n", label, esp_err_to_name(err));
+        return;
+    }
+    mcp_result_printf(result,
+        "%s: %lu handshakes, server %lu.%03lu ms, client %lu.%03lu ms, peak heap %u bytes, %s\n",
+        label, (unsigned long)r->handshakes,
+        (unsigned long)(r->server_us / 1000), (unsigned long)(r->server_us % 1000),
+        (unsigned long)(r->client_us / 1000), (unsigned long)(r->client_us % 1000),
+        (unsigned)r->peak_heap, r->ciphersuite);
+}
+
+esp_err_t tool_sys_tls_bench(cJSON *args, mcp_result_t *result)
+{
+    int handshakes = TLS_BENCH_DEFAULT;
+    cJSON *n = cJSON_GetObjectItem(args, "handshakes");
+    if (cJSON_IsNumber(n)) {
+        handshakes = n->valueint;
+    }
+    if (handshakes < 1 || handshakes > TLS_BENCH_MAX) {
+        mcp_result_printf(result, "'handshakes' must be 1-%d", TLS_BENCH_MAX);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Embedded PEMs are NUL-terminated by EMBED_TXTFILES
+    tls_bench_result_t r = {0};
+    esp_err_t err = tls_bench_run((const char *)servercert_start, (const char *)prvtkey_pem_start,
+                                  handshakes, result->cancelled, &r);
+    bench_report(result, "RSA-2048", err, &r);
+    if (mcp_result_cancelled(result)) {
+        return ESP_OK;
+    }
+
+    esp_err_t ec_err = ec_credentials_load();
+    if (ec_err != ESP_OK) {
+        mcp_result_printf(result, "ECDSA P-256: no key (%s)\n", esp_err_to_name(ec_err));
+        return ec_err;
+    }
+    ec_err = tls_bench_run(s_ec_cert, s_ec_key, handshakes, result->cancelled, &r);
+    bench_report(result, "ECDSA P-256", ec_err, &r);
+    return err != ESP_OK ? err : ec_err;
+}
+
+void mcp_tls_get_stats(mcp_tls_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->tickets = s_tickets;
+    if (!s_lock) {
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    stats->started = s_started;
+    stats->full = s_count[0];
+    stats->resumed = s_count[1];
+    stats->full_avg_ms = s_count[0] ? (uint32_t)(s_total_us[0] / s_count[0] / 1000) : 0;
+    stats->resumed_avg_ms = s_count[1] ? (uint32_t)(s_total_us[1] / s_count[1] / 1000) : 0;
+    stats->full_max_ms = s_max_us[0] / 1000;
+    stats->resumed_max_ms = s_max_us[1] / 1000;
+    xSemaphoreGive(s_lock);
+}
@@ -0,0 +1,79 @@
+/*
+ * MCP TLS Setup
+ *
+ * Session resumption and handshake statistics for the HTTPS/WSS server.
+ * Clients of the streamable-HTTP transport reconnect often, so resumed
+ * handshakes (session tickets) skip the server's private-key operation
+ * that dominates connection setup. The server key is either an ECDSA P-256
+ * key generated on the device or the built-in RSA-2048 example.
+ */
+
+#ifndef MCP_TLS_H
+#define MCP_TLS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_https_server.h>
+#include "mcp_tools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Handshake counters since boot
+ */
+typedef struct {
+    bool tickets;               // Session tickets are issued
+    uint32_t started;           // Handshakes begun (started - full - resumed: failed or in progress)
+    uint32_t full;
+    uint32_t resumed;
+    uint32_t full_avg_ms;
+    uint32_t full_max_ms;
+    uint32_t resumed_avg_ms;
+    uint32_t resumed_max_ms;
+} mcp_tls_stats_t;
+
+/**
+ * Enable session tickets and handshake timing on a server configuration
+ * (before httpd_ssl_start). Handshakes are timed by link-time wrappers of
+ * esp_tls_server_session_create() and mbedtls_ssl_ticket_parse().
+ *
+ * @param conf HTTPS server configuration
+ * @return ESP_OK on success
+ */
+esp_err_t mcp_tls_configure(httpd_ssl_config_t *conf);
+
+/**
+ * Set the server certificate and key (before httpd_ssl_start)
+ * With CONFIG_MCP_TLS_KEY_ECDSA_P256 the key is read from NVS, or generated
+ * and stored there on first boot (CONFIG_MCP_TLS_KEY_PERSIST), or generated
+ * anew on every boot; if that fails the built-in RSA pair is set and the
+ * error returned.
+ *
+ * @param conf HTTPS server configuration
+ * @return ESP_OK on success
+ */
+esp_err_t mcp_tls_load_credentials(httpd_ssl_config_t *conf);
+
+/**
+ * Snapshot of the handshake counters
+ */
+void mcp_tls_get_stats(mcp_tls_stats_t *stats);
+
+/**
+ * Tool handler: sys_tls_bench
+ * Runs in-memory handshakes with the RSA-2048 and ECDSA P-256 keys and
+ * reports time per side and peak heap for each.
+ *
+ * Parameters:
+ *   handshakes - Handshakes per key (default 3, max 20)
+ */
+esp_err_t tool_sys_tls_bench(cJSON *args, mcp_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MCP_TLS_H
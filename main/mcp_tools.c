@@ -4,10 +4,26 @@
 
 #include "mcp_tools.h"
 #include "mcp_log.h"
+#include "mcp_log_archive.h"
 #include "mcp_ota.h"
+#include "mcp_sse.h"
+#include "mcp_session.h"
+#include "mcp_bufpool.h"
+#include "mcp_arena.h"
+#include "mcp_mem.h"
+#include "mcp_metrics.h"
+#include "mcp_trace.h"
+#if CONFIG_ESP_HTTPS_SERVER_ENABLE
+#include "mcp_tls.h"
+#endif
 #include "lua_runtime.h"
+#include "json_writer.h"
+#include "name_index.h"
 #include <stdarg.h>
+#include <inttypes.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <esp_log.h>
 #include <esp_heap_caps.h>
@@ -15,6 +31,8 @@
 #include <esp_timer.h>
 #include <esp_wifi.h>
 #include <driver/gpio.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 static const char *TAG = "mcp_tools";
 
@@ -27,18 +45,19 @@ static const char *PROJECT_SYSTEM_PROMPT =
     "For DI display switching, prefer lua_bind_dependency to update bindings.lua.\n"
     "Default display interface is 'display' with providers like 'mock_display'.\n"
     "Useful tools: get_status, sys_get_logs, lua_list_scripts, lua_get_script, lua_push_script, lua_bind_dependency, lua_restart, lua_exec.\n"
+    "Scripts can add MCP tools with mcp.register_tool(name, description, schema, fn); main.lua serves their calls during time.sleep_ms().\n"
     "Safety: keep script changes small, verify each step, and rollback by restoring previous script content if needed.";
 
 // Forward declarations of tool handlers
-static esp_err_t tool_control_led(cJSON *args, char *result, size_t max_len);
-static esp_err_t tool_get_status(cJSON *args, char *result, size_t max_len);
-static esp_err_t tool_get_system_prompt(cJSON *args, char *result, size_t max_len);
-static esp_err_t tool_lua_push_script(cJSON *args, char *result, size_t max_len);
-static esp_err_t tool_lua_get_script(cJSON *args, char *result, size_t max_len);
-static esp_err_t tool_lua_list_scripts(cJSON *args, char *result, size_t max_len);
-static esp_err_t tool_lua_exec(cJSON *args, char *result, size_t max_len);
-static esp_err_t tool_lua_restart(cJSON *args, char *result, size_t max_len);
-static esp_err_t tool_lua_bind_dependency(cJSON *args, char *result, size_t max_len);
+static esp_err_t tool_control_led(cJSON *args, mcp_result_t *result);
+static esp_err_t tool_get_status(cJSON *args, mcp_result_t *result);
+static esp_err_t tool_get_system_prompt(cJSON *args, mcp_result_t *result);
+static esp_err_t tool_lua_push_script(cJSON *args, mcp_result_t *result);
+static esp_err_t tool_lua_get_script(cJSON *args, mcp_result_t *result);
+static esp_err_t tool_lua_list_scripts(cJSON *args, mcp_result_t *result);
+static esp_err_t tool_lua_exec(cJSON *args, mcp_result_t *result);
+static esp_err_t tool_lua_restart(cJSON *args, mcp_result_t *result);
+static esp_err_t tool_lua_bind_dependency(cJSON *args, mcp_result_t *result);
 
 // Tool registry (static, compile-time)
 static const mcp_tool_t tool_registry[] = {
@@ -55,25 +74,71 @@ static const mcp_tool_t tool_registry[] = {
         .name = "get_status",
         .description = "Get system status including heap, Lua runtime memory, WiFi, and uptime",
         .input_schema_json = "{\"type\":\"object\",\"properties\":{}}",
-        .handler = tool_get_status
+        .handler = tool_get_status,
+        .read_only = true
     },
     {
         .name = "get_system_prompt",
         .description = "Get the overall project prompt for AI agents (what this project does and recommended tool workflow)",
         .input_schema_json = "{\"type\":\"object\",\"properties\":{}}",
-        .handler = tool_get_system_prompt
+        .handler = tool_get_system_prompt,
+        .read_only = true
     },
     {
         .name = "sys_get_logs",
-        .description = "Retrieve recent runtime logs from the device",
+        .description = "Retrieve runtime logs from the device; pass the returned next_seq as since_seq to get only newer lines",
         .input_schema_json =
             "{\"type\":\"object\","
             "\"properties\":{"
             "\"level\":{\"type\":\"string\",\"enum\":[\"error\",\"warn\",\"info\",\"debug\",\"verbose\"],\"description\":\"Minimum log level filter\",\"default\":\"info\"},"
             "\"lines\":{\"type\":\"integer\",\"description\":\"Max number of log lines to return\",\"default\":20},"
-            "\"filter\":{\"type\":\"string\",\"description\":\"Substring filter for log messages\"}"
+            "\"filter\":{\"type\":\"string\",\"description\":\"Substring filter for log messages\"},"
+            "\"exclude\":{\"type\":\"string\",\"description\":\"Skip lines containing this substring\"},"
+            "\"tags\":{\"type\":\"array\",\"items\":{\"type\":\"string\"},\"description\":\"Only lines with one of these tags, such as lua or mcp_server\"},"
+            "\"exclude_tags\":{\"type\":\"array\",\"items\":{\"type\":\"string\"},\"description\":\"Skip lines with these tags\"},"
+            "\"last_s\":{\"type\":\"number\",\"description\":\"Only lines from the last N seconds\"},"
+            "\"since_t\":{\"type\":\"integer\",\"description\":\"Only lines with t (ms since boot) at or after this\"},"
+            "\"until_t\":{\"type\":\"integer\",\"description\":\"Only lines with t (ms since boot) at or before this\"},"
+            "\"since_seq\":{\"type\":\"integer\",\"description\":\"Return lines from this sequence number on (next_seq of the previous call), oldest first\"},"
+            "\"since_restart\":{\"type\":\"boolean\",\"description\":\"Only lines logged since the last lua_restart\"}"
+            "}}",
+        .handler = tool_sys_get_logs,
+        .read_only = true
+    },
+    {
+        .name = "sys_get_boot_logs",
+        .description = "List the boots kept in the flash log archive, or read the logs of one boot (e.g. the one before a crash or reboot)",
+        .input_schema_json =
+            "{\"type\":\"object\","
+            "\"properties\":{"
+            "\"boot\":{\"type\":\"integer\",\"description\":\"Boot id to read; omit to list the archived boots\"},"
+            "\"since_seq\":{\"type\":\"integer\",\"description\":\"Return lines from this sequence number on (next_seq of the previous call), oldest first\"},"
+            "\"lines\":{\"type\":\"integer\",\"description\":\"Max number of log lines to return\",\"default\":50,\"maximum\":128}"
             "}}",
-        .handler = tool_sys_get_logs
+        .handler = tool_sys_get_boot_logs,
+        .read_only = true
+    },
+    {
+        .name = "sys_get_metrics",
+        .description = "Get request latency percentiles (p50/p90/p99) per stage, method and tool, plus bytes sent and received",
+        .input_schema_json =
+            "{\"type\":\"object\","
+            "\"properties\":{"
+            "\"kind\":{\"type\":\"string\",\"enum\":[\"stage\",\"method\",\"tool\"],\"description\":\"Only series of this kind\"}"
+            "}}",
+        .handler = tool_sys_get_metrics,
+        .read_only = true
+    },
+    {
+        .name = "sys_trace",
+        .description = "Start or stop span tracing of requests, Lua and SPIFFS I/O; GET /trace returns the spans as Chrome trace JSON",
+        .input_schema_json =
+            "{\"type\":\"object\","
+            "\"properties\":{"
+            "\"enable\":{\"type\":\"boolean\",\"description\":\"true to record spans, false to stop\"},"
+            "\"clear\":{\"type\":\"boolean\",\"description\":\"Drop the recorded spans first\"}"
+            "}}",
+        .handler = tool_sys_trace
     },
     {
         .name = "sys_ota_push",
@@ -90,7 +155,8 @@ static const mcp_tool_t tool_registry[] = {
         .name = "sys_ota_status",
         .description = "Get current OTA update state and progress",
         .input_schema_json = "{\"type\":\"object\",\"properties\":{}}",
-        .handler = tool_sys_ota_status
+        .handler = tool_sys_ota_status,
+        .read_only = true
     },
     {
         .name = "sys_ota_rollback",
@@ -104,6 +170,18 @@ static const mcp_tool_t tool_registry[] = {
         .input_schema_json = "{\"type\":\"object\",\"properties\":{}}",
         .handler = tool_sys_reboot
     },
+#if CONFIG_ESP_HTTPS_SERVER_ENABLE
+    {
+        .name = "sys_tls_bench",
+        .description = "Benchmark TLS handshakes in memory with the RSA-2048 and ECDSA P-256 server keys (time per side, peak heap)",
+        .input_schema_json =
+            "{\"type\":\"object\","
+            "\"properties\":{"
+            "\"handshakes\":{\"type\":\"integer\",\"description\":\"Handshakes per key\",\"default\":3,\"minimum\":1,\"maximum\":20}"
+            "}}",
+        .handler = tool_sys_tls_bench
+    },
+#endif
     {
         .name = "lua_push_script",
         .description = "Write or update a Lua script on the device. Use append=true for large scripts sent in chunks.",
@@ -126,13 +204,15 @@ static const mcp_tool_t tool_registry[] = {
             "\"name\":{\"type\":\"string\",\"description\":\"Script filename (e.g. main.lua)\"}"
             "},"
             "\"required\":[\"name\"]}",
-        .handler = tool_lua_get_script
+        .handler = tool_lua_get_script,
+        .read_only = true
     },
     {
         .name = "lua_list_scripts",
         .description = "List all Lua scripts stored on the device",
         .input_schema_json = "{\"type\":\"object\",\"properties\":{}}",
-        .handler = tool_lua_list_scripts
+        .handler = tool_lua_list_scripts,
+        .read_only = true
     },
     {
         .name = "lua_exec",
@@ -165,13 +245,49 @@ static const mcp_tool_t tool_registry[] = {
         .input_schema_json = "{\"type\":\"object\",\"properties\":{}}",
         .handler = tool_lua_restart
     },
-    {NULL, NULL, NULL, NULL}  // Sentinel
+    {NULL, NULL, NULL, NULL, false}  // Sentinel
 };
 
 // LED GPIO configuration
 #define LED_GPIO CONFIG_BLINK_GPIO
 static bool led_initialized = false;
 
+/* Name -> tool index, built by mcp_tools_init */
+#define TOOL_COUNT (sizeof(tool_registry) / sizeof(tool_registry[0]) - 1)
+_Static_assert(TOOL_COUNT <= 256, "tool_registry outgrew NAME_INDEX_SLOTS");
+static name_index_slot_t s_tool_slots[NAME_INDEX_SLOTS(TOOL_COUNT)];
+static name_index_t s_tool_index;
+
+/* Tools registered from Lua: heap copies of the strings, handler NULL */
+#define LUA_TOOLS_MAX       CONFIG_MCP_LUA_TOOLS_MAX
+#define LUA_TOOL_NAME_MAX   64
+static mcp_tool_t s_lua_tools[LUA_TOOLS_MAX];
+static name_index_slot_t s_lua_tool_slots[NAME_INDEX_SLOTS(LUA_TOOLS_MAX)];
+static name_index_t s_lua_tool_index;
+
+/* Cached tools/list; the lock also guards the Lua tools */
+static _Atomic(SemaphoreHandle_t) s_list_lock = NULL;
+static mcp_tools_list_t *s_list = NULL;     // Holds one reference while cached
+
+// Created by mcp_tools_init() or the first Lua registration, whichever
+// comes first: main.lua may start before the MCP server
+static SemaphoreHandle_t registry_lock(void)
+{
+    SemaphoreHandle_t lock = atomic_load(&s_list_lock);
+    if (lock) {
+        return lock;
+    }
+    SemaphoreHandle_t created = xSemaphoreCreateMutex();
+    if (!created) {
+        return NULL;
+    }
+    if (!atomic_compare_exchange_strong(&s_list_lock, &lock, created)) {
+        vSemaphoreDelete(created);  // Lost the race; lock holds the winner
+        return lock;
+    }
+    return created;
+}
+
 esp_err_t mcp_tools_init(void)
 {
     ESP_LOGI(TAG, "Initializing tool registry");
@@ -193,90 +309,427 @@ esp_err_t mcp_tools_init(void)
         ESP_LOGW(TAG, "Failed to initialize LED GPIO: %s", esp_err_to_name(ret));
     }
     
-    // Count registered tools
-    int tool_count = 0;
+    // Index the registry; a duplicate name is a build mistake
+    name_index_init(&s_tool_index, s_tool_slots, sizeof(s_tool_slots) / sizeof(s_tool_slots[0]));
     for (const mcp_tool_t *tool = tool_registry; tool->name != NULL; tool++) {
-        tool_count++;
+        ret = name_index_add(&s_tool_index, tool->name, tool);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Cannot index tool %s: %s", tool->name,
+                     ret == ESP_ERR_INVALID_STATE ? "duplicate name" : esp_err_to_name(ret));
+            return ret;
+        }
     }
     
-    ESP_LOGI(TAG, "Tool registry initialized with %d tools", tool_count);
+    if (!registry_lock()) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "Tool registry initialized with %u tools", (unsigned)name_index_count(&s_tool_index));
     return ESP_OK;
 }
 
 const mcp_tool_t* mcp_tools_find(const char *name)
 {
-    if (!name) {
-        return NULL;
+    return name_index_find(&s_tool_index, name);
+}
+
+bool mcp_tools_is_read_only(const char *name)
+{
+    const mcp_tool_t *tool = mcp_tools_find(name);
+    if (tool) {
+        return tool->read_only;
     }
-    
-    for (const mcp_tool_t *tool = tool_registry; tool->name != NULL; tool++) {
-        if (strcmp(tool->name, name) == 0) {
-            return tool;
+    SemaphoreHandle_t lock = atomic_load(&s_list_lock);
+    if (!lock || !name) {
+        return false;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    tool = name_index_find(&s_lua_tool_index, name);
+    bool read_only = tool && tool->read_only;
+    xSemaphoreGive(lock);
+    return read_only;
+}
+
+/* --- Tools registered from Lua --- */
+
+static bool lua_tool_name_valid(const char *name)
+{
+    size_t len = 0;
+    for (const char *p = name; *p; p++, len++) {
+        char c = *p;
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                  (c >= '0' && c <= '9') || c == '_' || c == '-';
+        if (!ok || len >= LUA_TOOL_NAME_MAX) {
+            return false;
         }
     }
-    
-    return NULL;
+    return len > 0;
 }
 
-cJSON* mcp_tools_get_list(void)
+static void lua_tool_free(mcp_tool_t *tool)
 {
-    cJSON *tools_array = cJSON_CreateArray();
-    if (!tools_array) {
-        ESP_LOGE(TAG, "Failed to create tools array");
-        return NULL;
+    free((char *)tool->name);
+    free((char *)tool->description);
+    free((char *)tool->input_schema_json);
+    memset(tool, 0, sizeof(*tool));
+}
+
+esp_err_t mcp_tools_register_lua(const char *name, const char *description,
+                                 const char *input_schema_json, bool read_only)
+{
+    if (!name || !description || !input_schema_json || !lua_tool_name_valid(name)) {
+        return ESP_ERR_INVALID_ARG;
     }
-    
+    cJSON *schema = cJSON_Parse(input_schema_json);
+    bool schema_ok = cJSON_IsObject(schema);
+    cJSON_Delete(schema);
+    if (!schema_ok) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (mcp_tools_find(name)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    SemaphoreHandle_t lock = registry_lock();
+    if (!lock) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    mcp_tool_t entry = {
+        .name = strdup(name),
+        .description = strdup(description),
+        .input_schema_json = strdup(input_schema_json),
+        .handler = NULL,
+        .read_only = read_only,
+    };
+    if (!entry.name || !entry.description || !entry.input_schema_json) {
+        lua_tool_free(&entry);
+        return ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (!s_lua_tool_index.slots) {
+        name_index_init(&s_lua_tool_index, s_lua_tool_slots,
+                        sizeof(s_lua_tool_slots) / sizeof(s_lua_tool_slots[0]));
+    }
+    mcp_tool_t *slot = (mcp_tool_t *)name_index_find(&s_lua_tool_index, name);
+    bool replaced = (slot != NULL);
+    if (slot) {
+        // main.lua registers again on every restart; only a change counts
+        if (strcmp(slot->description, description) == 0 &&
+            strcmp(slot->input_schema_json, input_schema_json) == 0 &&
+            slot->read_only == read_only) {
+            xSemaphoreGive(lock);
+            lua_tool_free(&entry);
+            return ESP_OK;
+        }
+        name_index_remove(&s_lua_tool_index, slot->name);
+        lua_tool_free(slot);
+    } else {
+        for (int i = 0; i < LUA_TOOLS_MAX && !slot; i++) {
+            if (!s_lua_tools[i].name) {
+                slot = &s_lua_tools[i];
+            }
+        }
+        if (!slot) {
+            xSemaphoreGive(lock);
+            lua_tool_free(&entry);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    *slot = entry;
+    name_index_add(&s_lua_tool_index, slot->name, slot);
+    xSemaphoreGive(lock);
+
+    ESP_LOGI(TAG, "Lua tool %s: %s", replaced ? "replaced" : "registered", name);
+    mcp_tools_list_invalidate();
+    return ESP_OK;
+}
+
+esp_err_t mcp_tools_unregister_lua(const char *name)
+{
+    SemaphoreHandle_t lock = atomic_load(&s_list_lock);
+    if (!lock || !name) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    mcp_tool_t *slot = (mcp_tool_t *)name_index_find(&s_lua_tool_index, name);
+    if (slot) {
+        name_index_remove(&s_lua_tool_index, slot->name);
+        lua_tool_free(slot);
+    }
+    xSemaphoreGive(lock);
+    if (!slot) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ESP_LOGI(TAG, "Lua tool unregistered: %s", name);
+    mcp_tools_list_invalidate();
+    return ESP_OK;
+}
+
+void mcp_tools_clear_lua(void)
+{
+    SemaphoreHandle_t lock = atomic_load(&s_list_lock);
+    if (!lock) {
+        return;
+    }
+    xSemaphoreTake(lock, portMAX_DELAY);
+    size_t count = s_lua_tool_index.slots ? name_index_count(&s_lua_tool_index) : 0;
+    if (count > 0) {
+        for (int i = 0; i < LUA_TOOLS_MAX; i++) {
+            if (s_lua_tools[i].name) {
+                lua_tool_free(&s_lua_tools[i]);
+            }
+        }
+        name_index_init(&s_lua_tool_index, s_lua_tool_slots,
+                        sizeof(s_lua_tool_slots) / sizeof(s_lua_tool_slots[0]));
+    }
+    xSemaphoreGive(lock);
+
+    if (count > 0) {
+        ESP_LOGI(TAG, "Removed %u Lua tools", (unsigned)count);
+        mcp_tools_list_invalidate();
+    }
+}
+
+/* --- Cached tools/list --- */
+
+static uint32_t fnv1a(const char *data, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return h;
+}
+
+// One tools/list entry; the schema is normalized once, an invalid one
+// becomes an empty object
+static void write_list_entry(json_writer_t *w, const mcp_tool_t *tool)
+{
+    json_writer_object_begin(w);
+    json_writer_key(w, "name");
+    json_writer_string(w, tool->name);
+    json_writer_key(w, "description");
+    json_writer_string(w, tool->description);
+    json_writer_key(w, "inputSchema");
+    size_t mark = mcp_arena_mark();
+    cJSON *schema = cJSON_Parse(tool->input_schema_json);
+    if (schema) {
+        json_writer_cjson(w, schema);
+        cJSON_Delete(schema);
+        mcp_arena_rewind(mark);
+    } else {
+        ESP_LOGW(TAG, "Failed to parse schema for tool: %s", tool->name);
+        json_writer_object_begin(w);
+        json_writer_object_end(w);
+    }
+    json_writer_object_end(w);
+}
+
+// Called with s_list_lock held
+static mcp_tools_list_t *build_list(void)
+{
+    json_writer_t w;
+    json_writer_init(&w, NULL, 0, NULL, NULL);
+    json_writer_array_begin(&w);
     for (const mcp_tool_t *tool = tool_registry; tool->name != NULL; tool++) {
-        cJSON *tool_obj = cJSON_CreateObject();
-        if (!tool_obj) {
-            ESP_LOGE(TAG, "Failed to create tool object");
-            cJSON_Delete(tools_array);
-            return NULL;
+        write_list_entry(&w, tool);
+    }
+    for (int i = 0; i < LUA_TOOLS_MAX; i++) {
+        if (s_lua_tools[i].name) {
+            write_list_entry(&w, &s_lua_tools[i]);
         }
-        
-        cJSON_AddStringToObject(tool_obj, "name", tool->name);
-        cJSON_AddStringToObject(tool_obj, "description", tool->description);
-        
-        // Parse and add input schema
-        cJSON *schema = cJSON_Parse(tool->input_schema_json);
-        if (schema) {
-            cJSON_AddItemToObject(tool_obj, "inputSchema", schema);
+    }
+    json_writer_array_end(&w);
+
+    size_t len = w.len;
+    char *json = json_writer_detach(&w);
+    if (!json) {
+        return NULL;
+    }
+    mcp_tools_list_t *list = malloc(sizeof(mcp_tools_list_t) + len + 1);
+    if (list) {
+        memcpy(list->json, json, len + 1);
+        list->len = len;
+        list->etag = fnv1a(json, len);
+        list->refs = 1;
+        ESP_LOGI(TAG, "Cached tools/list (%u bytes, etag %08lx)", (unsigned)len, (unsigned long)list->etag);
+    }
+    free(json);
+    return list;
+}
+
+const mcp_tools_list_t* mcp_tools_list_get(void)
+{
+    if (!s_list_lock) {
+        return NULL;
+    }
+    xSemaphoreTake(s_list_lock, portMAX_DELAY);
+    if (!s_list) {
+        s_list = build_list();
+    }
+    mcp_tools_list_t *list = s_list;
+    if (list) {
+        list->refs++;
+    }
+    xSemaphoreGive(s_list_lock);
+    return list;
+}
+
+void mcp_tools_list_put(const mcp_tools_list_t *list)
+{
+    if (!list) {
+        return;
+    }
+    mcp_tools_list_t *l = (mcp_tools_list_t *)list;
+    xSemaphoreTake(s_list_lock, portMAX_DELAY);
+    bool last = (--l->refs == 0);
+    xSemaphoreGive(s_list_lock);
+    if (last) {
+        free(l);
+    }
+}
+
+void mcp_tools_list_invalidate(void)
+{
+    if (!s_list_lock) {
+        return;
+    }
+    xSemaphoreTake(s_list_lock, portMAX_DELAY);
+    mcp_tools_list_t *old = s_list;
+    s_list = NULL;
+    xSemaphoreGive(s_list_lock);
+    mcp_tools_list_put(old);
+
+    static const char notification[] =
+        "{\"jsonrpc\":\"2.0\",\"method\":\"notifications/tools/list_changed\"}";
+    mcp_sse_publish(notification, sizeof(notification) - 1);
+}
+
+void mcp_result_write(mcp_result_t *r, const char *data, size_t len)
+{
+    if (r->truncated) {
+        return;
+    }
+    if (len > r->budget - r->len) {
+        len = r->budget - r->len;
+        r->truncated = true;
+    }
+    if (len > 0 && r->write(r, data, len) == ESP_OK) {
+        r->len += len;
+    }
+}
+
+void mcp_result_puts(mcp_result_t *r, const char *str)
+{
+    mcp_result_write(r, str, strlen(str));
+}
+
+void mcp_result_printf(mcp_result_t *r, const char *fmt, ...)
+{
+    char stack_buf[192];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(stack_buf, sizeof(stack_buf), fmt, args);
+    va_end(args);
+    if (n < 0) {
+        return;
+    }
+    if ((size_t)n < sizeof(stack_buf)) {
+        mcp_result_write(r, stack_buf, (size_t)n);
+        return;
+    }
+
+    // Long output (e.g. get_status): format once more in the request arena
+    char *heap_buf = mcp_arena_alloc((size_t)n + 1);
+    if (!heap_buf) {
+        mcp_result_write(r, stack_buf, sizeof(stack_buf) - 1);
+        return;
+    }
+    va_start(args, fmt);
+    vsnprintf(heap_buf, (size_t)n + 1, fmt, args);
+    va_end(args);
+    mcp_result_write(r, heap_buf, (size_t)n);
+    mcp_arena_free(heap_buf);
+}
+
+void mcp_result_json_escaped(mcp_result_t *r, const char *text)
+{
+    // Pass clean runs through whole
+    const char *run = text;
+    const char *p = text;
+    for (; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        mcp_result_write(r, run, (size_t)(p - run));
+        if (c == '"' || c == '\\') {
+            char esc[2] = {'\\', (char)c};
+            mcp_result_write(r, esc, 2);
+        } else if (c == '\n') {
+            mcp_result_write(r, "\\n", 2);
         } else {
-            ESP_LOGW(TAG, "Failed to parse schema for tool: %s", tool->name);
-            // Add empty schema as fallback
-            cJSON_AddItemToObject(tool_obj, "inputSchema", cJSON_CreateObject());
+            mcp_result_printf(r, "\\u%04x", c);
         }
-        
-        cJSON_AddItemToArray(tools_array, tool_obj);
+        run = p + 1;
     }
-    
-    return tools_array;
+    mcp_result_write(r, run, (size_t)(p - run));
+}
+
+void mcp_result_progress(mcp_result_t *r, double progress, double total, const char *message)
+{
+    if (r->progress_token) {
+        mcp_sse_notify_progress(r->session, r->progress_token, progress, total, message);
+    }
+}
+
+// Lua runtime output callback feeding a tool result
+static void result_out(void *ctx, const char *data, size_t len)
+{
+    mcp_result_write((mcp_result_t *)ctx, data, len);
 }
 
 esp_err_t mcp_tools_execute(const char *tool_name, cJSON *arguments,
-                            char *result_text, size_t max_len, bool *is_error)
+                            mcp_result_t *result, bool *is_error)
 {
-    if (!tool_name || !result_text || !is_error) {
+    if (!tool_name || !result || !is_error) {
         return ESP_ERR_INVALID_ARG;
     }
     
     *is_error = false;
     
-    // Find tool
+    // Find tool: built-in first, then the ones registered from Lua
     const mcp_tool_t *tool = mcp_tools_find(tool_name);
+    bool lua_tool = false;
     if (!tool) {
-        snprintf(result_text, max_len, "Tool not found: %s", tool_name);
-        *is_error = true;
-        return ESP_ERR_NOT_FOUND;
+        SemaphoreHandle_t lock = atomic_load(&s_list_lock);
+        if (lock) {
+            xSemaphoreTake(lock, portMAX_DELAY);
+            lua_tool = name_index_find(&s_lua_tool_index, tool_name) != NULL;
+            xSemaphoreGive(lock);
+        }
+        if (!lua_tool) {
+            mcp_result_printf(result, "Tool not found: %s", tool_name);
+            *is_error = true;
+            return ESP_ERR_NOT_FOUND;
+        }
     }
     
-    // Execute tool handler
-    esp_err_t ret = tool->handler(arguments, result_text, max_len);
+    // Execute tool handler (a Lua tool runs its function inside the VM)
+    // Lua tool names are copied for the trace only while it records
+    const char *span = !lua_tool ? tool->name : mcp_trace_on ? mcp_trace_intern(tool_name) : "lua_tool";
+    MCP_TRACE_BEGIN(MCP_TRACE_TOOL, span);
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = lua_tool
+        ? lua_runtime_call_tool(tool_name, arguments, result_out, result, result->cancelled)
+        : tool->handler(arguments, result);
+    mcp_metrics_record_since(mcp_metrics_get(MCP_METRIC_TOOL, tool_name), start, ret != ESP_OK);
+    MCP_TRACE_END(MCP_TRACE_TOOL, span);
     if (ret != ESP_OK) {
         *is_error = true;
         // If handler didn't set error message, set a generic one
-        if (strlen(result_text) == 0) {
-            snprintf(result_text, max_len, "Tool execution failed: %s", esp_err_to_name(ret));
+        if (result->len == 0) {
+            mcp_result_printf(result, "Tool execution failed: %s", esp_err_to_name(ret));
         }
     }
     
@@ -287,17 +740,17 @@ esp_err_t mcp_tools_execute(const char *tool_name, cJSON *arguments,
 // Tool Implementations
 // ============================================================================
 
-static esp_err_t tool_control_led(cJSON *args, char *result, size_t max_len)
+static esp_err_t tool_control_led(cJSON *args, mcp_result_t *result)
 {
     if (!led_initialized) {
-        snprintf(result, max_len, "LED not initialized (GPIO %d not available)", LED_GPIO);
+        mcp_result_printf(result, "LED not initialized (GPIO %d not available)", LED_GPIO);
         return ESP_ERR_INVALID_STATE;
     }
     
     // Extract state parameter
     cJSON *state_item = cJSON_GetObjectItem(args, "state");
     if (!state_item || !cJSON_IsString(state_item)) {
-        snprintf(result, max_len, "Missing or invalid 'state' parameter. Must be 'on', 'off', or 'toggle'");
+        mcp_result_printf(result, "Missing or invalid 'state' parameter. Must be 'on', 'off', or 'toggle'");
         return ESP_ERR_INVALID_ARG;
     }
     
@@ -306,23 +759,58 @@ static esp_err_t tool_control_led(cJSON *args, char *result, size_t max_len)
     // Execute command
     if (strcmp(state, "on") == 0) {
         gpio_set_level(LED_GPIO, 1);
-        snprintf(result, max_len, "LED turned on (GPIO %d)", LED_GPIO);
+        mcp_result_printf(result, "LED turned on (GPIO %d)", LED_GPIO);
     } else if (strcmp(state, "off") == 0) {
         gpio_set_level(LED_GPIO, 0);
-        snprintf(result, max_len, "LED turned off (GPIO %d)", LED_GPIO);
+        mcp_result_printf(result, "LED turned off (GPIO %d)", LED_GPIO);
     } else if (strcmp(state, "toggle") == 0) {
         int current = gpio_get_level(LED_GPIO);
         gpio_set_level(LED_GPIO, !current);
-        snprintf(result, max_len, "LED toggled to %s (GPIO %d)", !current ? "on" : "off", LED_GPIO);
+        mcp_result_printf(result, "LED toggled to %s (GPIO %d)", !current ? "on" : "off", LED_GPIO);
     } else {
-        snprintf(result, max_len, "Invalid state: '%s'. Must be 'on', 'off', or 'toggle'", state);
+        mcp_result_printf(result, "Invalid state: '%s'. Must be 'on', 'off', or 'toggle'", state);
         return ESP_ERR_INVALID_ARG;
     }
     
     return ESP_OK;
 }
 
-static esp_err_t tool_get_status(cJSON *args, char *result, size_t max_len)
+/* Session rows are copied out first: the table is locked while they are
+ * gathered, and writing a result can block on the client socket */
+typedef struct {
+    uint32_t sid;
+    bool websocket;
+    bool initialized;
+    char client_name[32];
+    unsigned requests;
+    unsigned errors;
+    unsigned tool_calls;
+    int64_t last_seen_us;
+} status_session_t;
+
+typedef struct {
+    status_session_t rows[CONFIG_MCP_MAX_SESSIONS];
+    int count;
+} status_sessions_t;
+
+static void status_collect_session(const mcp_session_t *s, void *ctx)
+{
+    status_sessions_t *out = ctx;
+    if (out->count >= CONFIG_MCP_MAX_SESSIONS) {
+        return;
+    }
+    status_session_t *row = &out->rows[out->count++];
+    row->sid = s->sid;
+    row->websocket = (s->fd >= 0);
+    row->initialized = s->initialized;
+    snprintf(row->client_name, sizeof(row->client_name), "%s", s->client_name);
+    row->requests = atomic_load(&s->requests);
+    row->errors = atomic_load(&s->errors);
+    row->tool_calls = atomic_load(&s->tool_calls);
+    row->last_seen_us = s->last_seen_us;
+}
+
+static esp_err_t tool_get_status(cJSON *args, mcp_result_t *result)
 {
     (void)args;
 
@@ -354,17 +842,17 @@ static esp_err_t tool_get_status(cJSON *args, char *result, size_t max_len)
     int rssi = (wifi_ret == ESP_OK) ? ap_info.rssi : 0;
 
     // Format result
-    int written = snprintf(result, max_len,
+    mcp_result_printf(result,
         "ESP32 System Status:\n"
         "-------------------\n"
-        "Total Heap: %lu bytes (%.1f KB)\n"
-        "Free Heap: %lu bytes (%.1f KB)\n"
-        "Min Free Heap: %lu bytes (%.1f KB)\n"
-        "Largest Free Block: %lu bytes (%.1f KB)\n"
-        "Internal Heap Total: %lu bytes (%.1f KB)\n"
-        "Internal Heap Free: %lu bytes (%.1f KB)\n"
-        "Internal Largest Block: %lu bytes (%.1f KB)\n"
-        "Uptime: %llu seconds (%.1f hours)\n",
+        "Total Heap: %" PRIu32 " bytes (%.1f KB)\n"
+        "Free Heap: %" PRIu32 " bytes (%.1f KB)\n"
+        "Min Free Heap: %" PRIu32 " bytes (%.1f KB)\n"
+        "Largest Free Block: %" PRIu32 " bytes (%.1f KB)\n"
+        "Internal Heap Total: %" PRIu32 " bytes (%.1f KB)\n"
+        "Internal Heap Free: %" PRIu32 " bytes (%.1f KB)\n"
+        "Internal Largest Block: %" PRIu32 " bytes (%.1f KB)\n"
+        "Uptime: %" PRIu64 " seconds (%.1f hours)\n",
         total_heap, total_heap / 1024.0,
         free_heap, free_heap / 1024.0,
         min_free_heap, min_free_heap / 1024.0,
@@ -376,53 +864,105 @@ static esp_err_t tool_get_status(cJSON *args, char *result, size_t max_len)
 
 #if CONFIG_SPIRAM
     if (psram_total > 0) {
-        written += snprintf(result + written, max_len - written,
-            "PSRAM Total: %lu bytes (%.1f KB)\n"
-            "PSRAM Free: %lu bytes (%.1f KB)\n"
-            "PSRAM Largest Block: %lu bytes (%.1f KB)\n",
+        mcp_result_printf(result,
+            "PSRAM Total: %" PRIu32 " bytes (%.1f KB)\n"
+            "PSRAM Free: %" PRIu32 " bytes (%.1f KB)\n"
+            "PSRAM Largest Block: %" PRIu32 " bytes (%.1f KB)\n",
             psram_total, psram_total / 1024.0,
             psram_free, psram_free / 1024.0,
             psram_largest_free_block, psram_largest_free_block / 1024.0);
     } else {
-        written += snprintf(result + written, max_len - written,
+        mcp_result_printf(result,
             "PSRAM: Enabled in config, but not initialized\n");
     }
 #else
-    written += snprintf(result + written, max_len - written,
+    mcp_result_printf(result,
         "PSRAM: Disabled in firmware config (CONFIG_SPIRAM=n)\n");
 #endif
 
     if (lua_mem_ret == ESP_OK) {
-        written += snprintf(result + written, max_len - written,
-            "Lua Heap Used: %lu bytes (%.1f KB)\n"
-            "Lua Heap Peak: %lu bytes (%.1f KB)\n",
+        mcp_result_printf(result,
+            "Lua Heap Used: %" PRIu32 " bytes (%.1f KB)\n"
+            "Lua Heap Peak: %" PRIu32 " bytes (%.1f KB)\n",
             lua_heap_current, lua_heap_current / 1024.0,
             lua_heap_peak, lua_heap_peak / 1024.0);
     } else {
-        written += snprintf(result + written, max_len - written,
+        mcp_result_printf(result,
             "Lua Runtime: Not initialized\n");
     }
 
     if (wifi_ret == ESP_OK) {
-        written += snprintf(result + written, max_len - written,
+        mcp_result_printf(result,
             "WiFi SSID: %s\n"
             "WiFi RSSI: %d dBm\n",
             ap_info.ssid, rssi);
     } else {
-        written += snprintf(result + written, max_len - written,
+        mcp_result_printf(result,
             "WiFi: Not connected\n");
     }
 
-    snprintf(result + written, max_len - written,
+#if CONFIG_ESP_HTTPS_SERVER_ENABLE
+    mcp_tls_stats_t tls;
+    mcp_tls_get_stats(&tls);
+    mcp_result_printf(result,
+        "TLS Handshakes: %lu full (avg %lu ms, max %lu ms), %lu resumed (avg %lu ms, max %lu ms), %lu failed or open\n"
+        "TLS Session Tickets: %s\n",
+        (unsigned long)tls.full, (unsigned long)tls.full_avg_ms, (unsigned long)tls.full_max_ms,
+        (unsigned long)tls.resumed, (unsigned long)tls.resumed_avg_ms, (unsigned long)tls.resumed_max_ms,
+        (unsigned long)(tls.started - tls.full - tls.resumed),
+        tls.tickets ? "on" : "off");
+#endif
+
+    mcp_bufpool_stats_t pool;
+    mcp_bufpool_get_stats(&pool);
+    mcp_result_printf(result,
+        "Buffer Pool: %d/%d receive, %d/%d response in use, %lu from heap (%s)\n",
+        pool.rx_in_use, pool.sets, pool.tx_in_use, pool.sets,
+        (unsigned long)pool.fallbacks, pool.psram ? "PSRAM" : "internal RAM");
+
+    mcp_arena_stats_t arena;
+    mcp_arena_get_stats(&arena);
+    mcp_result_printf(result,
+        "Request Arenas: %d/%d in use, peak %u of %u bytes, %lu requests, %lu heap spills\n",
+        arena.in_use, arena.count, (unsigned)arena.peak, (unsigned)arena.size,
+        (unsigned long)arena.requests, (unsigned long)arena.spills);
+
+    mcp_result_printf(result, "Memory:\n");
+    for (int i = 0; i < MCP_MEM_COUNT; i++) {
+        mcp_mem_stats_t mem;
+        mcp_mem_get_stats(i, &mem);
+        mcp_result_printf(result, "  %s (%s): %u bytes, peak %u, %u in PSRAM, %lu misplaced\n",
+            mem.name, mem.psram ? "PSRAM" : "internal", (unsigned)mem.live, (unsigned)mem.peak,
+            (unsigned)mem.live_psram, (unsigned long)mem.misplaced);
+    }
+
+    status_sessions_t *sessions = mcp_arena_calloc(1, sizeof(status_sessions_t));
+    if (sessions) {
+        mcp_session_foreach(status_collect_session, sessions);
+        int64_t now = esp_timer_get_time();
+        mcp_result_printf(result, "Sessions: %d open (max %d)\n", sessions->count, CONFIG_MCP_MAX_SESSIONS);
+        for (int i = 0; i < sessions->count; i++) {
+            const status_session_t *row = &sessions->rows[i];
+            mcp_result_printf(result,
+                "  #%lu %s %s: %u requests, %u errors, %u tool calls, idle %llds\n",
+                (unsigned long)row->sid, row->websocket ? "ws" : "http",
+                row->client_name[0] ? row->client_name : (row->initialized ? "?" : "(not initialized)"),
+                row->requests, row->errors, row->tool_calls,
+                (long long)((now - row->last_seen_us) / 1000000));
+        }
+        mcp_arena_free(sessions);
+    }
+
+    mcp_result_printf(result,
         "Project Prompt: call get_system_prompt for agent workflow and usage guidance");
 
     return ESP_OK;
 }
 
-static esp_err_t tool_get_system_prompt(cJSON *args, char *result, size_t max_len)
+static esp_err_t tool_get_system_prompt(cJSON *args, mcp_result_t *result)
 {
     (void)args;
-    snprintf(result, max_len, "%s", PROJECT_SYSTEM_PROMPT);
+    mcp_result_puts(result, PROJECT_SYSTEM_PROMPT);
     return ESP_OK;
 }
 
@@ -588,17 +1128,17 @@ static bool build_bindings_lua_script(const char *interface_name, const char *pr
     return true;
 }
 
-static esp_err_t tool_lua_bind_dependency(cJSON *args, char *result, size_t max_len)
+static esp_err_t tool_lua_bind_dependency(cJSON *args, mcp_result_t *result)
 {
     if (!args || !cJSON_IsObject(args)) {
-        snprintf(result, max_len, "Missing arguments object");
+        mcp_result_printf(result, "Missing arguments object");
         return ESP_ERR_INVALID_ARG;
     }
 
     cJSON *provider_item = cJSON_GetObjectItem(args, "provider");
     if (!provider_item || !cJSON_IsString(provider_item) || !provider_item->valuestring ||
         provider_item->valuestring[0] == '\0') {
-        snprintf(result, max_len, "Missing required parameter: provider");
+        mcp_result_printf(result, "Missing required parameter: provider");
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -607,7 +1147,7 @@ static esp_err_t tool_lua_bind_dependency(cJSON *args, char *result, size_t max_
     if (interface_item) {
         if (!cJSON_IsString(interface_item) || !interface_item->valuestring ||
             interface_item->valuestring[0] == '\0') {
-            snprintf(result, max_len, "Invalid parameter: interface must be non-empty string");
+            mcp_result_printf(result, "Invalid parameter: interface must be non-empty string");
             return ESP_ERR_INVALID_ARG;
         }
         interface_name = interface_item->valuestring;
@@ -615,7 +1155,7 @@ static esp_err_t tool_lua_bind_dependency(cJSON *args, char *result, size_t max_
 
     cJSON *opts_item = cJSON_GetObjectItem(args, "opts");
     if (opts_item && !cJSON_IsObject(opts_item)) {
-        snprintf(result, max_len, "Invalid parameter: opts must be object");
+        mcp_result_printf(result, "Invalid parameter: opts must be object");
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -623,7 +1163,7 @@ static esp_err_t tool_lua_bind_dependency(cJSON *args, char *result, size_t max_
     cJSON *restart_item = cJSON_GetObjectItem(args, "restart");
     if (restart_item) {
         if (!cJSON_IsTrue(restart_item) && !cJSON_IsFalse(restart_item)) {
-            snprintf(result, max_len, "Invalid parameter: restart must be boolean");
+            mcp_result_printf(result, "Invalid parameter: restart must be boolean");
             return ESP_ERR_INVALID_ARG;
         }
         restart = cJSON_IsTrue(restart_item);
@@ -632,38 +1172,41 @@ static esp_err_t tool_lua_bind_dependency(cJSON *args, char *result, size_t max_
     char bindings_script[2048];
     if (!build_bindings_lua_script(interface_name, provider_item->valuestring,
                                    opts_item, bindings_script, sizeof(bindings_script))) {
-        snprintf(result, max_len, "Failed to generate bindings.lua (payload too large or unsupported type)");
+        mcp_result_printf(result, "Failed to generate bindings.lua (payload too large or unsupported type)");
         return ESP_ERR_INVALID_SIZE;
     }
 
     esp_err_t ret = lua_runtime_push_script("bindings.lua", bindings_script, false);
     if (ret != ESP_OK) {
-        snprintf(result, max_len, "Failed to write bindings.lua");
+        mcp_result_printf(result, "Failed to write bindings.lua");
         return ret;
     }
 
     if (restart) {
         ret = lua_runtime_restart();
         if (ret != ESP_OK) {
-            snprintf(result, max_len,
+            mcp_result_printf(result,
                      "bindings.lua updated: %s -> %s, but lua_restart failed",
                      interface_name, provider_item->valuestring);
             return ret;
         }
     }
 
-    snprintf(result, max_len, "Binding updated: %s -> %s (restart=%s)",
+    mcp_result_printf(result, "Binding updated: %s -> %s (restart=%s)",
              interface_name, provider_item->valuestring, restart ? "true" : "false");
     return ESP_OK;
 }
 
-static esp_err_t tool_lua_push_script(cJSON *args, char *result, size_t max_len)
+static esp_err_t tool_lua_push_script(cJSON *args, mcp_result_t *result)
 {
     cJSON *name_item = cJSON_GetObjectItem(args, "name");
     cJSON *content_item = cJSON_GetObjectItem(args, "content");
-    if (!name_item || !cJSON_IsString(name_item) ||
-        !content_item || !cJSON_IsString(content_item)) {
-        snprintf(result, max_len, "Missing required parameters: name, content");
+    /* Oversized content arrives staged on SPIFFS: {"$spill":"<path>","length":N} */
+    cJSON *spill_item = cJSON_IsObject(content_item) ?
+                        cJSON_GetObjectItem(content_item, "$spill") : NULL;
+    if (!name_item || !cJSON_IsString(name_item) || !content_item ||
+        !(cJSON_IsString(content_item) || cJSON_IsString(spill_item))) {
+        mcp_result_printf(result, "Missing required parameters: name, content");
         return ESP_ERR_INVALID_ARG;
     }
 
@@ -673,55 +1216,67 @@ static esp_err_t tool_lua_push_script(cJSON *args, char *result, size_t max_len)
         append = true;
     }
 
-    esp_err_t ret = lua_runtime_push_script(name_item->valuestring,
-                                             content_item->valuestring, append);
+    esp_err_t ret;
+    int length;
+    if (spill_item) {
+        cJSON *length_item = cJSON_GetObjectItem(content_item, "length");
+        length = cJSON_IsNumber(length_item) ? length_item->valueint : 0;
+        ret = lua_runtime_push_script_file(name_item->valuestring,
+                                           spill_item->valuestring, append);
+    } else {
+        length = (int)strlen(content_item->valuestring);
+        ret = lua_runtime_push_script(name_item->valuestring,
+                                      content_item->valuestring, append);
+    }
     if (ret == ESP_OK) {
-        snprintf(result, max_len, "Script '%s' %s (%d bytes)",
+        mcp_result_printf(result, "Script '%s' %s (%d bytes)",
                  name_item->valuestring,
                  append ? "appended" : "written",
-                 (int)strlen(content_item->valuestring));
+                 length);
+    } else if (spill_item && ret == ESP_ERR_INVALID_ARG) {
+        mcp_result_printf(result, "content must be a string");
     } else {
-        snprintf(result, max_len, "Failed to write script '%s'", name_item->valuestring);
+        mcp_result_printf(result, "Failed to write script '%s'", name_item->valuestring);
     }
     return ret;
 }
 
-static esp_err_t tool_lua_get_script(cJSON *args, char *result, size_t max_len)
+static esp_err_t tool_lua_get_script(cJSON *args, mcp_result_t *result)
 {
     cJSON *name_item = cJSON_GetObjectItem(args, "name");
     if (!name_item || !cJSON_IsString(name_item)) {
-        snprintf(result, max_len, "Missing required parameter: name");
+        mcp_result_printf(result, "Missing required parameter: name");
         return ESP_ERR_INVALID_ARG;
     }
 
-    return lua_runtime_get_script(name_item->valuestring, result, max_len);
+    return lua_runtime_get_script(name_item->valuestring, result_out, result);
 }
 
-static esp_err_t tool_lua_list_scripts(cJSON *args, char *result, size_t max_len)
+static esp_err_t tool_lua_list_scripts(cJSON *args, mcp_result_t *result)
 {
     (void)args;
-    return lua_runtime_list_scripts(result, max_len);
+    return lua_runtime_list_scripts(result_out, result);
 }
 
-static esp_err_t tool_lua_exec(cJSON *args, char *result, size_t max_len)
+static esp_err_t tool_lua_exec(cJSON *args, mcp_result_t *result)
 {
     cJSON *code_item = cJSON_GetObjectItem(args, "code");
     if (!code_item || !cJSON_IsString(code_item)) {
-        snprintf(result, max_len, "Missing required parameter: code");
+        mcp_result_printf(result, "Missing required parameter: code");
         return ESP_ERR_INVALID_ARG;
     }
 
-    return lua_runtime_exec(code_item->valuestring, result, max_len);
+    return lua_runtime_exec(code_item->valuestring, result_out, result, result->cancelled);
 }
 
-static esp_err_t tool_lua_restart(cJSON *args, char *result, size_t max_len)
+static esp_err_t tool_lua_restart(cJSON *args, mcp_result_t *result)
 {
     (void)args;
     esp_err_t ret = lua_runtime_restart();
     if (ret == ESP_OK) {
-        snprintf(result, max_len, "Lua VM restarted, main.lua re-executing");
+        mcp_result_printf(result, "Lua VM restarted, main.lua re-executing");
     } else {
-        snprintf(result, max_len, "Failed to restart Lua VM");
+        mcp_result_printf(result, "Failed to restart Lua VM");
     }
     return ret;
 }
@@ -10,25 +10,83 @@
 #include <esp_err.h>
 #include <cJSON.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 /**
- * Maximum tool result size
+ * Maximum tool result size (budget for the text of one tool result)
  */
-#define MCP_MAX_TOOL_RESULT_SIZE 2048
+#define MCP_MAX_TOOL_RESULT_SIZE CONFIG_MCP_MAX_TOOL_RESULT_SIZE
+
+/**
+ * Tool result sink
+ *
+ * Tools write their text through the sink instead of into a fixed buffer.
+ * The owner decides where it goes (tools/call escapes it straight into the
+ * response). Output past the budget is dropped and flagged as truncated.
+ */
+typedef struct mcp_result {
+    esp_err_t (*write)(struct mcp_result *r, const char *data, size_t len);
+    size_t len;                         // Bytes accepted so far
+    size_t budget;                      // Maximum bytes accepted
+    bool truncated;                     // Output was dropped at the budget
+    const char *progress_token;         // Request's _meta.progressToken as JSON, or NULL
+    uint32_t session;                   // Session of the request (progress goes to its streams), or 0
+    const volatile bool *cancelled;     // Set when the client cancels the request, or NULL
+} mcp_result_t;
+
+/**
+ * Whether the client has cancelled the request (long tools should poll this)
+ */
+static inline bool mcp_result_cancelled(const mcp_result_t *r)
+{
+    return r->cancelled && *r->cancelled;
+}
+
+/**
+ * Report progress for the request (no-op without a progress token)
+ *
+ * @param progress Progress so far
+ * @param total Total, or 0 if unknown
+ * @param message Optional human-readable status
+ */
+void mcp_result_progress(mcp_result_t *r, double progress, double total, const char *message);
+
+/**
+ * Append bytes to a tool result
+ */
+void mcp_result_write(mcp_result_t *r, const char *data, size_t len);
+
+/**
+ * Append a NUL-terminated string to a tool result
+ */
+void mcp_result_puts(mcp_result_t *r, const char *str);
+
+/**
+ * Append formatted text to a tool result
+ */
+void mcp_result_printf(mcp_result_t *r, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Append text escaped for the inside of a JSON string (no quotes added)
+ */
+void mcp_result_json_escaped(mcp_result_t *r, const char *text);
 
 /**
  * Tool handler function type
+ * Scratch memory that is not needed after the call should come from
+ * mcp_arena_alloc (mcp_arena.h): it is released with the request.
  *
  * @param arguments Tool arguments (cJSON object)
- * @param result_text Output buffer for result text
- * @param max_len Maximum length of result_text buffer
+ * @param result Result sink for the tool's text output
  * @return ESP_OK on success, error code on failure
  */
-typedef esp_err_t (*mcp_tool_handler_t)(cJSON *arguments, char *result_text, size_t max_len);
+typedef esp_err_t (*mcp_tool_handler_t)(cJSON *arguments, mcp_result_t *result);
 
 /**
  * Tool definition structure
@@ -37,7 +95,8 @@ typedef struct {
     const char *name;                   // Tool name
     const char *description;            // Tool description
     const char *input_schema_json;      // Pre-serialized JSON schema
-    mcp_tool_handler_t handler;         // Tool handler function
+    mcp_tool_handler_t handler;         // Tool handler function (NULL for Lua tools)
+    bool read_only;                     // Does not change device state
 } mcp_tool_t;
 
 /**
@@ -48,34 +107,90 @@ typedef struct {
 esp_err_t mcp_tools_init(void);
 
 /**
- * Get list of all registered tools
- * Returns a cJSON array of tool definitions
+ * Serialized tools/list array, shared and immutable
+ */
+typedef struct {
+    uint32_t etag;                      // Hash of json; changes with the registry
+    size_t len;                         // Length of json
+    int refs;                           // Private
+    char json[];                        // [{"name":...,"description":...,"inputSchema":...},...]
+} mcp_tools_list_t;
+
+/**
+ * Get the tools array, serialized on first use and cached until the
+ * registry changes. Release it with mcp_tools_list_put().
  *
- * @return cJSON array (caller must free with cJSON_Delete), or NULL on error
+ * @return Cached list, or NULL if it could not be built
+ */
+const mcp_tools_list_t* mcp_tools_list_get(void);
+
+/**
+ * Release a list returned by mcp_tools_list_get()
  */
-cJSON* mcp_tools_get_list(void);
+void mcp_tools_list_put(const mcp_tools_list_t *list);
+
+/**
+ * Drop the cached list after the registry changed and send
+ * notifications/tools/list_changed to subscribed clients
+ */
+void mcp_tools_list_invalidate(void);
 
 /**
  * Execute a tool by name
  *
  * @param tool_name Name of the tool to execute
  * @param arguments Tool arguments (cJSON object)
- * @param result_text Output buffer for result text
- * @param max_len Maximum length of result_text buffer
+ * @param result Result sink (its budget caps the output)
  * @param is_error Output flag indicating if execution resulted in error
  * @return ESP_OK on success, error code on failure
  */
 esp_err_t mcp_tools_execute(const char *tool_name, cJSON *arguments,
-                            char *result_text, size_t max_len, bool *is_error);
+                            mcp_result_t *result, bool *is_error);
 
 /**
- * Find a tool by name
+ * Find a built-in tool by name
  *
  * @param name Tool name
  * @return Pointer to tool definition, or NULL if not found
  */
 const mcp_tool_t* mcp_tools_find(const char *name);
 
+/**
+ * Whether a tool (built-in or Lua) is marked read-only
+ *
+ * @return false if the tool does not exist
+ */
+bool mcp_tools_is_read_only(const char *name);
+
+/**
+ * Add or replace a tool implemented in Lua (mcp.register_tool)
+ * Calls to it are passed to lua_runtime_call_tool(). Re-registering a
+ * name with a changed definition replaces it and notifies clients.
+ *
+ * @param name Tool name: letters, digits, '_' or '-', at most 64
+ * @param description Tool description
+ * @param input_schema_json JSON schema (must be an object)
+ * @param read_only Does not change device state
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for a bad name, ESP_ERR_INVALID_SIZE
+ *         if the schema is not a JSON object, ESP_ERR_INVALID_STATE if a
+ *         built-in tool has the name, or ESP_ERR_NO_MEM when
+ *         CONFIG_MCP_LUA_TOOLS_MAX tools are registered
+ */
+esp_err_t mcp_tools_register_lua(const char *name, const char *description,
+                                 const char *input_schema_json, bool read_only);
+
+/**
+ * Remove a tool added by mcp_tools_register_lua()
+ *
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND
+ */
+esp_err_t mcp_tools_unregister_lua(const char *name);
+
+/**
+ * Remove every Lua tool (the VM that implemented them is gone)
+ */
+void mcp_tools_clear_lua(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,341 @@
+/*
+ * MCP Span Tracing Implementation
+ *
+ * Writers claim a slot with one atomic add on the head counter and mark
+ * it complete with its sequence number, so recording never blocks. The
+ * dump copies each slot and skips any that were rewritten meanwhile.
+ * Tasks get a small id and their name the first time they record.
+ */
+
+#include "mcp_trace.h"
+#include "mcp_mem.h"
+#include "json_writer.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+static const char *TAG = "mcp_trace";
+
+volatile bool mcp_trace_on = false;
+
+#if CONFIG_MCP_TRACE
+
+#define TRACE_EVENTS        CONFIG_MCP_TRACE_EVENTS
+#define TRACE_TASKS         24          // Named task ids; later tasks show as "task"
+#define TRACE_NAMES         32          // Interned span names
+#define TRACE_NAME_MAX      32
+
+typedef struct {
+    int64_t ts_us;
+    const char *name;
+    uint16_t tid;
+    uint8_t cat;
+    uint8_t core;
+    char phase;
+    atomic_uint seq;                    // Event number + 1 once written, 0 while written
+} trace_event_t;
+
+static const char *const s_cat_names[MCP_TRACE_CAT_COUNT] = {
+    [MCP_TRACE_HTTP] = "http",
+    [MCP_TRACE_WS] = "ws",
+    [MCP_TRACE_RPC] = "rpc",
+    [MCP_TRACE_EXEC] = "exec",
+    [MCP_TRACE_TOOL] = "tool",
+    [MCP_TRACE_LUA] = "lua",
+    [MCP_TRACE_FS] = "fs",
+};
+
+static trace_event_t *s_ring = NULL;
+static atomic_uint s_head = 0;          // Events ever claimed
+static atomic_uint s_base = 0;          // Head at the last clear
+
+static char s_task_names[TRACE_TASKS][16];
+static atomic_uint s_task_count = 0;
+static __thread uint16_t t_tid;
+
+static char s_names[TRACE_NAMES][TRACE_NAME_MAX];
+static atomic_int s_name_count = 0;
+static _Atomic(SemaphoreHandle_t) s_lock = NULL;
+
+static SemaphoreHandle_t trace_lock(void)
+{
+    SemaphoreHandle_t lock = atomic_load(&s_lock);
+    if (lock) {
+        return lock;
+    }
+    SemaphoreHandle_t created = xSemaphoreCreateMutex();
+    if (!created) {
+        return NULL;
+    }
+    if (!atomic_compare_exchange_strong(&s_lock, &lock, created)) {
+        vSemaphoreDelete(created);  // Lost the race; lock holds the winner
+        return lock;
+    }
+    return created;
+}
+
+// Id of the calling task, named on its first event
+static uint16_t trace_tid(void)
+{
+    if (!t_tid) {
+        unsigned id = atomic_fetch_add(&s_task_count, 1) + 1;
+        if (id <= TRACE_TASKS) {
+            const char *name = pcTaskGetName(NULL);
+            snprintf(s_task_names[id - 1], sizeof(s_task_names[0]), "%s", name ? name : "task");
+        }
+        t_tid = id > UINT16_MAX ? UINT16_MAX : id;
+    }
+    return t_tid;
+}
+
+void mcp_trace_event(char phase, mcp_trace_cat_t cat, const char *name)
+{
+    trace_event_t *ring = s_ring;
+    if (!ring) {
+        return;
+    }
+    unsigned n = atomic_fetch_add_explicit(&s_head, 1, memory_order_relaxed);
+    trace_event_t *e = &ring[n % TRACE_EVENTS];
+    atomic_store_explicit(&e->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    e->ts_us = esp_timer_get_time();
+    e->name = name;
+    e->tid = trace_tid();
+    e->cat = cat;
+    e->core = xPortGetCoreID();
+    e->phase = phase;
+    atomic_store_explicit(&e->seq, n + 1, memory_order_release);
+}
+
+const char *mcp_trace_intern(const char *name)
+{
+    int count = atomic_load(&s_name_count);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(s_names[i], name) == 0) {
+            return s_names[i];
+        }
+    }
+    SemaphoreHandle_t lock = trace_lock();
+    if (!lock) {
+        return "(other)";
+    }
+    const char *found = "(other)";
+    xSemaphoreTake(lock, portMAX_DELAY);
+    count = atomic_load(&s_name_count);
+    int i = 0;
+    while (i < count && strcmp(s_names[i], name) != 0) {
+        i++;
+    }
+    if (i < count) {
+        found = s_names[i];
+    } else if (count < TRACE_NAMES) {
+        snprintf(s_names[count], TRACE_NAME_MAX, "%s", name);
+        found = s_names[count];
+        atomic_store(&s_name_count, count + 1);
+    }
+    xSemaphoreGive(lock);
+    return found;
+}
+
+esp_err_t mcp_trace_set_enabled(bool enabled)
+{
+    if (enabled && !s_ring) {
+        SemaphoreHandle_t lock = trace_lock();
+        if (!lock) {
+            return ESP_ERR_NO_MEM;
+        }
+        xSemaphoreTake(lock, portMAX_DELAY);
+        if (!s_ring) {
+            s_ring = mcp_mem_calloc(MCP_MEM_TRACE, TRACE_EVENTS, sizeof(trace_event_t));
+        }
+        xSemaphoreGive(lock);
+        if (!s_ring) {
+            ESP_LOGE(TAG, "Cannot allocate %d trace events", TRACE_EVENTS);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (enabled != mcp_trace_on) {
+        ESP_LOGI(TAG, "Tracing %s", enabled ? "on" : "off");
+    }
+    mcp_trace_on = enabled;
+    return ESP_OK;
+}
+
+void mcp_trace_clear(void)
+{
+    atomic_store(&s_base, atomic_load(&s_head));
+}
+
+// Oldest event still in the ring, and the number recorded since the clear
+static unsigned trace_window(unsigned *first, unsigned *recorded)
+{
+    unsigned head = atomic_load(&s_head);
+    unsigned base = atomic_load(&s_base);
+    *recorded = head - base;
+    *first = (*recorded > TRACE_EVENTS) ? head - TRACE_EVENTS : base;
+    return head;
+}
+
+/* --- GET /trace --- */
+
+static esp_err_t trace_flush(void *ctx, const char *data, size_t len)
+{
+    return httpd_resp_send_chunk(ctx, data, len);
+}
+
+static void write_meta(json_writer_t *w, int tid, const char *key, const char *value)
+{
+    json_writer_object_begin(w);
+    json_writer_key(w, "name");
+    json_writer_string(w, key);
+    json_writer_key(w, "ph");
+    json_writer_string(w, "M");
+    json_writer_key(w, "pid");
+    json_writer_int(w, 1);
+    json_writer_key(w, "tid");
+    json_writer_int(w, tid);
+    json_writer_key(w, "args");
+    json_writer_object_begin(w);
+    json_writer_key(w, "name");
+    json_writer_string(w, value);
+    json_writer_object_end(w);
+    json_writer_object_end(w);
+}
+
+esp_err_t mcp_trace_handler(httpd_req_t *req)
+{
+    char buf[512];
+    json_writer_t w;
+    json_writer_init(&w, buf, sizeof(buf), trace_flush, req);
+    httpd_resp_set_type(req, "application/json");
+
+    json_writer_object_begin(&w);
+    json_writer_key(&w, "displayTimeUnit");
+    json_writer_string(&w, "ms");
+    json_writer_key(&w, "traceEvents");
+    json_writer_array_begin(&w);
+    write_meta(&w, 0, "process_name", "esp32-mcp-server");
+    unsigned tasks = atomic_load(&s_task_count);
+    for (unsigned i = 0; i < tasks && i < TRACE_TASKS; i++) {
+        write_meta(&w, i + 1, "thread_name", s_task_names[i]);
+    }
+
+    unsigned first, recorded;
+    unsigned head = trace_window(&first, &recorded);
+    for (unsigned n = first; s_ring && n != head && w.err == ESP_OK; n++) {
+        trace_event_t *slot = &s_ring[n % TRACE_EVENTS];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != n + 1) {
+            continue;   // Not written yet
+        }
+        trace_event_t e = {
+            .ts_us = slot->ts_us,
+            .name = slot->name,
+            .tid = slot->tid,
+            .cat = slot->cat,
+            .core = slot->core,
+            .phase = slot->phase,
+        };
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != n + 1) {
+            continue;   // Overwritten while copied
+        }
+        char ph[2] = { e.phase, '\0' };
+        json_writer_object_begin(&w);
+        json_writer_key(&w, "name");
+        json_writer_string(&w, e.name);
+        json_writer_key(&w, "cat");
+        json_writer_string(&w, s_cat_names[e.cat]);
+        json_writer_key(&w, "ph");
+        json_writer_string(&w, ph);
+        json_writer_key(&w, "ts");
+        json_writer_int(&w, e.ts_us);
+        json_writer_key(&w, "pid");
+        json_writer_int(&w, 1);
+        json_writer_key(&w, "tid");
+        json_writer_int(&w, e.tid);
+        json_writer_key(&w, "args");
+        json_writer_object_begin(&w);
+        json_writer_key(&w, "core");
+        json_writer_int(&w, e.core);
+        json_writer_object_end(&w);
+        json_writer_object_end(&w);
+    }
+    json_writer_array_end(&w);
+    json_writer_object_end(&w);
+
+    esp_err_t ret = json_writer_finish(&w);
+    if (ret == ESP_OK) {
+        ret = httpd_resp_send_chunk(req, NULL, 0);
+    }
+    return ret;
+}
+
+/* --- sys_trace --- */
+
+esp_err_t tool_sys_trace(cJSON *args, mcp_result_t *result)
+{
+    cJSON *clear = cJSON_GetObjectItem(args, "clear");
+    if (cJSON_IsTrue(clear)) {
+        mcp_trace_clear();
+    }
+    cJSON *enable = cJSON_GetObjectItem(args, "enable");
+    if (cJSON_IsBool(enable)) {
+        esp_err_t ret = mcp_trace_set_enabled(cJSON_IsTrue(enable));
+        if (ret != ESP_OK) {
+            mcp_result_printf(result, "Cannot start tracing: %s", esp_err_to_name(ret));
+            return ret;
+        }
+    }
+
+    unsigned first, recorded;
+    trace_window(&first, &recorded);
+    unsigned kept = recorded < TRACE_EVENTS ? recorded : TRACE_EVENTS;
+    mcp_result_printf(result,
+        "Tracing %s: %u of %d events in the ring (%u overwritten), %u tasks.\n"
+        "GET /trace returns them as Chrome trace JSON.\n",
+        mcp_trace_on ? "on" : "off", kept, TRACE_EVENTS, recorded - kept,
+        (unsigned)atomic_load(&s_task_count));
+    return ESP_OK;
+}
+
+#else // !CONFIG_MCP_TRACE
+
+void mcp_trace_event(char phase, mcp_trace_cat_t cat, const char *name)
+{
+    (void)phase;
+    (void)cat;
+    (void)name;
+}
+
+const char *mcp_trace_intern(const char *name)
+{
+    return name;
+}
+
+esp_err_t mcp_trace_set_enabled(bool enabled)
+{
+    return enabled ? ESP_ERR_NOT_SUPPORTED : ESP_OK;
+}
+
+void mcp_trace_clear(void)
+{
+}
+
+esp_err_t mcp_trace_handler(httpd_req_t *req)
+{
+    return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Tracing not built (CONFIG_MCP_TRACE)");
+}
+
+esp_err_t tool_sys_trace(cJSON *args, mcp_result_t *result)
+{
+    (void)args;
+    mcp_result_printf(result, "Tracing is not built into this firmware (CONFIG_MCP_TRACE)");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif // CONFIG_MCP_TRACE
@@ -0,0 +1,104 @@
+/*
+ * MCP Span Tracing
+ *
+ * Begin/end events from the request path (httpd receive, parse, dispatch,
+ * executor, Lua VM handoff, SPIFFS I/O, send) and from Lua scripts
+ * (trace.span) go into a fixed ring with task and core ids. GET /trace
+ * returns the ring in Chrome trace_event format, for chrome://tracing or
+ * Perfetto, so one slow request can be followed end to end.
+ *
+ * Without CONFIG_MCP_TRACE the macros compile to nothing; with it, a
+ * disabled trace costs one flag test per span. Tracing is switched on at
+ * run time with the sys_trace tool (or CONFIG_MCP_TRACE_AT_BOOT).
+ */
+
+#ifndef MCP_TRACE_H
+#define MCP_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <esp_err.h>
+#include <esp_http_server.h>
+#include <cJSON.h>
+#include "mcp_tools.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Subsystem of a span (the Chrome "cat" field)
+ */
+typedef enum {
+    MCP_TRACE_HTTP,
+    MCP_TRACE_WS,
+    MCP_TRACE_RPC,
+    MCP_TRACE_EXEC,
+    MCP_TRACE_TOOL,
+    MCP_TRACE_LUA,
+    MCP_TRACE_FS,
+    MCP_TRACE_CAT_COUNT
+} mcp_trace_cat_t;
+
+/**
+ * Runtime switch; read it through the macros
+ */
+extern volatile bool mcp_trace_on;
+
+/**
+ * Record an event ('B' begin, 'E' end); name must stay valid (a literal,
+ * or a string from mcp_trace_intern)
+ */
+void mcp_trace_event(char phase, mcp_trace_cat_t cat, const char *name);
+
+#if CONFIG_MCP_TRACE
+#define MCP_TRACE_BEGIN(cat, name) \
+    do { if (mcp_trace_on) mcp_trace_event('B', (cat), (name)); } while (0)
+#define MCP_TRACE_END(cat, name) \
+    do { if (mcp_trace_on) mcp_trace_event('E', (cat), (name)); } while (0)
+#else
+#define MCP_TRACE_BEGIN(cat, name) ((void)0)
+#define MCP_TRACE_END(cat, name) ((void)0)
+#endif
+
+/**
+ * Stable copy of a span name that is not a literal (Lua span and tool
+ * names). The table holds a few dozen names; past that "(other)" is
+ * returned.
+ */
+const char *mcp_trace_intern(const char *name);
+
+/**
+ * Switch tracing on or off; the ring is allocated the first time
+ *
+ * @return ESP_OK, ESP_ERR_NO_MEM, or ESP_ERR_NOT_SUPPORTED without
+ *         CONFIG_MCP_TRACE
+ */
+esp_err_t mcp_trace_set_enabled(bool enabled);
+
+/**
+ * Drop every recorded event
+ */
+void mcp_trace_clear(void);
+
+/**
+ * GET /trace handler (Chrome trace_event JSON)
+ */
+esp_err_t mcp_trace_handler(httpd_req_t *req);
+
+/**
+ * Tool handler: sys_trace
+ * Switches tracing and reports how full the ring is.
+ *
+ * Parameters (via cJSON args):
+ *   enable - true to start recording, false to stop (optional)
+ *   clear  - drop the recorded events first (optional)
+ */
+esp_err_t tool_sys_trace(cJSON *args, mcp_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MCP_TRACE_H
@@ -0,0 +1,106 @@
+/*
+ * Name Index Implementation
+ *
+ * Linear probing with the full 32-bit FNV-1a hash stored per slot, so a
+ * probe only calls strcmp when the hashes match. The table is kept at most
+ * half full, which bounds the expected probe length to about 1.5 slots.
+ * Removal shifts later entries of the same cluster back instead of
+ * leaving tombstones.
+ */
+
+#include "name_index.h"
+#include <string.h>
+
+static uint32_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h;
+}
+
+// Slot holding name, or the free slot where it would go
+static size_t name_index_probe(const name_index_t *idx, const char *name, uint32_t hash)
+{
+    size_t i = hash & idx->mask;
+    while (idx->slots[i].name) {
+        if (idx->slots[i].hash == hash && strcmp(idx->slots[i].name, name) == 0) {
+            break;
+        }
+        i = (i + 1) & idx->mask;
+    }
+    return i;
+}
+
+esp_err_t name_index_init(name_index_t *idx, name_index_slot_t *slots, size_t n_slots)
+{
+    if (!idx || !slots || n_slots == 0 || (n_slots & (n_slots - 1)) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(slots, 0, n_slots * sizeof(name_index_slot_t));
+    idx->slots = slots;
+    idx->mask = n_slots - 1;
+    idx->count = 0;
+    return ESP_OK;
+}
+
+esp_err_t name_index_add(name_index_t *idx, const char *name, const void *value)
+{
+    if (!idx || !name) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (idx->count + 1 > (idx->mask + 1) / 2) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t hash = name_hash(name);
+    size_t i = name_index_probe(idx, name, hash);
+    if (idx->slots[i].name) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    idx->slots[i].name = name;
+    idx->slots[i].value = value;
+    idx->slots[i].hash = hash;
+    idx->count++;
+    return ESP_OK;
+}
+
+esp_err_t name_index_remove(name_index_t *idx, const char *name)
+{
+    if (!idx || !name) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t hole = name_index_probe(idx, name, name_hash(name));
+    if (!idx->slots[hole].name) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Move back any later entry of the cluster whose home slot is at or
+    // before the hole, so lookups never stop early at it
+    size_t i = hole;
+    for (;;) {
+        i = (i + 1) & idx->mask;
+        if (!idx->slots[i].name) {
+            break;
+        }
+        size_t home = idx->slots[i].hash & idx->mask;
+        if (((i - home) & idx->mask) >= ((i - hole) & idx->mask)) {
+            idx->slots[hole] = idx->slots[i];
+            hole = i;
+        }
+    }
+    memset(&idx->slots[hole], 0, sizeof(name_index_slot_t));
+    idx->count--;
+    return ESP_OK;
+}
+
+const void *name_index_find(const name_index_t *idx, const char *name)
+{
+    if (!idx || !idx->slots || !name) {
+        return NULL;
+    }
+    size_t i = name_index_probe(idx, name, name_hash(name));
+    return idx->slots[i].name ? idx->slots[i].value : NULL;
+}
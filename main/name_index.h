@@ -0,0 +1,94 @@
+/*
+ * Name Index
+ *
+ * Open-addressing hash table from NUL-terminated names to entries, used to
+ * dispatch methods and tools without scanning their tables. Slots are
+ * provided by the caller (usually a static array sized at compile time),
+ * so an index never allocates. Names are not copied and must outlive it.
+ */
+
+#ifndef NAME_INDEX_H
+#define NAME_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Slot count for an index of up to n names: a power of two, at most half full
+ */
+#define NAME_INDEX_SLOTS(n) \
+    ((n) <= 4 ? 8 : (n) <= 8 ? 16 : (n) <= 16 ? 32 : (n) <= 32 ? 64 : \
+     (n) <= 64 ? 128 : (n) <= 128 ? 256 : 512)
+
+/**
+ * One slot (treat as private)
+ */
+typedef struct {
+    const char *name;       // NULL while the slot is free
+    const void *value;
+    uint32_t hash;
+} name_index_slot_t;
+
+/**
+ * Index state (treat fields as private)
+ */
+typedef struct {
+    name_index_slot_t *slots;
+    size_t mask;            // Slot count - 1
+    size_t count;
+} name_index_t;
+
+/**
+ * Start an empty index over caller-provided slots
+ *
+ * @param idx Index
+ * @param slots Slot storage
+ * @param n_slots Number of slots (power of two)
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG if n_slots is not a power of two
+ */
+esp_err_t name_index_init(name_index_t *idx, name_index_slot_t *slots, size_t n_slots);
+
+/**
+ * Add a name
+ *
+ * @param idx Index
+ * @param name Name (kept by reference)
+ * @param value Entry returned by name_index_find()
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the name is already present,
+ *         or ESP_ERR_NO_MEM if the index is half full
+ */
+esp_err_t name_index_add(name_index_t *idx, const char *name, const void *value);
+
+/**
+ * Remove a name
+ *
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND
+ */
+esp_err_t name_index_remove(name_index_t *idx, const char *name);
+
+/**
+ * Look up a name
+ *
+ * @return The entry added under name, or NULL
+ */
+const void *name_index_find(const name_index_t *idx, const char *name);
+
+/**
+ * Number of names in the index
+ */
+static inline size_t name_index_count(const name_index_t *idx)
+{
+    return idx->count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // NAME_INDEX_H
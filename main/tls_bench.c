@@ -0,0 +1,221 @@
+/*
+ * TLS Handshake Benchmark Implementation
+ *
+ * Each endpoint reads and writes through a fixed buffer standing in for
+ * one direction of the socket. The two sides are stepped alternately until
+ * both have finished; the time spent inside each side's handshake call is
+ * added to that side.
+ */
+
+#include "tls_bench.h"
+#include "tls_keys.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <mbedtls/version.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/x509_crt.h>
+#if defined(MBEDTLS_PSA_CRYPTO_C)
+#include <psa/crypto.h>
+#endif
+
+// mbedtls_ssl_conf_max_tls_version() and the seven-argument
+// mbedtls_pk_parse_key()
+#if MBEDTLS_VERSION_NUMBER < 0x03020000
+#error "mbedTLS 3.2 or later (ESP-IDF 5.0 or later) is required"
+#endif
+
+static const char *TAG = "tls_bench";
+
+#define BENCH_PIPE_SIZE     8192    // Largest flight: certificate plus key exchange
+#define BENCH_MAX_ROUNDS    64      // Both sides stepped; a handshake needs about 4
+
+typedef struct {
+    unsigned char buf[BENCH_PIPE_SIZE];
+    size_t len;
+} bench_pipe_t;
+
+typedef struct {
+    bench_pipe_t *in;
+    bench_pipe_t *out;
+} bench_io_t;
+
+static int bench_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    bench_pipe_t *p = ((bench_io_t *)ctx)->out;
+    size_t room = sizeof(p->buf) - p->len;
+    if (room == 0) {
+        return MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+    if (len > room) {
+        len = room;
+    }
+    memcpy(p->buf + p->len, buf, len);
+    p->len += len;
+    return (int)len;
+}
+
+static int bench_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    bench_pipe_t *p = ((bench_io_t *)ctx)->in;
+    if (p->len == 0) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+    if (len > p->len) {
+        len = p->len;
+    }
+    memcpy(buf, p->buf, len);
+    memmove(p->buf, p->buf + len, p->len - len);
+    p->len -= len;
+    return (int)len;
+}
+
+// One step of one side: 1 when done, 0 when waiting for the peer, <0 on error
+static int bench_step(mbedtls_ssl_context *ssl, bool *done, uint64_t *elapsed_us)
+{
+    if (*done) {
+        return 1;
+    }
+    int64_t t0 = esp_timer_get_time();
+    int ret = mbedtls_ssl_handshake(ssl);
+    *elapsed_us += (uint64_t)(esp_timer_get_time() - t0);
+    if (ret == 0) {
+        *done = true;
+        return 1;
+    }
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return 0;
+    }
+    return ret;
+}
+
+static void bench_conf(mbedtls_ssl_config *conf, int endpoint)
+{
+    mbedtls_ssl_conf_rng(conf, tls_keys_rng, NULL);
+    // The device server speaks TLS 1.2 (ESP-TLS default)
+    mbedtls_ssl_conf_max_tls_version(conf, MBEDTLS_SSL_VERSION_TLS1_2);
+    mbedtls_ssl_conf_authmode(conf, endpoint == MBEDTLS_SSL_IS_SERVER ?
+                              MBEDTLS_SSL_VERIFY_NONE : MBEDTLS_SSL_VERIFY_OPTIONAL);
+}
+
+// One handshake on fresh contexts, as for a new connection
+static esp_err_t bench_handshake(const mbedtls_ssl_config *srv_conf, const mbedtls_ssl_config *cli_conf,
+                                 bench_pipe_t *pipes, uint64_t *server_us, uint64_t *client_us,
+                                 char *suite, size_t suite_len)
+{
+    mbedtls_ssl_context server, client;
+    mbedtls_ssl_init(&server);
+    mbedtls_ssl_init(&client);
+    pipes[0].len = 0;
+    pipes[1].len = 0;
+    bench_io_t srv_io = { .in = &pipes[0], .out = &pipes[1] };
+    bench_io_t cli_io = { .in = &pipes[1], .out = &pipes[0] };
+
+    esp_err_t err = ESP_ERR_NO_MEM;
+    if (mbedtls_ssl_setup(&server, srv_conf) == 0 && mbedtls_ssl_setup(&client, cli_conf) == 0 &&
+        mbedtls_ssl_set_hostname(&client, "esp32-mcp-server") == 0) {
+        mbedtls_ssl_set_bio(&server, &srv_io, bench_send, bench_recv, NULL);
+        mbedtls_ssl_set_bio(&client, &cli_io, bench_send, bench_recv, NULL);
+
+        bool srv_done = false, cli_done = false;
+        int ret = 0;
+        err = ESP_FAIL;
+        for (int round = 0; round < BENCH_MAX_ROUNDS && ret >= 0; round++) {
+            int c = bench_step(&client, &cli_done, client_us);
+            int s = (c < 0) ? c : bench_step(&server, &srv_done, server_us);
+            ret = (c < 0) ? c : s;
+            if (srv_done && cli_done) {
+                snprintf(suite, suite_len, "%s", mbedtls_ssl_get_ciphersuite(&server));
+                err = ESP_OK;
+                break;
+            }
+        }
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Handshake failed: -0x%04x", (unsigned)-ret);
+        }
+    }
+
+    mbedtls_ssl_free(&client);
+    mbedtls_ssl_free(&server);
+    return err;
+}
+
+esp_err_t tls_bench_run(const char *cert_pem, const char *key_pem, int handshakes,
+                        const volatile bool *cancel, tls_bench_result_t *out)
+{
+    if (!cert_pem || !key_pem || handshakes <= 0 || !out) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(out, 0, sizeof(*out));
+#if defined(MBEDTLS_PSA_CRYPTO_C)
+    if (psa_crypto_init() != PSA_SUCCESS) {
+        return ESP_FAIL;
+    }
+#endif
+
+    // The pipes stand in for socket buffers and are not counted. Heap is
+    // measured from before the credentials are parsed: a server holds them
+    // for as long as it runs.
+    bench_pipe_t *pipes = calloc(2, sizeof(bench_pipe_t));
+    size_t free_before = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    heap_caps_monitor_local_minimum_free_size_start();
+
+    mbedtls_x509_crt crt;
+    mbedtls_pk_context key;
+    mbedtls_ssl_config srv_conf, cli_conf;
+    mbedtls_x509_crt_init(&crt);
+    mbedtls_pk_init(&key);
+    mbedtls_ssl_config_init(&srv_conf);
+    mbedtls_ssl_config_init(&cli_conf);
+
+    esp_err_t err = ESP_OK;
+    if (!pipes) {
+        err = ESP_ERR_NO_MEM;
+    } else if (mbedtls_x509_crt_parse(&crt, (const unsigned char *)cert_pem, strlen(cert_pem) + 1) != 0 ||
+               mbedtls_pk_parse_key(&key, (const unsigned char *)key_pem, strlen(key_pem) + 1,
+                                    NULL, 0, tls_keys_rng, NULL) != 0) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if (mbedtls_ssl_config_defaults(&srv_conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT) != 0 ||
+               mbedtls_ssl_config_defaults(&cli_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT) != 0 ||
+               mbedtls_ssl_conf_own_cert(&srv_conf, &crt, &key) != 0) {
+        err = ESP_FAIL;
+    }
+
+    uint64_t server_us = 0, client_us = 0;
+    if (err == ESP_OK) {
+        bench_conf(&srv_conf, MBEDTLS_SSL_IS_SERVER);
+        bench_conf(&cli_conf, MBEDTLS_SSL_IS_CLIENT);
+        mbedtls_ssl_conf_ca_chain(&cli_conf, &crt, NULL);
+        for (int i = 0; i < handshakes && err == ESP_OK; i++) {
+            if (cancel && *cancel) {
+                break;
+            }
+            err = bench_handshake(&srv_conf, &cli_conf, pipes, &server_us, &client_us,
+                                  out->ciphersuite, sizeof(out->ciphersuite));
+            if (err == ESP_OK) {
+                out->handshakes++;
+            }
+        }
+    }
+
+    size_t free_min = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heap_caps_monitor_local_minimum_free_size_stop();
+    out->peak_heap = free_before > free_min ? free_before - free_min : 0;
+    if (out->handshakes) {
+        out->server_us = (uint32_t)(server_us / out->handshakes);
+        out->client_us = (uint32_t)(client_us / out->handshakes);
+    }
+
+    mbedtls_ssl_config_free(&cli_conf);
+    mbedtls_ssl_config_free(&srv_conf);
+    mbedtls_pk_free(&key);
+    mbedtls_x509_crt_free(&crt);
+    free(pipes);
+    return err;
+}
@@ -0,0 +1,51 @@
+/*
+ * TLS Handshake Benchmark
+ *
+ * Runs complete TLS 1.2 handshakes between an mbedTLS client and server in
+ * memory, so the cost of a server key can be measured without a network:
+ * time spent on each side and the heap needed while both are set up. The
+ * client verifies the certificate, as a real client would.
+ */
+
+#ifndef TLS_BENCH_H
+#define TLS_BENCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Result of one run
+ */
+typedef struct {
+    uint32_t handshakes;        // Completed handshakes
+    uint32_t server_us;         // Average server time per handshake
+    uint32_t client_us;         // Average client time per handshake
+    size_t peak_heap;           // Heap in use above the starting point (whole system)
+    char ciphersuite[64];       // Negotiated suite
+} tls_bench_result_t;
+
+/**
+ * Run handshakes with one server certificate and key
+ *
+ * @param cert_pem Server certificate, PEM
+ * @param key_pem Server private key, PEM
+ * @param handshakes Number of handshakes
+ * @param cancel Stop early when this becomes true, or NULL
+ * @param out Result
+ * @return ESP_OK, ESP_ERR_INVALID_ARG for unusable credentials,
+ *         ESP_ERR_NO_MEM, or ESP_FAIL if a handshake failed
+ */
+esp_err_t tls_bench_run(const char *cert_pem, const char *key_pem, int handshakes,
+                        const volatile bool *cancel, tls_bench_result_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TLS_BENCH_H
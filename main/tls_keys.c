@@ -0,0 +1,116 @@
+/*
+ * TLS Keys Implementation
+ */
+
+#include "tls_keys.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <esp_log.h>
+#include <esp_random.h>
+#include <mbedtls/version.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/ecp.h>
+#include <mbedtls/x509_crt.h>
+#include <mbedtls/bignum.h>
+
+static const char *TAG = "tls_keys";
+
+#define TLS_KEY_PEM_MAX     512     // P-256 key: about 230 bytes
+#define TLS_CERT_PEM_MAX    1024    // Self-signed P-256 certificate: about 600 bytes
+
+int tls_keys_rng(void *ctx, unsigned char *buf, size_t len)
+{
+    (void)ctx;
+    esp_fill_random(buf, len);
+    return 0;
+}
+
+// Version 3 certificate signed by its own key, valid until 2049
+static int write_self_signed(mbedtls_pk_context *key, const char *subject, char *out, size_t out_size)
+{
+    mbedtls_x509write_cert crt;
+    mbedtls_x509write_crt_init(&crt);
+    mbedtls_x509write_crt_set_version(&crt, MBEDTLS_X509_CRT_VERSION_3);
+    mbedtls_x509write_crt_set_md_alg(&crt, MBEDTLS_MD_SHA256);
+    mbedtls_x509write_crt_set_subject_key(&crt, key);
+    mbedtls_x509write_crt_set_issuer_key(&crt, key);
+
+    unsigned char serial[16];
+    esp_fill_random(serial, sizeof(serial));
+    serial[0] &= 0x7f;          // Serial numbers are positive
+    serial[0] |= 0x01;          // and have no leading zero byte
+
+    int ret = mbedtls_x509write_crt_set_subject_name(&crt, subject);
+    if (ret == 0) {
+        ret = mbedtls_x509write_crt_set_issuer_name(&crt, subject);
+    }
+    if (ret == 0) {
+#if MBEDTLS_VERSION_NUMBER >= 0x03040000
+        ret = mbedtls_x509write_crt_set_serial_raw(&crt, serial, sizeof(serial));
+#else
+        mbedtls_mpi mpi;
+        mbedtls_mpi_init(&mpi);
+        ret = mbedtls_mpi_read_binary(&mpi, serial, sizeof(serial));
+        if (ret == 0) {
+            ret = mbedtls_x509write_crt_set_serial(&crt, &mpi);
+        }
+        mbedtls_mpi_free(&mpi);
+#endif
+    }
+    if (ret == 0) {
+        ret = mbedtls_x509write_crt_set_validity(&crt, "20250101000000", "20491231235959");
+    }
+    if (ret == 0) {
+        ret = mbedtls_x509write_crt_set_basic_constraints(&crt, 0, -1);
+    }
+    if (ret == 0) {
+        ret = mbedtls_x509write_crt_pem(&crt, (unsigned char *)out, out_size, tls_keys_rng, NULL);
+    }
+    mbedtls_x509write_crt_free(&crt);
+    return ret;
+}
+
+esp_err_t tls_keys_generate_ecdsa(const char *common_name, char **cert_pem, char **key_pem)
+{
+    if (!common_name || !cert_pem || !key_pem) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *cert_pem = NULL;
+    *key_pem = NULL;
+
+    char subject[80];
+    snprintf(subject, sizeof(subject), "CN=%s", common_name);
+
+    char *cert = calloc(1, TLS_CERT_PEM_MAX);
+    char *key = calloc(1, TLS_KEY_PEM_MAX);
+    if (!cert || !key) {
+        free(cert);
+        free(key);
+        return ESP_ERR_NO_MEM;
+    }
+
+    mbedtls_pk_context pk;
+    mbedtls_pk_init(&pk);
+    int ret = mbedtls_pk_setup(&pk, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY));
+    if (ret == 0) {
+        ret = mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(pk), tls_keys_rng, NULL);
+    }
+    if (ret == 0) {
+        ret = mbedtls_pk_write_key_pem(&pk, (unsigned char *)key, TLS_KEY_PEM_MAX);
+    }
+    if (ret == 0) {
+        ret = write_self_signed(&pk, subject, cert, TLS_CERT_PEM_MAX);
+    }
+    mbedtls_pk_free(&pk);
+
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Key generation failed: -0x%04x", (unsigned)-ret);
+        free(cert);
+        free(key);
+        return ESP_FAIL;
+    }
+    *cert_pem = cert;
+    *key_pem = key;
+    return ESP_OK;
+}
@@ -0,0 +1,39 @@
+/*
+ * TLS Keys
+ *
+ * Self-signed ECDSA P-256 server credentials, generated on the device so
+ * every board gets its own key instead of the shared example certificate.
+ */
+
+#ifndef TLS_KEYS_H
+#define TLS_KEYS_H
+
+#include <stddef.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Random source for mbedTLS (esp_fill_random; the hardware RNG is only
+ * fully random while Wi-Fi or Bluetooth is running)
+ */
+int tls_keys_rng(void *ctx, unsigned char *buf, size_t len);
+
+/**
+ * Generate a P-256 key and a self-signed certificate for it
+ * Both are NUL-terminated PEM strings allocated with malloc.
+ *
+ * @param common_name Certificate subject CN
+ * @param cert_pem Output certificate
+ * @param key_pem Output private key
+ * @return ESP_OK, ESP_ERR_NO_MEM, or ESP_FAIL if mbedTLS failed
+ */
+esp_err_t tls_keys_generate_ecdsa(const char *common_name, char **cert_pem, char **key_pem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TLS_KEYS_H